@@ -0,0 +1,129 @@
+// Float64Array benchmark: times each farray builtin against the Monkey loop
+// computing the same result, on the same data.
+//
+// Usage: float64_array [length] [repetitions]
+#include "../src/compiler/compiler.h"
+#include "../src/lexer/lexer.h"
+#include "../src/object/float64_array.h"
+#include "../src/parser/parser.h"
+#include "../src/vm/vm.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ARRAY_LEN(arr) (sizeof(arr) / sizeof(arr[0]))
+#define SOURCE_SIZE 1024
+
+// Both programs of a case see `a` and `b` filled with 0..n-1 and run their
+// body `r` times. %1$zu is the length and %2$zu the repetitions.
+#define FILL_ARRAYS                                                            \
+  "let a = []; let b = [];"                                                    \
+  "for (let i = 0; i < %1$zu; i = i + 1) { a = push(a, i); b = push(b, i); }"
+#define FILL_FARRAYS                                                           \
+  "let a = farray(%1$zu); let b = farray(%1$zu);"                              \
+  "for (let i = 0; i < %1$zu; i = i + 1) { a[i] = i; b[i] = i; }"
+#define REPEAT "let t = 0; for (let r = 0; r < %2$zu; r = r + 1) "
+
+typedef struct {
+  const char *name;
+  const char *loop;
+  const char *builtin;
+} Case;
+
+static const Case cases[] = {
+    {
+        .name = "sum",
+        .loop = FILL_ARRAYS REPEAT
+        "{ for (let i = 0; i < %1$zu; i = i + 1) { t = t + a[i]; } }",
+        .builtin = FILL_FARRAYS REPEAT "{ t = t + sum(a); }",
+    },
+    {
+        .name = "dot",
+        .loop = FILL_ARRAYS REPEAT
+        "{ for (let i = 0; i < %1$zu; i = i + 1) { t = t + a[i] * b[i]; } }",
+        .builtin = FILL_FARRAYS REPEAT "{ t = t + dot(a, b); }",
+    },
+    {
+        .name = "max",
+        .loop = FILL_ARRAYS REPEAT
+        "{ for (let i = 0; i < %1$zu; i = i + 1) {"
+        "    if (a[i] > t) { t = a[i]; } } }",
+        .builtin = FILL_FARRAYS REPEAT "{ t = max(a); }",
+    },
+    {
+        .name = "add",
+        .loop = FILL_FARRAYS "let c = farray(%1$zu);" REPEAT
+        "{ for (let i = 0; i < %1$zu; i = i + 1) { c[i] = a[i] + b[i]; } }",
+        .builtin = FILL_FARRAYS REPEAT "{ let c = add(a, b); }",
+    },
+};
+
+static double seconds_since(struct timespec start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Returns the seconds taken to compile and run the program, or a negative
+// number when it failed.
+static double run_program(const char *format, size_t len, size_t reps) {
+  char source[SOURCE_SIZE];
+  snprintf(source, sizeof(source), format, len, reps);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  Parser *parser = new_parser(new_lexer(source));
+  Program *program = parse_program(parser);
+  if (parser->errors.len > 0) {
+    free_program(program);
+    free_parser(parser);
+    return -1;
+  }
+
+  Compiler *compiler = new_compiler();
+  if (compile_program(compiler, program) != COMPILER_OK) {
+    free_program(program);
+    free_parser(parser);
+    return -1;
+  }
+
+  VM *vm = new_vm(bytecode(compiler));
+  VMResult result = run_vm(vm);
+  double elapsed = seconds_since(start);
+
+  free_vm(vm);
+  free_compiler(compiler);
+  free_program(program);
+  free_parser(parser);
+
+  return result == VM_OK ? elapsed : -1;
+}
+
+int main(int argc, char **argv) {
+  // The numbers the loop cases create live until their VM is freed, about
+  // 45 MB per repetition of 10000 elements for all of them together
+  size_t len = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000;
+  size_t reps = argc > 2 ? strtoul(argv[2], NULL, 10) : 20;
+
+  fprintf(stderr, "%zu elements, %zu repetitions, %s kernels\n", len, reps,
+          float64_kernels()->name);
+  fprintf(stderr, "%8s %10s %10s %8s\n", "case", "loop (s)", "farray (s)",
+          "speedup");
+
+  for (size_t i = 0; i < ARRAY_LEN(cases); i++) {
+    double loop = run_program(cases[i].loop, len, reps);
+    double builtin = run_program(cases[i].builtin, len, reps);
+    if (loop < 0 || builtin < 0) {
+      fprintf(stderr, "%s failed\n", cases[i].name);
+      return 1;
+    }
+
+    fprintf(stderr, "%8s %10.3f %10.3f %7.1fx\n", cases[i].name, loop, builtin,
+            loop / builtin);
+  }
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+// Thread scaling benchmark: every thread repeatedly compiles and runs its
+// own copy of the examples/*.monk workloads, so the threads share nothing
+// but the allocator. Throughput should grow with the thread count until the
+// machine runs out of cores.
+//
+// Usage: thread_scaling [max-threads] [runs-per-thread]
+#include "../src/compiler/compiler.h"
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/vm/vm.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ARRAY_LEN(arr) (sizeof(arr) / sizeof(arr[0]))
+
+static const char *workload_paths[] = {
+    "examples/bubblesort.monk",
+    "examples/fib.monk",
+    "examples/rule110.monk",
+};
+
+static char *workloads[ARRAY_LEN(workload_paths)];
+
+typedef struct {
+  size_t runs;
+  size_t failures;
+} Worker;
+
+static char *read_source(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+
+  char *source = malloc(size + 1);
+  if (source) {
+    size_t read = fread(source, 1, size, file);
+    source[read] = '\0';
+  }
+
+  fclose(file);
+  return source;
+}
+
+static bool run_workload(char *source) {
+  Parser *parser = new_parser(new_lexer(source));
+  Program *program = parse_program(parser);
+  if (parser->errors.len > 0) {
+    free_program(program);
+    free_parser(parser);
+    return false;
+  }
+
+  Compiler *compiler = new_compiler();
+  if (compile_program(compiler, program) != COMPILER_OK) {
+    free_program(program);
+    free_parser(parser);
+    return false;
+  }
+
+  VM *vm = new_vm(bytecode(compiler));
+  VMResult result = run_vm(vm);
+
+  free_vm(vm);
+  free_compiler(compiler);
+  free_program(program);
+  free_parser(parser);
+
+  return result == VM_OK;
+}
+
+static void *run_worker(void *arg) {
+  Worker *worker = arg;
+
+  for (size_t i = 0; i < worker->runs; i++) {
+    if (!run_workload(workloads[i % ARRAY_LEN(workloads)])) {
+      worker->failures++;
+    }
+  }
+
+  return NULL;
+}
+
+static double seconds_since(struct timespec start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+  size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : 8;
+  size_t runs_per_thread = argc > 2 ? strtoul(argv[2], NULL, 10) : 60;
+
+  for (size_t i = 0; i < ARRAY_LEN(workload_paths); i++) {
+    workloads[i] = read_source(workload_paths[i]);
+    if (!workloads[i]) {
+      fprintf(stderr, "Could not read %s\n", workload_paths[i]);
+      return 1;
+    }
+  }
+
+  // The workloads print their results, keep the report readable
+  if (!freopen("/dev/null", "w", stdout)) {
+    return 1;
+  }
+
+  fprintf(stderr, "%8s %8s %10s %10s %8s\n", "threads", "runs", "seconds",
+          "runs/s", "speedup");
+
+  double single_thread_throughput = 0;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    pthread_t ids[threads];
+    Worker workers[threads];
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < threads; i++) {
+      workers[i] = (Worker){.runs = runs_per_thread};
+      pthread_create(&ids[i], NULL, run_worker, &workers[i]);
+    }
+
+    size_t failures = 0;
+    for (size_t i = 0; i < threads; i++) {
+      pthread_join(ids[i], NULL);
+      failures += workers[i].failures;
+    }
+
+    double elapsed = seconds_since(start);
+    size_t runs = threads * runs_per_thread;
+    double throughput = runs / elapsed;
+    if (threads == 1) {
+      single_thread_throughput = throughput;
+    }
+
+    fprintf(stderr, "%8zu %8zu %10.3f %10.1f %7.2fx\n", threads, runs, elapsed,
+            throughput, throughput / single_thread_throughput);
+
+    if (failures > 0) {
+      fprintf(stderr, "%zu runs failed\n", failures);
+      return 1;
+    }
+  }
+
+  return 0;
+}
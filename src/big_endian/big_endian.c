@@ -10,7 +10,7 @@ void uint16_to_big_endian(uint16_t num, uint8_t* buf) {
 }
 
 void big_endian_to_uint16(uint16_t *num, int8_t *buf) {
-    *num = (buf[0] << 8) | buf[1];
+    *num = ((uint8_t)buf[0] << 8) | (uint8_t)buf[1];
 }
 
 void big_endian_push_uint16(IntArray *arr, uint16_t num) {
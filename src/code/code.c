@@ -63,7 +63,11 @@ static Definition definitions[OP_COUNT] = {
         .operand_count = 1,
         .operand_widths = {2},
     },
-    {"OP_INDEX"},
+    {
+        .name = "OP_INDEX",
+        .operand_count = 1,
+        .operand_widths = {2},
+    },
     {
         .name = "OP_CALL",
         .operand_count = 1,
@@ -107,13 +111,66 @@ static Definition definitions[OP_COUNT] = {
     {
         .name = "OP_BREAK",
         .operand_count = 1,
-        .operand_widths = {1},
+        .operand_widths = {2},
     },
     {"OP_AND"},
     {"OP_OR"},
     {"OP_REASSIGN_INDEX"},
+    {
+        .name = "OP_SET_LOCAL_SCALAR",
+        .operand_count = 1,
+        .operand_widths = {1},
+    },
+    {
+        .name = "OP_SET_FREE_SCALAR",
+        .operand_count = 1,
+        .operand_widths = {1},
+    },
+    {
+        .name = "OP_SET_LOCAL_CAPTURED",
+        .operand_count = 1,
+        .operand_widths = {1},
+    },
+    {
+        .name = "OP_JMP_IF_TRUE",
+        .operand_count = 1,
+        .operand_widths = {2},
+    },
+    {"OP_LEN"},
+    {"OP_FIRST"},
+    {"OP_LAST"},
+    {"OP_PUSH"},
+    {"OP_ADD_NUMBER"},
+    {"OP_SUB_NUMBER"},
+    {"OP_MUL_NUMBER"},
+    {"OP_DIV_NUMBER"},
+    {"OP_LSHIFT_NUMBER"},
+    {"OP_RSHIFT_NUMBER"},
+    {"OP_MOD_NUMBER"},
+    {"OP_BIT_OR_NUMBER"},
+    {"OP_BIT_AND_NUMBER"},
+    {"OP_BIT_XOR_NUMBER"},
+    {"OP_EQ_NUMBER"},
+    {"OP_NOT_EQ_NUMBER"},
+    {"OP_GREATER_NUMBER"},
+    {"OP_ADD_STRING"},
+};
+
+static const struct {
+  OpCode generic;
+  OpCode number;
+} number_opcodes[] = {
+    {OP_ADD, OP_ADD_NUMBER},         {OP_SUB, OP_SUB_NUMBER},
+    {OP_MUL, OP_MUL_NUMBER},         {OP_DIV, OP_DIV_NUMBER},
+    {OP_LSHIFT, OP_LSHIFT_NUMBER},   {OP_RSHIFT, OP_RSHIFT_NUMBER},
+    {OP_MOD, OP_MOD_NUMBER},         {OP_BIT_OR, OP_BIT_OR_NUMBER},
+    {OP_BIT_AND, OP_BIT_AND_NUMBER}, {OP_BIT_XOR, OP_BIT_XOR_NUMBER},
+    {OP_EQ, OP_EQ_NUMBER},           {OP_NOT_EQ, OP_NOT_EQ_NUMBER},
+    {OP_GREATER, OP_GREATER_NUMBER},
 };
 
+#define NUMBER_OPCODES_LEN (sizeof(number_opcodes) / sizeof(number_opcodes[0]))
+
 Definition *lookup(OpCode opcode) {
   if (opcode > OP_COUNT) {
     return NULL;
@@ -121,6 +178,30 @@ Definition *lookup(OpCode opcode) {
   return &definitions[opcode];
 }
 
+OpCode number_opcode(OpCode op) {
+  for (size_t i = 0; i < NUMBER_OPCODES_LEN; i++) {
+    if (number_opcodes[i].generic == op) {
+      return number_opcodes[i].number;
+    }
+  }
+
+  return OP_COUNT;
+}
+
+OpCode generic_opcode(OpCode op) {
+  if (op == OP_ADD_STRING) {
+    return OP_ADD;
+  }
+
+  for (size_t i = 0; i < NUMBER_OPCODES_LEN; i++) {
+    if (number_opcodes[i].number == op) {
+      return number_opcodes[i].generic;
+    }
+  }
+
+  return op;
+}
+
 Instruction make_instruction(OpCode op_code, int *operands,
                              size_t operand_count) {
   Definition *def = lookup(op_code);
@@ -6,6 +6,8 @@
 #include <stdint.h>
 
 #define OPERAND_WIDTHS 4
+// Inline caches the operand of OP_INDEX can refer to
+#define INDEX_CACHES_SIZE 4096
 
 typedef IntArray Instruction;
 typedef IntArray Instructions;
@@ -54,6 +56,33 @@ typedef enum {
   OP_AND,
   OP_OR,
   OP_REASSIGN_INDEX,
+  OP_SET_LOCAL_SCALAR,
+  OP_SET_FREE_SCALAR,
+  OP_SET_LOCAL_CAPTURED, // a local closures or loop bodies write through
+  OP_JMP_IF_TRUE,
+  // Calls to the builtins of the same name the compiler could resolve, with
+  // the arguments on the stack and no builtin under them
+  OP_LEN,
+  OP_FIRST,
+  OP_LAST,
+  OP_PUSH,
+  // Operators the compiler proved get two numbers, or two strings for
+  // OP_ADD_STRING, so the VM does not check the types of their operands.
+  // The arithmetic ones leave an unboxed result the VM overwrites later.
+  OP_ADD_NUMBER,
+  OP_SUB_NUMBER,
+  OP_MUL_NUMBER,
+  OP_DIV_NUMBER,
+  OP_LSHIFT_NUMBER,
+  OP_RSHIFT_NUMBER,
+  OP_MOD_NUMBER,
+  OP_BIT_OR_NUMBER,
+  OP_BIT_AND_NUMBER,
+  OP_BIT_XOR_NUMBER,
+  OP_EQ_NUMBER,
+  OP_NOT_EQ_NUMBER,
+  OP_GREATER_NUMBER,
+  OP_ADD_STRING,
   OP_COUNT,
 } OpCode;
 
@@ -69,6 +98,11 @@ void instructions_to_string(ResizableBuffer *, const Instructions *);
 
 Definition *lookup(OpCode);
 
+// The variant of an operator for two numbers, OP_COUNT if it has none
+OpCode number_opcode(OpCode);
+// The operator a typed opcode specializes, the opcode itself for the others
+OpCode generic_opcode(OpCode);
+
 IntArray read_operands(Definition *, const Instructions *, size_t, size_t *);
 
 Instructions concat_instructions(size_t, Instruction *);
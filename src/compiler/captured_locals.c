@@ -0,0 +1,218 @@
+#include "captured_locals.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  char *name;
+  bool bound;
+  size_t bound_depth;    // of the outermost scope binding the name
+  size_t assigned_depth; // of the innermost scope assigning it
+} CapturedName;
+
+// Scopes are counted from the function being compiled: its body is at depth
+// 0, and every function literal or loop body adds one.
+typedef struct {
+  CapturedLocals *locals;
+  size_t depth;
+} Search;
+
+static void search_expression(Search *, Expression *);
+static void search_block(Search *, BlockStatement *);
+
+static CapturedName *captured_name(Search *s, char *name) {
+  DynamicArray *names = &s->locals->names;
+  for (size_t i = 0; i < names->len; i++) {
+    CapturedName *n = names->arr[i];
+    if (strcmp(n->name, name) == 0) {
+      return n;
+    }
+  }
+
+  CapturedName *n = malloc(sizeof(CapturedName));
+  assert(n != NULL);
+
+  *n = (CapturedName){.name = name};
+  array_append(names, n);
+
+  return n;
+}
+
+static void bind_name(Search *s, char *name) {
+  CapturedName *n = captured_name(s, name);
+  if (!n->bound || s->depth < n->bound_depth) {
+    n->bound_depth = s->depth;
+  }
+  n->bound = true;
+}
+
+static void assign_name(Search *s, char *name) {
+  CapturedName *n = captured_name(s, name);
+  if (s->depth > n->assigned_depth) {
+    n->assigned_depth = s->depth;
+  }
+}
+
+static void search_statement(Search *s, Statement *stmt) {
+  if (stmt->type == LET_STATEMENT) {
+    bind_name(s, stmt->name->value);
+  }
+  if (stmt->expression != NULL) {
+    search_expression(s, stmt->expression);
+  }
+}
+
+static void search_block(Search *s, BlockStatement *block) {
+  for (size_t i = 0; i < block->statements.len; i++) {
+    search_statement(s, block->statements.arr[i]);
+  }
+}
+
+static void search_nested_block(Search *s, BlockStatement *block) {
+  s->depth++;
+  search_block(s, block);
+  s->depth--;
+}
+
+static int search_hash_pair(void *const ctx,
+                            struct hashmap_element_s *const pair) {
+  search_expression(ctx, (Expression *)pair->key);
+  search_expression(ctx, pair->data);
+  return 0;
+}
+
+static void search_expression(Search *s, Expression *expr) {
+  switch (expr->type) {
+  case IDENT_EXPR:
+  case INT_EXPR:
+  case BOOL_EXPR:
+  case STRING_EXPR:
+    break;
+  case PREFIX_EXPR:
+    search_expression(s, ((PrefixExpression *)expr)->right);
+    break;
+  case INFIX_EXPR:
+    search_expression(s, ((InfixExpression *)expr)->left);
+    search_expression(s, ((InfixExpression *)expr)->right);
+    break;
+  case IF_EXPR: {
+    IfExpression *if_expr = (IfExpression *)expr;
+    search_expression(s, if_expr->condition);
+    search_block(s, if_expr->consequence);
+    if (if_expr->alternative) {
+      search_block(s, if_expr->alternative);
+    }
+    break;
+  }
+  case FN_EXPR: {
+    FunctionLiteral *fn = (FunctionLiteral *)expr;
+    s->depth++;
+    for (size_t i = 0; i < fn->parameters.len; i++) {
+      bind_name(s, ((Identifier *)fn->parameters.arr[i])->value);
+    }
+    search_block(s, fn->body);
+    s->depth--;
+    break;
+  }
+  case CALL_EXPR: {
+    CallExpression *call = (CallExpression *)expr;
+    search_expression(s, call->function);
+    for (size_t i = 0; i < call->arguments.len; i++) {
+      search_expression(s, call->arguments.arr[i]);
+    }
+    break;
+  }
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    for (size_t i = 0; i < elements->len; i++) {
+      search_expression(s, elements->arr[i]);
+    }
+    break;
+  }
+  case HASH_EXPR:
+    hashmap_iterate_pairs(&((HashLiteral *)expr)->pairs, &search_hash_pair,
+                          s);
+    break;
+  case INDEX_EXPR:
+    search_expression(s, ((IndexExpression *)expr)->left);
+    search_expression(s, ((IndexExpression *)expr)->index);
+    break;
+  // The condition, initialization and update of a loop run in the
+  // enclosing scope, only the body is compiled as a closure
+  case WHILE_EXPR:
+    search_expression(s, ((WhileLoop *)expr)->condition);
+    search_nested_block(s, ((WhileLoop *)expr)->body);
+    break;
+  case FOR_EXPR: {
+    ForLoop *loop = (ForLoop *)expr;
+    if (loop->initialization) {
+      search_statement(s, loop->initialization);
+    }
+    search_expression(s, loop->condition);
+    if (loop->update) {
+      search_statement(s, loop->update);
+    }
+    search_nested_block(s, loop->body);
+    break;
+  }
+  case REASSIGN_EXPR: {
+    Reassignment *reassign = (Reassignment *)expr;
+    if (reassign->name->type == IDENT_EXPR) {
+      assign_name(s, ((Identifier *)reassign->name)->value);
+    } else {
+      search_expression(s, reassign->name);
+    }
+    search_expression(s, reassign->value);
+    break;
+  }
+  }
+}
+
+static CapturedLocals *new_captured_locals(void) {
+  CapturedLocals *locals = malloc(sizeof(CapturedLocals));
+  assert(locals != NULL);
+
+  array_init(&locals->names, 8);
+  return locals;
+}
+
+CapturedLocals *find_program_captures(Program *program) {
+  Search s = {.locals = new_captured_locals()};
+
+  for (size_t i = 0; i < program->statements.len; i++) {
+    search_statement(&s, program->statements.arr[i]);
+  }
+
+  return s.locals;
+}
+
+CapturedLocals *find_function_captures(FunctionLiteral *fn) {
+  Search s = {.locals = new_captured_locals()};
+
+  for (size_t i = 0; i < fn->parameters.len; i++) {
+    bind_name(&s, ((Identifier *)fn->parameters.arr[i])->value);
+  }
+  search_block(&s, fn->body);
+
+  return s.locals;
+}
+
+bool is_captured_local(const CapturedLocals *locals, const char *name) {
+  if (locals == NULL) {
+    return true;
+  }
+
+  for (size_t i = 0; i < locals->names.len; i++) {
+    CapturedName *n = locals->names.arr[i];
+    if (strcmp(n->name, name) == 0) {
+      return n->bound && n->assigned_depth > n->bound_depth;
+    }
+  }
+
+  return false;
+}
+
+void free_captured_locals(CapturedLocals *locals) {
+  array_free(&locals->names);
+  free(locals);
+}
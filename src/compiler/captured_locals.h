@@ -0,0 +1,28 @@
+#ifndef CAPTURED_LOCALS_H
+#define CAPTURED_LOCALS_H
+
+#include "../ast/ast.h"
+#include "../dyn_array/dyn_array.h"
+#include <stdbool.h>
+
+// The locals of a function that a function literal or a loop body nested in
+// it assigns. The VM boxes a local when it creates a closure that refers to
+// it, and an assignment in the closure overwrites the box in place through
+// OP_SET_FREE, so stores to such a local must never leave one of the shared
+// immortal objects in its slot. Loop bodies are scopes of their own, so the
+// lets of a loop body are captured only by what is nested in that body.
+typedef struct {
+  DynamicArray names; // CapturedName*[]
+} CapturedLocals;
+
+CapturedLocals *find_program_captures(Program *);
+CapturedLocals *find_function_captures(FunctionLiteral *);
+
+// Names are tracked per function, so a name bound again and assigned by a
+// nested function literal or loop body counts as captured. Without an
+// analysis, every local does.
+bool is_captured_local(const CapturedLocals *, const char *);
+
+void free_captured_locals(CapturedLocals *);
+
+#endif // CAPTURED_LOCALS_H
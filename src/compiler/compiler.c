@@ -2,6 +2,7 @@
 #include "../ast/ast.h"
 #include "../object/builtins.h"
 #include "../object/object.h"
+#include "ssa.h"
 #include "symbol_table.h"
 #include <assert.h>
 #include <stdio.h>
@@ -23,6 +24,89 @@ CompilationScope new_compilation_scope(void) {
   return new_scope;
 }
 
+static void init_constant_pool(ConstantPool *pool) {
+  hashmap_create(8, &pool->numbers);
+  hashmap_create(8, &pool->strings);
+  hashmap_create(8, &pool->functions);
+}
+
+static void free_constant_pool(ConstantPool *pool) {
+  hashmap_destroy(&pool->numbers);
+  hashmap_destroy(&pool->strings);
+  hashmap_destroy(&pool->functions);
+}
+
+// The map and key a constant is pooled under, false for constants that are
+// never shared. Numbers are compared bitwise, which keeps 0 and -0 apart.
+// Loop bodies are left out: their break jumps are patched after they are
+// added.
+static bool constant_key(ConstantPool *pool, Object *obj, hashmap_t **map,
+                         const void **key, size_t *len) {
+  switch (obj->type) {
+  case NUMBER_OBJ:
+    *map = &pool->numbers;
+    *key = &((Number *)obj)->value;
+    *len = sizeof(double);
+    return true;
+  case STRING_OBJ:
+    *map = &pool->strings;
+    // With the terminator, so that the empty string has a key too
+    *key = string_value((String *)obj);
+    *len = ((String *)obj)->len + 1;
+    return true;
+  case COMPILED_FUNCTION_OBJ: {
+    Instructions *ins = &((CompiledFunction *)obj)->instructions;
+    *map = &pool->functions;
+    *key = ins->arr;
+    *len = ins->len * sizeof(ins->arr[0]);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+static bool same_function(Object *a, Object *b) {
+  CompiledFunction *fa = (CompiledFunction *)a;
+  CompiledFunction *fb = (CompiledFunction *)b;
+  return fa->num_locals == fb->num_locals &&
+         fa->num_parameters == fb->num_parameters;
+}
+
+static void pool_constant(Compiler *compiler, size_t index) {
+  Object *obj = compiler->constants->arr[index];
+
+  hashmap_t *map;
+  const void *key;
+  size_t len;
+  if (constant_key(&compiler->pool, obj, &map, &key, &len) &&
+      hashmap_get(map, key, len) == NULL) {
+    hashmap_put(map, key, len, (void *)(index + 1));
+  }
+}
+
+// Returns the index of a constant equal to `obj`, or -1
+static int64_t find_pooled_constant(Compiler *compiler, Object *obj) {
+  hashmap_t *map;
+  const void *key;
+  size_t len;
+  if (!constant_key(&compiler->pool, obj, &map, &key, &len)) {
+    return -1;
+  }
+
+  size_t found = (size_t)hashmap_get(map, key, len);
+  if (found == 0) {
+    return -1;
+  }
+
+  Object *pooled = compiler->constants->arr[found - 1];
+  if (obj->type == COMPILED_FUNCTION_OBJ && !same_function(obj, pooled)) {
+    return -1;
+  }
+
+  return found - 1;
+}
+
 Compiler *new_compiler() {
   Compiler *compiler = malloc(sizeof(Compiler));
   assert(compiler != NULL);
@@ -37,10 +121,20 @@ Compiler *new_compiler() {
   }
 
   compiler->symbol_table = symbol_table;
+  init_constant_pool(&compiler->pool);
   compiler->scopes[0] = new_compilation_scope();
   compiler->scope_index = 0;
   compiler->is_void_expression = false;
   compiler->loop = NULL;
+  compiler->scalars = NULL;
+  compiler->captured = NULL;
+  compiler->num_index_caches = 0;
+  compiler->optimization_level = default_optimization_level();
+  compiler->peephole = (PeepholeStats){0};
+  compiler->whole_program = true;
+  compiler->inline_candidates = NULL;
+  compiler->inlined = NULL;
+  compiler->hoisted = NULL;
 
   return compiler;
 }
@@ -63,6 +157,11 @@ Compiler *new_compiler_with_state(SymbolTable *symbol_table,
 
   compiler->constants = constants;
   compiler->symbol_table = symbol_table;
+  compiler->whole_program = false;
+
+  for (size_t i = 0; i < constants->len; i++) {
+    pool_constant(compiler, i);
+  }
 
   return compiler;
 }
@@ -73,11 +172,22 @@ void free_compiler(Compiler *compiler) {
   }
 
   free_symbol_table(compiler->symbol_table);
+  free_constant_pool(&compiler->pool);
   free(compiler);
 }
 
 size_t add_constant(Compiler *compiler, Object *obj) {
+  int64_t pooled = find_pooled_constant(compiler, obj);
+  if (pooled >= 0) {
+    if (obj->type == COMPILED_FUNCTION_OBJ) {
+      int_array_free(&((CompiledFunction *)obj)->instructions);
+    }
+    free_object(obj);
+    return pooled;
+  }
+
   array_append(compiler->constants, obj);
+  pool_constant(compiler, compiler->constants->len - 1);
   return compiler->constants->len - 1;
 }
 
@@ -133,6 +243,16 @@ void load_symbol(Compiler *c, Symbol *s) {
   }
 }
 
+static void save_local(Compiler *c, const Symbol *s) {
+  if (is_scalar_local(c->scalars, s->name)) {
+    emit(c, OP_SET_LOCAL_SCALAR, (int[]){s->index}, 1);
+  } else if (is_captured_local(c->captured, s->name)) {
+    emit(c, OP_SET_LOCAL_CAPTURED, (int[]){s->index}, 1);
+  } else {
+    emit(c, OP_SET_LOCAL, (int[]){s->index}, 1);
+  }
+}
+
 // TODO: this is wrong in the context of a reassignment, since any variable
 // can be reassigned, not only globals and locals
 void save_symbol(Compiler *c, const Symbol *s) {
@@ -143,7 +263,7 @@ void save_symbol(Compiler *c, const Symbol *s) {
     emit(c, OP_SET_GLOBAL, (int[]){s->index}, 1);
     break;
   case SYMBOL_LOCAL_SCOPE:
-    emit(c, OP_SET_LOCAL, (int[]){s->index}, 1);
+    save_local(c, s);
     break;
   case SYMBOL_BUILTIN_SCOPE:
   case SYMBOL_FREE_SCOPE:
@@ -183,16 +303,139 @@ void change_operand(Compiler *compiler, size_t opPos, size_t operand) {
                            compiler_current_instructions(compiler));
 }
 
+static bool runs_pass(const Compiler *compiler, OptimizationPass pass) {
+  return pass_enabled(compiler->optimization_level, pass);
+}
+
+static ScalarLocals *find_program_scalars(Compiler *compiler,
+                                          Program *program) {
+  if (!runs_pass(compiler, PASS_ESCAPE_ANALYSIS)) {
+    return NULL;
+  }
+
+  double start = pass_timer_start();
+  ScalarLocals *scalars = analyze_program_scalars(program);
+  pass_timer_stop(PASS_ESCAPE_ANALYSIS, start);
+  return scalars;
+}
+
+static ScalarLocals *find_function_scalars(Compiler *compiler,
+                                           FunctionLiteral *fn) {
+  if (!runs_pass(compiler, PASS_ESCAPE_ANALYSIS)) {
+    return NULL;
+  }
+
+  double start = pass_timer_start();
+  ScalarLocals *scalars = analyze_function_scalars(fn);
+  pass_timer_stop(PASS_ESCAPE_ANALYSIS, start);
+  return scalars;
+}
+
 CompilerResult compile_program(Compiler *compiler, Program *program) {
-  for (size_t i = 0; i < program->statements.len; i++) {
-    CompilerResult result =
-        compile_statement(compiler, program->statements.arr[i]);
-    if (result != COMPILER_OK) {
-      return result;
+  if (runs_pass(compiler, PASS_CONSTANT_FOLDING)) {
+    double start = pass_timer_start();
+    fold_constants(program, compiler->symbol_table, compiler->whole_program);
+    pass_timer_stop(PASS_CONSTANT_FOLDING, start);
+  }
+  if (runs_pass(compiler, PASS_DEAD_CODE)) {
+    double start = pass_timer_start();
+    eliminate_dead_code(program, compiler->whole_program);
+    pass_timer_stop(PASS_DEAD_CODE, start);
+  }
+
+  DynamicArray inline_candidates = {0};
+  if (runs_pass(compiler, PASS_INLINING) && compiler->whole_program) {
+    double start = pass_timer_start();
+    inline_candidates = find_inline_candidates(program);
+    compiler->inline_candidates = &inline_candidates;
+    pass_timer_stop(PASS_INLINING, start);
+  }
+
+  ScalarLocals *enclosing_scalars = compiler->scalars;
+  compiler->scalars = find_program_scalars(compiler, program);
+  CapturedLocals *enclosing_captured = compiler->captured;
+  compiler->captured = find_program_captures(program);
+
+  CompilerResult result = COMPILER_OK;
+  for (size_t i = 0; i < program->statements.len && result == COMPILER_OK;
+       i++) {
+    result = compile_statement(compiler, program->statements.arr[i]);
+  }
+
+  free_scalar_locals(compiler->scalars);
+  compiler->scalars = enclosing_scalars;
+  free_captured_locals(compiler->captured);
+  compiler->captured = enclosing_captured;
+
+  compiler->inline_candidates = NULL;
+  free_inline_candidates(&inline_candidates);
+
+  return result;
+}
+
+static const Symbol *define_inlined_local(Compiler *compiler, char *name,
+                                          Symbol symbol) {
+  InlinedCall *inlined = compiler->inlined;
+  assert(inlined->num_locals < INLINE_BUDGET);
+
+  InlinedLocal *local = &inlined->locals[inlined->num_locals++];
+  *local = (InlinedLocal){.name = name, .symbol = symbol};
+
+  return &local->symbol;
+}
+
+static const Symbol *define_symbol(Compiler *compiler, char *name) {
+  InlinedCall *inlined = compiler->inlined;
+  if (inlined) {
+    assert(inlined->num_lets_defined < inlined->candidate->num_lets);
+    return define_inlined_local(compiler, name,
+                                inlined->lets[inlined->num_lets_defined++]);
+  }
+
+  return symbol_define(compiler->symbol_table, name);
+}
+
+// Names in an inlined body are its own parameters and lets, or the globals
+// and builtins they referred to right after the top-level let of the
+// function, even if a later let has bound the name again.
+static const Symbol *resolve_symbol(Compiler *compiler, char *name) {
+  InlinedCall *inlined = compiler->inlined;
+  if (inlined == NULL) {
+    return symbol_resolve(compiler->symbol_table, name);
+  }
+
+  for (size_t i = inlined->num_locals; i-- > 0;) {
+    if (strcmp(inlined->locals[i].name, name) == 0) {
+      return &inlined->locals[i].symbol;
     }
   }
 
-  return COMPILER_OK;
+  const Symbol *global = candidate_global(inlined->candidate, name);
+  if (global) {
+    return global;
+  }
+
+  SymbolTable *globals = compiler->symbol_table;
+  while (globals->outer) {
+    globals = globals->outer;
+  }
+
+  return symbol_resolve(globals, name);
+}
+
+// Calls to the function resolve to it from here on
+static void define_inline_candidate(Compiler *compiler, Statement *let,
+                                    const Symbol *symbol) {
+  if (compiler->inline_candidates == NULL ||
+      symbol->scope != SYMBOL_GLOBAL_SCOPE) {
+    return;
+  }
+
+  InlineCandidate *candidate =
+      find_inline_candidate(compiler->inline_candidates, let->name->value);
+  if (candidate && candidate->fn == (FunctionLiteral *)let->expression) {
+    define_candidate_globals(candidate, compiler->symbol_table);
+  }
 }
 
 CompilerResult compile_statement(Compiler *compiler, Statement *stmt) {
@@ -211,8 +454,7 @@ CompilerResult compile_statement(Compiler *compiler, Statement *stmt) {
     break;
   }
   case LET_STATEMENT: {
-    const Symbol *symbol =
-        symbol_define(compiler->symbol_table, stmt->name->value);
+    const Symbol *symbol = define_symbol(compiler, stmt->name->value);
 
     CompilerResult result = compile_expression(compiler, stmt->expression);
     if (result != COMPILER_OK) {
@@ -220,6 +462,7 @@ CompilerResult compile_statement(Compiler *compiler, Statement *stmt) {
     }
 
     save_symbol(compiler, symbol);
+    define_inline_candidate(compiler, stmt, symbol);
 
     break;
   }
@@ -229,7 +472,12 @@ CompilerResult compile_statement(Compiler *compiler, Statement *stmt) {
       return result;
     }
 
-    emit_no_operands(compiler, OP_RETURN_VALUE);
+    if (compiler->inlined) {
+      size_t jmp_pos = emit(compiler, OP_JMP, (int[]){JUMP_SENTINEL}, 1);
+      int_array_append(&compiler->inlined->returns, jmp_pos);
+    } else {
+      emit_no_operands(compiler, OP_RETURN_VALUE);
+    }
     break;
   }
   case CONTINUE_STATEMENT: {
@@ -254,65 +502,60 @@ CompilerResult compile_statement(Compiler *compiler, Statement *stmt) {
   return COMPILER_OK;
 }
 
-static CompilerResult compile_infix_operand(Compiler *compiler, char *operand) {
-  if (strncmp(operand, "<<", 2) == 0) {
-    emit(compiler, OP_LSHIFT, (int[]){}, 0);
-    return COMPILER_OK;
+OpCode infix_opcode(char *operator) {
+  if (strncmp(operator, "<<", 2) == 0) {
+    return OP_LSHIFT;
   }
-  if (strncmp(operand, ">>", 2) == 0) {
-    emit(compiler, OP_RSHIFT, (int[]){}, 0);
-    return COMPILER_OK;
+  if (strncmp(operator, ">>", 2) == 0) {
+    return OP_RSHIFT;
   }
-  if (strncmp(operand, "==", 2) == 0) {
-    emit_no_operands(compiler, OP_EQ);
-    return COMPILER_OK;
+  if (strncmp(operator, "==", 2) == 0) {
+    return OP_EQ;
   }
-  if (strncmp(operand, "!=", 2) == 0) {
-    emit_no_operands(compiler, OP_NOT_EQ);
-    return COMPILER_OK;
+  if (strncmp(operator, "!=", 2) == 0) {
+    return OP_NOT_EQ;
   }
 
-  if (strncmp(operand, "||", 2) == 0) {
-    emit_no_operands(compiler, OP_OR);
-    return COMPILER_OK;
+  if (strncmp(operator, "||", 2) == 0) {
+    return OP_OR;
   }
 
-  if (strncmp(operand, "&&", 2) == 0) {
-    emit_no_operands(compiler, OP_AND);
-    return COMPILER_OK;
+  if (strncmp(operator, "&&", 2) == 0) {
+    return OP_AND;
   }
 
-  switch (operand[0]) {
+  switch (operator[0]) {
   case '+':
-    emit_no_operands(compiler, OP_ADD);
-    return COMPILER_OK;
+    return OP_ADD;
   case '-':
-    emit_no_operands(compiler, OP_SUB);
-    return COMPILER_OK;
+    return OP_SUB;
   case '*':
-    emit_no_operands(compiler, OP_MUL);
-    return COMPILER_OK;
+    return OP_MUL;
   case '/':
-    emit_no_operands(compiler, OP_DIV);
-    return COMPILER_OK;
+    return OP_DIV;
   case '&':
-    emit_no_operands(compiler, OP_BIT_AND);
-    return COMPILER_OK;
+    return OP_BIT_AND;
   case '|':
-    emit_no_operands(compiler, OP_BIT_OR);
-    return COMPILER_OK;
+    return OP_BIT_OR;
   case '^':
-    emit_no_operands(compiler, OP_BIT_XOR);
-    return COMPILER_OK;
+    return OP_BIT_XOR;
   case '%':
-    emit_no_operands(compiler, OP_MOD);
-    return COMPILER_OK;
+    return OP_MOD;
   case '>':
-    emit_no_operands(compiler, OP_GREATER);
-    return COMPILER_OK;
+    return OP_GREATER;
   }
 
-  return COMPILER_UNKNOWN_OPERATOR;
+  return OP_COUNT;
+}
+
+static CompilerResult compile_infix_operand(Compiler *compiler, char *operand) {
+  OpCode op = infix_opcode(operand);
+  if (op == OP_COUNT) {
+    return COMPILER_UNKNOWN_OPERATOR;
+  }
+
+  emit_no_operands(compiler, op);
+  return COMPILER_OK;
 }
 
 CompilerResult compile_infix_expression(Compiler *compiler,
@@ -346,17 +589,25 @@ CompilerResult compile_infix_expression(Compiler *compiler,
   return compile_infix_operand(compiler, ((InfixExpression *)expr)->operator);
 }
 
-CompilerResult compile_prefix_operand(Compiler *compiler, char *operand) {
-  switch (operand[0]) {
+OpCode prefix_opcode(char *operator) {
+  switch (operator[0]) {
   case '!':
-    emit_no_operands(compiler, OP_BANG);
-    return COMPILER_OK;
+    return OP_BANG;
   case '-':
-    emit_no_operands(compiler, OP_MINUS);
-    return COMPILER_OK;
+    return OP_MINUS;
   }
 
-  return COMPILER_UNKNOWN_OPERATOR;
+  return OP_COUNT;
+}
+
+CompilerResult compile_prefix_operand(Compiler *compiler, char *operand) {
+  OpCode op = prefix_opcode(operand);
+  if (op == OP_COUNT) {
+    return COMPILER_UNKNOWN_OPERATOR;
+  }
+
+  emit_no_operands(compiler, op);
+  return COMPILER_OK;
 }
 
 CompilerResult compile_prefix_expression(Compiler *compiler,
@@ -383,7 +634,57 @@ CompilerResult compile_block_statement(Compiler *compiler,
   return COMPILER_OK;
 }
 
+// Returns, breaks and continues leave the block without a value
+static bool ends_with_jump(BlockStatement *block) {
+  if (block->statements.len == 0) {
+    return false;
+  }
+
+  Statement *last = block->statements.arr[block->statements.len - 1];
+  return last->type == RETURN_STATEMENT || last->type == BREAK_STATEMENT ||
+         last->type == CONTINUE_STATEMENT;
+}
+
+// Compiles a block that evaluates to a value: the value of its last
+// expression statement, or null when it ends with a let or a loop.
+static CompilerResult compile_block_value(Compiler *compiler,
+                                          BlockStatement *block) {
+  size_t block_pos = compiler_current_instructions(compiler)->len;
+  CompilerResult result = compile_block_statement(compiler, block);
+  if (result != COMPILER_OK) {
+    return result;
+  }
+
+  if (compiler_current_instructions(compiler)->len > block_pos &&
+      last_instruction_is(compiler, OP_POP)) {
+    remove_last_pop(compiler);
+  } else if (!ends_with_jump(block)) {
+    emit_no_operands(compiler, OP_NULL);
+  }
+
+  return COMPILER_OK;
+}
+
+// Compiles the branch a literal condition always takes, or a null when there
+// is none.
+static CompilerResult compile_taken_branch(Compiler *compiler,
+                                           BlockStatement *branch) {
+  if (branch == NULL) {
+    emit_no_operands(compiler, OP_NULL);
+    return COMPILER_OK;
+  }
+
+  return compile_block_value(compiler, branch);
+}
+
 CompilerResult compile_if_expression(Compiler *compiler, IfExpression *expr) {
+  bool truthy;
+  if (runs_pass(compiler, PASS_DEAD_CODE) &&
+      constant_condition(expr->condition, &truthy)) {
+    return compile_taken_branch(compiler, truthy ? expr->consequence
+                                                 : expr->alternative);
+  }
+
   CompilerResult result = compile_expression(compiler, expr->condition);
   if (result != COMPILER_OK) {
     return result;
@@ -392,28 +693,21 @@ CompilerResult compile_if_expression(Compiler *compiler, IfExpression *expr) {
   size_t jmp_if_false_pos =
       emit(compiler, OP_JMP_IF_FALSE, (int[]){JUMP_SENTINEL}, 1);
 
-  result = compile_block_statement(compiler, expr->consequence);
+  result = compile_block_value(compiler, expr->consequence);
   if (result != COMPILER_OK) {
     return result;
   }
 
-  if (last_instruction_is(compiler, OP_POP)) {
-    remove_last_pop(compiler);
-  }
   size_t jmp_pos = emit(compiler, OP_JMP, (int[]){JUMP_SENTINEL}, 1);
 
   size_t after_consequence_pos = compiler_current_instructions(compiler)->len;
   change_operand(compiler, jmp_if_false_pos, after_consequence_pos);
 
   if (expr->alternative) {
-    result = compile_block_statement(compiler, expr->alternative);
+    result = compile_block_value(compiler, expr->alternative);
     if (result != COMPILER_OK) {
       return result;
     }
-
-    if (last_instruction_is(compiler, OP_POP)) {
-      remove_last_pop(compiler);
-    }
   } else {
     emit_no_operands(compiler, OP_NULL);
   }
@@ -466,8 +760,59 @@ CompilerResult compile_hash_expression(Compiler *compiler, HashLiteral *expr) {
   return context.result;
 }
 
-CompilerResult compile_function_literal(Compiler *compiler,
-                                        FunctionLiteral *fn) {
+// Runs after the peephole optimizer, which leaves fewer loads and stores
+static size_t pack_locals(Compiler *compiler, Instructions *instructions,
+                          size_t num_locals, size_t num_parameters) {
+  if (!runs_pass(compiler, PASS_SLOT_PACKING)) {
+    return num_locals;
+  }
+
+  double start = pass_timer_start();
+  num_locals = pack_local_slots(instructions, num_locals, num_parameters);
+  pass_timer_stop(PASS_SLOT_PACKING, start);
+  return num_locals;
+}
+
+// Runs last, on the final slots of the locals
+static void specialize_operators(Compiler *compiler,
+                                 Instructions *instructions,
+                                 size_t num_locals) {
+  if (!runs_pass(compiler, PASS_TYPE_INFERENCE)) {
+    return;
+  }
+
+  double start = pass_timer_start();
+  specialize_types(instructions, compiler->constants, num_locals);
+  pass_timer_stop(PASS_TYPE_INFERENCE, start);
+}
+
+void emit_closure(Compiler *compiler, size_t num_locals,
+                  size_t num_parameters) {
+  // Copied, the symbol table is freed when leaving the scope
+  SymbolTable *symbols = compiler->symbol_table;
+  size_t free_symbols_len = symbols->free_symbols_len;
+  Symbol free_symbols[ARRAY_LEN(symbols->free_symbols)];
+  memcpy(free_symbols, symbols->free_symbols,
+         free_symbols_len * sizeof(Symbol));
+
+  Instructions *instructions = leave_compiler_scope(compiler);
+  num_locals =
+      pack_locals(compiler, instructions, num_locals, num_parameters);
+  specialize_operators(compiler, instructions, num_locals);
+
+  for (size_t i = 0; i < free_symbols_len; i++) {
+    load_symbol(compiler, &free_symbols[i]);
+  }
+
+  Object *compiled_fn =
+      new_compiled_function(instructions, num_locals, num_parameters);
+
+  size_t new_constant_pos = add_constant(compiler, compiled_fn);
+  emit(compiler, OP_CLOSURE, (int[]){new_constant_pos, free_symbols_len}, 2);
+}
+
+static CompilerResult compile_function_body(Compiler *compiler,
+                                            FunctionLiteral *fn) {
   enter_compiler_scope(compiler);
 
   if (fn->name) {
@@ -480,6 +825,15 @@ CompilerResult compile_function_literal(Compiler *compiler,
     symbol_define(compiler->symbol_table, param->value);
   }
 
+  // Arguments may be shared objects, captured parameters get their own
+  for (size_t i = 0; i < fn->parameters.len; i++) {
+    Identifier *param = fn->parameters.arr[i];
+    if (is_captured_local(compiler->captured, param->value)) {
+      emit(compiler, OP_GET_LOCAL, (int[]){i}, 1);
+      emit(compiler, OP_SET_LOCAL_CAPTURED, (int[]){i}, 1);
+    }
+  }
+
   CompilerResult result = compile_block_statement(compiler, fn->body);
   if (result != COMPILER_OK) {
     return result;
@@ -497,24 +851,110 @@ CompilerResult compile_function_literal(Compiler *compiler,
     emit_no_operands(compiler, OP_RETURN);
   }
 
-  Symbol *free_symbols = compiler->symbol_table->free_symbols;
-  size_t free_symbols_len = compiler->symbol_table->free_symbols_len;
+  emit_closure(compiler, compiler->symbol_table->num_definitions,
+               fn->parameters.len);
+  return COMPILER_OK;
+}
 
-  size_t num_locals = compiler->symbol_table->num_definitions;
+CompilerResult compile_function_literal(Compiler *compiler,
+                                        FunctionLiteral *fn) {
+  ScalarLocals *enclosing_scalars = compiler->scalars;
+  compiler->scalars = find_function_scalars(compiler, fn);
+  CapturedLocals *enclosing_captured = compiler->captured;
+  compiler->captured = find_function_captures(fn);
+
+  CompilerResult result = COMPILER_OK;
+  if (!runs_pass(compiler, PASS_SSA) || !compile_ssa_function(compiler, fn)) {
+    result = compile_function_body(compiler, fn);
+  }
 
-  Instructions *instructions = leave_compiler_scope(compiler);
+  free_scalar_locals(compiler->scalars);
+  compiler->scalars = enclosing_scalars;
+  free_captured_locals(compiler->captured);
+  compiler->captured = enclosing_captured;
 
-  for (size_t i = 0; i < free_symbols_len; i++) {
-    load_symbol(compiler, &free_symbols[i]);
+  return result;
+}
+
+// Any function but a builtin could assign the variables the loop reads
+static bool calls_only_builtins(Compiler *compiler, const LoopEffects *e) {
+  if (e->calls_expression) {
+    return false;
   }
 
-  Object *compiled_fn =
-      new_compiled_function(instructions, num_locals, fn->parameters.len);
+  for (size_t i = 0; i < e->callees.len; i++) {
+    char *name = e->callees.arr[i];
+    if (loop_assigns(e, name)) {
+      return false;
+    }
 
-  size_t new_constant_pos = add_constant(compiler, compiled_fn);
-  emit(compiler, OP_CLOSURE, (int[]){new_constant_pos, free_symbols_len}, 2);
+    const Symbol *symbol = resolve_symbol(compiler, name);
+    if (symbol == NULL || symbol->scope != SYMBOL_BUILTIN_SCOPE) {
+      return false;
+    }
+  }
 
-  return COMPILER_OK;
+  return true;
+}
+
+// Evaluates the loop-invariant parts of a loop condition into temporaries
+// ahead of the loop, which the condition then loads instead. Hoisting from
+// the condition alone means an expression that fails still fails before
+// the first iteration, as it did before.
+static CompilerResult hoist_loop_invariants(Compiler *compiler,
+                                            Expression *condition,
+                                            BlockStatement *body,
+                                            Statement *update,
+                                            DynamicArray *hoisted) {
+  LoopEffects effects;
+  find_loop_effects(&effects, condition, body, update);
+
+  DynamicArray invariants;
+  array_init(&invariants, 1);
+  if (calls_only_builtins(compiler, &effects)) {
+    find_loop_invariants(&effects, condition, &invariants);
+  }
+
+  SymbolTable *symbols = compiler->symbol_table;
+  size_t max_slots = symbols->outer ? UINT8_MAX : UINT16_MAX;
+  if (symbols->num_definitions + invariants.len > max_slots) {
+    invariants.len = 0;
+  }
+
+  CompilerResult result = COMPILER_OK;
+  for (size_t i = 0; i < invariants.len; i++) {
+    result = compile_expression(compiler, invariants.arr[i]);
+    if (result != COMPILER_OK) {
+      break;
+    }
+
+    HoistedExpression *h = malloc(sizeof(HoistedExpression));
+    assert(h != NULL);
+
+    h->expr = invariants.arr[i];
+    h->symbol = symbol_define_temporary(symbols);
+    save_symbol(compiler, &h->symbol);
+    array_append(hoisted, h);
+  }
+
+  free(invariants.arr);
+  free_loop_effects(&effects);
+  return result;
+}
+
+static const Symbol *hoisted_symbol(Compiler *compiler, Expression *expr) {
+  if (compiler->hoisted == NULL) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < compiler->hoisted->len; i++) {
+    HoistedExpression *h = compiler->hoisted->arr[i];
+    if (h->expr == expr) {
+      return &h->symbol;
+    }
+  }
+
+  return NULL;
 }
 
 CompilerResult compile_loop(Compiler *compiler, Expression *condition,
@@ -530,9 +970,26 @@ CompilerResult compile_loop(Compiler *compiler, Expression *condition,
     }
   }
 
+  DynamicArray hoisted;
+  array_init(&hoisted, 1);
+  if (runs_pass(compiler, PASS_LOOP_INVARIANTS)) {
+    double start = pass_timer_start();
+    result = hoist_loop_invariants(compiler, condition, body, update,
+                                   &hoisted);
+    pass_timer_stop(PASS_LOOP_INVARIANTS, start);
+    if (result != COMPILER_OK) {
+      array_free(&hoisted);
+      return result;
+    }
+  }
+
   size_t before_condition_pos = compiler_current_instructions(compiler)->len;
 
+  DynamicArray *enclosing_hoisted = compiler->hoisted;
+  compiler->hoisted = &hoisted;
   result = compile_expression(compiler, condition);
+  compiler->hoisted = enclosing_hoisted;
+  array_free(&hoisted);
   if (result != COMPILER_OK) {
     return result;
   }
@@ -546,8 +1003,12 @@ CompilerResult compile_loop(Compiler *compiler, Expression *condition,
     return result;
   }
 
-  Symbol *free_symbols = compiler->symbol_table->free_symbols;
-  size_t free_symbols_len = compiler->symbol_table->free_symbols_len;
+  // Copied, the symbol table is freed when leaving the scope
+  SymbolTable *symbols = compiler->symbol_table;
+  size_t free_symbols_len = symbols->free_symbols_len;
+  Symbol free_symbols[ARRAY_LEN(symbols->free_symbols)];
+  memcpy(free_symbols, symbols->free_symbols,
+         free_symbols_len * sizeof(Symbol));
 
   size_t num_locals = compiler->symbol_table->num_definitions;
 
@@ -556,13 +1017,16 @@ CompilerResult compile_loop(Compiler *compiler, Expression *condition,
   }
 
   Instructions *loop_instructions = leave_compiler_scope(compiler);
-  CurrentLoop loop_info = exit_loop(compiler);
+  exit_loop(compiler);
+  num_locals = pack_locals(compiler, loop_instructions, num_locals, 0);
+  specialize_operators(compiler, loop_instructions, num_locals);
 
   for (size_t i = 0; i < free_symbols_len; i++) {
     load_symbol(compiler, &free_symbols[i]);
   }
 
   Object *compiled_loop_body = new_compiled_loop(loop_instructions, num_locals);
+  loop_instructions = &((CompiledLoop *)compiled_loop_body)->instructions;
 
   size_t loop_body_pos = add_constant(compiler, compiled_loop_body);
   emit(compiler, OP_CLOSURE, (int[]){loop_body_pos, free_symbols_len}, 2);
@@ -580,8 +1044,7 @@ CompilerResult compile_loop(Compiler *compiler, Expression *condition,
   size_t after_loop_pos = compiler_current_instructions(compiler)->len;
   change_operand(compiler, jmp_if_false_pos, after_loop_pos);
 
-  patch_break_statements(compiler, after_loop_pos, loop_info,
-                         loop_instructions);
+  patch_break_statements(compiler, after_loop_pos, loop_instructions);
 
   compiler->is_void_expression = true;
 
@@ -599,7 +1062,7 @@ CompilerResult compile_for_loop(Compiler *compiler, ForLoop *loop) {
 
 CompilerResult compile_ident_reassignment(Compiler *compiler, Reassignment *expr) {
   const Symbol *old_symbol =
-      symbol_resolve(compiler->symbol_table, ((Identifier *)expr->name)->value);
+      resolve_symbol(compiler, ((Identifier *)expr->name)->value);
 
   if (!old_symbol) {
     return COMPILER_UNKNOWN_IDENTIFIER;
@@ -616,11 +1079,15 @@ CompilerResult compile_ident_reassignment(Compiler *compiler, Reassignment *expr
     emit(compiler, OP_GET_GLOBAL, (int[]){old_symbol->index}, 1);
     break;
   case SYMBOL_LOCAL_SCOPE:
-    emit(compiler, OP_SET_LOCAL, (int[]){old_symbol->index}, 1);
+    save_local(compiler, old_symbol);
     emit(compiler, OP_GET_LOCAL, (int[]){old_symbol->index}, 1);
     break;
   case SYMBOL_FREE_SCOPE:
-    emit(compiler, OP_SET_FREE, (int[]){old_symbol->index}, 1);
+    if (is_scalar_local(compiler->scalars, old_symbol->name)) {
+      emit(compiler, OP_SET_FREE_SCALAR, (int[]){old_symbol->index}, 1);
+    } else {
+      emit(compiler, OP_SET_FREE, (int[]){old_symbol->index}, 1);
+    }
     emit(compiler, OP_GET_FREE, (int[]){old_symbol->index}, 1);
     break;
   case SYMBOL_FUNCTION_SCOPE:
@@ -663,7 +1130,143 @@ CompilerResult compile_reassignment(Compiler *compiler, Reassignment *expr) {
   }
 }
 
+// The function a call can be compiled as the body of, if any. Every inlined
+// call takes new slots in the caller's frame, as many as the operands of
+// OP_SET_LOCAL and OP_SET_GLOBAL can address.
+InlineCandidate *inline_candidate(Compiler *compiler, CallExpression *call) {
+  if (compiler->inline_candidates == NULL ||
+      call->function->type != IDENT_EXPR) {
+    return NULL;
+  }
+
+  char *name = ((Identifier *)call->function)->value;
+  InlineCandidate *candidate =
+      find_inline_candidate(compiler->inline_candidates, name);
+  if (candidate == NULL || !candidate->defined ||
+      candidate->fn->parameters.len != call->arguments.len) {
+    return NULL;
+  }
+
+  if (compiler->inlined && compiler->inlined->depth >= INLINE_MAX_DEPTH) {
+    return NULL;
+  }
+
+  SymbolTable *symbols = compiler->symbol_table;
+  size_t max_slots = symbols->outer ? UINT8_MAX : UINT16_MAX;
+  if (symbols->num_definitions + INLINE_BUDGET > max_slots) {
+    return NULL;
+  }
+
+  // A local or parameter may shadow the function where it is called
+  const Symbol *symbol = resolve_symbol(compiler, name);
+  if (symbol == NULL || symbol->scope != SYMBOL_GLOBAL_SCOPE) {
+    return NULL;
+  }
+
+  return candidate;
+}
+
+static const struct {
+  char *name;
+  size_t num_args;
+  OpCode op;
+} intrinsics[] = {
+    {"len", 1, OP_LEN},
+    {"first", 1, OP_FIRST},
+    {"last", 1, OP_LAST},
+    {"push", 2, OP_PUSH},
+};
+
+// The opcode a call to a builtin can be compiled as, or OP_COUNT. Only a
+// name that resolves to the builtin itself qualifies, not a global or local
+// shadowing it, and only with the number of arguments the builtin takes, so
+// that a wrong count still fails the way the builtin reports it.
+OpCode intrinsic_opcode(Compiler *compiler, CallExpression *call) {
+  if (call->function->type != IDENT_EXPR) {
+    return OP_COUNT;
+  }
+
+  char *name = ((Identifier *)call->function)->value;
+  for (size_t i = 0; i < ARRAY_LEN(intrinsics); i++) {
+    if (strcmp(intrinsics[i].name, name) != 0 ||
+        intrinsics[i].num_args != call->arguments.len) {
+      continue;
+    }
+
+    const Symbol *symbol = resolve_symbol(compiler, name);
+    if (symbol && symbol->scope == SYMBOL_BUILTIN_SCOPE) {
+      return intrinsics[i].op;
+    }
+    break;
+  }
+
+  return OP_COUNT;
+}
+
+// Compiles a call as the body of the function: the arguments are stored in
+// the slots of its parameters, and the value it returns is left on the
+// stack where the call would have pushed it.
+static CompilerResult compile_inlined_call(Compiler *compiler,
+                                           CallExpression *call,
+                                           InlineCandidate *candidate) {
+  FunctionLiteral *fn = candidate->fn;
+  for (size_t i = 0; i < call->arguments.len; i++) {
+    CompilerResult result =
+        compile_expression(compiler, call->arguments.arr[i]);
+    if (result != COMPILER_OK) {
+      return result;
+    }
+  }
+
+  InlinedCall inlined = {
+      .enclosing = compiler->inlined,
+      .candidate = candidate,
+      .depth = compiler->inlined ? compiler->inlined->depth + 1 : 1,
+      .num_locals = 0,
+      .num_lets_defined = 0,
+  };
+  int_array_init(&inlined.returns, 1);
+  compiler->inlined = &inlined;
+
+  SymbolTable *symbols = compiler->symbol_table;
+  for (size_t i = 0; i < fn->parameters.len; i++) {
+    define_inlined_local(compiler,
+                         ((Identifier *)fn->parameters.arr[i])->value,
+                         symbol_define_temporary(symbols));
+  }
+  for (size_t i = fn->parameters.len; i-- > 0;) {
+    save_symbol(compiler, &inlined.locals[i].symbol);
+  }
+
+  // A let may be read on a path that never stored it, or hold the value of
+  // an earlier call through the same slot
+  for (size_t i = 0; i < candidate->num_lets; i++) {
+    inlined.lets[i] = symbol_define_temporary(symbols);
+    emit_no_operands(compiler, OP_NULL);
+    save_symbol(compiler, &inlined.lets[i]);
+  }
+
+  CompilerResult result = compile_block_value(compiler, fn->body);
+  compiler->inlined = inlined.enclosing;
+
+  if (result == COMPILER_OK) {
+    size_t after_body_pos = compiler_current_instructions(compiler)->len;
+    for (size_t i = 0; i < inlined.returns.len; i++) {
+      change_operand(compiler, inlined.returns.arr[i], after_body_pos);
+    }
+  }
+
+  int_array_free(&inlined.returns);
+  return result;
+}
+
 CompilerResult compile_expression(Compiler *compiler, Expression *expr) {
+  const Symbol *hoisted = hoisted_symbol(compiler, expr);
+  if (hoisted) {
+    load_symbol(compiler, (Symbol *)hoisted);
+    return COMPILER_OK;
+  }
+
   switch (expr->type) {
   case INFIX_EXPR:
     return compile_infix_expression(compiler, (InfixExpression *)expr);
@@ -687,7 +1290,7 @@ CompilerResult compile_expression(Compiler *compiler, Expression *expr) {
     return compile_if_expression(compiler, (IfExpression *)expr);
   case IDENT_EXPR: {
     const Symbol *symbol =
-        symbol_resolve(compiler->symbol_table, ((Identifier *)expr)->value);
+        resolve_symbol(compiler, ((Identifier *)expr)->value);
     if (!symbol) {
       return COMPILER_UNKNOWN_IDENTIFIER;
     }
@@ -698,7 +1301,7 @@ CompilerResult compile_expression(Compiler *compiler, Expression *expr) {
   }
   case STRING_EXPR: {
     StringLiteral *str_lit = (StringLiteral *)expr;
-    Object *str = new_string(str_lit->value);
+    Object *str = new_interned_string(str_lit->value);
     size_t new_constant_pos = add_constant(compiler, str);
     emit(compiler, OP_CONSTANT, (int[]){new_constant_pos}, 1);
     break;
@@ -728,16 +1331,33 @@ CompilerResult compile_expression(Compiler *compiler, Expression *expr) {
       return result;
     }
 
-    emit_no_operands(compiler, OP_INDEX);
+    // Every index site gets its own inline cache in the VM. Caches check
+    // both the shape and the key, so sites sharing one after wrapping around
+    // only cost misses.
+    int cache = compiler->num_index_caches++ % INDEX_CACHES_SIZE;
+    emit(compiler, OP_INDEX, (int[]){cache}, 1);
     break;
   }
   case FN_EXPR:
     return compile_function_literal(compiler, (FunctionLiteral *)expr);
   case CALL_EXPR: {
     CallExpression *call = (CallExpression *)expr;
-    CompilerResult result = compile_expression(compiler, call->function);
-    if (result != COMPILER_OK) {
-      return result;
+    InlineCandidate *candidate = inline_candidate(compiler, call);
+    if (candidate) {
+      return compile_inlined_call(compiler, call, candidate);
+    }
+
+    OpCode intrinsic = OP_COUNT;
+    if (runs_pass(compiler, PASS_INTRINSICS)) {
+      double start = pass_timer_start();
+      intrinsic = intrinsic_opcode(compiler, call);
+      pass_timer_stop(PASS_INTRINSICS, start);
+    }
+    if (intrinsic == OP_COUNT) {
+      CompilerResult result = compile_expression(compiler, call->function);
+      if (result != COMPILER_OK) {
+        return result;
+      }
     }
 
     for (size_t i = 0; i < call->arguments.len; i++) {
@@ -748,7 +1368,11 @@ CompilerResult compile_expression(Compiler *compiler, Expression *expr) {
       }
     }
 
-    emit(compiler, OP_CALL, (int[]){call->arguments.len}, 1);
+    if (intrinsic != OP_COUNT) {
+      emit_no_operands(compiler, intrinsic);
+    } else {
+      emit(compiler, OP_CALL, (int[]){call->arguments.len}, 1);
+    }
     break;
   }
   case WHILE_EXPR:
@@ -765,6 +1389,14 @@ CompilerResult compile_expression(Compiler *compiler, Expression *expr) {
 }
 
 Bytecode bytecode(Compiler *compiler) {
+  if (runs_pass(compiler, PASS_PEEPHOLE)) {
+    double start = pass_timer_start();
+    peephole_optimize(compiler_current_instructions(compiler),
+                      compiler->constants, true, &compiler->peephole);
+    pass_timer_stop(PASS_PEEPHOLE, start);
+  }
+  specialize_operators(compiler, compiler_current_instructions(compiler), 0);
+
   Bytecode bytecode = {
       .constants = *compiler->constants,
       .instructions = *compiler_current_instructions(compiler),
@@ -806,6 +1438,12 @@ void enter_compiler_scope(Compiler *c) {
 
 Instructions *leave_compiler_scope(Compiler *c) {
   Instructions *instructions = compiler_current_instructions(c);
+  if (runs_pass(c, PASS_PEEPHOLE)) {
+    double start = pass_timer_start();
+    peephole_optimize(instructions, c->constants, false, &c->peephole);
+    pass_timer_stop(PASS_PEEPHOLE, start);
+  }
+
   c->scope_index--;
 
   SymbolTable *temp = c->symbol_table;
@@ -815,13 +1453,20 @@ Instructions *leave_compiler_scope(Compiler *c) {
   return instructions;
 }
 
+void discard_compiler_scope(Compiler *c) {
+  int_array_free(compiler_current_instructions(c));
+  c->scope_index--;
+
+  SymbolTable *temp = c->symbol_table;
+  c->symbol_table = c->symbol_table->outer;
+  free_symbol_table(temp);
+}
+
 void enter_loop(Compiler *c) {
   CurrentLoop *new_loop = malloc(sizeof(CurrentLoop));
   assert(new_loop != NULL);
 
   *new_loop = (CurrentLoop){
-      .break_locations = {0},
-      .break_location_index = 0,
       .enclosing = c->loop,
   };
 
@@ -838,13 +1483,25 @@ CurrentLoop exit_loop(Compiler *c) {
 }
 
 void new_break_statement(Compiler *c) {
-  size_t break_pos = emit(c, OP_BREAK, (int[]){JUMP_SENTINEL}, 1);
-  c->loop->break_locations[c->loop->break_location_index++] = break_pos;
+  emit(c, OP_BREAK, (int[]){JUMP_SENTINEL}, 1);
 }
 
+// Breaks of nested loops live in the nested loop bodies, so every break in
+// `ins` belongs to the loop being patched. They are found by walking the
+// body rather than by position, since the peephole optimizer may have moved
+// them.
 void patch_break_statements(Compiler *c, size_t exit_position,
-                            CurrentLoop loop_info, Instructions *ins) {
-  for (size_t i = 0; i < loop_info.break_location_index; i++) {
-    change_operand_ex(c, loop_info.break_locations[i], exit_position, ins);
+                            Instructions *ins) {
+  size_t pos = 0;
+  while (pos < ins->len) {
+    Definition *def = lookup(ins->arr[pos]);
+    if (ins->arr[pos] == OP_BREAK) {
+      change_operand_ex(c, pos, exit_position, ins);
+    }
+
+    size_t bytes_read;
+    IntArray operands = read_operands(def, ins, pos + 1, &bytes_read);
+    int_array_free(&operands);
+    pos += 1 + bytes_read;
   }
 }
@@ -3,7 +3,18 @@
 
 #include "../ast/ast.h"
 #include "../code/code.h"
+#include "../object/object.h"
+#include "captured_locals.h"
+#include "constant_folding.h"
+#include "dead_code.h"
+#include "escape_analysis.h"
+#include "inlining.h"
+#include "local_slots.h"
+#include "loop_invariants.h"
+#include "passes.h"
+#include "peephole.h"
 #include "symbol_table.h"
+#include "type_inference.h"
 
 typedef enum {
   COMPILER_OK,
@@ -21,24 +32,69 @@ typedef struct {
 } EmmittedInstruction;
 
 typedef struct CurrentLoop {
-  size_t break_location_index;
-  size_t break_locations[100];
   struct CurrentLoop *enclosing;
 } CurrentLoop;
 
+typedef struct {
+  char *name;
+  Symbol symbol;
+} InlinedLocal;
+
+// A call being compiled as the body of the function it calls. The
+// parameters and lets of the body live in slots of the caller's frame, and
+// its returns jump past the end of the body. The slots of the lets are set
+// to null before the body runs, as a frame's are when a function is called.
+typedef struct InlinedCall {
+  struct InlinedCall *enclosing;
+  const InlineCandidate *candidate;
+  size_t depth;
+  InlinedLocal locals[INLINE_BUDGET];
+  size_t num_locals;
+  Symbol lets[INLINE_BUDGET];
+  size_t num_lets_defined;
+  IntArray returns; // positions of the jumps to patch
+} InlinedCall;
+
+// A loop-invariant part of a loop condition, evaluated once into a
+// temporary before the loop starts
+typedef struct {
+  Expression *expr;
+  Symbol symbol;
+} HoistedExpression;
+
 typedef struct {
   Instructions instructions;
   EmmittedInstruction last_instruction;
   EmmittedInstruction previous_instruction;
 } CompilationScope;
 
+// Indexes of the constants already in the pool, so that equal numbers,
+// strings and function bodies are only added once. Keys point into the
+// constants themselves, values are the index plus one.
+typedef struct {
+  hashmap_t numbers;
+  hashmap_t strings;
+  hashmap_t functions;
+} ConstantPool;
+
 typedef struct {
   DynamicArray *constants; // Object*[]
+  ConstantPool pool;
   SymbolTable *symbol_table;
   CompilationScope scopes[256];
   size_t scope_index;
   bool is_void_expression;
   CurrentLoop *loop;
+  ScalarLocals *scalars; // escape analysis of the function being compiled
+  CapturedLocals *captured; // of the function being compiled
+  size_t num_index_caches;
+  OptimizationLevel optimization_level; // see passes.h
+  PeepholeStats peephole;
+  bool whole_program; // false when the REPL compiles one line at a time
+  DynamicArray *inline_candidates; // InlineCandidate*[], NULL when disabled
+  InlinedCall *inlined;
+  DynamicArray *hoisted; // HoistedExpression*[], while compiling a loop
+                         // condition
 } Compiler;
 
 Compiler *new_compiler();
@@ -61,11 +117,27 @@ void compiler_error(CompilerResult, char *, size_t);
 
 void enter_compiler_scope(Compiler *);
 Instructions *leave_compiler_scope(Compiler *);
+// Leaves the scope without optimizing or keeping what was compiled in it
+void discard_compiler_scope(Compiler *);
+Instructions *compiler_current_instructions(Compiler *);
+
+size_t add_constant(Compiler *, Object *);
+// Leaves the scope of a function literal whose body has been compiled, with
+// `num_locals` slots, and emits the closure of it
+void emit_closure(Compiler *, size_t num_locals, size_t num_parameters);
+
+// The opcodes of operators, OP_COUNT for unknown ones
+OpCode infix_opcode(char *);
+OpCode prefix_opcode(char *);
+// The opcode a call to a builtin can be compiled as, or OP_COUNT
+OpCode intrinsic_opcode(Compiler *, CallExpression *);
+// The function a call can be compiled as the body of, if any
+InlineCandidate *inline_candidate(Compiler *, CallExpression *);
 
 void save_to_file(Bytecode, const char *);
 void enter_loop(Compiler *);
 CurrentLoop exit_loop(Compiler *);
-void patch_break_statements(Compiler *, size_t, CurrentLoop, Instructions *);
+void patch_break_statements(Compiler *, size_t, Instructions *);
 void new_break_statement(Compiler *);
 
 #endif // COMPILER_H
@@ -9,7 +9,12 @@
 
 #define ARRAY_LEN(arr) (sizeof(arr) / sizeof(arr[0]))
 
-#define RUN_COMPILER_TESTS(tests) run_compiler_tests(tests, ARRAY_LEN(tests))
+// Most tests check the code generated for each construct, so they compile
+// without folding constants first.
+#define RUN_COMPILER_TESTS(tests)                                              \
+  run_compiler_tests(tests, ARRAY_LEN(tests), OPTIMIZATION_O0)
+#define RUN_OPTIMIZED_COMPILER_TESTS(tests)                                    \
+  run_compiler_tests(tests, ARRAY_LEN(tests), OPTIMIZATION_O2)
 
 typedef struct {
   char *input;
@@ -117,16 +122,18 @@ void test_constants(compilerTestCase test, Bytecode code) {
       TEST_FAIL_MESSAGE("unreachable");
     }
 
-    free(test.expected_constants[i]);
+    free_object(test.expected_constants[i]);
   }
 }
 
-void run_compiler_tests(compilerTestCase *test_cases, size_t test_count) {
+void run_compiler_tests(compilerTestCase *test_cases, size_t test_count,
+                        OptimizationLevel level) {
   for (uint32_t i = 0; i < test_count; i++) {
     compilerTestCase test = test_cases[i];
 
     Program *program = parse(&test);
     Compiler *compiler = new_compiler();
+    compiler->optimization_level = level;
     int8_t result = compile_program(compiler, program);
     if (result != COMPILER_OK) {
       char msg[100];
@@ -744,14 +751,12 @@ void test_index_expressions(void) {
   compilerTestCase tests[] = {
       {
           .input = "[1, 2, 3][1 + 1]",
-          .expected_constants_len = 5,
+          .expected_constants_len = 3,
           .expected_constants =
               {
                   new_number(1),
                   new_number(2),
                   new_number(3),
-                  new_number(1),
-                  new_number(1),
               },
           .expected_instructions_len = 9,
           .expected_instructions =
@@ -760,22 +765,20 @@ void test_index_expressions(void) {
                   make_instruction(OP_CONSTANT, (int[]){1}, 1),
                   make_instruction(OP_CONSTANT, (int[]){2}, 1),
                   make_instruction(OP_ARRAY, (int[]){3}, 1),
-                  make_instruction(OP_CONSTANT, (int[]){3}, 1),
-                  make_instruction(OP_CONSTANT, (int[]){4}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
                   make_instruction(OP_ADD, (int[]){}, 0),
-                  make_instruction(OP_INDEX, (int[]){}, 0),
+                  make_instruction(OP_INDEX, (int[]){0}, 1),
                   make_instruction(OP_POP, (int[]){}, 0),
               },
       },
       {
           .input = "{1: 2}[2 - 1]",
-          .expected_constants_len = 4,
+          .expected_constants_len = 2,
           .expected_constants =
               {
                   new_number(1),
                   new_number(2),
-                  new_number(2),
-                  new_number(1),
               },
           .expected_instructions_len = 8,
           .expected_instructions =
@@ -783,10 +786,10 @@ void test_index_expressions(void) {
                   make_instruction(OP_CONSTANT, (int[]){0}, 1),
                   make_instruction(OP_CONSTANT, (int[]){1}, 1),
                   make_instruction(OP_HASH, (int[]){2}, 1),
-                  make_instruction(OP_CONSTANT, (int[]){2}, 1),
-                  make_instruction(OP_CONSTANT, (int[]){3}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
                   make_instruction(OP_SUB, (int[]){}, 0),
-                  make_instruction(OP_INDEX, (int[]){}, 0),
+                  make_instruction(OP_INDEX, (int[]){0}, 1),
                   make_instruction(OP_POP, (int[]){}, 0),
               },
       },
@@ -1317,6 +1320,44 @@ void test_closures(void) {
                       make_instruction(OP_POP, (int[]){}, 0),
                   },
           },
+          {
+              .input = "fn(a) {"
+                       "  fn() {"
+                       "    a = 1;"
+                       "  }"
+                       "}",
+              .expected_constants_len = 3,
+              .expected_constants =
+                  {
+                      new_number(1),
+                      new_concatted_compiled_function(
+                          (Instruction[]){
+                              make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                              make_instruction(OP_SET_FREE, (int[]){0}, 1),
+                              make_instruction(OP_GET_FREE, (int[]){0}, 1),
+                              make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                              make_instruction(OP_RETURN, (int[]){}, 0),
+                          },
+                          5),
+                      new_concatted_compiled_function(
+                          (Instruction[]){
+                              make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                              make_instruction(OP_SET_LOCAL_CAPTURED,
+                                               (int[]){0}, 1),
+                              make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                              make_instruction(OP_CLOSURE, (int[]){1, 1}, 2),
+                              make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                              make_instruction(OP_RETURN, (int[]){}, 0),
+                          },
+                          6),
+                  },
+              .expected_instructions_len = 2,
+              .expected_instructions =
+                  {
+                      make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
+                      make_instruction(OP_POP, (int[]){}, 0),
+                  },
+          },
       };
 
   RUN_COMPILER_TESTS(tests);
@@ -1327,7 +1368,7 @@ void test_recursive_functions(void) {
       {
           .input = "let countDown = fn(x) { countDown(x - 1); };"
                    "countDown(1);",
-          .expected_constants_len = 3,
+          .expected_constants_len = 2,
           .expected_constants =
               {
                   new_number(1),
@@ -1341,7 +1382,6 @@ void test_recursive_functions(void) {
                           make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
                       },
                       6),
-                  new_number(1),
               },
           .expected_instructions_len = 6,
           .expected_instructions =
@@ -1349,7 +1389,7 @@ void test_recursive_functions(void) {
                   make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
                   make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
                   make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
-                  make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
                   make_instruction(OP_CALL, (int[]){1}, 1),
                   make_instruction(OP_POP, (int[]){}, 0),
               },
@@ -1360,7 +1400,7 @@ void test_recursive_functions(void) {
                    "  countDown(1);"
                    "};"
                    "wrapper();",
-          .expected_constants_len = 4,
+          .expected_constants_len = 3,
           .expected_constants =
               {
                   new_number(1),
@@ -1374,13 +1414,12 @@ void test_recursive_functions(void) {
                           make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
                       },
                       6),
-                  new_number(1),
                   new_concatted_compiled_function(
                       (Instruction[]){
                           make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
                           make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
                           make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
-                          make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
                           make_instruction(OP_CALL, (int[]){1}, 1),
                           make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
                       },
@@ -1389,7 +1428,7 @@ void test_recursive_functions(void) {
           .expected_instructions_len = 5,
           .expected_instructions =
               {
-                  make_instruction(OP_CLOSURE, (int[]){3, 0}, 2),
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
                   make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
                   make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
                   make_instruction(OP_CALL, (int[]){0}, 1),
@@ -1456,18 +1495,17 @@ void test_reassignment(void) {
           },
           {
               .input = "let a = 1; a = a + 1;",
-              .expected_constants_len = 2,
+              .expected_constants_len = 1,
               .expected_constants =
                   {
                       new_number(1),
-                      new_number(1),
                   },
               .expected_instructions =
                   {
                       make_instruction(OP_CONSTANT, (int[]){0}, 1),
                       make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
                       make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
-                      make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                      make_instruction(OP_CONSTANT, (int[]){0}, 1),
                       make_instruction(OP_ADD, (int[]){}, 0),
                       make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
                       make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
@@ -1477,13 +1515,12 @@ void test_reassignment(void) {
           },
           {
               .input = "let arr = [1, 2]; arr[0] = 2;",
-              .expected_constants_len = 4,
+              .expected_constants_len = 3,
               .expected_constants =
                   {
                       new_number(1),
                       new_number(2),
                       new_number(0),
-                      new_number(2),
                   },
               .expected_instructions_len = 9,
               .expected_instructions =
@@ -1494,19 +1531,18 @@ void test_reassignment(void) {
                       make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
                       make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
                       make_instruction(OP_CONSTANT, (int[]){2}, 1),
-                      make_instruction(OP_CONSTANT, (int[]){3}, 1),
+                      make_instruction(OP_CONSTANT, (int[]){1}, 1),
                       make_instruction(OP_REASSIGN_INDEX, (int[]){}, 0),
                       make_instruction(OP_POP, (int[]){}, 0),
                   },
           },
           {
               .input = "let hash = { \"a\": 1 }; hash[\"a\"] = 2;",
-              .expected_constants_len = 4,
+              .expected_constants_len = 3,
               .expected_constants =
                   {
                       new_string("a"),
                       new_number(1),
-                      new_string("a"),
                       new_number(2),
                   },
               .expected_instructions_len = 9,
@@ -1517,8 +1553,8 @@ void test_reassignment(void) {
                       make_instruction(OP_HASH, (int[]){2}, 1),
                       make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
                       make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                      make_instruction(OP_CONSTANT, (int[]){0}, 1),
                       make_instruction(OP_CONSTANT, (int[]){2}, 1),
-                      make_instruction(OP_CONSTANT, (int[]){3}, 1),
                       make_instruction(OP_REASSIGN_INDEX, (int[]){}, 0),
                       make_instruction(OP_POP, (int[]){}, 0),
                   },
@@ -1677,10 +1713,9 @@ void test_for_loops(void) {
                    "for (let b = 0; b < 10; b = b + 1) {"
                    "  a = a + b;                        "
                    "}                                   ",
-          .expected_constants_len = 5,
+          .expected_constants_len = 4,
           .expected_constants =
               {
-                  new_number(0),
                   new_number(0),
                   new_number(10),
                   new_concatted_compiled_loop(
@@ -1700,16 +1735,16 @@ void test_for_loops(void) {
               {
                   make_instruction(OP_CONSTANT, (int[]){0}, 1),
                   make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
-                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
                   make_instruction(OP_SET_GLOBAL, (int[]){1}, 1),
-                  make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
                   make_instruction(OP_GET_GLOBAL, (int[]){1}, 1),
                   make_instruction(OP_GREATER, (int[]){}, 0),
                   make_instruction(OP_JMP_IF_FALSE, (int[]){44}, 1),
-                  make_instruction(OP_CLOSURE, (int[]){3, 0}, 2),
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
                   make_instruction(OP_LOOP, (int[]){}, 0),
                   make_instruction(OP_GET_GLOBAL, (int[]){1}, 1),
-                  make_instruction(OP_CONSTANT, (int[]){4}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){3}, 1),
                   make_instruction(OP_ADD, (int[]){}, 0),
                   make_instruction(OP_SET_GLOBAL, (int[]){1}, 1),
                   make_instruction(OP_GET_GLOBAL, (int[]){1}, 1),
@@ -1723,6 +1758,1113 @@ void test_for_loops(void) {
   RUN_COMPILER_TESTS(tests);
 }
 
+void test_scalar_locals(void) {
+  compilerTestCase tests[] = {
+      {
+          .input = "fn() { let i = 0; i = i + 1; let j = 2; j }",
+          .expected_constants_len = 4,
+          .expected_constants =
+              {
+                  new_number(0),
+                  new_number(1),
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL_SCALAR, (int[]){0},
+                                           1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_ADD_NUMBER, (int[]){}, 0),
+                          make_instruction(OP_SET_LOCAL_SCALAR, (int[]){0},
+                                           1),
+                          make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      10),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){3, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "fn(a) { let b = a; let c = 1; puts(c); let d = 2; "
+                   "fn() { d } }",
+          .expected_constants_len = 4,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_FREE, (int[]){0}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_BUILTIN, (int[]){1}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CALL, (int[]){1}, 1),
+                          make_instruction(OP_POP, (int[]){}, 0),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CLOSURE, (int[]){2, 1}, 2),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      13),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){3, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_OPTIMIZED_COMPILER_TESTS(tests);
+}
+
+void test_constant_folding(void) {
+  compilerTestCase tests[] = {
+      {
+          .input = "1 + 2 * 3 - (8 >> 1)",
+          .expected_constants_len = 1,
+          .expected_constants = {new_number(3)},
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "!true == (1 > 2)",
+          .expected_constants_len = 0,
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_TRUE, (int[]){}, 0),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "\"mon\" + \"key\"",
+          .expected_constants_len = 1,
+          .expected_constants = {new_string("monkey")},
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "len(\"abc\") + len([1, 2])",
+          .expected_constants_len = 1,
+          .expected_constants = {new_number(5)},
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // Mixed types are left for the VM to reject
+          .input = "1 + true",
+          .expected_constants_len = 1,
+          .expected_constants = {new_number(1)},
+          .expected_instructions_len = 4,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_TRUE, (int[]){}, 0),
+                  make_instruction(OP_ADD, (int[]){}, 0),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "let N = 2; N * 3",
+          .expected_constants_len = 2,
+          .expected_constants = {new_number(2), new_number(6)},
+          .expected_instructions_len = 4,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // Globals that are reassigned keep being loaded
+          .input = "let N = 2; N = 3; N * 2",
+          .expected_constants_len = 2,
+          .expected_constants = {new_number(2), new_number(3)},
+          .expected_instructions_len = 8,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_MUL, (int[]){}, 0),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_OPTIMIZED_COMPILER_TESTS(tests);
+}
+
+void test_constant_deduplication(void) {
+  compilerTestCase tests[] = {
+      {
+          .input = "1; 1; \"a\"; \"a\"; \"\"; \"\"",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_string("a"),
+                  new_string(""),
+              },
+          .expected_instructions_len = 12,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+                  make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+                  make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "fn() { 1 }; fn() { 1 }",
+          .expected_constants_len = 2,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      2),
+              },
+          .expected_instructions_len = 4,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_COMPILER_TESTS(tests);
+}
+
+void test_peephole(void) {
+  compilerTestCase tests[] = {
+      {
+          // The program's final value stays on the stack for the REPL
+          .input = "let a = 1; a = 2",
+          .expected_constants_len = 2,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_number(2),
+              },
+          .expected_instructions_len = 6,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "fn(a) { if (!a) { 1 } else { 2 } }",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_JMP_IF_TRUE, (int[]){11}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_JMP, (int[]){14}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      6),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // The null an if without else leaves is never pushed
+          .input = "fn(a) { if (a) { 1 }; 2 }",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_JMP_IF_FALSE, (int[]){9}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_POP, (int[]){}, 0),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      6),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // Reassignments are not reloaded
+          .input = "fn(a) { let b = a; b = 2; b }",
+          .expected_constants_len = 2,
+          .expected_constants =
+              {
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      6),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // Breaks are re-patched when the code before the loop shrinks
+          .input = "let i = 0; if (i > 1) { 5 }; "
+                   "while (i < 9) { if (i == 3) { break; }; i = i + 1; }; i",
+          .expected_constants_len = 6,
+          .expected_constants =
+              {
+                  new_number(0),
+                  new_number(1),
+                  new_number(5),
+                  new_number(9),
+                  new_number(3),
+                  new_concatted_compiled_loop(
+                      (Instruction[]){
+                          make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){4}, 1),
+                          make_instruction(OP_EQ, (int[]){}, 0),
+                          make_instruction(OP_JMP_IF_FALSE, (int[]){13}, 1),
+                          make_instruction(OP_BREAK, (int[]){38}, 1),
+                          make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_ADD, (int[]){}, 0),
+                          make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                          make_instruction(OP_CONTINUE, (int[]){}, 0),
+                      },
+                      10, 0),
+              },
+          .expected_instructions_len = 17,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                  make_instruction(OP_GREATER, (int[]){}, 0),
+                  make_instruction(OP_JMP_IF_FALSE, (int[]){20}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+                  make_instruction(OP_CONSTANT, (int[]){3}, 1),
+                  make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_GREATER, (int[]){}, 0),
+                  make_instruction(OP_JMP_IF_FALSE, (int[]){38}, 1),
+                  make_instruction(OP_CLOSURE, (int[]){5, 0}, 2),
+                  make_instruction(OP_LOOP, (int[]){}, 0),
+                  make_instruction(OP_JMP, (int[]){20}, 1),
+                  make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_OPTIMIZED_COMPILER_TESTS(tests);
+}
+
+void test_peephole_stats(void) {
+  compilerTestCase test = {
+      .input = "fn(a) { if (!a) { return 1; } else { return 2; } }"};
+  Program *program = parse(&test);
+  // The lowering of the SSA form at O3 leaves nothing unreachable
+  Compiler *compiler = new_compiler();
+  compiler->optimization_level = OPTIMIZATION_O2;
+  TEST_ASSERT_EQUAL(COMPILER_OK, compile_program(compiler, program));
+  bytecode(compiler);
+
+  PeepholeStats *stats = &compiler->peephole;
+  TEST_ASSERT_EQUAL(1, stats->removed[PEEPHOLE_NEGATED_JUMP]);
+  TEST_ASSERT_GREATER_THAN(0, stats->removed[PEEPHOLE_UNREACHABLE]);
+  TEST_ASSERT_EQUAL(0, stats->removed[PEEPHOLE_STORE_LOAD]);
+
+  free_program(program);
+  free_compiler(compiler);
+}
+
+void test_dead_code(void) {
+  compilerTestCase tests[] = {
+      {
+          .input = "if (true) { 10 } else { 20 }; 3333",
+          .expected_constants_len = 2,
+          .expected_constants = {new_number(10), new_number(3333)},
+          .expected_instructions_len = 4,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+                  make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "if (1 > 2) { 10 }",
+          .expected_constants_len = 0,
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_NULL, (int[]){}, 0),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "fn() { return 1; 2 }",
+          .expected_constants_len = 2,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      2),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // g is only called by f, which nothing calls
+          .input = "let f = fn() { f(); g() }; let g = fn() { 1 }; 2",
+          .expected_constants_len = 1,
+          .expected_constants = {new_number(2)},
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_OPTIMIZED_COMPILER_TESTS(tests);
+}
+
+void test_inlining(void) {
+  compilerTestCase tests[] = {
+      {
+          .input = "let twice = fn(x) { x * 2 }; twice(3)",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_MUL, (int[]){}, 0),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      4),
+                  new_number(3),
+              },
+          .expected_instructions_len = 8,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                  make_instruction(OP_SET_GLOBAL, (int[]){1}, 1),
+                  make_instruction(OP_GET_GLOBAL, (int[]){1}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_MUL, (int[]){}, 0),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // Parameters are stored in the caller's frame, where x is no longer
+          // needed, and returns jump past the body
+          .input = "let max = fn(a, b) { if (a > b) { return a; }; b };"
+                   "fn(x) { max(x, 1) }",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_GREATER, (int[]){}, 0),
+                          make_instruction(OP_JMP_IF_FALSE, (int[]){11}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      8),
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_GREATER, (int[]){}, 0),
+                          make_instruction(OP_JMP_IF_FALSE, (int[]){22}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_JMP, (int[]){24}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      12),
+              },
+          .expected_instructions_len = 4,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){0, 0}, 2),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // The global may hold another function by the time of the call
+          .input = "let f = fn() { 1 }; f = fn() { 2 }; f()",
+          .expected_constants_len = 4,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      2),
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      2),
+              },
+          .expected_instructions_len = 7,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CLOSURE, (int[]){3, 0}, 2),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CALL, (int[]){0}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_OPTIMIZED_COMPILER_TESTS(tests);
+}
+
+void test_intrinsics(void) {
+  compilerTestCase tests[] = {
+      {
+          .input = "fn(a) { [len(a), push(a, 1), first(a), last(a)] }",
+          .expected_constants_len = 2,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_LEN, (int[]){}, 0),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_PUSH, (int[]){}, 0),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_FIRST, (int[]){}, 0),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_LAST, (int[]){}, 0),
+                          make_instruction(OP_ARRAY, (int[]){4}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      11),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // The builtin reports the wrong number of arguments
+          .input = "len([], 1)",
+          .expected_constants_len = 1,
+          .expected_constants =
+              {
+                  new_number(1),
+              },
+          .expected_instructions_len = 5,
+          .expected_instructions =
+              {
+                  make_instruction(OP_GET_BUILTIN, (int[]){0}, 1),
+                  make_instruction(OP_ARRAY, (int[]){0}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                  make_instruction(OP_CALL, (int[]){2}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          .input = "fn(len) { len([]) }",
+          .expected_constants_len = 1,
+          .expected_constants =
+              {
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_ARRAY, (int[]){0}, 1),
+                          make_instruction(OP_CALL, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      4),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){0, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_OPTIMIZED_COMPILER_TESTS(tests);
+}
+
+void test_loop_invariants(void) {
+  compilerTestCase tests[] = {
+      {
+          .input = "fn(n) { let i = 0; while (i < n - 1) { i = i + 1; }; i }",
+          .expected_constants_len = 4,
+          .expected_constants =
+              {
+                  new_number(0),
+                  new_number(1),
+                  new_concatted_compiled_loop(
+                      (Instruction[]){
+                          make_instruction(OP_GET_FREE, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_ADD, (int[]){}, 0),
+                          make_instruction(OP_SET_FREE, (int[]){0}, 1),
+                          make_instruction(OP_CONTINUE, (int[]){}, 0),
+                      },
+                      5, 0),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL_CAPTURED, (int[]){1},
+                                           1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_SUB, (int[]){}, 0),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_GREATER, (int[]){}, 0),
+                          make_instruction(OP_JMP_IF_FALSE, (int[]){31}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_CLOSURE, (int[]){2, 1}, 2),
+                          make_instruction(OP_LOOP, (int[]){}, 0),
+                          make_instruction(OP_JMP, (int[]){13}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      16),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){3, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      {
+          // f may assign n
+          .input = "fn(n, f) { let i = 0; while (i < n - 1) { i = f(i); }; i }",
+          .expected_constants_len = 4,
+          .expected_constants =
+              {
+                  new_number(0),
+                  new_number(1),
+                  new_concatted_compiled_loop(
+                      (Instruction[]){
+                          make_instruction(OP_GET_FREE, (int[]){1}, 1),
+                          make_instruction(OP_GET_FREE, (int[]){0}, 1),
+                          make_instruction(OP_CALL, (int[]){1}, 1),
+                          make_instruction(OP_SET_FREE, (int[]){0}, 1),
+                          make_instruction(OP_CONTINUE, (int[]){}, 0),
+                      },
+                      5, 0),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL_CAPTURED, (int[]){2},
+                                           1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_SUB, (int[]){}, 0),
+                          make_instruction(OP_GET_LOCAL, (int[]){2}, 1),
+                          make_instruction(OP_GREATER, (int[]){}, 0),
+                          make_instruction(OP_JMP_IF_FALSE, (int[]){29}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){2}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_CLOSURE, (int[]){2, 2}, 2),
+                          make_instruction(OP_LOOP, (int[]){}, 0),
+                          make_instruction(OP_JMP, (int[]){5}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){2}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      15),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){3, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_OPTIMIZED_COMPILER_TESTS(tests);
+}
+
+void test_optimization_levels(void) {
+  TEST_ASSERT_FALSE(pass_enabled(OPTIMIZATION_O0, PASS_PEEPHOLE));
+  TEST_ASSERT_FALSE(pass_enabled(OPTIMIZATION_O0, PASS_ESCAPE_ANALYSIS));
+  TEST_ASSERT_TRUE(pass_enabled(OPTIMIZATION_O1, PASS_ESCAPE_ANALYSIS));
+  TEST_ASSERT_TRUE(pass_enabled(OPTIMIZATION_O1, PASS_INTRINSICS));
+  TEST_ASSERT_FALSE(pass_enabled(OPTIMIZATION_O1, PASS_INLINING));
+  TEST_ASSERT_TRUE(pass_enabled(OPTIMIZATION_O2, PASS_LOOP_INVARIANTS));
+  TEST_ASSERT_FALSE(pass_enabled(OPTIMIZATION_O2, PASS_SSA));
+  TEST_ASSERT_TRUE(pass_enabled(OPTIMIZATION_O3, PASS_SSA));
+  TEST_ASSERT_TRUE(pass_enabled(OPTIMIZATION_O3, PASS_GVN));
+  TEST_ASSERT_TRUE(pass_enabled(OPTIMIZATION_O3, PASS_LOOP_INVARIANTS));
+
+  // Folded, but not inlined
+  compilerTestCase tests[] = {
+      {
+          .input = "let twice = fn(x) { x * 2 }; twice(1 + 2)",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_MUL, (int[]){}, 0),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      4),
+                  new_number(3),
+              },
+          .expected_instructions_len = 6,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_SET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_GET_GLOBAL, (int[]){0}, 1),
+                  make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                  make_instruction(OP_CALL, (int[]){1}, 1),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  run_compiler_tests(tests, ARRAY_LEN(tests), OPTIMIZATION_O1);
+}
+
+void test_ssa_form(void) {
+  compilerTestCase tests[] = {
+      // The loop is part of the function, its counter stays in a slot
+      {
+          .input = "fn(n) { let i = 0; while (i < n - 1) { i = i + 1; }; i }",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_number(0),
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          // 0000
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+                          // 0005
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_SUB, (int[]){}, 0),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_GREATER_NUMBER, (int[]){}, 0),
+                          make_instruction(OP_JMP_IF_FALSE, (int[]){28}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_ADD, (int[]){}, 0),
+                          make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_JMP, (int[]){5}, 1),
+                          // 0028
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      15),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      // The sum in the branch is the one before it
+      {
+          .input = "fn(a, b) { let s = a + b; if (s > 2) { a + b } else { "
+                   "s * 2 } }",
+          .expected_constants_len = 2,
+          .expected_constants =
+              {
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          // 0000
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_ADD, (int[]){}, 0),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_GREATER, (int[]){}, 0),
+                          make_instruction(OP_JMP_IF_FALSE, (int[]){23}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_JMP, (int[]){31}, 1),
+                          // 0023
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_MUL, (int[]){}, 0),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          // 0031
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      17),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  run_compiler_tests(tests, ARRAY_LEN(tests), OPTIMIZATION_O3);
+}
+
+void test_slot_packing(void) {
+  compilerTestCase tests[] = {
+      // b is stored after the last load of a, so they share a slot
+      {
+          .input = "fn() { let a = \"x\"; puts(a); let b = \"y\"; puts(b) }",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_string("x"),
+                  new_string("y"),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_BUILTIN, (int[]){1}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CALL, (int[]){1}, 1),
+                          make_instruction(OP_POP, (int[]){}, 0),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_BUILTIN, (int[]){1}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CALL, (int[]){1}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      12),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      // Both are live at the call
+      {
+          .input = "fn() { let a = \"x\"; let b = \"y\"; puts(a, b) }",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_string("x"),
+                  new_string("y"),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_GET_BUILTIN, (int[]){1}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_CALL, (int[]){2}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      9),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_OPTIMIZED_COMPILER_TESTS(tests);
+}
+
+void test_type_inference(void) {
+  compilerTestCase tests[] = {
+      // The multiplication proves a is a number, d always is one. The
+      // difference is returned, so it is still allocated
+      {
+          .input = "fn(a, b) { let d = a * b + 1; d - a }",
+          .expected_constants_len = 2,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_MUL, (int[]){}, 0),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_ADD_NUMBER, (int[]){}, 0),
+                          make_instruction(OP_SET_LOCAL_SCALAR, (int[]){2}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){2}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_SUB, (int[]){}, 0),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      10),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      // Comparisons allocate nothing, whatever happens to their result
+      {
+          .input = "fn(a) { a * 2 > a - 1 }",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_number(2),
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_MUL, (int[]){}, 0),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_SUB_NUMBER, (int[]){}, 0),
+                          make_instruction(OP_GREATER_NUMBER, (int[]){}, 0),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      8),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      // What the first subtraction proves about a is lost in the call
+      {
+          .input = "fn(a) { let b = a - 1; puts(b); a - b }",
+          .expected_constants_len = 2,
+          .expected_constants =
+              {
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SUB, (int[]){}, 0),
+                          make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_GET_BUILTIN, (int[]){1}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_CALL, (int[]){1}, 1),
+                          make_instruction(OP_POP, (int[]){}, 0),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_SUB, (int[]){}, 0),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      12),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){1, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      // Closures capturing locals can change their type
+      {
+          .input = "fn(a) { let b = a * 2; let f = fn() { b }; b + 1 }",
+          .expected_constants_len = 4,
+          .expected_constants =
+              {
+                  new_number(2),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_FREE, (int[]){0}, 1),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      2),
+                  new_number(1),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_MUL, (int[]){}, 0),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CLOSURE, (int[]){1, 1}, 2),
+                          make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){2}, 1),
+                          make_instruction(OP_ADD, (int[]){}, 0),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      11),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){3, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+      // Both operands are strings
+      {
+          .input = "fn() { let s = \"x\"; s + \"y\" }",
+          .expected_constants_len = 3,
+          .expected_constants =
+              {
+                  new_string("x"),
+                  new_string("y"),
+                  new_concatted_compiled_function(
+                      (Instruction[]){
+                          make_instruction(OP_CONSTANT, (int[]){0}, 1),
+                          make_instruction(OP_SET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+                          make_instruction(OP_CONSTANT, (int[]){1}, 1),
+                          make_instruction(OP_ADD_STRING, (int[]){}, 0),
+                          make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+                      },
+                      6),
+              },
+          .expected_instructions_len = 2,
+          .expected_instructions =
+              {
+                  make_instruction(OP_CLOSURE, (int[]){2, 0}, 2),
+                  make_instruction(OP_POP, (int[]){}, 0),
+              },
+      },
+  };
+
+  RUN_OPTIMIZED_COMPILER_TESTS(tests);
+}
+
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_compiler_scopes);
@@ -1744,5 +2886,18 @@ int main(void) {
   RUN_TEST(test_for_loops);
   RUN_TEST(test_index_expressions);
   RUN_TEST(test_functions);
+  RUN_TEST(test_scalar_locals);
+  RUN_TEST(test_constant_folding);
+  RUN_TEST(test_constant_deduplication);
+  RUN_TEST(test_peephole);
+  RUN_TEST(test_peephole_stats);
+  RUN_TEST(test_dead_code);
+  RUN_TEST(test_inlining);
+  RUN_TEST(test_intrinsics);
+  RUN_TEST(test_loop_invariants);
+  RUN_TEST(test_optimization_levels);
+  RUN_TEST(test_ssa_form);
+  RUN_TEST(test_slot_packing);
+  RUN_TEST(test_type_inference);
   return UNITY_END();
 }
@@ -0,0 +1,517 @@
+#include "constant_folding.h"
+#include "../object/builtins.h"
+#include "../object/object.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  char *name;
+  size_t num_bindings; // lets, reassignments and parameters
+  Expression *value;   // literal it can be replaced with, once bound
+} Binding;
+
+// Bindings are counted over the whole program first, so that folding knows
+// whether a global is ever rebound, even further down.
+typedef enum {
+  COUNT_BINDINGS,
+  FOLD,
+} Pass;
+
+typedef struct {
+  Pass pass;
+  DynamicArray bindings; // Binding*[]
+  SymbolTable *symbols;
+} Folder;
+
+static void walk_expression(Folder *, Expression **);
+static void walk_block(Folder *, BlockStatement *);
+
+static Binding *find_binding(Folder *f, const char *name) {
+  for (size_t i = 0; i < f->bindings.len; i++) {
+    Binding *b = f->bindings.arr[i];
+    if (strcmp(b->name, name) == 0) {
+      return b;
+    }
+  }
+
+  return NULL;
+}
+
+static void bind(Folder *f, const char *name) {
+  if (f->pass != COUNT_BINDINGS) {
+    return;
+  }
+
+  Binding *b = find_binding(f, name);
+  if (b == NULL) {
+    b = malloc(sizeof(Binding));
+    assert(b != NULL);
+
+    *b = (Binding){.name = (char *)name};
+    array_append(&f->bindings, b);
+  }
+
+  b->num_bindings++;
+}
+
+static Token literal_token(TokenType type, const char *literal) {
+  Token token = {.Type = type};
+  snprintf(token.literal, MAX_LEN, "%s", literal);
+  return token;
+}
+
+static Expression *number_literal(double value) {
+  NumberLiteral *lit = malloc(sizeof(NumberLiteral));
+  assert(lit != NULL);
+
+  char formatted[MAX_LEN];
+  snprintf(formatted, MAX_LEN, "%g", value);
+
+  *lit = (NumberLiteral){
+      .type = INT_EXPR,
+      .token = literal_token(NUMBER, formatted),
+      .value = value,
+  };
+  return (Expression *)lit;
+}
+
+static Expression *boolean_literal(bool value) {
+  BooleanLiteral *lit = malloc(sizeof(BooleanLiteral));
+  assert(lit != NULL);
+
+  *lit = (BooleanLiteral){
+      .type = BOOL_EXPR,
+      .token = value ? literal_token(TRUE, "true")
+                     : literal_token(FALSE, "false"),
+      .value = value,
+  };
+  return (Expression *)lit;
+}
+
+// Takes ownership of `value`
+static Expression *string_literal(char *value) {
+  StringLiteral *lit = malloc(sizeof(StringLiteral));
+  assert(lit != NULL);
+
+  *lit = (StringLiteral){
+      .type = STRING_EXPR,
+      .token = literal_token(STRING, value),
+      .value = value,
+      .len = strlen(value),
+  };
+  return (Expression *)lit;
+}
+
+static bool is_literal(Expression *expr) {
+  return expr->type == INT_EXPR || expr->type == BOOL_EXPR ||
+         expr->type == STRING_EXPR;
+}
+
+// Casting a double out of the range of long is undefined
+static bool fits_long(double value) {
+  return value >= (double)LONG_MIN && value < (double)LONG_MAX;
+}
+
+// Mirrors execute_binary_integer_operation and execute_number_comparison
+static Expression *fold_number_infix(const char *op, double l, double r) {
+  if (strcmp(op, "+") == 0) {
+    return number_literal(l + r);
+  }
+  if (strcmp(op, "-") == 0) {
+    return number_literal(l - r);
+  }
+  if (strcmp(op, "*") == 0) {
+    return number_literal(l * r);
+  }
+  if (strcmp(op, "/") == 0) {
+    return number_literal(l / r);
+  }
+  if (strcmp(op, "<") == 0) {
+    return boolean_literal(l < r);
+  }
+  if (strcmp(op, ">") == 0) {
+    return boolean_literal(l > r);
+  }
+  if (strcmp(op, "==") == 0) {
+    return boolean_literal(l == r);
+  }
+  if (strcmp(op, "!=") == 0) {
+    return boolean_literal(l != r);
+  }
+
+  if (!fits_long(l) || !fits_long(r)) {
+    return NULL;
+  }
+
+  long a = l;
+  long b = r;
+  bool valid_shift = b >= 0 && b < (long)(sizeof(long) * CHAR_BIT);
+
+  if (strcmp(op, "%") == 0 && b != 0 && !(a == LONG_MIN && b == -1)) {
+    return number_literal(a % b);
+  }
+  if (strcmp(op, "<<") == 0 && valid_shift && a >= 0) {
+    return number_literal(a << b);
+  }
+  if (strcmp(op, ">>") == 0 && valid_shift) {
+    return number_literal(a >> b);
+  }
+  if (strcmp(op, "&") == 0) {
+    return number_literal(a & b);
+  }
+  if (strcmp(op, "|") == 0) {
+    return number_literal(a | b);
+  }
+  if (strcmp(op, "^") == 0) {
+    return number_literal(a ^ b);
+  }
+
+  return NULL;
+}
+
+static Expression *fold_string_infix(const char *op, StringLiteral *l,
+                                     StringLiteral *r) {
+  if (strcmp(op, "+") == 0) {
+    char *value = malloc(l->len + r->len + 1);
+    assert(value != NULL);
+
+    memcpy(value, l->value, l->len);
+    memcpy(value + l->len, r->value, r->len + 1);
+    return string_literal(value);
+  }
+  if (strcmp(op, "==") == 0) {
+    return boolean_literal(strcmp(l->value, r->value) == 0);
+  }
+  if (strcmp(op, "!=") == 0) {
+    return boolean_literal(strcmp(l->value, r->value) != 0);
+  }
+
+  return NULL;
+}
+
+static Expression *fold_boolean_infix(const char *op, bool l, bool r) {
+  if (strcmp(op, "&&") == 0) {
+    return boolean_literal(l && r);
+  }
+  if (strcmp(op, "||") == 0) {
+    return boolean_literal(l || r);
+  }
+  if (strcmp(op, "==") == 0) {
+    return boolean_literal(l == r);
+  }
+  if (strcmp(op, "!=") == 0) {
+    return boolean_literal(l != r);
+  }
+
+  return NULL;
+}
+
+// Operands of different types are left alone, whatever the VM makes of them.
+static Expression *fold_infix(InfixExpression *infix) {
+  Expression *left = infix->left;
+  Expression *right = infix->right;
+  if (!is_literal(left) || left->type != right->type) {
+    return NULL;
+  }
+
+  switch (left->type) {
+  case INT_EXPR:
+    return fold_number_infix(infix->operator, ((NumberLiteral *)left)->value,
+                             ((NumberLiteral *)right)->value);
+  case STRING_EXPR:
+    return fold_string_infix(infix->operator, (StringLiteral *)left,
+                             (StringLiteral *)right);
+  case BOOL_EXPR:
+    return fold_boolean_infix(infix->operator,
+                              ((BooleanLiteral *)left)->value,
+                              ((BooleanLiteral *)right)->value);
+  default:
+    return NULL;
+  }
+}
+
+// Mirrors execute_minus_operator and execute_bang_operator
+static Expression *fold_prefix(PrefixExpression *prefix) {
+  Expression *right = prefix->right;
+  if (!is_literal(right)) {
+    return NULL;
+  }
+
+  if (strcmp(prefix->operator, "-") == 0 && right->type == INT_EXPR) {
+    return number_literal(-((NumberLiteral *)right)->value);
+  }
+
+  if (strcmp(prefix->operator, "!") == 0) {
+    return boolean_literal(right->type == BOOL_EXPR &&
+                           !((BooleanLiteral *)right)->value);
+  }
+
+  return NULL;
+}
+
+// Returns NULL when the expression is not made of literals only
+static Object *literal_object(Expression *expr) {
+  switch (expr->type) {
+  case INT_EXPR:
+    return new_number(((NumberLiteral *)expr)->value);
+  case BOOL_EXPR:
+    return new_boolean(((BooleanLiteral *)expr)->value);
+  case STRING_EXPR:
+    return new_string(((StringLiteral *)expr)->value);
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    Object *objects[elements->len + 1];
+
+    for (size_t i = 0; i < elements->len; i++) {
+      objects[i] = literal_object(elements->arr[i]);
+      if (objects[i] == NULL) {
+        return NULL;
+      }
+    }
+
+    return new_array(objects, elements->len);
+  }
+  default:
+    return NULL;
+  }
+}
+
+static Expression *object_literal(Object *obj) {
+  switch (obj->type) {
+  case NUMBER_OBJ:
+    return number_literal(((Number *)obj)->value);
+  case BOOLEAN_OBJ:
+    return boolean_literal(((Boolean *)obj)->value);
+  case STRING_OBJ: {
+    char *value = strdup(string_value((String *)obj));
+    assert(value != NULL);
+    return string_literal(value);
+  }
+  default:
+    return NULL;
+  }
+}
+
+static bool is_pure_builtin(Folder *f, const char *name) {
+  static const char *pure_builtins[] = {"len", "first", "last"};
+
+  for (size_t i = 0; i < sizeof(pure_builtins) / sizeof(pure_builtins[0]);
+       i++) {
+    if (strcmp(name, pure_builtins[i]) == 0) {
+      const Symbol *s = symbol_resolve(f->symbols, (char *)name);
+      return find_binding(f, name) == NULL && s != NULL &&
+             s->scope == SYMBOL_BUILTIN_SCOPE;
+    }
+  }
+
+  return false;
+}
+
+// Runs the builtin itself, so the result is the one the VM would get.
+// Errors and non-literal results are left for the VM to produce.
+static Expression *fold_call(Folder *f, CallExpression *call) {
+  if (call->function->type != IDENT_EXPR) {
+    return NULL;
+  }
+
+  char *name = ((Identifier *)call->function)->value;
+  if (!is_pure_builtin(f, name)) {
+    return NULL;
+  }
+
+  DynamicArray args;
+  array_init(&args, call->arguments.len + 1);
+
+  Expression *result = NULL;
+  for (size_t i = 0; i < call->arguments.len; i++) {
+    Object *arg = literal_object(call->arguments.arr[i]);
+    if (arg == NULL) {
+      goto cleanup;
+    }
+    array_append(&args, arg);
+  }
+
+  Object *value = get_builtin_by_name(name)->fn(args);
+  if (value != NULL) {
+    result = object_literal(value);
+  }
+
+cleanup:
+  free(args.arr);
+  return result;
+}
+
+static void walk_statement(Folder *f, Statement *stmt) {
+  switch (stmt->type) {
+  case LET_STATEMENT:
+    bind(f, stmt->name->value);
+    walk_expression(f, &stmt->expression);
+    break;
+  case RETURN_STATEMENT:
+  case EXPR_STATEMENT:
+    walk_expression(f, &stmt->expression);
+    break;
+  case BREAK_STATEMENT:
+  case CONTINUE_STATEMENT:
+    break;
+  }
+}
+
+static void walk_block(Folder *f, BlockStatement *block) {
+  for (size_t i = 0; i < block->statements.len; i++) {
+    walk_statement(f, block->statements.arr[i]);
+  }
+}
+
+// Only values are folded: keys are what the parser's hashmap is keyed on.
+static int walk_hash_pair(void *const ctx,
+                          struct hashmap_element_s *const pair) {
+  walk_expression(ctx, (Expression **)&pair->data);
+  return 0;
+}
+
+static void walk_reassignment(Folder *f, Reassignment *expr) {
+  if (expr->name->type == IDENT_EXPR) {
+    bind(f, ((Identifier *)expr->name)->value);
+  } else if (expr->name->type == INDEX_EXPR) {
+    IndexExpression *index = (IndexExpression *)expr->name;
+    walk_expression(f, &index->left);
+    walk_expression(f, &index->index);
+  }
+
+  walk_expression(f, &expr->value);
+}
+
+static void walk_expression(Folder *f, Expression **slot) {
+  Expression *expr = *slot;
+  Expression *folded = NULL;
+
+  switch (expr->type) {
+  case IDENT_EXPR:
+    if (f->pass == FOLD) {
+      Binding *b = find_binding(f, ((Identifier *)expr)->value);
+      folded = b ? b->value : NULL;
+    }
+    break;
+  case INT_EXPR:
+  case BOOL_EXPR:
+  case STRING_EXPR:
+    break;
+  case PREFIX_EXPR: {
+    PrefixExpression *prefix = (PrefixExpression *)expr;
+    walk_expression(f, &prefix->right);
+    if (f->pass == FOLD) {
+      folded = fold_prefix(prefix);
+    }
+    break;
+  }
+  case INFIX_EXPR: {
+    InfixExpression *infix = (InfixExpression *)expr;
+    walk_expression(f, &infix->left);
+    walk_expression(f, &infix->right);
+    if (f->pass == FOLD) {
+      folded = fold_infix(infix);
+    }
+    break;
+  }
+  case IF_EXPR: {
+    IfExpression *if_expr = (IfExpression *)expr;
+    walk_expression(f, &if_expr->condition);
+    walk_block(f, if_expr->consequence);
+    if (if_expr->alternative) {
+      walk_block(f, if_expr->alternative);
+    }
+    break;
+  }
+  case FN_EXPR: {
+    FunctionLiteral *fn = (FunctionLiteral *)expr;
+    for (size_t i = 0; i < fn->parameters.len; i++) {
+      bind(f, ((Identifier *)fn->parameters.arr[i])->value);
+    }
+    walk_block(f, fn->body);
+    break;
+  }
+  case CALL_EXPR: {
+    CallExpression *call = (CallExpression *)expr;
+    walk_expression(f, &call->function);
+    for (size_t i = 0; i < call->arguments.len; i++) {
+      walk_expression(f, (Expression **)&call->arguments.arr[i]);
+    }
+    if (f->pass == FOLD) {
+      folded = fold_call(f, call);
+    }
+    break;
+  }
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    for (size_t i = 0; i < elements->len; i++) {
+      walk_expression(f, (Expression **)&elements->arr[i]);
+    }
+    break;
+  }
+  case HASH_EXPR:
+    hashmap_iterate_pairs(&((HashLiteral *)expr)->pairs, &walk_hash_pair, f);
+    break;
+  case INDEX_EXPR: {
+    IndexExpression *index = (IndexExpression *)expr;
+    walk_expression(f, &index->left);
+    walk_expression(f, &index->index);
+    break;
+  }
+  case WHILE_EXPR: {
+    WhileLoop *loop = (WhileLoop *)expr;
+    walk_expression(f, &loop->condition);
+    walk_block(f, loop->body);
+    break;
+  }
+  case FOR_EXPR: {
+    ForLoop *loop = (ForLoop *)expr;
+    if (loop->initialization) {
+      walk_statement(f, loop->initialization);
+    }
+    walk_expression(f, &loop->condition);
+    if (loop->update) {
+      walk_statement(f, loop->update);
+    }
+    walk_block(f, loop->body);
+    break;
+  }
+  case REASSIGN_EXPR:
+    walk_reassignment(f, (Reassignment *)expr);
+    break;
+  }
+
+  if (folded != NULL) {
+    *slot = folded;
+  }
+}
+
+void fold_constants(Program *program, SymbolTable *symbols,
+                    bool propagate_globals) {
+  Folder f = {.pass = COUNT_BINDINGS, .symbols = symbols};
+  array_init(&f.bindings, 8);
+
+  for (size_t i = 0; i < program->statements.len; i++) {
+    walk_statement(&f, program->statements.arr[i]);
+  }
+
+  f.pass = FOLD;
+  for (size_t i = 0; i < program->statements.len; i++) {
+    Statement *stmt = program->statements.arr[i];
+    walk_statement(&f, stmt);
+
+    // Reads are only replaced after the let, like the compiler only
+    // resolves the global after it
+    if (propagate_globals && stmt->type == LET_STATEMENT &&
+        is_literal(stmt->expression)) {
+      Binding *b = find_binding(&f, stmt->name->value);
+      if (b->num_bindings == 1) {
+        b->value = stmt->expression;
+      }
+    }
+  }
+
+  array_free(&f.bindings);
+}
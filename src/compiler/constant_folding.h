@@ -0,0 +1,19 @@
+#ifndef CONSTANT_FOLDING_H
+#define CONSTANT_FOLDING_H
+
+#include "../ast/ast.h"
+#include "symbol_table.h"
+#include <stdbool.h>
+
+// Rewrites the program in place before it is compiled:
+//  - prefix and infix operators over literals become the literal the VM
+//    would compute, unless the VM would fail or the C operation is undefined
+//  - calls to the pure builtins len, first and last on literals become their
+//    result, as long as `symbols` still resolves the name to the builtin
+//  - with `propagate_globals`, reads of a global bound once by a top-level
+//    `let` to a literal and never reassigned become the literal itself.
+//    This needs the whole program: the REPL compiles one line at a time and
+//    a later line may rebind the global.
+void fold_constants(Program *, SymbolTable *symbols, bool propagate_globals);
+
+#endif // CONSTANT_FOLDING_H
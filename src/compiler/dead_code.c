@@ -0,0 +1,209 @@
+#include "dead_code.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+  TRUNCATE_BLOCKS,
+  FIND_REFERENCE,
+} Pass;
+
+typedef struct {
+  Pass pass;
+  const char *name; // identifier FIND_REFERENCE looks for
+  bool found;
+} Walker;
+
+static void walk_expression(Walker *, Expression *);
+
+bool constant_condition(Expression *condition, bool *truthy) {
+  switch (condition->type) {
+  case BOOL_EXPR:
+    *truthy = ((BooleanLiteral *)condition)->value;
+    return true;
+  case INT_EXPR:
+  case STRING_EXPR:
+    *truthy = true;
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool is_terminal(Statement *stmt) {
+  return stmt->type == RETURN_STATEMENT || stmt->type == BREAK_STATEMENT ||
+         stmt->type == CONTINUE_STATEMENT;
+}
+
+static void walk_statement(Walker *w, Statement *stmt) {
+  if (stmt->expression != NULL) {
+    walk_expression(w, stmt->expression);
+  }
+}
+
+static void walk_block(Walker *w, BlockStatement *block) {
+  for (size_t i = 0; i < block->statements.len; i++) {
+    Statement *stmt = block->statements.arr[i];
+    walk_statement(w, stmt);
+
+    if (w->pass == TRUNCATE_BLOCKS && is_terminal(stmt)) {
+      for (size_t j = i + 1; j < block->statements.len; j++) {
+        free(block->statements.arr[j]);
+      }
+      block->statements.len = i + 1;
+    }
+  }
+}
+
+static int walk_hash_pair(void *const ctx,
+                          struct hashmap_element_s *const pair) {
+  walk_expression(ctx, (Expression *)pair->key);
+  walk_expression(ctx, pair->data);
+  return 0;
+}
+
+// Only the branch that runs can refer to anything
+static void walk_if(Walker *w, IfExpression *expr) {
+  walk_expression(w, expr->condition);
+
+  bool truthy;
+  bool constant = w->pass == FIND_REFERENCE &&
+                  constant_condition(expr->condition, &truthy);
+
+  if (!constant || truthy) {
+    walk_block(w, expr->consequence);
+  }
+  if (expr->alternative && (!constant || !truthy)) {
+    walk_block(w, expr->alternative);
+  }
+}
+
+static void walk_expression(Walker *w, Expression *expr) {
+  switch (expr->type) {
+  case IDENT_EXPR:
+    if (w->pass == FIND_REFERENCE &&
+        strcmp(((Identifier *)expr)->value, w->name) == 0) {
+      w->found = true;
+    }
+    break;
+  case INT_EXPR:
+  case BOOL_EXPR:
+  case STRING_EXPR:
+    break;
+  case PREFIX_EXPR:
+    walk_expression(w, ((PrefixExpression *)expr)->right);
+    break;
+  case INFIX_EXPR: {
+    InfixExpression *infix = (InfixExpression *)expr;
+    walk_expression(w, infix->left);
+    walk_expression(w, infix->right);
+    break;
+  }
+  case IF_EXPR:
+    walk_if(w, (IfExpression *)expr);
+    break;
+  case FN_EXPR:
+    walk_block(w, ((FunctionLiteral *)expr)->body);
+    break;
+  case CALL_EXPR: {
+    CallExpression *call = (CallExpression *)expr;
+    walk_expression(w, call->function);
+    for (size_t i = 0; i < call->arguments.len; i++) {
+      walk_expression(w, call->arguments.arr[i]);
+    }
+    break;
+  }
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    for (size_t i = 0; i < elements->len; i++) {
+      walk_expression(w, elements->arr[i]);
+    }
+    break;
+  }
+  case HASH_EXPR:
+    hashmap_iterate_pairs(&((HashLiteral *)expr)->pairs, &walk_hash_pair, w);
+    break;
+  case INDEX_EXPR: {
+    IndexExpression *index = (IndexExpression *)expr;
+    walk_expression(w, index->left);
+    walk_expression(w, index->index);
+    break;
+  }
+  case WHILE_EXPR: {
+    WhileLoop *loop = (WhileLoop *)expr;
+    walk_expression(w, loop->condition);
+    walk_block(w, loop->body);
+    break;
+  }
+  case FOR_EXPR: {
+    ForLoop *loop = (ForLoop *)expr;
+    if (loop->initialization) {
+      walk_statement(w, loop->initialization);
+    }
+    walk_expression(w, loop->condition);
+    if (loop->update) {
+      walk_statement(w, loop->update);
+    }
+    walk_block(w, loop->body);
+    break;
+  }
+  case REASSIGN_EXPR: {
+    // Assigning to a global needs its let as much as reading it does
+    Reassignment *reassign = (Reassignment *)expr;
+    walk_expression(w, reassign->name);
+    walk_expression(w, reassign->value);
+    break;
+  }
+  }
+}
+
+static bool is_function_binding(Statement *stmt) {
+  return stmt->type == LET_STATEMENT && stmt->expression->type == FN_EXPR;
+}
+
+// Locals and parameters with the same name count as references too, which
+// only ever keeps a function that could have gone.
+static bool is_referenced(Program *program, size_t binding) {
+  Statement *let = program->statements.arr[binding];
+  Walker w = {.pass = FIND_REFERENCE, .name = let->name->value};
+
+  for (size_t i = 0; i < program->statements.len && !w.found; i++) {
+    if (i != binding) {
+      walk_statement(&w, program->statements.arr[i]);
+    }
+  }
+
+  return w.found;
+}
+
+static bool remove_unused_functions(Program *program) {
+  size_t len = program->statements.len;
+  bool unused[len + 1];
+  for (size_t i = 0; i < len; i++) {
+    unused[i] = is_function_binding(program->statements.arr[i]) &&
+                !is_referenced(program, i);
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (unused[i]) {
+      free(program->statements.arr[i]);
+    } else {
+      program->statements.arr[kept++] = program->statements.arr[i];
+    }
+  }
+
+  program->statements.len = kept;
+  return kept < len;
+}
+
+void eliminate_dead_code(Program *program, bool whole_program) {
+  Walker w = {.pass = TRUNCATE_BLOCKS};
+  for (size_t i = 0; i < program->statements.len; i++) {
+    walk_statement(&w, program->statements.arr[i]);
+  }
+
+  if (whole_program) {
+    while (remove_unused_functions(program)) {
+    }
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef DEAD_CODE_H
+#define DEAD_CODE_H
+
+#include "../ast/ast.h"
+#include <stdbool.h>
+
+// Rewrites the program in place, after constant folding, so that code it can
+// never run is not compiled:
+//  - statements following a return, break or continue in the same block
+//  - with `whole_program`, top-level lets binding a function literal to a
+//    global nothing else in the program refers to. Removing one may leave
+//    the functions it called unreferenced too, so this runs to a fixed point.
+// Ifs with a literal condition are left to the compiler, which only emits
+// the branch that is taken (see constant_condition).
+void eliminate_dead_code(Program *, bool whole_program);
+
+// Whether `condition` is a literal, and if so whether the VM would find it
+// truthy.
+bool constant_condition(Expression *condition, bool *truthy);
+
+#endif // DEAD_CODE_H
@@ -0,0 +1,303 @@
+#include "escape_analysis.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  char *name;
+  bool has_store;
+  bool disqualified;
+} ScalarCandidate;
+
+// How the value of an expression is used by its parent.
+typedef enum {
+  VALUE_DISCARDED, // popped right away
+  VALUE_CONSUMED,  // read by an operator, condition or index and dropped
+  VALUE_ESCAPES,   // stored, returned, passed along or captured
+} ValueUse;
+
+typedef struct {
+  ScalarLocals *locals;
+  size_t closure_depth;
+  // Inside an operand, an operand evaluated before it may still hold the
+  // Number of a local on the stack, which a scalar store would overwrite.
+  size_t operand_depth;
+} Analysis;
+
+static void analyze_expression(Analysis *, Expression *, ValueUse);
+static void analyze_block(Analysis *, BlockStatement *, ValueUse);
+
+static ScalarCandidate *candidate(Analysis *a, const char *name) {
+  DynamicArray *candidates = &a->locals->candidates;
+  for (size_t i = 0; i < candidates->len; i++) {
+    ScalarCandidate *c = candidates->arr[i];
+    if (strcmp(c->name, name) == 0) {
+      return c;
+    }
+  }
+
+  ScalarCandidate *c = malloc(sizeof(ScalarCandidate));
+  assert(c != NULL);
+
+  *c = (ScalarCandidate){.name = (char *)name};
+  array_append(candidates, c);
+
+  return c;
+}
+
+// Names are tracked per function, so a name mentioned by a nested function
+// literal is treated as captured, even when the literal shadows it.
+static void use_identifier(Analysis *a, const char *name, ValueUse use) {
+  if (use == VALUE_ESCAPES || a->closure_depth > 0) {
+    candidate(a, name)->disqualified = true;
+  }
+}
+
+static bool is_arithmetic_operator(const char *op) {
+  static const char *operators[] = {"+", "-",  "*",  "/", "%",
+                                    "&", "|", "^", "<<", ">>"};
+
+  for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+    if (strcmp(op, operators[i]) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Expressions the VM evaluates into a number that nothing else references.
+static bool is_fresh_number(Expression *expr) {
+  switch (expr->type) {
+  case INT_EXPR:
+    return true;
+  case PREFIX_EXPR:
+    return strcmp(((PrefixExpression *)expr)->operator, "-") == 0;
+  case INFIX_EXPR:
+    return is_arithmetic_operator(((InfixExpression *)expr)->operator);
+  default:
+    return false;
+  }
+}
+
+static void store_identifier(Analysis *a, const char *name,
+                             Expression *value) {
+  ScalarCandidate *c = candidate(a, name);
+  c->has_store = true;
+
+  if (a->closure_depth > 0 || a->operand_depth > 0 ||
+      !is_fresh_number(value)) {
+    c->disqualified = true;
+  }
+}
+
+// Operands of operators, calls and indexes. An if in such a position passes
+// the context on to its branches.
+static void analyze_operand(Analysis *a, Expression *expr, ValueUse use) {
+  a->operand_depth++;
+  analyze_expression(a, expr, use);
+  a->operand_depth--;
+}
+
+static void analyze_statement(Analysis *a, Statement *stmt, ValueUse use) {
+  switch (stmt->type) {
+  case LET_STATEMENT:
+    store_identifier(a, stmt->name->value, stmt->expression);
+    analyze_expression(a, stmt->expression, VALUE_ESCAPES);
+    break;
+  case RETURN_STATEMENT:
+    analyze_expression(a, stmt->expression, VALUE_ESCAPES);
+    break;
+  case EXPR_STATEMENT:
+    analyze_expression(a, stmt->expression, use);
+    break;
+  case BREAK_STATEMENT:
+  case CONTINUE_STATEMENT:
+    break;
+  }
+}
+
+// Only the last statement of a block can become its value: the compiler
+// turns it into the value of an if expression or an implicit return.
+static void analyze_block(Analysis *a, BlockStatement *block, ValueUse use) {
+  for (size_t i = 0; i < block->statements.len; i++) {
+    bool is_last = i == block->statements.len - 1;
+    analyze_statement(a, block->statements.arr[i],
+                      is_last ? use : VALUE_DISCARDED);
+  }
+}
+
+static int analyze_hash_pair(void *const ctx,
+                             struct hashmap_element_s *const pair) {
+  Analysis *a = ctx;
+  analyze_expression(a, (Expression *)pair->key, VALUE_ESCAPES);
+  analyze_expression(a, pair->data, VALUE_ESCAPES);
+  return 0;
+}
+
+static void analyze_reassignment(Analysis *a, Reassignment *expr,
+                                 ValueUse use) {
+  if (expr->name->type == IDENT_EXPR) {
+    Identifier *name = (Identifier *)expr->name;
+    store_identifier(a, name->value, expr->value);
+    analyze_expression(a, expr->value, VALUE_ESCAPES);
+
+    // The reassignment evaluates to the variable itself
+    use_identifier(a, name->value, use);
+    return;
+  }
+
+  if (expr->name->type == INDEX_EXPR) {
+    IndexExpression *index = (IndexExpression *)expr->name;
+    analyze_operand(a, index->left, VALUE_CONSUMED);
+    // Hash keys are kept by the hash
+    analyze_operand(a, index->index, VALUE_ESCAPES);
+    analyze_operand(a, expr->value, VALUE_ESCAPES);
+    return;
+  }
+
+  analyze_expression(a, expr->value, VALUE_ESCAPES);
+}
+
+static void analyze_expression(Analysis *a, Expression *expr, ValueUse use) {
+  switch (expr->type) {
+  case IDENT_EXPR:
+    use_identifier(a, ((Identifier *)expr)->value, use);
+    break;
+  case INT_EXPR:
+  case BOOL_EXPR:
+  case STRING_EXPR:
+    break;
+  case PREFIX_EXPR:
+    analyze_operand(a, ((PrefixExpression *)expr)->right, VALUE_CONSUMED);
+    break;
+  case INFIX_EXPR: {
+    InfixExpression *infix = (InfixExpression *)expr;
+    analyze_operand(a, infix->left, VALUE_CONSUMED);
+    analyze_operand(a, infix->right, VALUE_CONSUMED);
+    break;
+  }
+  case IF_EXPR: {
+    IfExpression *if_expr = (IfExpression *)expr;
+    analyze_expression(a, if_expr->condition, VALUE_CONSUMED);
+    analyze_block(a, if_expr->consequence, use);
+    if (if_expr->alternative) {
+      analyze_block(a, if_expr->alternative, use);
+    }
+    break;
+  }
+  case FN_EXPR: {
+    FunctionLiteral *fn = (FunctionLiteral *)expr;
+    a->closure_depth++;
+    for (size_t i = 0; i < fn->parameters.len; i++) {
+      Identifier *param = fn->parameters.arr[i];
+      use_identifier(a, param->value, VALUE_ESCAPES);
+    }
+    analyze_block(a, fn->body, VALUE_ESCAPES);
+    a->closure_depth--;
+    break;
+  }
+  case CALL_EXPR: {
+    CallExpression *call = (CallExpression *)expr;
+    analyze_operand(a, call->function, VALUE_CONSUMED);
+    for (size_t i = 0; i < call->arguments.len; i++) {
+      analyze_operand(a, call->arguments.arr[i], VALUE_ESCAPES);
+    }
+    break;
+  }
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    for (size_t i = 0; i < elements->len; i++) {
+      analyze_expression(a, elements->arr[i], VALUE_ESCAPES);
+    }
+    break;
+  }
+  case HASH_EXPR:
+    hashmap_iterate_pairs(&((HashLiteral *)expr)->pairs, &analyze_hash_pair,
+                          a);
+    break;
+  case INDEX_EXPR: {
+    IndexExpression *index = (IndexExpression *)expr;
+    analyze_operand(a, index->left, VALUE_CONSUMED);
+    analyze_operand(a, index->index, VALUE_CONSUMED);
+    break;
+  }
+  case WHILE_EXPR: {
+    WhileLoop *loop = (WhileLoop *)expr;
+    analyze_expression(a, loop->condition, VALUE_CONSUMED);
+    analyze_block(a, loop->body, VALUE_DISCARDED);
+    break;
+  }
+  case FOR_EXPR: {
+    ForLoop *loop = (ForLoop *)expr;
+    if (loop->initialization) {
+      analyze_statement(a, loop->initialization, VALUE_DISCARDED);
+    }
+    analyze_expression(a, loop->condition, VALUE_CONSUMED);
+    if (loop->update) {
+      analyze_statement(a, loop->update, VALUE_DISCARDED);
+    }
+    analyze_block(a, loop->body, VALUE_DISCARDED);
+    break;
+  }
+  case REASSIGN_EXPR:
+    analyze_reassignment(a, (Reassignment *)expr, use);
+    break;
+  }
+}
+
+static ScalarLocals *new_scalar_locals(void) {
+  ScalarLocals *locals = malloc(sizeof(ScalarLocals));
+  assert(locals != NULL);
+
+  array_init(&locals->candidates, 8);
+  return locals;
+}
+
+ScalarLocals *analyze_program_scalars(Program *program) {
+  Analysis a = {.locals = new_scalar_locals()};
+
+  for (size_t i = 0; i < program->statements.len; i++) {
+    analyze_statement(&a, program->statements.arr[i], VALUE_DISCARDED);
+  }
+
+  return a.locals;
+}
+
+ScalarLocals *analyze_function_scalars(FunctionLiteral *fn) {
+  Analysis a = {.locals = new_scalar_locals()};
+
+  // Arguments are shared with the caller
+  for (size_t i = 0; i < fn->parameters.len; i++) {
+    Identifier *param = fn->parameters.arr[i];
+    use_identifier(&a, param->value, VALUE_ESCAPES);
+  }
+
+  analyze_block(&a, fn->body, VALUE_ESCAPES);
+
+  return a.locals;
+}
+
+bool is_scalar_local(const ScalarLocals *locals, const char *name) {
+  if (locals == NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < locals->candidates.len; i++) {
+    ScalarCandidate *c = locals->candidates.arr[i];
+    if (strcmp(c->name, name) == 0) {
+      return c->has_store && !c->disqualified;
+    }
+  }
+
+  return false;
+}
+
+void free_scalar_locals(ScalarLocals *locals) {
+  if (locals == NULL) {
+    return;
+  }
+
+  array_free(&locals->candidates);
+  free(locals);
+}
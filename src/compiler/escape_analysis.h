@@ -0,0 +1,24 @@
+#ifndef ESCAPE_ANALYSIS_H
+#define ESCAPE_ANALYSIS_H
+
+#include "../ast/ast.h"
+#include "../dyn_array/dyn_array.h"
+#include <stdbool.h>
+
+// A local is scalar when every value stored in it is a fresh number
+// temporary and no reference to it outlives the expression that reads it:
+// it is never returned, stored in another variable or container, passed to
+// a call or captured by a function literal. The VM can then overwrite the
+// Number held in the slot instead of allocating a new one on every store.
+typedef struct {
+  DynamicArray candidates; // ScalarCandidate*[]
+} ScalarLocals;
+
+ScalarLocals *analyze_program_scalars(Program *);
+ScalarLocals *analyze_function_scalars(FunctionLiteral *);
+
+bool is_scalar_local(const ScalarLocals *, const char *);
+
+void free_scalar_locals(ScalarLocals *);
+
+#endif // ESCAPE_ANALYSIS_H
@@ -0,0 +1,75 @@
+#include "flow_graph.h"
+#include "../big_endian/big_endian.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static size_t decode(const Instructions *ins, FlowNode *nodes,
+                     size_t *node_at) {
+  size_t len = 0;
+  for (size_t pos = 0; pos < ins->len; len++) {
+    OpCode op = ins->arr[pos];
+    Definition *def = lookup(op);
+
+    node_at[pos] = len;
+    nodes[len] = (FlowNode){.pos = pos, .op = op};
+
+    pos++;
+    for (size_t i = 0; i < def->operand_count; i++) {
+      pos += def->operand_widths[i];
+    }
+  }
+
+  return len;
+}
+
+// Jumps are resolved once every instruction has a node. Going past the last
+// instruction leaves the frame.
+static void link(const Instructions *ins, FlowNode *nodes, size_t len,
+                 const size_t *node_at) {
+  for (size_t i = 0; i < len; i++) {
+    FlowNode *node = &nodes[i];
+
+    switch (node->op) {
+    case OP_JMP:
+    case OP_JMP_IF_FALSE:
+    case OP_JMP_IF_TRUE: {
+      uint16_t target = big_endian_read_uint16(ins, node->pos + 1);
+      if (target < ins->len) {
+        node->next[node->num_next++] = node_at[target];
+      }
+      if (node->op != OP_JMP && i + 1 < len) {
+        node->next[node->num_next++] = i + 1;
+      }
+      break;
+    }
+    case OP_RETURN_VALUE:
+    case OP_RETURN:
+    case OP_CONTINUE:
+    case OP_BREAK:
+      break;
+    default:
+      if (i + 1 < len) {
+        node->next[node->num_next++] = i + 1;
+      }
+    }
+  }
+}
+
+FlowGraph build_flow_graph(const Instructions *ins) {
+  FlowNode *nodes = malloc((ins->len + 1) * sizeof(FlowNode));
+  size_t *node_at = malloc((ins->len + 1) * sizeof(size_t));
+  assert(nodes != NULL && node_at != NULL);
+
+  size_t len = decode(ins, nodes, node_at);
+  link(ins, nodes, len, node_at);
+  free(node_at);
+
+  return (FlowGraph){.nodes = nodes, .len = len};
+}
+
+void free_flow_graph(FlowGraph *graph) {
+  free(graph->nodes);
+  graph->nodes = NULL;
+  graph->len = 0;
+}
@@ -0,0 +1,28 @@
+#ifndef FLOW_GRAPH_H
+#define FLOW_GRAPH_H
+
+#include "../code/code.h"
+#include <stddef.h>
+
+// One instruction of a stream and the instructions execution can go on at
+// after it. Jumps have two successors at most, returns, continues and breaks
+// have none since they leave the frame.
+typedef struct {
+  size_t pos;
+  OpCode op;
+  size_t next[2];
+  size_t num_next;
+} FlowNode;
+
+typedef struct {
+  FlowNode *nodes;
+  size_t len;
+} FlowGraph;
+
+// The control flow of a function, a loop body or the main program. A break
+// goes on in the stream running its loop, which also reaches the break's
+// target when the loop condition turns false.
+FlowGraph build_flow_graph(const Instructions *);
+void free_flow_graph(FlowGraph *);
+
+#endif // FLOW_GRAPH_H
@@ -0,0 +1,456 @@
+#include "inlining.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  char *name;
+  size_t num_bindings; // lets, reassignments and parameters
+} Binding;
+
+static void count_expression(DynamicArray *, Expression *);
+
+static void bind(DynamicArray *bindings, char *name) {
+  for (size_t i = 0; i < bindings->len; i++) {
+    Binding *b = bindings->arr[i];
+    if (strcmp(b->name, name) == 0) {
+      b->num_bindings++;
+      return;
+    }
+  }
+
+  Binding *b = malloc(sizeof(Binding));
+  assert(b != NULL);
+
+  *b = (Binding){.name = name, .num_bindings = 1};
+  array_append(bindings, b);
+}
+
+static size_t num_bindings(DynamicArray *bindings, const char *name) {
+  for (size_t i = 0; i < bindings->len; i++) {
+    Binding *b = bindings->arr[i];
+    if (strcmp(b->name, name) == 0) {
+      return b->num_bindings;
+    }
+  }
+
+  return 0;
+}
+
+static void count_statement(DynamicArray *bindings, Statement *stmt) {
+  if (stmt->type == LET_STATEMENT) {
+    bind(bindings, stmt->name->value);
+  }
+  if (stmt->expression != NULL) {
+    count_expression(bindings, stmt->expression);
+  }
+}
+
+static void count_block(DynamicArray *bindings, BlockStatement *block) {
+  for (size_t i = 0; i < block->statements.len; i++) {
+    count_statement(bindings, block->statements.arr[i]);
+  }
+}
+
+static int count_hash_pair(void *const ctx,
+                           struct hashmap_element_s *const pair) {
+  count_expression(ctx, (Expression *)pair->key);
+  count_expression(ctx, pair->data);
+  return 0;
+}
+
+static void count_expression(DynamicArray *bindings, Expression *expr) {
+  switch (expr->type) {
+  case IDENT_EXPR:
+  case INT_EXPR:
+  case BOOL_EXPR:
+  case STRING_EXPR:
+    break;
+  case PREFIX_EXPR:
+    count_expression(bindings, ((PrefixExpression *)expr)->right);
+    break;
+  case INFIX_EXPR:
+    count_expression(bindings, ((InfixExpression *)expr)->left);
+    count_expression(bindings, ((InfixExpression *)expr)->right);
+    break;
+  case IF_EXPR: {
+    IfExpression *if_expr = (IfExpression *)expr;
+    count_expression(bindings, if_expr->condition);
+    count_block(bindings, if_expr->consequence);
+    if (if_expr->alternative) {
+      count_block(bindings, if_expr->alternative);
+    }
+    break;
+  }
+  case FN_EXPR: {
+    FunctionLiteral *fn = (FunctionLiteral *)expr;
+    for (size_t i = 0; i < fn->parameters.len; i++) {
+      bind(bindings, ((Identifier *)fn->parameters.arr[i])->value);
+    }
+    count_block(bindings, fn->body);
+    break;
+  }
+  case CALL_EXPR: {
+    CallExpression *call = (CallExpression *)expr;
+    count_expression(bindings, call->function);
+    for (size_t i = 0; i < call->arguments.len; i++) {
+      count_expression(bindings, call->arguments.arr[i]);
+    }
+    break;
+  }
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    for (size_t i = 0; i < elements->len; i++) {
+      count_expression(bindings, elements->arr[i]);
+    }
+    break;
+  }
+  case HASH_EXPR:
+    hashmap_iterate_pairs(&((HashLiteral *)expr)->pairs, &count_hash_pair,
+                          bindings);
+    break;
+  case INDEX_EXPR:
+    count_expression(bindings, ((IndexExpression *)expr)->left);
+    count_expression(bindings, ((IndexExpression *)expr)->index);
+    break;
+  case WHILE_EXPR:
+    count_expression(bindings, ((WhileLoop *)expr)->condition);
+    count_block(bindings, ((WhileLoop *)expr)->body);
+    break;
+  case FOR_EXPR: {
+    ForLoop *loop = (ForLoop *)expr;
+    if (loop->initialization) {
+      count_statement(bindings, loop->initialization);
+    }
+    count_expression(bindings, loop->condition);
+    if (loop->update) {
+      count_statement(bindings, loop->update);
+    }
+    count_block(bindings, loop->body);
+    break;
+  }
+  case REASSIGN_EXPR: {
+    Reassignment *reassign = (Reassignment *)expr;
+    if (reassign->name->type == IDENT_EXPR) {
+      bind(bindings, ((Identifier *)reassign->name)->value);
+    } else {
+      count_expression(bindings, reassign->name);
+    }
+    count_expression(bindings, reassign->value);
+    break;
+  }
+  }
+}
+
+// Measures a body against the budget, and rejects anything in it that the
+// caller's frame could not hold.
+typedef struct {
+  const char *name; // of the function itself
+  size_t size;
+  size_t num_lets;
+  bool fits;
+} Body;
+
+static void measure_expression(Body *, Expression *);
+
+static void measure_block(Body *b, BlockStatement *block,
+                          bool may_return) {
+  for (size_t i = 0; i < block->statements.len; i++) {
+    Statement *stmt = block->statements.arr[i];
+    b->size++;
+
+    switch (stmt->type) {
+    case RETURN_STATEMENT:
+      b->fits &= may_return;
+      measure_expression(b, stmt->expression);
+      break;
+    case BREAK_STATEMENT:
+    case CONTINUE_STATEMENT:
+      b->fits = false;
+      break;
+    case LET_STATEMENT:
+      b->num_lets++;
+      measure_expression(b, stmt->expression);
+      break;
+    case EXPR_STATEMENT: {
+      // The branches of an if statement run at the same stack height
+      Expression *expr = stmt->expression;
+      if (expr->type != IF_EXPR) {
+        measure_expression(b, expr);
+        break;
+      }
+
+      IfExpression *if_expr = (IfExpression *)expr;
+      b->size++;
+      measure_expression(b, if_expr->condition);
+      measure_block(b, if_expr->consequence, may_return);
+      if (if_expr->alternative) {
+        measure_block(b, if_expr->alternative, may_return);
+      }
+      break;
+    }
+    }
+  }
+}
+
+static int measure_hash_pair(void *const ctx,
+                             struct hashmap_element_s *const pair) {
+  measure_expression(ctx, (Expression *)pair->key);
+  measure_expression(ctx, pair->data);
+  return 0;
+}
+
+static void measure_expression(Body *b, Expression *expr) {
+  b->size++;
+
+  switch (expr->type) {
+  case IDENT_EXPR:
+    b->fits &= strcmp(((Identifier *)expr)->value, b->name) != 0;
+    break;
+  case INT_EXPR:
+  case BOOL_EXPR:
+  case STRING_EXPR:
+    break;
+  case PREFIX_EXPR:
+    measure_expression(b, ((PrefixExpression *)expr)->right);
+    break;
+  case INFIX_EXPR:
+    measure_expression(b, ((InfixExpression *)expr)->left);
+    measure_expression(b, ((InfixExpression *)expr)->right);
+    break;
+  case IF_EXPR: {
+    IfExpression *if_expr = (IfExpression *)expr;
+    measure_expression(b, if_expr->condition);
+    measure_block(b, if_expr->consequence, false);
+    if (if_expr->alternative) {
+      measure_block(b, if_expr->alternative, false);
+    }
+    break;
+  }
+  case CALL_EXPR: {
+    CallExpression *call = (CallExpression *)expr;
+    measure_expression(b, call->function);
+    for (size_t i = 0; i < call->arguments.len; i++) {
+      measure_expression(b, call->arguments.arr[i]);
+    }
+    break;
+  }
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    for (size_t i = 0; i < elements->len; i++) {
+      measure_expression(b, elements->arr[i]);
+    }
+    break;
+  }
+  case HASH_EXPR:
+    hashmap_iterate_pairs(&((HashLiteral *)expr)->pairs, &measure_hash_pair,
+                          b);
+    break;
+  case INDEX_EXPR:
+    measure_expression(b, ((IndexExpression *)expr)->left);
+    measure_expression(b, ((IndexExpression *)expr)->index);
+    break;
+  case REASSIGN_EXPR:
+    measure_expression(b, ((Reassignment *)expr)->name);
+    measure_expression(b, ((Reassignment *)expr)->value);
+    break;
+  case FN_EXPR:
+  case WHILE_EXPR:
+  case FOR_EXPR:
+    b->fits = false;
+    break;
+  }
+}
+
+static Body measure_body(char *name, FunctionLiteral *fn) {
+  Body b = {.name = name, .size = fn->parameters.len, .fits = true};
+
+  for (size_t i = 0; i < fn->parameters.len; i++) {
+    b.fits &= strcmp(((Identifier *)fn->parameters.arr[i])->value, name) != 0;
+  }
+  measure_block(&b, fn->body, true);
+
+  b.fits &= b.size <= INLINE_BUDGET;
+  return b;
+}
+
+DynamicArray find_inline_candidates(Program *program) {
+  DynamicArray bindings;
+  array_init(&bindings, 8);
+  for (size_t i = 0; i < program->statements.len; i++) {
+    count_statement(&bindings, program->statements.arr[i]);
+  }
+
+  DynamicArray candidates;
+  array_init(&candidates, 1);
+
+  for (size_t i = 0; i < program->statements.len; i++) {
+    Statement *stmt = program->statements.arr[i];
+    if (stmt->type != LET_STATEMENT || stmt->expression->type != FN_EXPR) {
+      continue;
+    }
+
+    char *name = stmt->name->value;
+    FunctionLiteral *fn = (FunctionLiteral *)stmt->expression;
+    if (num_bindings(&bindings, name) != 1) {
+      continue;
+    }
+
+    Body body = measure_body(name, fn);
+    if (!body.fits) {
+      continue;
+    }
+
+    InlineCandidate *c = malloc(sizeof(InlineCandidate));
+    assert(c != NULL);
+
+    *c = (InlineCandidate){
+        .name = name,
+        .fn = fn,
+        .num_lets = body.num_lets,
+        .defined = false,
+    };
+    array_init(&c->globals, 4);
+    array_append(&candidates, c);
+  }
+
+  array_free(&bindings);
+  return candidates;
+}
+
+InlineCandidate *find_inline_candidate(const DynamicArray *candidates,
+                                       const char *name) {
+  for (size_t i = 0; i < candidates->len; i++) {
+    InlineCandidate *c = candidates->arr[i];
+    if (strcmp(c->name, name) == 0) {
+      return c;
+    }
+  }
+
+  return NULL;
+}
+
+void free_inline_candidates(DynamicArray *candidates) {
+  for (size_t i = 0; i < candidates->len; i++) {
+    InlineCandidate *c = candidates->arr[i];
+    array_free(&c->globals);
+  }
+
+  array_free(candidates);
+}
+
+typedef struct {
+  InlineCandidate *candidate;
+  SymbolTable *globals;
+} Recording;
+
+static void record_expression(Recording *, Expression *);
+
+static void record_name(Recording *r, char *name) {
+  if (candidate_global(r->candidate, name) != NULL) {
+    return;
+  }
+
+  const Symbol *symbol = symbol_resolve(r->globals, name);
+  if (symbol == NULL) {
+    return;
+  }
+
+  Symbol *copy = malloc(sizeof(Symbol));
+  assert(copy != NULL);
+
+  *copy = *symbol;
+  array_append(&r->candidate->globals, copy);
+}
+
+static void record_block(Recording *r, BlockStatement *block) {
+  for (size_t i = 0; i < block->statements.len; i++) {
+    Statement *stmt = block->statements.arr[i];
+    if (stmt->expression != NULL) {
+      record_expression(r, stmt->expression);
+    }
+  }
+}
+
+static int record_hash_pair(void *const ctx,
+                            struct hashmap_element_s *const pair) {
+  record_expression(ctx, (Expression *)pair->key);
+  record_expression(ctx, pair->data);
+  return 0;
+}
+
+// Candidates hold no function literals or loops, see measure_body
+static void record_expression(Recording *r, Expression *expr) {
+  switch (expr->type) {
+  case IDENT_EXPR:
+    record_name(r, ((Identifier *)expr)->value);
+    break;
+  case INT_EXPR:
+  case BOOL_EXPR:
+  case STRING_EXPR:
+  case FN_EXPR:
+  case WHILE_EXPR:
+  case FOR_EXPR:
+    break;
+  case PREFIX_EXPR:
+    record_expression(r, ((PrefixExpression *)expr)->right);
+    break;
+  case INFIX_EXPR:
+    record_expression(r, ((InfixExpression *)expr)->left);
+    record_expression(r, ((InfixExpression *)expr)->right);
+    break;
+  case IF_EXPR: {
+    IfExpression *if_expr = (IfExpression *)expr;
+    record_expression(r, if_expr->condition);
+    record_block(r, if_expr->consequence);
+    if (if_expr->alternative) {
+      record_block(r, if_expr->alternative);
+    }
+    break;
+  }
+  case CALL_EXPR: {
+    CallExpression *call = (CallExpression *)expr;
+    record_expression(r, call->function);
+    for (size_t i = 0; i < call->arguments.len; i++) {
+      record_expression(r, call->arguments.arr[i]);
+    }
+    break;
+  }
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    for (size_t i = 0; i < elements->len; i++) {
+      record_expression(r, elements->arr[i]);
+    }
+    break;
+  }
+  case HASH_EXPR:
+    hashmap_iterate_pairs(&((HashLiteral *)expr)->pairs, &record_hash_pair,
+                          r);
+    break;
+  case INDEX_EXPR:
+    record_expression(r, ((IndexExpression *)expr)->left);
+    record_expression(r, ((IndexExpression *)expr)->index);
+    break;
+  case REASSIGN_EXPR:
+    record_expression(r, ((Reassignment *)expr)->name);
+    record_expression(r, ((Reassignment *)expr)->value);
+    break;
+  }
+}
+
+void define_candidate_globals(InlineCandidate *c, SymbolTable *globals) {
+  Recording r = {.candidate = c, .globals = globals};
+  record_block(&r, c->fn->body);
+  c->defined = true;
+}
+
+const Symbol *candidate_global(const InlineCandidate *c, const char *name) {
+  for (size_t i = 0; i < c->globals.len; i++) {
+    Symbol *symbol = c->globals.arr[i];
+    if (strcmp(symbol->name, name) == 0) {
+      return symbol;
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef INLINING_H
+#define INLINING_H
+
+#include "../ast/ast.h"
+#include "../dyn_array/dyn_array.h"
+#include "symbol_table.h"
+#include <stdbool.h>
+
+// Largest body, in AST nodes, a call is replaced with
+#define INLINE_BUDGET 64
+// Calls inlined into the body of another inlined call, and so on
+#define INLINE_MAX_DEPTH 3
+
+// A function bound by a top-level let that calls may be compiled as its
+// body instead. The name is bound nowhere else in the program, the body
+// fits the budget, never mentions the function's own name, holds no loops
+// or function literals, and only returns from statements that run with
+// nothing else on the stack: those of the body and of the branches of the
+// ifs among them.
+typedef struct {
+  char *name;
+  FunctionLiteral *fn;
+  size_t num_lets; // in the body and its branches
+  bool defined; // its let has been compiled, so calls resolve to it
+  // Symbol*[], what the names in the body referred to when the let was
+  // compiled. A later let may have bound them to another global since.
+  DynamicArray globals;
+} InlineCandidate;
+
+// Needs the whole program, like global propagation in fold_constants.
+DynamicArray find_inline_candidates(Program *); // InlineCandidate*[]
+void free_inline_candidates(DynamicArray *);
+
+InlineCandidate *find_inline_candidate(const DynamicArray *, const char *);
+
+// Marks the candidate defined, and resolves the names in its body in the
+// global symbol table as it is right after the function's let.
+void define_candidate_globals(InlineCandidate *, SymbolTable *globals);
+// The symbol a name in the body was resolved to, NULL if there was none.
+const Symbol *candidate_global(const InlineCandidate *, const char *);
+
+#endif // INLINING_H
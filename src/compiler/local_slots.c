@@ -0,0 +1,199 @@
+// Liveness is computed over the instructions of one stream: a local is live
+// between a store and the last load that store can reach, following jumps
+// backwards and forwards. Two locals interfere when one is stored while the
+// other is live, and locals that do not interfere get the same slot, picked
+// greedily in the order the compiler defined them.
+//
+// Loads of a local before any store read the null the VM fills new frames
+// with, so such locals are kept out of the slots of the parameters and of
+// each other.
+#include "local_slots.h"
+#include "flow_graph.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The operand of OP_GET_LOCAL and OP_SET_LOCAL is a single byte
+#define MAX_LOCALS (UINT8_MAX + 1)
+#define SET_WORDS (MAX_LOCALS / 64)
+
+typedef struct {
+  uint64_t words[SET_WORDS];
+} LocalSet;
+
+typedef struct {
+  int local; // operand of a local load or store, -1 for anything else
+  bool store;
+  LocalSet live_in;
+} Node;
+
+static void set_add(LocalSet *s, size_t local) {
+  s->words[local / 64] |= (uint64_t)1 << (local % 64);
+}
+
+static bool set_has(const LocalSet *s, size_t local) {
+  return s->words[local / 64] & ((uint64_t)1 << (local % 64));
+}
+
+static void set_union(LocalSet *s, const LocalSet *other) {
+  for (size_t i = 0; i < SET_WORDS; i++) {
+    s->words[i] |= other->words[i];
+  }
+}
+
+static void find_locals(const Instructions *ins, const FlowGraph *graph,
+                        Node *nodes) {
+  for (size_t i = 0; i < graph->len; i++) {
+    const FlowNode *flow = &graph->nodes[i];
+
+    nodes[i] = (Node){.local = -1};
+    if (flow->op == OP_GET_LOCAL || flow->op == OP_SET_LOCAL ||
+        flow->op == OP_SET_LOCAL_SCALAR ||
+        flow->op == OP_SET_LOCAL_CAPTURED) {
+      nodes[i].local = ins->arr[flow->pos + 1];
+      nodes[i].store = flow->op != OP_GET_LOCAL;
+    }
+  }
+}
+
+static LocalSet live_out(const FlowGraph *graph, const Node *nodes,
+                         size_t i) {
+  LocalSet out = {0};
+  for (size_t j = 0; j < graph->nodes[i].num_next; j++) {
+    set_union(&out, &nodes[graph->nodes[i].next[j]].live_in);
+  }
+  return out;
+}
+
+static void compute_liveness(const FlowGraph *graph, Node *nodes) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (size_t i = graph->len; i-- > 0;) {
+      Node *node = &nodes[i];
+      LocalSet in = live_out(graph, nodes, i);
+      if (node->local >= 0) {
+        if (node->store) {
+          in.words[node->local / 64] &= ~((uint64_t)1 << (node->local % 64));
+        } else {
+          set_add(&in, node->local);
+        }
+      }
+
+      if (memcmp(&in, &node->live_in, sizeof(LocalSet)) != 0) {
+        node->live_in = in;
+        changed = true;
+      }
+    }
+  }
+}
+
+static void interfere(LocalSet *graph, size_t a, size_t b) {
+  if (a != b) {
+    set_add(&graph[a], b);
+    set_add(&graph[b], a);
+  }
+}
+
+size_t pack_local_slots(Instructions *ins, size_t num_locals,
+                        size_t num_parameters) {
+  assert(num_locals <= MAX_LOCALS);
+  if (num_locals <= num_parameters + 1 || ins->len == 0) {
+    return num_locals;
+  }
+
+  FlowGraph flow = build_flow_graph(ins);
+  Node *nodes = malloc(flow.len * sizeof(Node));
+  assert(nodes != NULL);
+
+  size_t len = flow.len;
+  find_locals(ins, &flow, nodes);
+  compute_liveness(&flow, nodes);
+
+  LocalSet graph[MAX_LOCALS] = {0};
+  bool used[MAX_LOCALS] = {false};
+  bool scalar[MAX_LOCALS] = {false};
+
+  for (size_t i = 0; i < len; i++) {
+    Node *node = &nodes[i];
+    if (node->local < 0) {
+      continue;
+    }
+
+    used[node->local] = true;
+    if (!node->store) {
+      continue;
+    }
+
+    scalar[node->local] |= flow.nodes[i].op == OP_SET_LOCAL_SCALAR;
+    LocalSet out = live_out(&flow, nodes, i);
+    for (size_t other = 0; other < num_locals; other++) {
+      if (set_has(&out, other)) {
+        interfere(graph, node->local, other);
+      }
+    }
+  }
+
+  // Parameters and the locals read before being stored all hold their
+  // value when the frame is entered
+  for (size_t local = 0; local < num_locals; local++) {
+    if (local >= num_parameters && !set_has(&nodes[0].live_in, local)) {
+      continue;
+    }
+
+    for (size_t other = 0; other < num_locals; other++) {
+      if (other < num_parameters || set_has(&nodes[0].live_in, other)) {
+        interfere(graph, local, other);
+      }
+    }
+  }
+
+  int slot_of[MAX_LOCALS];
+  bool slot_scalar[MAX_LOCALS] = {false};
+  size_t num_slots = num_parameters;
+
+  for (size_t local = 0; local < num_locals; local++) {
+    slot_of[local] = -1;
+
+    if (local < num_parameters) {
+      slot_of[local] = local;
+      continue;
+    }
+    if (!used[local]) {
+      continue;
+    }
+
+    bool taken[MAX_LOCALS] = {false};
+    for (size_t other = 0; other < local; other++) {
+      if (slot_of[other] >= 0 &&
+          (set_has(&graph[local], other) ||
+           slot_scalar[slot_of[other]] != scalar[local])) {
+        taken[slot_of[other]] = true;
+      }
+    }
+
+    size_t slot = 0;
+    while (slot < num_slots && taken[slot]) {
+      slot++;
+    }
+
+    slot_of[local] = slot;
+    slot_scalar[slot] = scalar[local];
+    if (slot == num_slots) {
+      num_slots++;
+    }
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    if (nodes[i].local >= 0) {
+      ins->arr[flow.nodes[i].pos + 1] = slot_of[nodes[i].local];
+    }
+  }
+
+  free(nodes);
+  free_flow_graph(&flow);
+  return num_slots;
+}
@@ -0,0 +1,16 @@
+#ifndef LOCAL_SLOTS_H
+#define LOCAL_SLOTS_H
+
+#include "../code/code.h"
+#include <stddef.h>
+
+// Renumbers the locals of a function or loop body so that locals that are
+// never live at the same time share a slot, and returns how many slots the
+// frame needs now. Parameters keep the slots the caller puts them in.
+// Locals stored with OP_SET_LOCAL_SCALAR only share slots with each other:
+// the VM overwrites the Number in their slot in place, which must not be
+// one another local let escape.
+size_t pack_local_slots(Instructions *, size_t num_locals,
+                        size_t num_parameters);
+
+#endif // LOCAL_SLOTS_H
@@ -0,0 +1,224 @@
+#include "loop_invariants.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void walk_expression(LoopEffects *, Expression *);
+
+static void walk_statement(LoopEffects *e, Statement *stmt) {
+  if (stmt->type == LET_STATEMENT) {
+    array_append(&e->assigned, stmt->name->value);
+  }
+  if (stmt->expression != NULL) {
+    walk_expression(e, stmt->expression);
+  }
+}
+
+static void walk_block(LoopEffects *e, BlockStatement *block) {
+  for (size_t i = 0; i < block->statements.len; i++) {
+    walk_statement(e, block->statements.arr[i]);
+  }
+}
+
+static int walk_hash_pair(void *const ctx,
+                          struct hashmap_element_s *const pair) {
+  walk_expression(ctx, (Expression *)pair->key);
+  walk_expression(ctx, pair->data);
+  return 0;
+}
+
+// `a[i] = x` cannot change the number, string or boolean an operator reads
+// from `a`, but counting it as assigning `a` keeps this conservative.
+static void walk_assignment_target(LoopEffects *e, Expression *target) {
+  while (target->type == INDEX_EXPR) {
+    walk_expression(e, ((IndexExpression *)target)->index);
+    target = ((IndexExpression *)target)->left;
+  }
+
+  if (target->type == IDENT_EXPR) {
+    array_append(&e->assigned, ((Identifier *)target)->value);
+  } else {
+    walk_expression(e, target);
+  }
+}
+
+static void walk_expression(LoopEffects *e, Expression *expr) {
+  switch (expr->type) {
+  case IDENT_EXPR:
+  case INT_EXPR:
+  case BOOL_EXPR:
+  case STRING_EXPR:
+    break;
+  case PREFIX_EXPR:
+    walk_expression(e, ((PrefixExpression *)expr)->right);
+    break;
+  case INFIX_EXPR:
+    walk_expression(e, ((InfixExpression *)expr)->left);
+    walk_expression(e, ((InfixExpression *)expr)->right);
+    break;
+  case IF_EXPR: {
+    IfExpression *if_expr = (IfExpression *)expr;
+    walk_expression(e, if_expr->condition);
+    walk_block(e, if_expr->consequence);
+    if (if_expr->alternative) {
+      walk_block(e, if_expr->alternative);
+    }
+    break;
+  }
+  case FN_EXPR: {
+    FunctionLiteral *fn = (FunctionLiteral *)expr;
+    for (size_t i = 0; i < fn->parameters.len; i++) {
+      array_append(&e->assigned, ((Identifier *)fn->parameters.arr[i])->value);
+    }
+    walk_block(e, fn->body);
+    break;
+  }
+  case CALL_EXPR: {
+    CallExpression *call = (CallExpression *)expr;
+    if (call->function->type == IDENT_EXPR) {
+      array_append(&e->callees, ((Identifier *)call->function)->value);
+    } else {
+      e->calls_expression = true;
+      walk_expression(e, call->function);
+    }
+    for (size_t i = 0; i < call->arguments.len; i++) {
+      walk_expression(e, call->arguments.arr[i]);
+    }
+    break;
+  }
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    for (size_t i = 0; i < elements->len; i++) {
+      walk_expression(e, elements->arr[i]);
+    }
+    break;
+  }
+  case HASH_EXPR:
+    hashmap_iterate_pairs(&((HashLiteral *)expr)->pairs, &walk_hash_pair, e);
+    break;
+  case INDEX_EXPR:
+    walk_expression(e, ((IndexExpression *)expr)->left);
+    walk_expression(e, ((IndexExpression *)expr)->index);
+    break;
+  case WHILE_EXPR:
+    walk_expression(e, ((WhileLoop *)expr)->condition);
+    walk_block(e, ((WhileLoop *)expr)->body);
+    break;
+  case FOR_EXPR: {
+    ForLoop *loop = (ForLoop *)expr;
+    if (loop->initialization) {
+      walk_statement(e, loop->initialization);
+    }
+    walk_expression(e, loop->condition);
+    if (loop->update) {
+      walk_statement(e, loop->update);
+    }
+    walk_block(e, loop->body);
+    break;
+  }
+  case REASSIGN_EXPR: {
+    Reassignment *reassign = (Reassignment *)expr;
+    walk_assignment_target(e, reassign->name);
+    walk_expression(e, reassign->value);
+    break;
+  }
+  }
+}
+
+void find_loop_effects(LoopEffects *e, Expression *condition,
+                       BlockStatement *body, Statement *update) {
+  array_init(&e->assigned, 4);
+  array_init(&e->callees, 4);
+  e->calls_expression = false;
+
+  walk_expression(e, condition);
+  walk_block(e, body);
+  if (update) {
+    walk_statement(e, update);
+  }
+}
+
+bool loop_assigns(const LoopEffects *e, const char *name) {
+  for (size_t i = 0; i < e->assigned.len; i++) {
+    if (strcmp(e->assigned.arr[i], name) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// The names point into the AST
+void free_loop_effects(LoopEffects *e) {
+  free(e->assigned.arr);
+  free(e->callees.arr);
+}
+
+static bool is_invariant(const LoopEffects *e, Expression *expr,
+                         bool *reads_name) {
+  switch (expr->type) {
+  case IDENT_EXPR:
+    *reads_name = true;
+    return !loop_assigns(e, ((Identifier *)expr)->value);
+  case INT_EXPR:
+  case BOOL_EXPR:
+  case STRING_EXPR:
+    return true;
+  case PREFIX_EXPR:
+    return is_invariant(e, ((PrefixExpression *)expr)->right, reads_name);
+  case INFIX_EXPR: {
+    InfixExpression *infix = (InfixExpression *)expr;
+    return is_invariant(e, infix->left, reads_name) &&
+           is_invariant(e, infix->right, reads_name);
+  }
+  default:
+    return false;
+  }
+}
+
+void find_loop_invariants(const LoopEffects *e, Expression *condition,
+                          DynamicArray *invariants) {
+  switch (condition->type) {
+  case PREFIX_EXPR:
+  case INFIX_EXPR: {
+    // Operators on literals alone were already folded, or fail every time
+    bool reads_name = false;
+    if (is_invariant(e, condition, &reads_name) && reads_name) {
+      array_append(invariants, condition);
+      return;
+    }
+
+    if (condition->type == PREFIX_EXPR) {
+      find_loop_invariants(e, ((PrefixExpression *)condition)->right,
+                           invariants);
+    } else {
+      find_loop_invariants(e, ((InfixExpression *)condition)->left,
+                           invariants);
+      find_loop_invariants(e, ((InfixExpression *)condition)->right,
+                           invariants);
+    }
+    break;
+  }
+  case CALL_EXPR: {
+    CallExpression *call = (CallExpression *)condition;
+    for (size_t i = 0; i < call->arguments.len; i++) {
+      find_loop_invariants(e, call->arguments.arr[i], invariants);
+    }
+    break;
+  }
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)condition)->elements;
+    for (size_t i = 0; i < elements->len; i++) {
+      find_loop_invariants(e, elements->arr[i], invariants);
+    }
+    break;
+  }
+  case INDEX_EXPR:
+    find_loop_invariants(e, ((IndexExpression *)condition)->left,
+                         invariants);
+    find_loop_invariants(e, ((IndexExpression *)condition)->index,
+                         invariants);
+    break;
+  default:
+    break;
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef LOOP_INVARIANTS_H
+#define LOOP_INVARIANTS_H
+
+#include "../ast/ast.h"
+#include "../dyn_array/dyn_array.h"
+#include <stdbool.h>
+
+// The names a loop's condition, body and update may change, found from the
+// AST alone. Names are only told apart by spelling, so a local shadowing a
+// variable of the enclosing scope counts as changing it.
+typedef struct {
+  DynamicArray assigned; // char*[], bound by a let or parameter or assigned
+  DynamicArray callees;  // char*[], names of the functions called
+  bool calls_expression; // calls the value of something other than a name
+} LoopEffects;
+
+// The initialization is left out, it runs once before anything is hoisted.
+void find_loop_effects(LoopEffects *, Expression *condition,
+                       BlockStatement *body, Statement *update);
+
+bool loop_assigns(const LoopEffects *, const char *name);
+
+void free_loop_effects(LoopEffects *);
+
+// Collects into `invariants` (Expression*[]) the largest prefix and infix
+// expressions of `condition` built only from literals and names the loop
+// never changes. The caller must make sure the loop calls nothing that
+// could change them either. Operands of assignments, branches of ifs and
+// function literals are not searched: the first could end up in a local
+// the VM overwrites in place, the others may never run.
+void find_loop_invariants(const LoopEffects *, Expression *condition,
+                          DynamicArray *invariants);
+
+#endif // LOOP_INVARIANTS_H
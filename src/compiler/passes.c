@@ -0,0 +1,84 @@
+#include "passes.h"
+#include <time.h>
+
+const char *OptimizationPassString[] = {
+    "constant folding", "dead code",        "escape analysis",
+    "inlining",         "intrinsics",       "loop invariants",
+    "peephole",         "slot packing",     "type inference",
+    "ssa form",         "type propagation", "gvn",
+    "copy propagation", "dead values",
+};
+
+// The lowest level each pass runs at
+static const OptimizationLevel pass_levels[PASS_COUNT] = {
+    [PASS_CONSTANT_FOLDING] = OPTIMIZATION_O1,
+    [PASS_DEAD_CODE] = OPTIMIZATION_O1,
+    [PASS_ESCAPE_ANALYSIS] = OPTIMIZATION_O1,
+    [PASS_INLINING] = OPTIMIZATION_O2,
+    [PASS_INTRINSICS] = OPTIMIZATION_O1,
+    [PASS_LOOP_INVARIANTS] = OPTIMIZATION_O2,
+    [PASS_PEEPHOLE] = OPTIMIZATION_O1,
+    [PASS_SLOT_PACKING] = OPTIMIZATION_O1,
+    [PASS_TYPE_INFERENCE] = OPTIMIZATION_O1,
+    [PASS_SSA] = OPTIMIZATION_O3,
+    [PASS_TYPE_PROPAGATION] = OPTIMIZATION_O3,
+    [PASS_GVN] = OPTIMIZATION_O3,
+    [PASS_COPY_PROPAGATION] = OPTIMIZATION_O3,
+    [PASS_DEAD_VALUES] = OPTIMIZATION_O3,
+};
+
+static OptimizationLevel default_level = OPTIMIZATION_O3;
+
+static struct {
+  bool enabled;
+  double seconds[PASS_COUNT];
+  size_t runs[PASS_COUNT];
+} pass_report;
+
+bool pass_enabled(OptimizationLevel level, OptimizationPass pass) {
+  return level >= pass_levels[pass];
+}
+
+void set_default_optimization_level(OptimizationLevel level) {
+  default_level = level;
+}
+
+OptimizationLevel default_optimization_level(void) { return default_level; }
+
+void pass_timings_enable(void) { pass_report.enabled = true; }
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double pass_timer_start(void) { return pass_report.enabled ? now() : 0; }
+
+void pass_timer_stop(OptimizationPass pass, double start) {
+  if (pass_report.enabled) {
+    pass_report.seconds[pass] += now() - start;
+    pass_report.runs[pass]++;
+  }
+}
+
+void pass_timings_print(FILE *out) {
+  fprintf(out, "Optimization passes:\n-------------\n");
+  fprintf(out, "%-24s %12s %12s\n", "pass", "runs", "ms");
+
+  double total = 0;
+  for (size_t i = 0; i < PASS_COUNT; i++) {
+    fprintf(out, "%-24s %12zu %12.3f\n", OptimizationPassString[i],
+            pass_report.runs[i], pass_report.seconds[i] * 1000);
+    total += pass_report.seconds[i];
+  }
+
+  fprintf(out, "%-24s %12s %12.3f\n", "total", "", total * 1000);
+  fprintf(out, "-------------\n");
+}
+
+void pass_timings_report(void) {
+  if (pass_report.enabled) {
+    pass_timings_print(stderr);
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// The optimizations the compiler can run. Constant folding, dead code and
+// inlining rewrite the AST before code generation, escape analysis,
+// intrinsics and loop invariants change how code is generated, peephole,
+// slot packing and type inference rewrite the bytecode of each scope the
+// compiler leaves, and the SSA passes rewrite functions in between.
+typedef enum {
+  PASS_CONSTANT_FOLDING,
+  PASS_DEAD_CODE,       // including the untaken branch of constant ifs
+  PASS_ESCAPE_ANALYSIS, // number locals overwritten in place
+  PASS_INLINING, // finding the candidates, the calls are expanded in place
+  PASS_INTRINSICS,
+  PASS_LOOP_INVARIANTS,
+  PASS_PEEPHOLE,
+  PASS_SLOT_PACKING,   // locals with disjoint lifetimes share a frame slot
+  PASS_TYPE_INFERENCE, // typed opcodes for operands of known types
+  // Function literals compiled through the IR of src/ir, and the passes
+  // running on it before it is lowered to bytecode, see ssa.h
+  PASS_SSA,
+  PASS_TYPE_PROPAGATION,
+  PASS_GVN,
+  PASS_COPY_PROPAGATION,
+  PASS_DEAD_VALUES,
+  PASS_COUNT,
+} OptimizationPass;
+
+extern const char *OptimizationPassString[];
+
+// Which passes run, selected with -O0 to -O3 on the command line:
+//  - O0 compiles every construct as written
+//  - O1 adds the passes that only look at one expression or scope at a time
+//  - O2 adds inlining and loop-invariant code motion
+//  - O3 adds the SSA form of functions and the passes on it
+typedef enum {
+  OPTIMIZATION_O0,
+  OPTIMIZATION_O1,
+  OPTIMIZATION_O2,
+  OPTIMIZATION_O3,
+} OptimizationLevel;
+
+bool pass_enabled(OptimizationLevel, OptimizationPass);
+
+// Level of the compilers created from now on, O3 unless changed
+void set_default_optimization_level(OptimizationLevel);
+OptimizationLevel default_optimization_level(void);
+
+// Time spent in each pass since the process started, printed to stderr on
+// exit when enabled. Passes wrap their work in pass_timer_start and
+// pass_timer_stop, which do nothing while timing is disabled.
+void pass_timings_enable(void);
+double pass_timer_start(void);
+void pass_timer_stop(OptimizationPass, double start);
+void pass_timings_print(FILE *);
+void pass_timings_report(void);
+
+#endif // PASSES_H
@@ -0,0 +1,520 @@
+// The peephole optimizer works on one instruction stream at a time: the
+// main program, a function or a loop body. The stream is decoded into a list
+// of instructions where jumps refer to the index of the instruction they go
+// to rather than to its offset, so that instructions can be dropped without
+// breaking them. The rewrites run until none applies anymore, then the
+// stream is encoded again with every jump pointed at the new offset of its
+// target.
+//
+// Loop bodies are constants of their own, but their breaks jump back into
+// the stream that runs the loop. Those breaks are found through the
+// OP_CLOSURE instructions that create the loop bodies and re-patched too.
+#include "peephole.h"
+#include "../big_endian/big_endian.h"
+#include "../object/object.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+const char *PeepholePassString[] = {
+    "jump threading", "store/load", "null/pop", "negated jump", "unreachable",
+};
+
+static struct {
+  bool enabled;
+  PeepholeStats totals;
+} peephole_report;
+
+typedef struct {
+  OpCode op;
+  int operands[2];
+  size_t target; // index of the instruction a jump goes to
+  bool removed;
+} Node;
+
+// A break of a loop body created in the stream. It leaves the loop body's
+// frame and goes on at `target` in the stream.
+typedef struct {
+  Instructions *body;
+  size_t operand; // offset of the break operand in the loop body
+  size_t target;
+} LoopExit;
+
+// Instructions are numbered from 0 to len - 1, and len stands for the end of
+// the stream. Going to a removed instruction means going to the next one
+// that is left, see next_live.
+typedef struct {
+  Node *nodes;
+  size_t len;
+  LoopExit *exits;
+  size_t exits_len;
+  size_t *referrers; // jumps and loop exits going to each instruction
+  bool keep_result;
+  PeepholeStats removed;
+} Stream;
+
+static bool is_jump(OpCode op) {
+  return op == OP_JMP || op == OP_JMP_IF_FALSE || op == OP_JMP_IF_TRUE;
+}
+
+// Execution does not go on at the next instruction after these
+static bool is_terminal(OpCode op) {
+  switch (op) {
+  case OP_JMP:
+  case OP_RETURN_VALUE:
+  case OP_RETURN:
+  case OP_BREAK:
+  case OP_CONTINUE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static size_t instruction_width(OpCode op) {
+  Definition *def = lookup(op);
+  size_t width = 1;
+  for (size_t i = 0; i < def->operand_count; i++) {
+    width += def->operand_widths[i];
+  }
+  return width;
+}
+
+static size_t next_live(const Stream *s, size_t i) {
+  while (i < s->len && s->nodes[i].removed) {
+    i++;
+  }
+  return i;
+}
+
+static size_t next(const Stream *s, size_t i) { return next_live(s, i + 1); }
+
+static bool is_label(const Stream *s, size_t i) { return s->referrers[i] > 0; }
+
+// With keep_result, the final OP_POP leaves the value the REPL prints
+static bool is_result(const Stream *s, size_t i) {
+  return s->keep_result && s->nodes[i].op == OP_POP && next(s, i) == s->len;
+}
+
+static void drop(Stream *s, size_t i, PeepholePass pass) {
+  Node *node = &s->nodes[i];
+  if (is_jump(node->op)) {
+    s->referrers[next_live(s, node->target)]--;
+  }
+
+  node->removed = true;
+  s->referrers[next_live(s, i)] += s->referrers[i];
+  s->referrers[i] = 0;
+  s->removed.removed[pass]++;
+}
+
+static void retarget(Stream *s, size_t i, size_t target) {
+  s->referrers[next_live(s, s->nodes[i].target)]--;
+  s->nodes[i].target = target;
+  s->referrers[target]++;
+}
+
+// Index of the instruction starting at each offset, SIZE_MAX for offsets
+// inside operands
+static size_t *index_offsets(const Instructions *ins, size_t *count) {
+  size_t *index_at = malloc((ins->len + 1) * sizeof(size_t));
+  assert(index_at != NULL);
+
+  size_t n = 0;
+  size_t offset = 0;
+  while (offset < ins->len) {
+    size_t width = instruction_width(ins->arr[offset]);
+    index_at[offset] = n++;
+    for (size_t i = 1; i < width && offset + i < ins->len; i++) {
+      index_at[offset + i] = SIZE_MAX;
+    }
+    offset += width;
+  }
+
+  index_at[ins->len] = n;
+  *count = n;
+  return index_at;
+}
+
+static Node decode_node(const Instructions *ins, size_t offset) {
+  Definition *def = lookup(ins->arr[offset]);
+  size_t bytes_read;
+  IntArray operands = read_operands(def, ins, offset + 1, &bytes_read);
+
+  Node node = {.op = ins->arr[offset], .operands = {0, 0}, .removed = false};
+  for (size_t i = 0; i < operands.len; i++) {
+    node.operands[i] = operands.arr[i];
+  }
+
+  int_array_free(&operands);
+  return node;
+}
+
+static bool resolve_target(const size_t *index_at, size_t len, size_t offset,
+                           size_t *target) {
+  if (offset > len || index_at[offset] == SIZE_MAX) {
+    return false;
+  }
+
+  *target = index_at[offset];
+  return true;
+}
+
+static bool add_loop_exits(Stream *s, Instructions *body,
+                           const size_t *index_at, size_t len) {
+  size_t offset = 0;
+  while (offset < body->len) {
+    OpCode op = body->arr[offset];
+    if (op == OP_BREAK) {
+      size_t target;
+      size_t after_loop = big_endian_read_uint16(body, offset + 1);
+      if (!resolve_target(index_at, len, after_loop, &target)) {
+        return false;
+      }
+
+      s->exits = realloc(s->exits, (s->exits_len + 1) * sizeof(LoopExit));
+      assert(s->exits != NULL);
+      s->exits[s->exits_len++] = (LoopExit){
+          .body = body,
+          .operand = offset + 1,
+          .target = target,
+      };
+    }
+
+    offset += instruction_width(op);
+  }
+
+  return true;
+}
+
+// Returns false, leaving the stream as it is, when a jump does not land on
+// an instruction.
+static bool decode(Stream *s, const Instructions *ins,
+                   const DynamicArray *constants) {
+  size_t *index_at = index_offsets(ins, &s->len);
+
+  s->nodes = malloc(s->len * sizeof(Node));
+  s->referrers = calloc(s->len + 1, sizeof(size_t));
+  assert(s->nodes != NULL && s->referrers != NULL);
+  s->exits = NULL;
+  s->exits_len = 0;
+
+  bool ok = true;
+  for (size_t offset = 0; offset < ins->len && ok;) {
+    Node node = decode_node(ins, offset);
+
+    if (is_jump(node.op)) {
+      ok = resolve_target(index_at, ins->len, node.operands[0], &node.target);
+      if (ok) {
+        s->referrers[node.target]++;
+      }
+    }
+
+    if (node.op == OP_CLOSURE && (size_t)node.operands[0] < constants->len) {
+      Object *obj = constants->arr[node.operands[0]];
+      if (obj->type == COMPILED_LOOP_OBJ) {
+        size_t first_exit = s->exits_len;
+        ok = add_loop_exits(s, &((CompiledLoop *)obj)->instructions, index_at,
+                            ins->len);
+        for (size_t i = first_exit; ok && i < s->exits_len; i++) {
+          s->referrers[s->exits[i].target]++;
+        }
+      }
+    }
+
+    s->nodes[index_at[offset]] = node;
+    offset += instruction_width(node.op);
+  }
+
+  free(index_at);
+  return ok;
+}
+
+static void encode(Stream *s, Instructions *ins) {
+  size_t *offsets = malloc((s->len + 1) * sizeof(size_t));
+  assert(offsets != NULL);
+
+  // Removed instructions get the offset of the next one that is left
+  size_t offset = 0;
+  for (size_t i = 0; i < s->len; i++) {
+    offsets[i] = offset;
+    if (!s->nodes[i].removed) {
+      offset += instruction_width(s->nodes[i].op);
+    }
+  }
+  offsets[s->len] = offset;
+
+  Instructions out;
+  int_array_init(&out, offset);
+  for (size_t i = 0; i < s->len; i++) {
+    Node *node = &s->nodes[i];
+    if (node->removed) {
+      continue;
+    }
+
+    int operands[2] = {node->operands[0], node->operands[1]};
+    if (is_jump(node->op)) {
+      operands[0] = offsets[node->target];
+    }
+
+    Instruction encoded =
+        make_instruction(node->op, operands, lookup(node->op)->operand_count);
+    for (size_t j = 0; j < encoded.len; j++) {
+      int_array_append(&out, encoded.arr[j]);
+    }
+    int_array_free(&encoded);
+  }
+
+  for (size_t i = 0; i < s->exits_len; i++) {
+    LoopExit *exit = &s->exits[i];
+    uint16_t target = offsets[exit->target];
+    exit->body->arr[exit->operand] = (target >> 8) & 0xFF;
+    exit->body->arr[exit->operand + 1] = target & 0xFF;
+  }
+
+  int_array_free(ins);
+  *ins = out;
+  free(offsets);
+}
+
+static bool drop_unreachable(Stream *s) {
+  bool *reached = calloc(s->len + 1, sizeof(bool));
+  size_t *work = malloc((2 * s->len + s->exits_len + 1) * sizeof(size_t));
+  assert(reached != NULL && work != NULL);
+
+  size_t work_len = 0;
+  work[work_len++] = next_live(s, 0);
+  for (size_t i = 0; i < s->exits_len; i++) {
+    work[work_len++] = next_live(s, s->exits[i].target);
+  }
+
+  while (work_len > 0) {
+    size_t i = work[--work_len];
+    if (i == s->len || reached[i]) {
+      continue;
+    }
+
+    reached[i] = true;
+    if (!is_terminal(s->nodes[i].op)) {
+      work[work_len++] = next(s, i);
+    }
+    if (is_jump(s->nodes[i].op)) {
+      work[work_len++] = next_live(s, s->nodes[i].target);
+    }
+  }
+
+  bool changed = false;
+  for (size_t i = 0; i < s->len; i++) {
+    if (!s->nodes[i].removed && !reached[i]) {
+      drop(s, i, PEEPHOLE_UNREACHABLE);
+      changed = true;
+    }
+  }
+
+  free(reached);
+  free(work);
+  return changed;
+}
+
+static bool thread_jumps(Stream *s) {
+  bool changed = false;
+  for (size_t i = 0; i < s->len; i++) {
+    Node *node = &s->nodes[i];
+    if (node->removed || !is_jump(node->op)) {
+      continue;
+    }
+
+    size_t target = next_live(s, node->target);
+    for (size_t hops = 0; hops < s->len && target < s->len &&
+                          s->nodes[target].op == OP_JMP;
+         hops++) {
+      target = next_live(s, s->nodes[target].target);
+    }
+
+    // Jumps going around in circles are left alone
+    bool resolved = target == s->len || s->nodes[target].op != OP_JMP;
+    if (resolved && target != next_live(s, node->target)) {
+      retarget(s, i, target);
+      changed = true;
+    }
+
+    if (node->op == OP_JMP && next_live(s, node->target) == next(s, i)) {
+      drop(s, i, PEEPHOLE_JUMP_THREADING);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+static OpCode load_of(OpCode store) {
+  switch (store) {
+  case OP_SET_GLOBAL:
+    return OP_GET_GLOBAL;
+  case OP_SET_LOCAL:
+  case OP_SET_LOCAL_SCALAR:
+  case OP_SET_LOCAL_CAPTURED:
+    return OP_GET_LOCAL;
+  case OP_SET_FREE:
+  case OP_SET_FREE_SCALAR:
+    return OP_GET_FREE;
+  default:
+    return OP_COUNT;
+  }
+}
+
+// A reassignment used as a statement stores the value, loads it back as the
+// value of the expression and pops it.
+static bool fold_store_loads(Stream *s) {
+  bool changed = false;
+  for (size_t i = 0; i < s->len; i++) {
+    Node *store = &s->nodes[i];
+    if (store->removed || load_of(store->op) == OP_COUNT) {
+      continue;
+    }
+
+    size_t load = next(s, i);
+    size_t pop = load < s->len ? next(s, load) : s->len;
+    if (pop == s->len || is_label(s, load) || is_label(s, pop)) {
+      continue;
+    }
+
+    if (s->nodes[load].op == load_of(store->op) &&
+        s->nodes[load].operands[0] == store->operands[0] &&
+        s->nodes[pop].op == OP_POP && !is_result(s, pop)) {
+      drop(s, load, PEEPHOLE_STORE_LOAD);
+      drop(s, pop, PEEPHOLE_STORE_LOAD);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+static bool drop_null_pops(Stream *s) {
+  bool changed = false;
+  for (size_t i = 0; i < s->len; i++) {
+    Node *node = &s->nodes[i];
+    if (node->removed) {
+      continue;
+    }
+
+    if (node->op == OP_NULL) {
+      size_t pop = next(s, i);
+      if (pop < s->len && s->nodes[pop].op == OP_POP && !is_label(s, pop) &&
+          !is_result(s, pop)) {
+        drop(s, i, PEEPHOLE_NULL_POP);
+        drop(s, pop, PEEPHOLE_NULL_POP);
+        changed = true;
+      }
+      continue;
+    }
+
+    // An if without else used as a statement:
+    //   JMP_IF_FALSE a; <consequence>; JMP b; a: NULL; b: POP
+    // The consequence can pop its own value, then nothing is left to do
+    // when the condition is false.
+    if (node->op != OP_JMP) {
+      continue;
+    }
+
+    size_t null = next(s, i);
+    size_t pop = null < s->len ? next(s, null) : s->len;
+    if (pop < s->len && s->nodes[null].op == OP_NULL &&
+        s->nodes[pop].op == OP_POP && next_live(s, node->target) == pop &&
+        s->referrers[pop] == 1 && !is_result(s, pop)) {
+      s->referrers[pop]--;
+      node->op = OP_POP;
+      drop(s, null, PEEPHOLE_NULL_POP);
+      drop(s, pop, PEEPHOLE_NULL_POP);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+static bool negate_jumps(Stream *s) {
+  bool changed = false;
+  for (size_t i = 0; i < s->len; i++) {
+    if (s->nodes[i].removed || s->nodes[i].op != OP_BANG) {
+      continue;
+    }
+
+    size_t jump = next(s, i);
+    if (jump == s->len || is_label(s, jump)) {
+      continue;
+    }
+
+    Node *node = &s->nodes[jump];
+    if (node->op == OP_JMP_IF_FALSE || node->op == OP_JMP_IF_TRUE) {
+      node->op =
+          node->op == OP_JMP_IF_FALSE ? OP_JMP_IF_TRUE : OP_JMP_IF_FALSE;
+      drop(s, i, PEEPHOLE_NEGATED_JUMP);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+static void add_stats(PeepholeStats *to, const PeepholeStats *from) {
+  for (size_t i = 0; i < PEEPHOLE_PASS_COUNT; i++) {
+    to->removed[i] += from->removed[i];
+  }
+}
+
+void peephole_optimize(Instructions *ins, const DynamicArray *constants,
+                       bool keep_result, PeepholeStats *stats) {
+  if (ins->len == 0) {
+    return;
+  }
+
+  Stream s = {.keep_result = keep_result};
+  if (decode(&s, ins, constants)) {
+    bool changed = true;
+    while (changed) {
+      changed = drop_unreachable(&s);
+      changed |= thread_jumps(&s);
+      changed |= fold_store_loads(&s);
+      changed |= drop_null_pops(&s);
+      changed |= negate_jumps(&s);
+    }
+
+    encode(&s, ins);
+
+    if (stats) {
+      add_stats(stats, &s.removed);
+    }
+    if (peephole_report.enabled) {
+      add_stats(&peephole_report.totals, &s.removed);
+    }
+  }
+
+  free(s.nodes);
+  free(s.referrers);
+  free(s.exits);
+}
+
+void peephole_stats_enable(void) { peephole_report.enabled = true; }
+
+void peephole_stats_print(FILE *out) {
+  fprintf(out, "Peephole optimizer:\n-------------\n");
+  fprintf(out, "%-24s %12s\n", "pass", "removed");
+
+  size_t total = 0;
+  for (size_t i = 0; i < PEEPHOLE_PASS_COUNT; i++) {
+    fprintf(out, "%-24s %12zu\n", PeepholePassString[i],
+            peephole_report.totals.removed[i]);
+    total += peephole_report.totals.removed[i];
+  }
+
+  fprintf(out, "%-24s %12zu\n", "total", total);
+  fprintf(out, "-------------\n");
+}
+
+void peephole_stats_report(void) {
+  if (peephole_report.enabled) {
+    peephole_stats_print(stderr);
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "../code/code.h"
+#include "../dyn_array/dyn_array.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef enum {
+  PEEPHOLE_JUMP_THREADING, // jumps to jumps, jumps to the next instruction
+  PEEPHOLE_STORE_LOAD,     // SET x; GET x; POP becomes SET x
+  PEEPHOLE_NULL_POP,       // NULL; POP, including the one of an if without else
+  PEEPHOLE_NEGATED_JUMP,   // BANG; JMP_IF_FALSE becomes JMP_IF_TRUE
+  PEEPHOLE_UNREACHABLE,    // code no jump or fall through reaches
+  PEEPHOLE_PASS_COUNT,
+} PeepholePass;
+
+typedef struct {
+  size_t removed[PEEPHOLE_PASS_COUNT]; // instructions removed by each pass
+} PeepholeStats;
+
+extern const char *PeepholePassString[];
+
+// Rewrites one instruction stream in place and re-patches its jumps, as well
+// as the breaks of the loop bodies it creates, which jump back into it.
+// `constants` is where those loop bodies are found. With `keep_result`, the
+// value popped last is left alone: the REPL and the tests print it.
+// Removed instructions are added to `stats`, which may be NULL.
+void peephole_optimize(Instructions *, const DynamicArray *constants,
+                       bool keep_result, PeepholeStats *stats);
+
+// Totals over every stream optimized since the process started, printed to
+// stderr on exit when enabled.
+void peephole_stats_enable(void);
+void peephole_stats_print(FILE *);
+void peephole_stats_report(void);
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,676 @@
+// Builds the IR of a function literal straight from its AST, a block at a
+// time, reading and writing variables as described in ir.h. The variables
+// are the slots the symbol table gives the parameters and lets of the
+// function, and temporaries of it for the lets of loop bodies and for the
+// values of ifs. Anything the builder does not handle makes it give up, and
+// the function is then compiled as written.
+#include "ssa.h"
+#include "../ir/copy_propagation.h"
+#include "../ir/dead_values.h"
+#include "../ir/gvn.h"
+#include "../ir/lowering.h"
+#include "../ir/type_propagation.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof(a[0]))
+
+typedef struct {
+  char *name;
+  size_t variable;
+} SsaLet;
+
+// A loop being built. Its lets live in variables of their own, found by
+// name before the symbol table is asked.
+typedef struct SsaLoop {
+  struct SsaLoop *enclosing;
+  IrBlock *header; // evaluates the condition
+  IrBlock *body;
+  IrBlock *next; // runs the update, created by the first continue
+  IrBlock *exit;
+  Statement *update;
+  DynamicArray lets; // SsaLet*[], in the order they were defined
+} SsaLoop;
+
+typedef struct {
+  Compiler *compiler;
+  IrFunction *fn;
+  IrBlock *block; // where the values built next go
+  IrValue *null;  // what variables hold before they are assigned
+  SsaLoop *loop;
+  IntArray scalar_variables; // of the lets escape analysis found scalar
+} SsaBuilder;
+
+static bool build_expression(SsaBuilder *, Expression *, IrValue **);
+static bool build_statement(SsaBuilder *, Statement *, IrValue **);
+static bool build_statements(SsaBuilder *, BlockStatement *, IrValue **);
+
+static IrValue *append(SsaBuilder *b, OpCode op, int operand,
+                       IrValue **args, size_t num_args) {
+  return ir_append(b->fn, b->block, op, operand, args, num_args);
+}
+
+static IrValue *read_variable(SsaBuilder *b, size_t variable) {
+  return ir_read_variable(b->fn, b->block, variable, b->null);
+}
+
+static IrBlock *new_sealed_block(SsaBuilder *b) {
+  IrBlock *block = ir_new_block(b->fn);
+  ir_seal_block(b->fn, block, b->null);
+  return block;
+}
+
+// Whatever follows a return, break or continue is built into a block no
+// other jumps to, which ir_compute_dominators drops
+static void start_unreachable_block(SsaBuilder *b) {
+  b->block = new_sealed_block(b);
+}
+
+static SsaLet *find_let(SsaBuilder *b, char *name) {
+  for (SsaLoop *loop = b->loop; loop; loop = loop->enclosing) {
+    for (size_t i = loop->lets.len; i-- > 0;) {
+      SsaLet *let = loop->lets.arr[i];
+      if (strcmp(let->name, name) == 0) {
+        return let;
+      }
+    }
+  }
+  return NULL;
+}
+
+static size_t new_variable(SsaBuilder *b, char *name) {
+  SymbolTable *symbols = b->compiler->symbol_table;
+  if (b->loop == NULL) {
+    return symbol_define(symbols, name)->index;
+  }
+
+  // The lets of a loop body are null again at the start of every iteration
+  SsaLet *let = malloc(sizeof(SsaLet));
+  assert(let != NULL);
+
+  *let = (SsaLet){
+      .name = name,
+      .variable = symbol_define_temporary(symbols).index,
+  };
+  array_append(&b->loop->lets, let);
+  ir_write_variable(b->loop->body, let->variable, b->null);
+  return let->variable;
+}
+
+static size_t define_variable(SsaBuilder *b, char *name) {
+  size_t variable = new_variable(b, name);
+  if (is_scalar_local(b->compiler->scalars, name)) {
+    int_array_append(&b->scalar_variables, variable);
+  }
+  return variable;
+}
+
+static bool is_scalar_variable(const SsaBuilder *b, size_t variable) {
+  for (size_t i = 0; i < b->scalar_variables.len; i++) {
+    if ((size_t)b->scalar_variables.arr[i] == variable) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void mark_scalar_phis(SsaBuilder *b) {
+  for (size_t i = 0; i < b->fn->blocks.len; i++) {
+    IrBlock *block = b->fn->blocks.arr[i];
+    for (size_t j = 0; j < block->phis.len; j++) {
+      IrValue *phi = block->phis.arr[j];
+      phi->scalar = is_scalar_variable(b, phi->operand);
+    }
+  }
+}
+
+static bool build_identifier(SsaBuilder *b, Identifier *ident,
+                             IrValue **value) {
+  SsaLet *let = find_let(b, ident->value);
+  if (let) {
+    *value = read_variable(b, let->variable);
+    return true;
+  }
+
+  const Symbol *symbol =
+      symbol_resolve(b->compiler->symbol_table, ident->value);
+  if (symbol == NULL) {
+    return false;
+  }
+
+  switch (symbol->scope) {
+  case SYMBOL_LOCAL_SCOPE:
+    *value = read_variable(b, symbol->index);
+    break;
+  case SYMBOL_GLOBAL_SCOPE:
+    *value = append(b, OP_GET_GLOBAL, symbol->index, NULL, 0);
+    break;
+  case SYMBOL_BUILTIN_SCOPE:
+    *value = append(b, OP_GET_BUILTIN, symbol->index, NULL, 0);
+    break;
+  case SYMBOL_FREE_SCOPE:
+    *value = append(b, OP_GET_FREE, symbol->index, NULL, 0);
+    break;
+  case SYMBOL_FUNCTION_SCOPE:
+    *value = append(b, OP_CURRENT_CLOSURE, 0, NULL, 0);
+    break;
+  }
+
+  return true;
+}
+
+// Builds the expressions in order, into `args`
+static bool build_arguments(SsaBuilder *b, Expression **exprs, size_t len,
+                            DynamicArray *args) {
+  for (size_t i = 0; i < len; i++) {
+    IrValue *value;
+    if (!build_expression(b, exprs[i], &value)) {
+      return false;
+    }
+    array_append(args, value);
+  }
+  return true;
+}
+
+static bool build_operation(SsaBuilder *b, OpCode op, int operand,
+                            Expression **exprs, size_t len,
+                            IrValue **value) {
+  DynamicArray args;
+  array_init(&args, len > 0 ? len : 1);
+
+  bool built = build_arguments(b, exprs, len, &args);
+  if (built) {
+    *value = append(b, op, operand, (IrValue **)args.arr, args.len);
+  }
+
+  free(args.arr);
+  return built;
+}
+
+static bool build_infix(SsaBuilder *b, InfixExpression *expr,
+                        IrValue **value) {
+  // The right operand of `<` is evaluated first, see
+  // compile_infix_expression
+  if (strcmp(expr->operator, "<") == 0) {
+    return build_operation(b, OP_GREATER, 0,
+                           (Expression *[]){expr->right, expr->left}, 2,
+                           value);
+  }
+
+  OpCode op = infix_opcode(expr->operator);
+  if (op == OP_COUNT) {
+    return false;
+  }
+
+  return build_operation(b, op, 0, (Expression *[]){expr->left, expr->right},
+                         2, value);
+}
+
+static bool build_prefix(SsaBuilder *b, PrefixExpression *expr,
+                         IrValue **value) {
+  OpCode op = prefix_opcode(expr->operator);
+  if (op == OP_COUNT) {
+    return false;
+  }
+
+  return build_operation(b, op, 0, &expr->right, 1, value);
+}
+
+// The value of a branch as compile_block_value leaves it
+static bool build_branch(SsaBuilder *b, BlockStatement *branch,
+                         IrValue **value) {
+  IrValue *last = NULL;
+  if (branch && !build_statements(b, branch, &last)) {
+    return false;
+  }
+
+  *value = last ? last : b->null;
+  return true;
+}
+
+// Each branch writes its value to a variable of the if, which the block
+// they join at reads back
+static bool build_if(SsaBuilder *b, IfExpression *expr, IrValue **value) {
+  bool truthy;
+  if (pass_enabled(b->compiler->optimization_level, PASS_DEAD_CODE) &&
+      constant_condition(expr->condition, &truthy)) {
+    return build_branch(b, truthy ? expr->consequence : expr->alternative,
+                        value);
+  }
+
+  IrValue *condition;
+  if (!build_expression(b, expr->condition, &condition)) {
+    return false;
+  }
+
+  size_t variable = symbol_define_temporary(b->compiler->symbol_table).index;
+  IrBlock *consequence = ir_new_block(b->fn);
+  IrBlock *alternative = ir_new_block(b->fn);
+  IrBlock *join = ir_new_block(b->fn);
+  ir_branch(b->block, condition, consequence, alternative);
+  ir_seal_block(b->fn, consequence, b->null);
+  ir_seal_block(b->fn, alternative, b->null);
+
+  BlockStatement *branches[] = {expr->consequence, expr->alternative};
+  IrBlock *blocks[] = {consequence, alternative};
+  for (size_t i = 0; i < 2; i++) {
+    b->block = blocks[i];
+    IrValue *branch_value;
+    if (!build_branch(b, branches[i], &branch_value)) {
+      return false;
+    }
+    ir_write_variable(b->block, variable, branch_value);
+    ir_jump(b->block, join);
+  }
+
+  ir_seal_block(b->fn, join, b->null);
+  b->block = join;
+  *value = read_variable(b, variable);
+  return true;
+}
+
+static bool build_index(SsaBuilder *b, IndexExpression *expr,
+                        IrValue **value) {
+  // Numbered as compile_expression numbers the index sites
+  Compiler *compiler = b->compiler;
+  int cache = compiler->num_index_caches++ % INDEX_CACHES_SIZE;
+  return build_operation(b, OP_INDEX, cache,
+                         (Expression *[]){expr->left, expr->index}, 2,
+                         value);
+}
+
+typedef struct {
+  SsaBuilder *builder;
+  DynamicArray *args;
+  bool built;
+} HashBuilder;
+
+static int build_hash_pair(void *const ctx,
+                           struct hashmap_element_s *const pair) {
+  HashBuilder *const hash = ctx;
+  Expression *exprs[] = {(Expression *)pair->key, pair->data};
+  hash->built = build_arguments(hash->builder, exprs, 2, hash->args);
+  return hash->built ? 0 : 1;
+}
+
+static bool build_hash(SsaBuilder *b, HashLiteral *expr, IrValue **value) {
+  DynamicArray args;
+  array_init(&args, expr->len * 2 + 1);
+
+  HashBuilder hash = {.builder = b, .args = &args, .built = true};
+  hashmap_iterate_pairs(&expr->pairs, &build_hash_pair, &hash);
+  if (hash.built) {
+    *value = append(b, OP_HASH, expr->len * 2, (IrValue **)args.arr,
+                    args.len);
+  }
+
+  free(args.arr);
+  return hash.built;
+}
+
+static bool build_call(SsaBuilder *b, CallExpression *call,
+                       IrValue **value) {
+  Compiler *compiler = b->compiler;
+  if (inline_candidate(compiler, call)) {
+    return false;
+  }
+
+  // A let of a loop body may shadow the builtin, which intrinsic_opcode
+  // does not know about
+  OpCode intrinsic = OP_COUNT;
+  if (pass_enabled(compiler->optimization_level, PASS_INTRINSICS) &&
+      (call->function->type != IDENT_EXPR ||
+       find_let(b, ((Identifier *)call->function)->value) == NULL)) {
+    double start = pass_timer_start();
+    intrinsic = intrinsic_opcode(compiler, call);
+    pass_timer_stop(PASS_INTRINSICS, start);
+  }
+
+  Expression **arguments = (Expression **)call->arguments.arr;
+  size_t num_arguments = call->arguments.len;
+  if (intrinsic != OP_COUNT) {
+    return build_operation(b, intrinsic, 0, arguments, num_arguments,
+                           value);
+  }
+
+  DynamicArray args;
+  array_init(&args, num_arguments + 1);
+
+  bool built = build_arguments(b, &call->function, 1, &args) &&
+               build_arguments(b, arguments, num_arguments, &args);
+  if (built) {
+    *value = append(b, OP_CALL, num_arguments, (IrValue **)args.arr,
+                    args.len);
+  }
+
+  free(args.arr);
+  return built;
+}
+
+// Locals and lets are written as variables, globals are stored and loaded
+// back as compile_ident_reassignment does. Free variables are left to it,
+// which knows whether escape analysis found them to be scalars.
+static bool build_ident_reassignment(SsaBuilder *b, Reassignment *expr,
+                                     IrValue **value) {
+  char *name = ((Identifier *)expr->name)->value;
+  SsaLet *let = find_let(b, name);
+  const Symbol *symbol =
+      let ? NULL : symbol_resolve(b->compiler->symbol_table, name);
+  if (let == NULL &&
+      (symbol == NULL || (symbol->scope != SYMBOL_LOCAL_SCOPE &&
+                          symbol->scope != SYMBOL_GLOBAL_SCOPE))) {
+    return false;
+  }
+
+  if (!build_expression(b, expr->value, value)) {
+    return false;
+  }
+
+  if (let) {
+    ir_write_variable(b->block, let->variable, *value);
+  } else if (symbol->scope == SYMBOL_LOCAL_SCOPE) {
+    ir_write_variable(b->block, symbol->index, *value);
+  } else {
+    append(b, OP_SET_GLOBAL, symbol->index, value, 1);
+    *value = append(b, OP_GET_GLOBAL, symbol->index, NULL, 0);
+  }
+
+  return true;
+}
+
+static bool build_reassignment(SsaBuilder *b, Reassignment *expr,
+                               IrValue **value) {
+  switch (expr->name->type) {
+  case IDENT_EXPR:
+    return build_ident_reassignment(b, expr, value);
+  case INDEX_EXPR: {
+    IndexExpression *index = (IndexExpression *)expr->name;
+    return build_operation(
+        b, OP_REASSIGN_INDEX, 0,
+        (Expression *[]){index->left, index->index, expr->value}, 3, value);
+  }
+  default:
+    return false;
+  }
+}
+
+static bool build_expression(SsaBuilder *b, Expression *expr,
+                             IrValue **value) {
+  Compiler *compiler = b->compiler;
+
+  switch (expr->type) {
+  case INFIX_EXPR:
+    return build_infix(b, (InfixExpression *)expr, value);
+  case PREFIX_EXPR:
+    return build_prefix(b, (PrefixExpression *)expr, value);
+  case INT_EXPR: {
+    Object *num = new_number(((NumberLiteral *)expr)->value);
+    *value = ir_constant(b->fn, b->block, add_constant(compiler, num),
+                         IR_TYPE_NUMBER);
+    return true;
+  }
+  case STRING_EXPR: {
+    Object *str = new_interned_string(((StringLiteral *)expr)->value);
+    *value = ir_constant(b->fn, b->block, add_constant(compiler, str),
+                         IR_TYPE_STRING);
+    return true;
+  }
+  case BOOL_EXPR:
+    *value = append(b, ((BooleanLiteral *)expr)->value ? OP_TRUE : OP_FALSE,
+                    0, NULL, 0);
+    return true;
+  case IDENT_EXPR:
+    return build_identifier(b, (Identifier *)expr, value);
+  case IF_EXPR:
+    return build_if(b, (IfExpression *)expr, value);
+  case ARRAY_EXPR: {
+    DynamicArray *elements = ((ArrayLiteral *)expr)->elements;
+    return build_operation(b, OP_ARRAY, elements->len,
+                           (Expression **)elements->arr, elements->len,
+                           value);
+  }
+  case HASH_EXPR:
+    return build_hash(b, (HashLiteral *)expr, value);
+  case INDEX_EXPR:
+    return build_index(b, (IndexExpression *)expr, value);
+  case CALL_EXPR:
+    return build_call(b, (CallExpression *)expr, value);
+  case REASSIGN_EXPR:
+    return build_reassignment(b, (Reassignment *)expr, value);
+  default:
+    // Function literals, and loops whose value is used
+    return false;
+  }
+}
+
+static void free_lets(SsaLoop *loop) { array_free(&loop->lets); }
+
+// Where the next iteration starts. The update goes in a block of its own
+// only when continues jump to it, otherwise it follows the body, where what
+// the body computes last can stay on the stack.
+static IrBlock *continue_target(SsaBuilder *b, SsaLoop *loop) {
+  if (loop->update == NULL) {
+    return loop->header;
+  }
+  if (loop->next == NULL) {
+    loop->next = ir_new_block(b->fn);
+  }
+  return loop->next;
+}
+
+// The condition is evaluated in a block of its own that the end of every
+// iteration jumps back to, so it is sealed last
+static bool build_loop(SsaBuilder *b, Expression *condition, Statement *init,
+                       BlockStatement *body, Statement *update) {
+  IrValue *ignored;
+  if (init && !build_statement(b, init, &ignored)) {
+    return false;
+  }
+
+  IrBlock *header = ir_new_block(b->fn);
+  ir_jump(b->block, header);
+  b->block = header;
+
+  IrValue *value;
+  if (!build_expression(b, condition, &value)) {
+    return false;
+  }
+
+  SsaLoop loop = {
+      .enclosing = b->loop,
+      .header = header,
+      .body = ir_new_block(b->fn),
+      .exit = ir_new_block(b->fn),
+      .update = update,
+  };
+  array_init(&loop.lets, 2);
+  ir_branch(b->block, value, loop.body, loop.exit);
+  ir_seal_block(b->fn, loop.body, b->null);
+
+  b->block = loop.body;
+  b->loop = &loop;
+  bool built = build_statements(b, body, &ignored);
+  b->loop = loop.enclosing;
+  free_lets(&loop);
+  if (!built) {
+    return false;
+  }
+
+  if (loop.next) {
+    ir_jump(b->block, loop.next);
+    ir_seal_block(b->fn, loop.next, b->null);
+    b->block = loop.next;
+  }
+  if (update && !build_statement(b, update, &ignored)) {
+    return false;
+  }
+
+  ir_jump(b->block, header);
+  ir_seal_block(b->fn, header, b->null);
+  ir_seal_block(b->fn, loop.exit, b->null);
+  b->block = loop.exit;
+  return true;
+}
+
+static bool is_loop(Expression *expr) {
+  return expr->type == WHILE_EXPR || expr->type == FOR_EXPR;
+}
+
+// Sets `value` to the value of an expression statement other than a loop,
+// NULL for any other statement
+static bool build_statement(SsaBuilder *b, Statement *stmt,
+                            IrValue **value) {
+  *value = NULL;
+
+  switch (stmt->type) {
+  case EXPR_STATEMENT: {
+    Expression *expr = stmt->expression;
+    if (expr->type == WHILE_EXPR) {
+      WhileLoop *loop = (WhileLoop *)expr;
+      return build_loop(b, loop->condition, NULL, loop->body, NULL);
+    }
+    if (expr->type == FOR_EXPR) {
+      ForLoop *loop = (ForLoop *)expr;
+      return build_loop(b, loop->condition, loop->initialization, loop->body,
+                        loop->update);
+    }
+    return build_expression(b, expr, value);
+  }
+  case LET_STATEMENT: {
+    size_t variable = define_variable(b, stmt->name->value);
+    IrValue *let_value;
+    if (is_loop(stmt->expression) ||
+        !build_expression(b, stmt->expression, &let_value)) {
+      return false;
+    }
+    ir_write_variable(b->block, variable, let_value);
+    return true;
+  }
+  case RETURN_STATEMENT: {
+    // Returning from a loop body only leaves the loop body
+    IrValue *return_value;
+    if (b->loop || !build_expression(b, stmt->expression, &return_value)) {
+      return false;
+    }
+    ir_return(b->block, return_value);
+    start_unreachable_block(b);
+    return true;
+  }
+  case BREAK_STATEMENT:
+  case CONTINUE_STATEMENT:
+    if (b->loop == NULL) {
+      return false;
+    }
+    ir_jump(b->block, stmt->type == BREAK_STATEMENT
+                          ? b->loop->exit
+                          : continue_target(b, b->loop));
+    start_unreachable_block(b);
+    return true;
+  }
+
+  return false;
+}
+
+// Sets `last` to the value of the last statement, see build_statement
+static bool build_statements(SsaBuilder *b, BlockStatement *block,
+                             IrValue **last) {
+  *last = NULL;
+  for (size_t i = 0; i < block->statements.len; i++) {
+    if (!build_statement(b, block->statements.arr[i], last)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool build_function(SsaBuilder *b, FunctionLiteral *fn) {
+  SymbolTable *symbols = b->compiler->symbol_table;
+  if (fn->name) {
+    symbol_define_function_name(symbols, fn->name);
+  }
+
+  IrBlock *entry = new_sealed_block(b);
+  b->block = entry;
+  b->null = append(b, OP_NULL, 0, NULL, 0);
+
+  for (size_t i = 0; i < fn->parameters.len; i++) {
+    Identifier *param = fn->parameters.arr[i];
+    size_t variable = symbol_define(symbols, param->value)->index;
+    ir_write_variable(entry, variable, ir_parameter(b->fn, i));
+  }
+
+  IrValue *last;
+  if (!build_statements(b, fn->body, &last)) {
+    return false;
+  }
+
+  ir_return(b->block, last);
+  ir_compute_dominators(b->fn);
+  mark_scalar_phis(b);
+  return true;
+}
+
+static const struct {
+  OptimizationPass pass;
+  void (*run)(IrFunction *);
+} ssa_passes[] = {
+    {PASS_TYPE_PROPAGATION, propagate_types},
+    {PASS_GVN, number_values},
+    {PASS_COPY_PROPAGATION, propagate_copies},
+    {PASS_DEAD_VALUES, remove_dead_values},
+};
+
+static void run_ssa_passes(Compiler *compiler, IrFunction *fn) {
+  for (size_t i = 0; i < ARRAY_LEN(ssa_passes); i++) {
+    if (!pass_enabled(compiler->optimization_level, ssa_passes[i].pass)) {
+      continue;
+    }
+
+    double start = pass_timer_start();
+    ssa_passes[i].run(fn);
+    pass_timer_stop(ssa_passes[i].pass, start);
+  }
+}
+
+bool compile_ssa_function(Compiler *compiler, FunctionLiteral *fn) {
+  // Inlined bodies and hoisted conditions refer to slots of the frame being
+  // compiled, which a nested function cannot
+  if (compiler->inlined || compiler->hoisted) {
+    return false;
+  }
+
+  double start = pass_timer_start();
+  enter_compiler_scope(compiler);
+
+  SsaBuilder b = {
+      .compiler = compiler,
+      .fn = new_ir_function(fn->parameters.len),
+  };
+  int_array_init(&b.scalar_variables, 4);
+  bool compiled = build_function(&b, fn);
+  int_array_free(&b.scalar_variables);
+
+  // Building and lowering the function are timed as one run of PASS_SSA,
+  // the passes in between as their own
+  double built = pass_timer_start();
+  size_t num_locals = 0;
+  if (compiled) {
+    run_ssa_passes(compiler, b.fn);
+    double lowering = pass_timer_start();
+    compiled = lower_ir_function(
+        b.fn, compiler_current_instructions(compiler), &num_locals);
+    start += lowering - built;
+  }
+
+  free_ir_function(b.fn);
+  pass_timer_stop(PASS_SSA, start);
+
+  if (!compiled) {
+    discard_compiler_scope(compiler);
+    return false;
+  }
+
+  emit_closure(compiler, num_locals, fn->parameters.len);
+  return true;
+}
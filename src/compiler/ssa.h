@@ -0,0 +1,26 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "../ast/ast.h"
+#include "compiler.h"
+#include <stdbool.h>
+
+// Compiles a function literal through the SSA form of src/ir: its body is
+// built into basic blocks, the SSA passes enabled at the level of the
+// compiler run on them in order, and the result is lowered back to bytecode
+// before the peephole, slot packing and type inference passes see it.
+//
+// Loops become blocks of the function rather than loop bodies of their own,
+// so that a value can stay in a slot across iterations. Their lets are set
+// to null again at the start of every iteration, as the slots of a loop body
+// are. Only functions without function literals, which could capture the
+// locals of a loop body, get there, and only with returns outside of loops
+// and loops used as statements: a return in a loop body leaves the loop
+// body rather than the function. Calls the compiler would inline are left to
+// it too.
+//
+// Emits the closure of the function and returns true, or returns false,
+// emitting nothing, for the functions the compiler compiles as written.
+bool compile_ssa_function(Compiler *, FunctionLiteral *);
+
+#endif // SSA_H
@@ -105,3 +105,11 @@ const Symbol *symbol_define_function_name(SymbolTable *table, char *name) {
   hashmap_put(&table->store, name, strlen(name), symbol);
   return symbol;
 }
+
+Symbol symbol_define_temporary(SymbolTable *table) {
+  return (Symbol){
+      .name = "",
+      .index = table->num_definitions++,
+      .scope = table->outer ? SYMBOL_LOCAL_SCOPE : SYMBOL_GLOBAL_SCOPE,
+  };
+}
@@ -34,4 +34,6 @@ const Symbol *symbol_resolve(SymbolTable *, char *);
 void free_symbol_table(SymbolTable *);
 const Symbol *symbol_define_builtin(SymbolTable *, size_t, char *);
 const Symbol *symbol_define_function_name(SymbolTable *, char *);
+// A new slot no name resolves to, for values only the compiler refers to
+Symbol symbol_define_temporary(SymbolTable *);
 #endif // SYMBOL_TABLE_H
@@ -0,0 +1,520 @@
+// Types flow forwards through the stream: each instruction gets the types of
+// the stack and of the locals it starts with, merged over every way to reach
+// it, until nothing changes anymore. Values come from three places:
+//  - literals and the results of operators have their type for good
+//  - an operator that did not fail tells the types of the locals it read,
+//    `n - 1` going on means `n` holds a number
+//  - anything else, like parameters, globals, free variables and the results
+//    of calls, is unknown
+//
+// Captured variables are boxes that closures overwrite in place, and any
+// value that is not a literal or the result of an operator could be one. So
+// what an operator tells about a local is forgotten at every instruction
+// that can run other code or write a box: calls, loops and stores to free
+// variables. Creating a closure boxes the locals it captures along with
+// every slot of the frame holding the same object, so streams capturing
+// their own locals are left alone.
+//
+// The typed arithmetic operators leave their result in an unboxed Number the
+// VM keeps for the stack slot, which the next result in that slot
+// overwrites. So an operator only gets its typed opcode when its result is
+// always copied out by whatever pops it: another operator, a conditional
+// jump, a pop or a scalar store. Results that are stored, passed, returned
+// or reach a join together with another value keep the generic opcode and
+// are allocated.
+#include "type_inference.h"
+#include "flow_graph.h"
+#include "../big_endian/big_endian.h"
+#include "../object/object.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+  TYPE_UNKNOWN,
+  TYPE_NUMBER,
+  TYPE_BOOLEAN,
+  TYPE_STRING,
+} Type;
+
+typedef struct {
+  Type type;
+  bool lasting; // still holds after a call, see above
+  int local;    // local the value was loaded from, -1 for any other
+  int result;   // instruction the value is the result of, -1 for any other
+} Value;
+
+// The locals followed by the stack
+typedef struct {
+  bool reached;
+  size_t depth;
+  Value *values;
+} State;
+
+typedef struct {
+  const Instructions *ins;
+  const DynamicArray *constants;
+  FlowGraph flow;
+  size_t num_locals;
+  State *states;
+  size_t *worklist;
+  size_t worklist_len;
+  bool *queued;
+  bool *escapes; // the result of the instruction is kept, see above
+} Inference;
+
+static const Value unknown = {
+    .type = TYPE_UNKNOWN,
+    .local = -1,
+    .result = -1,
+};
+
+static Value known(Type type) {
+  return (Value){.type = type, .lasting = true, .local = -1, .result = -1};
+}
+
+static Value result_of(size_t i, Type type) {
+  Value v = known(type);
+  v.result = i;
+  return v;
+}
+
+static void escape(Inference *inf, Value v) {
+  if (v.result >= 0) {
+    inf->escapes[v.result] = true;
+  }
+}
+
+// The instructions that read the values they pop without holding on to them
+static bool copies_operands(OpCode op) {
+  switch (generic_opcode(op)) {
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_LSHIFT:
+  case OP_RSHIFT:
+  case OP_BIT_OR:
+  case OP_BIT_AND:
+  case OP_BIT_XOR:
+  case OP_AND:
+  case OP_OR:
+  case OP_EQ:
+  case OP_NOT_EQ:
+  case OP_GREATER:
+  case OP_MINUS:
+  case OP_BANG:
+  case OP_POP:
+  case OP_JMP_IF_FALSE:
+  case OP_JMP_IF_TRUE:
+  case OP_SET_LOCAL_SCALAR:
+  case OP_SET_FREE_SCALAR:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static void enqueue(Inference *inf, size_t i) {
+  if (!inf->queued[i]) {
+    inf->queued[i] = true;
+    inf->worklist[inf->worklist_len++] = i;
+  }
+}
+
+// Loads of a local right before OP_CLOSURE capture it
+static bool captures_locals(const FlowGraph *flow, const Instructions *ins) {
+  for (size_t i = 0; i < flow->len; i++) {
+    if (flow->nodes[i].op != OP_CLOSURE) {
+      continue;
+    }
+
+    size_t num_free = ins->arr[flow->nodes[i].pos + 3];
+    for (size_t j = i > num_free ? i - num_free : 0; j < i; j++) {
+      if (flow->nodes[j].op == OP_GET_LOCAL) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+static Type constant_type(const Inference *inf, size_t pos) {
+  uint16_t index = big_endian_read_uint16(inf->ins, pos + 1);
+  Object *constant = inf->constants->arr[index];
+
+  switch (constant->type) {
+  case NUMBER_OBJ:
+    return TYPE_NUMBER;
+  case STRING_OBJ:
+    return TYPE_STRING;
+  default:
+    return TYPE_UNKNOWN;
+  }
+}
+
+static Value *stack(Inference *inf, Value *values) {
+  return values + inf->num_locals;
+}
+
+static bool pop(Inference *inf, const FlowNode *node, Value *values,
+                size_t *depth, size_t n) {
+  if (*depth < n) {
+    return false;
+  }
+
+  *depth -= n;
+  if (!copies_operands(node->op)) {
+    for (size_t j = 0; j < n; j++) {
+      escape(inf, stack(inf, values)[*depth + j]);
+    }
+  }
+  return true;
+}
+
+static void push(Inference *inf, Value *values, size_t *depth, Value v) {
+  stack(inf, values)[(*depth)++] = v;
+}
+
+static void prove(Value *values, Value v, Type type) {
+  if (type != TYPE_UNKNOWN && v.local >= 0 && values[v.local].type != type) {
+    values[v.local] = (Value){.type = type, .local = -1};
+  }
+}
+
+static void forget_passing_facts(Inference *inf, Value *values,
+                                 size_t depth) {
+  for (size_t i = 0; i < inf->num_locals + depth; i++) {
+    if (!values[i].lasting) {
+      values[i].type = TYPE_UNKNOWN;
+    }
+  }
+}
+
+// Applies the instruction at `i` to `values`, false if the stream does not
+// keep the stack balanced
+static bool transfer(Inference *inf, size_t i, Value *values, size_t *depth) {
+  const FlowNode *node = &inf->flow.nodes[i];
+  Value *top = stack(inf, values) + *depth;
+
+  switch (generic_opcode(node->op)) {
+  case OP_CONSTANT:
+    push(inf, values, depth, known(constant_type(inf, node->pos)));
+    return true;
+  case OP_TRUE:
+  case OP_FALSE:
+    push(inf, values, depth, known(TYPE_BOOLEAN));
+    return true;
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_LSHIFT:
+  case OP_RSHIFT:
+  case OP_BIT_OR:
+  case OP_BIT_AND:
+  case OP_BIT_XOR:
+    if (!pop(inf, node, values, depth, 2)) {
+      return false;
+    }
+    prove(values, top[-2], TYPE_NUMBER);
+    prove(values, top[-1], TYPE_NUMBER);
+    push(inf, values, depth, result_of(i, TYPE_NUMBER));
+    return true;
+  case OP_ADD: {
+    if (!pop(inf, node, values, depth, 2)) {
+      return false;
+    }
+
+    // Both operands are numbers or both are strings
+    Type type = top[-2].type != TYPE_UNKNOWN ? top[-2].type : top[-1].type;
+    prove(values, top[-2], type);
+    prove(values, top[-1], type);
+    push(inf, values, depth,
+         type == TYPE_UNKNOWN ? unknown : result_of(i, type));
+    return true;
+  }
+  case OP_AND:
+  case OP_OR:
+    if (!pop(inf, node, values, depth, 2)) {
+      return false;
+    }
+    prove(values, top[-2], TYPE_BOOLEAN);
+    prove(values, top[-1], TYPE_BOOLEAN);
+    push(inf, values, depth, known(TYPE_BOOLEAN));
+    return true;
+  case OP_EQ:
+  case OP_NOT_EQ:
+  case OP_GREATER:
+    // Operands of different types compare unequal instead of failing
+    if (!pop(inf, node, values, depth, 2)) {
+      return false;
+    }
+    push(inf, values, depth, known(TYPE_BOOLEAN));
+    return true;
+  case OP_MINUS:
+    if (!pop(inf, node, values, depth, 1)) {
+      return false;
+    }
+    prove(values, top[-1], TYPE_NUMBER);
+    push(inf, values, depth, known(TYPE_NUMBER));
+    return true;
+  case OP_BANG:
+    if (!pop(inf, node, values, depth, 1)) {
+      return false;
+    }
+    push(inf, values, depth, known(TYPE_BOOLEAN));
+    return true;
+  case OP_GET_LOCAL: {
+    uint8_t local = inf->ins->arr[node->pos + 1];
+    Value v = values[local];
+    v.local = local;
+    push(inf, values, depth, v);
+    return true;
+  }
+  case OP_SET_LOCAL:
+  case OP_SET_LOCAL_SCALAR:
+  case OP_SET_LOCAL_CAPTURED: {
+    if (!pop(inf, node, values, depth, 1)) {
+      return false;
+    }
+
+    uint8_t local = inf->ins->arr[node->pos + 1];
+    values[local] = top[-1];
+    values[local].local = -1;
+    values[local].result = -1;
+    for (size_t j = 0; j < *depth; j++) {
+      if (stack(inf, values)[j].local == local) {
+        stack(inf, values)[j].local = -1;
+      }
+    }
+    return true;
+  }
+  case OP_NULL:
+  case OP_GET_GLOBAL:
+  case OP_GET_FREE:
+  case OP_GET_BUILTIN:
+  case OP_CURRENT_CLOSURE:
+    push(inf, values, depth, unknown);
+    return true;
+  case OP_POP:
+  case OP_SET_GLOBAL:
+  case OP_JMP_IF_FALSE:
+  case OP_JMP_IF_TRUE:
+  case OP_RETURN_VALUE:
+    return pop(inf, node, values, depth, 1);
+  case OP_SET_FREE:
+  case OP_SET_FREE_SCALAR:
+  case OP_LOOP:
+    if (!pop(inf, node, values, depth, 1)) {
+      return false;
+    }
+    forget_passing_facts(inf, values, *depth);
+    return true;
+  case OP_CALL:
+    if (!pop(inf, node, values, depth, inf->ins->arr[node->pos + 1] + 1)) {
+      return false;
+    }
+    forget_passing_facts(inf, values, *depth);
+    push(inf, values, depth, unknown);
+    return true;
+  case OP_ARRAY:
+  case OP_HASH:
+    if (!pop(inf, node, values, depth,
+             big_endian_read_uint16(inf->ins, node->pos + 1))) {
+      return false;
+    }
+    push(inf, values, depth, unknown);
+    return true;
+  case OP_CLOSURE:
+    if (!pop(inf, node, values, depth, inf->ins->arr[node->pos + 3])) {
+      return false;
+    }
+    push(inf, values, depth, unknown);
+    return true;
+  case OP_LEN:
+  case OP_FIRST:
+  case OP_LAST:
+    if (!pop(inf, node, values, depth, 1)) {
+      return false;
+    }
+    push(inf, values, depth, unknown);
+    return true;
+  case OP_PUSH:
+  case OP_INDEX:
+    if (!pop(inf, node, values, depth, 2)) {
+      return false;
+    }
+    push(inf, values, depth, unknown);
+    return true;
+  case OP_REASSIGN_INDEX:
+    if (!pop(inf, node, values, depth, 3)) {
+      return false;
+    }
+    push(inf, values, depth, unknown);
+    return true;
+  case OP_JMP:
+  case OP_RETURN:
+  case OP_CONTINUE:
+  case OP_BREAK:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Values coming from different instructions share nothing
+static bool merge(Inference *inf, Value *into, Value v) {
+  if (into->result != v.result) {
+    escape(inf, *into);
+    escape(inf, v);
+  }
+
+  Value merged = {
+      .type = into->type == v.type ? v.type : TYPE_UNKNOWN,
+      .lasting = into->lasting && v.lasting,
+      .local = into->local == v.local ? v.local : -1,
+      .result = into->result == v.result ? v.result : -1,
+  };
+  if (merged.type == TYPE_UNKNOWN) {
+    merged.lasting = false;
+  }
+
+  bool changed = merged.type != into->type ||
+                 merged.lasting != into->lasting ||
+                 merged.local != into->local ||
+                 merged.result != into->result;
+  *into = merged;
+  return changed;
+}
+
+// False if the stack is not as deep on every way into the instruction
+static bool flow_into(Inference *inf, size_t i, const Value *values,
+                      size_t depth) {
+  State *state = &inf->states[i];
+  size_t len = inf->num_locals + depth;
+
+  if (!state->reached) {
+    state->reached = true;
+    state->depth = depth;
+    state->values = malloc((len + 1) * sizeof(Value));
+    assert(state->values != NULL);
+    memcpy(state->values, values, len * sizeof(Value));
+    enqueue(inf, i);
+    return true;
+  }
+
+  if (state->depth != depth) {
+    return false;
+  }
+
+  bool changed = false;
+  for (size_t j = 0; j < len; j++) {
+    changed |= merge(inf, &state->values[j], values[j]);
+  }
+  if (changed) {
+    enqueue(inf, i);
+  }
+
+  return true;
+}
+
+static bool infer(Inference *inf) {
+  size_t max_depth = 0;
+  Value *values = malloc((inf->num_locals + 1) * sizeof(Value));
+  assert(values != NULL);
+
+  for (size_t j = 0; j < inf->num_locals; j++) {
+    values[j] = unknown;
+  }
+  bool ok = flow_into(inf, 0, values, 0);
+
+  while (ok && inf->worklist_len > 0) {
+    size_t i = inf->worklist[--inf->worklist_len];
+    inf->queued[i] = false;
+
+    State *state = &inf->states[i];
+    if (state->depth + 1 > max_depth) {
+      max_depth = state->depth + 1;
+      values = realloc(values, (inf->num_locals + max_depth) * sizeof(Value));
+      assert(values != NULL);
+    }
+
+    size_t depth = state->depth;
+    memcpy(values, state->values, (inf->num_locals + depth) * sizeof(Value));
+    ok = transfer(inf, i, values, &depth);
+
+    const FlowNode *node = &inf->flow.nodes[i];
+    for (size_t j = 0; ok && j < node->num_next; j++) {
+      ok = flow_into(inf, node->next[j], values, depth);
+    }
+  }
+
+  free(values);
+  return ok;
+}
+
+static void rewrite(Inference *inf, Instructions *ins) {
+  for (size_t i = 0; i < inf->flow.len; i++) {
+    const State *state = &inf->states[i];
+    OpCode op = inf->flow.nodes[i].op;
+    if (!state->reached || state->depth < 2 ||
+        number_opcode(op) == OP_COUNT) {
+      continue;
+    }
+
+    const Value *top = state->values + inf->num_locals + state->depth;
+    Type left = top[-2].type;
+    Type right = top[-1].type;
+
+    bool compares = op == OP_EQ || op == OP_NOT_EQ || op == OP_GREATER;
+    if (left == TYPE_NUMBER && right == TYPE_NUMBER &&
+        (compares || !inf->escapes[i])) {
+      ins->arr[inf->flow.nodes[i].pos] = number_opcode(op);
+    } else if (op == OP_ADD && left == TYPE_STRING && right == TYPE_STRING) {
+      ins->arr[inf->flow.nodes[i].pos] = OP_ADD_STRING;
+    }
+  }
+}
+
+void specialize_types(Instructions *ins, const DynamicArray *constants,
+                      size_t num_locals) {
+  if (ins->len == 0) {
+    return;
+  }
+
+  Inference inf = {
+      .ins = ins,
+      .constants = constants,
+      .flow = build_flow_graph(ins),
+      .num_locals = num_locals,
+  };
+  if (captures_locals(&inf.flow, ins)) {
+    free_flow_graph(&inf.flow);
+    return;
+  }
+
+  inf.states = calloc(inf.flow.len, sizeof(State));
+  inf.worklist = malloc(inf.flow.len * sizeof(size_t));
+  inf.queued = calloc(inf.flow.len, sizeof(bool));
+  inf.escapes = calloc(inf.flow.len, sizeof(bool));
+  assert(inf.states != NULL && inf.worklist != NULL && inf.queued != NULL &&
+         inf.escapes != NULL);
+
+  if (infer(&inf)) {
+    rewrite(&inf, ins);
+  }
+
+  for (size_t i = 0; i < inf.flow.len; i++) {
+    free(inf.states[i].values);
+  }
+  free(inf.states);
+  free(inf.worklist);
+  free(inf.queued);
+  free(inf.escapes);
+  free_flow_graph(&inf.flow);
+}
@@ -0,0 +1,17 @@
+#ifndef TYPE_INFERENCE_H
+#define TYPE_INFERENCE_H
+
+#include "../code/code.h"
+#include "../dyn_array/dyn_array.h"
+#include <stddef.h>
+
+// Follows the types of the values on the stack and in the locals of one
+// instruction stream, and replaces the comparisons that always get two
+// numbers, the arithmetic operators that always get two numbers and whose
+// results are only ever copied, and the additions that always get two
+// strings, with their typed opcodes. Other operators keep the generic
+// opcodes. `constants` gives the types of OP_CONSTANT.
+void specialize_types(Instructions *, const DynamicArray *constants,
+                      size_t num_locals);
+
+#endif // TYPE_INFERENCE_H
@@ -90,5 +90,5 @@ void disassemble_file(const char *filename) {
   free(instructions_buf.buf);
   free(constants_buf.buf);
   int_array_free(&bt.instructions);
-  array_free(&bt.constants);
+  free_objects(&bt.constants);
 }
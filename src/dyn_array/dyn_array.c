@@ -3,7 +3,7 @@
 
 void array_append(DynamicArray *arr, void *value) {
   if (arr->cap == arr->len) {
-    arr->cap *= 2;
+    arr->cap = arr->cap ? arr->cap * 2 : 1;
     arr->arr = realloc(arr->arr, arr->cap * sizeof(void*));
   }
 
@@ -28,7 +28,7 @@ void array_free(DynamicArray *arr) {
 
 void int_array_append(IntArray *arr, int value) {
     if (arr->cap == arr->len) {
-        arr->cap *= 2;
+        arr->cap = arr->cap ? arr->cap * 2 : 1;
         arr->arr = realloc(arr->arr, arr->cap * sizeof(int));
     }
     
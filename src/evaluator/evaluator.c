@@ -1,5 +1,9 @@
 #include "./evaluator.h"
+#include "../object/array.h"
+#include "../object/bits.h"
 #include "../object/builtins.h"
+#include "../object/deque.h"
+#include "../object/heap.h"
 #include "../object/object.h"
 #include "../str_utils/str_utils.h"
 #include <assert.h>
@@ -17,20 +21,6 @@ bool is_error(Object *obj) {
   return false;
 }
 
-Boolean obj_true = {
-    .type = BOOLEAN_OBJ,
-    .value = true,
-};
-
-Boolean obj_false = {
-    .type = BOOLEAN_OBJ,
-    .value = false,
-};
-
-Null obj_null = {
-    .type = NULL_OBJ,
-};
-
 Object *native_bool_to_boolean_object(bool condition) {
   if (condition) {
     return (Object *)&obj_true;
@@ -115,13 +105,7 @@ Object *eval_minus_operator_expression(Object *right) {
 
   Number *intt = (Number *)right;
 
-  Number *new_int = malloc(sizeof(Number));
-  assert(new_int != NULL && "error allocating memory for new integer");
-
-  new_int->type = NUMBER_OBJ;
-  new_int->value = -intt->value;
-
-  return (Object *)new_int;
+  return new_number(-intt->value);
 }
 
 Object *eval_integer_boolean_operation(Object *left_obj, char *operator,
@@ -150,10 +134,7 @@ Object *eval_integer_boolean_operation(Object *left_obj, char *operator,
 
 Object *eval_integer_infix_expression(Object *left_obj, char *operator,
                                       Object * right_obj) {
-  Number *evaluated = malloc(sizeof(Number));
-  assert(evaluated != NULL && "error allocating memory for evaluated integer");
-
-  evaluated->type = NUMBER_OBJ;
+  Number *evaluated = (Number *)new_number(0);
   Number *left = (Number *)left_obj;
   Number *right = (Number *)right_obj;
 
@@ -178,7 +159,7 @@ Object *eval_integer_infix_expression(Object *left_obj, char *operator,
   } else if (strcmp(operator, "%") == 0) {
     evaluated->value = (long)left->value % (long)right->value;
   } else {
-    free(evaluated);
+    free_object((Object *)evaluated);
     return eval_integer_boolean_operation(left_obj, operator, right_obj);
   }
 
@@ -216,19 +197,27 @@ Object *eval_string_infix_expression(Object *left, char *operator,
   assert(left->type == STRING_OBJ && "left object should be string");
   assert(right->type == STRING_OBJ && "right object should be string");
 
-  if (strcmp(operator, "+") != 0) {
-    char error_message[255];
-    sprintf(error_message, "unknown operator: %s %s %s",
-            ObjectTypeString[left->type], operator,
-            ObjectTypeString[right->type]);
+  String *left_str = (String *)left;
+  String *right_str = (String *)right;
 
-    return new_error(error_message);
+  if (strcmp(operator, "+") == 0) {
+    return new_concatted_string(left_str, right_str);
   }
 
-  String *left_str = (String *)left;
-  String *right_str = (String *)right;
+  if (strcmp(operator, "==") == 0) {
+    return new_boolean(string_equals(left_str, right_str));
+  }
 
-  return new_concatted_string(left_str, right_str);
+  if (strcmp(operator, "!=") == 0) {
+    return new_boolean(!string_equals(left_str, right_str));
+  }
+
+  char error_message[255];
+  sprintf(error_message, "unknown operator: %s %s %s",
+          ObjectTypeString[left->type], operator,
+          ObjectTypeString[right->type]);
+
+  return new_error(error_message);
 }
 
 Object *eval_prefix_expression(PrefixExpression *expr, Environment *env) {
@@ -332,24 +321,24 @@ Object *eval_if_expression(IfExpression *expr, Environment *env) {
 }
 
 Object *eval_identifier(Identifier *ident, Environment *env) {
-  const Builtin *builtin = get_builtin_by_name(ident->value);
+  // Bindings shadow builtins, as they do in the compiler
+  Object *val = env_get(env, ident->value);
+  if (val != NULL) {
+    return val;
+  }
 
+  const Builtin *builtin = get_builtin_by_name(ident->value);
   if (builtin) {
     return (Object *)builtin;
   }
 
-  Object *val = env_get(env, ident->value);
-  if (val == NULL) {
-    char error_message[255];
-    sprintf(error_message, "undeclared identifier '%s'", ident->value);
-    return new_error(error_message);
-  }
-
-  return val;
+  char error_message[255];
+  sprintf(error_message, "undeclared identifier '%s'", ident->value);
+  return new_error(error_message);
 }
 
 Object *eval_function_literal(FunctionLiteral *lit, Environment *env) {
-  Function *fn = malloc(sizeof(Function));
+  Function *fn = heap_alloc(sizeof(Function));
   fn->type = FUNCTION_OBJ;
   fn->env = env;
 
@@ -367,7 +356,7 @@ DynamicArray eval_expressions(DynamicArray *expressions, Environment *env) {
     Object *evaluated_expression = eval_expression(expressions->arr[i], env);
 
     if (is_error(evaluated_expression)) {
-      array_free(&evaluated);
+      free_objects(&evaluated);
       array_init(&evaluated, 1);
       array_append(&evaluated, evaluated_expression);
       return evaluated;
@@ -436,10 +425,10 @@ Object *eval_function_call(CallExpression *call, Environment *env) {
   DynamicArray args = eval_expressions(&call->arguments, env);
   if (args.len == 1 && is_error(args.arr[0])) {
     free_object(fn);
-    Object *ret_value = malloc(sizeof(Object));
+    Object *ret_value = heap_alloc(sizeof(Object));
 
     memcpy(args.arr[0], ret_value, sizeof(Object));
-    array_free(&args);
+    free_objects(&args);
     return ret_value;
   }
 
@@ -447,21 +436,25 @@ Object *eval_function_call(CallExpression *call, Environment *env) {
 }
 
 Object *eval_array_literal(ArrayLiteral *literal, Environment *env) {
-  Array *array = malloc(sizeof(Array));
+  Array *array = (Array *)new_empty_array();
   assert(array != NULL && "Error allocating memory for array");
-  array_init(&array->elements, literal->elements->len);
 
   for (size_t i = 0; i < literal->elements->len; i++) {
     Object *evaluated = eval_expression(literal->elements->arr[i], env);
     if (is_error(evaluated)) {
-      array_free(&array->elements);
+      // Numbers are stored unboxed, there is nothing to free for them
+      for (size_t j = 0; array->kind == ARRAY_OBJECTS &&
+                         j < array->elements.len;
+           j++) {
+        free_object(vector_get(&array->elements, j));
+      }
+      free_object((Object *)array);
       return evaluated;
     }
 
-    array_append(&array->elements, evaluated);
+    array_push(array, evaluated);
   }
 
-  array->type = ARRAY_OBJ;
   return (Object *)array;
 }
 
@@ -482,11 +475,80 @@ Object *eval_array_indexing(Object *left, IndexExpression *idx,
   Array *evaluated_array = (Array *)left;
   Number *index = (Number *)evaluated_index;
 
-  if (index->value > evaluated_array->elements.len - 1 || index->value < 0) {
+  if (index->value >= evaluated_array->elements.len || index->value < 0) {
+    return (Object *)&obj_null;
+  }
+
+  return array_get(evaluated_array, index->value);
+}
+
+Object *eval_deque_indexing(Object *left, IndexExpression *idx,
+                            Environment *env) {
+  Object *evaluated_index = eval_expression(idx->index, env);
+
+  if (evaluated_index->type != NUMBER_OBJ) {
+    char error_msg[255];
+    sprintf(error_msg,
+            "attempting to index deque with non-integer index: got %s",
+            ObjectTypeString[evaluated_index->type]);
+
+    return new_error(error_msg);
+  }
+
+  Deque *deque = (Deque *)left;
+  Number *index = (Number *)evaluated_index;
+
+  if (index->value >= deque->len || index->value < 0) {
     return (Object *)&obj_null;
   }
 
-  return evaluated_array->elements.arr[(long)index->value];
+  return deque_get(deque, index->value);
+}
+
+Object *eval_float64_array_indexing(Object *left, IndexExpression *idx,
+                                    Environment *env) {
+  Object *evaluated_index = eval_expression(idx->index, env);
+
+  if (evaluated_index->type != NUMBER_OBJ) {
+    char error_msg[255];
+    sprintf(error_msg,
+            "attempting to index farray with non-integer index: got %s",
+            ObjectTypeString[evaluated_index->type]);
+
+    return new_error(error_msg);
+  }
+
+  Float64Array *array = (Float64Array *)left;
+  Number *index = (Number *)evaluated_index;
+
+  if (index->value >= array->len || index->value < 0) {
+    return (Object *)&obj_null;
+  }
+
+  return new_number(array->values[(size_t)index->value]);
+}
+
+Object *eval_bits_indexing(Object *left, IndexExpression *idx,
+                           Environment *env) {
+  Object *evaluated_index = eval_expression(idx->index, env);
+
+  if (evaluated_index->type != NUMBER_OBJ) {
+    char error_msg[255];
+    sprintf(error_msg,
+            "attempting to index bits with non-integer index: got %s",
+            ObjectTypeString[evaluated_index->type]);
+
+    return new_error(error_msg);
+  }
+
+  Bits *bits = (Bits *)left;
+  Number *index = (Number *)evaluated_index;
+
+  if (index->value >= bits->len || index->value < 0) {
+    return (Object *)&obj_null;
+  }
+
+  return new_boolean(bits_get(bits, index->value));
 }
 
 Object *eval_hash_indexing(Object *left, IndexExpression *idx,
@@ -496,8 +558,8 @@ Object *eval_hash_indexing(Object *left, IndexExpression *idx,
   assert(left->type == HASH_OBJ);
   Hash *hash_object = (Hash *)left;
 
-  int32_t key = get_hash_key(evaluated_index);
-  if (key == -1) {
+  uint64_t key;
+  if (!get_hash_key(evaluated_index, &key)) {
     char error_msg[255];
     sprintf(error_msg, "unusable as hash key: %s",
             ObjectTypeString[evaluated_index->type]);
@@ -505,12 +567,12 @@ Object *eval_hash_indexing(Object *left, IndexExpression *idx,
     return new_error(error_msg);
   }
 
-  HashPair *pair = hashmap_get(&hash_object->pairs, &key, sizeof(int32_t));
-  if (pair == NULL) {
+  Object *value = hash_get(hash_object, evaluated_index);
+  if (value == NULL) {
     return (Object *)&obj_null;
   }
 
-  return pair->value;
+  return value;
 }
 
 Object *eval_index_expression(IndexExpression *idx, Environment *env) {
@@ -519,6 +581,12 @@ Object *eval_index_expression(IndexExpression *idx, Environment *env) {
   switch (left->type) {
   case ARRAY_OBJ:
     return eval_array_indexing(left, idx, env);
+  case DEQUE_OBJ:
+    return eval_deque_indexing(left, idx, env);
+  case FLOAT64_ARRAY_OBJ:
+    return eval_float64_array_indexing(left, idx, env);
+  case BITS_OBJ:
+    return eval_bits_indexing(left, idx, env);
   case HASH_OBJ:
     return eval_hash_indexing(left, idx, env);
   default:
@@ -533,7 +601,7 @@ Object *eval_index_expression(IndexExpression *idx, Environment *env) {
 typedef struct {
   Object *error;
   Environment *env;
-  hashmap_t *evaluated_hash;
+  Hash *evaluated_hash;
 } hashEvaluationContext;
 
 int iter_eval_hash_literal(void *context, hashmap_element_t *pair) {
@@ -548,17 +616,13 @@ int iter_eval_hash_literal(void *context, hashmap_element_t *pair) {
     return 1;
   }
 
-  int32_t hash_key = get_hash_key(key);
-  if (hash_key == -1) {
+  uint64_t hash_key;
+  if (!get_hash_key(key, &hash_key)) {
     char err_msg[255];
     sprintf(err_msg, "Unusable as hash key: %s", ObjectTypeString[key->type]);
     eval_context->error = new_error(err_msg);
     return 1;
   }
-  int32_t *hash_key_in_heap = malloc(sizeof(int32_t));
-  assert(hash_key_in_heap != NULL);
-
-  memcpy(hash_key_in_heap, &hash_key, sizeof(int32_t));
 
   Object *value = eval_expression(value_node, eval_context->env);
   if (is_error(value)) {
@@ -566,44 +630,35 @@ int iter_eval_hash_literal(void *context, hashmap_element_t *pair) {
     return 1;
   }
 
-  HashPair *hash_pair = malloc(sizeof(HashPair));
-  assert(pair != NULL);
-  hash_pair->key = key;
-  hash_pair->value = value;
-
-  hashmap_put(eval_context->evaluated_hash, hash_key_in_heap, sizeof(int32_t),
-              hash_pair);
+  bool ok = hash_put(eval_context->evaluated_hash, key, value);
+  assert(ok);
 
   return 0;
 }
 
 Object *eval_hash_literal(HashLiteral *lit, Environment *env) {
-  Hash *hash = malloc(sizeof(Hash));
+  Hash *hash = (Hash *)new_hash(hashmap_num_entries(&lit->pairs));
   assert(hash != NULL);
 
-  hashmap_create(10, &hash->pairs);
-
   hashEvaluationContext context;
   context.error = NULL;
   context.env = env;
-  context.evaluated_hash = &hash->pairs;
+  context.evaluated_hash = hash;
 
   hashmap_iterate_pairs(&lit->pairs, &iter_eval_hash_literal, &context);
 
   if (context.error != NULL) {
-    hashmap_destroy(&hash->pairs);
-    free(hash);
+    free_object((Object *)hash);
 
     return context.error;
   }
 
-  hash->type = HASH_OBJ;
   return (Object *)hash;
 }
 
 Object *check_non_boolean_condition(Object *condition) {
   if (condition->type != BOOLEAN_OBJ) {
-    free(condition);
+    free_object(condition);
     char error_message[255];
     sprintf(error_message, "Loop condition should produce a boolean value");
     return new_error(error_message);
@@ -732,7 +787,7 @@ Object *eval_array_index_reassignment(Expression *index_expr, Object *new_value,
   // TODO: if reassigning to greater index, resize array and set previous values
   // to null.
   assert((size_t)index->value < arr->elements.len);
-  arr->elements.arr[(size_t)index->value] = new_value;
+  array_set(arr, index->value, new_value);
 
   return (Object *)arr;
 }
@@ -752,6 +807,74 @@ Object *unhandled_object_reassignment_error(ObjectType type) {
   return new_error(error_message);
 }
 
+Object *eval_float64_array_index_reassignment(Expression *index_expr,
+                                              Object *new_value,
+                                              Float64Array *array,
+                                              Environment *env) {
+  Object *index = eval_expression(index_expr, env);
+  if (is_error(index)) {
+    return index;
+  }
+
+  char error_message[255];
+  if (index->type != NUMBER_OBJ) {
+    sprintf(error_message,
+            "attempting to index farray with non-integer index: got %s",
+            ObjectTypeString[index->type]);
+    return new_error(error_message);
+  }
+
+  double i = ((Number *)index)->value;
+  if (i < 0 || i >= array->len) {
+    sprintf(error_message, "farray index out of range: %g", i);
+    return new_error(error_message);
+  }
+
+  if (new_value->type != NUMBER_OBJ) {
+    sprintf(error_message, "cannot store %s in farray",
+            ObjectTypeString[new_value->type]);
+    return new_error(error_message);
+  }
+
+  array->values[(size_t)i] = ((Number *)new_value)->value;
+
+  return (Object *)array;
+}
+
+Object *eval_bits_index_reassignment(Expression *index_expr,
+                                     Object *new_value, Bits *bits,
+                                     Environment *env) {
+  Object *index = eval_expression(index_expr, env);
+  if (is_error(index)) {
+    return index;
+  }
+
+  char error_message[255];
+  if (index->type != NUMBER_OBJ) {
+    sprintf(error_message,
+            "attempting to index bits with non-integer index: got %s",
+            ObjectTypeString[index->type]);
+    return new_error(error_message);
+  }
+
+  double i = ((Number *)index)->value;
+  if (i < 0 || i >= bits->len) {
+    sprintf(error_message, "bits index out of range: %g", i);
+    return new_error(error_message);
+  }
+
+  bool value;
+  if (!bit_value(new_value, &value)) {
+    sprintf(error_message, "cannot store %s in bits",
+            ObjectTypeString[new_value->type]);
+    return new_error(error_message);
+  }
+
+  bits_set(bits, i, value);
+
+  return (Object *)bits;
+}
+
 Object *eval_ident_index_reassignment(IndexExpression *index_expr,
                                       Object *new_value, Environment *env) {
   Identifier *ident = (Identifier *)index_expr->left;
@@ -767,6 +890,12 @@ Object *eval_ident_index_reassignment(IndexExpression *index_expr,
   case ARRAY_OBJ:
     return eval_array_index_reassignment(index_expr->index, new_value,
                                          (Array *)cur_value, env);
+  case FLOAT64_ARRAY_OBJ:
+    return eval_float64_array_index_reassignment(
+        index_expr->index, new_value, (Float64Array *)cur_value, env);
+  case BITS_OBJ:
+    return eval_bits_index_reassignment(index_expr->index, new_value,
+                                        (Bits *)cur_value, env);
   default:
     return unhandled_object_reassignment_error(cur_value->type);
   }
@@ -844,14 +973,14 @@ Object *eval_expression(Expression *expr, Environment *env) {
 }
 
 Object *eval_return_statement(Expression *expr, Environment *env) {
-  ReturnValue *ret = malloc(sizeof(ReturnValue));
+  ReturnValue *ret = heap_alloc(sizeof(ReturnValue));
   assert(ret != NULL && "error allocating memory for return value");
 
   ret->value = eval_expression(expr, env);
 
   if (is_error(ret->value)) {
     Object *err = ret->value;
-    free(ret);
+    heap_free(ret);
     return err;
   }
 
@@ -870,7 +999,7 @@ Object *eval_let_statement(Statement *stmt, Environment *env) {
 }
 
 Object *eval_continue_statement(Statement *stmt) {
-  Object *obj = malloc(sizeof(Object));
+  Object *obj = heap_alloc(sizeof(Object));
   assert(obj != NULL);
 
   obj->type = CONTINUE_OBJ;
@@ -879,7 +1008,7 @@ Object *eval_continue_statement(Statement *stmt) {
 }
 
 Object *eval_break_statement(Statement *stmt) {
-  Object *obj = malloc(sizeof(Object));
+  Object *obj = heap_alloc(sizeof(Object));
   assert(obj != NULL);
 
   obj->type = BREAK_OBJ;
@@ -1,4 +1,6 @@
 #include "../evaluator/evaluator.h"
+#include "../object/array.h"
+#include "../object/bits.h"
 #include "../unity/src/unity.h"
 #include "../unity/src/unity_internals.h"
 #include <stdint.h>
@@ -71,7 +73,7 @@ void test_eval_integer_expression(void) {
     Object *evaluated = test_eval(tests[i].input);
     test_number_object(evaluated, tests[i].expected);
 
-    free(evaluated);
+    free_object(evaluated);
   }
 }
 
@@ -343,6 +345,13 @@ void test_string_concatenation(void) {
   TEST_ASSERT_EQUAL_STRING(expected_string, str->value);
 }
 
+void test_string_comparison(void) {
+  test_boolean_object(test_eval("\"Hello\" == \"Hello\""), true);
+  test_boolean_object(test_eval("\"Hel\" + \"lo\" == \"Hello\""), true);
+  test_boolean_object(test_eval("\"Hello\" != \"World\""), true);
+  test_boolean_object(test_eval("\"Hello\" == \"World\""), false);
+}
+
 void test_builtin_len_function(void) {
   struct testCase {
     char *input;
@@ -382,9 +391,9 @@ void test_array_literals(void) {
 
   Array *arr = (Array *)evaluated;
 
-  test_number_object(arr->elements.arr[0], 1);
-  test_number_object(arr->elements.arr[1], 4);
-  test_number_object(arr->elements.arr[2], 6);
+  test_number_object(array_get(arr, 0), 1);
+  test_number_object(array_get(arr, 1), 4);
+  test_number_object(array_get(arr, 2), 6);
 }
 
 void test_array_indexing(void) {
@@ -471,17 +480,11 @@ void test_builtin_array_functions(void) {
   }
 }
 
-int iter_hash_literal_test(void *generated_map, hashmap_element_t *pair) {
-  hashmap_t *map = generated_map;
-
-  const int32_t *key = pair->key;
-
-  HashPair *value = hashmap_get(map, key, sizeof(int32_t));
+static void assert_hash_entry(Hash *hash, Object *key, long expected) {
+  Object *value = hash_get(hash, key);
   TEST_ASSERT_NOT_NULL(value);
 
-  test_number_object(value->value, *(long *)pair->data);
-
-  return 0;
+  test_number_object(value, expected);
 }
 
 void test_hash_literals(void) {
@@ -498,39 +501,19 @@ void test_hash_literals(void) {
   TEST_ASSERT_EQUAL(HASH_OBJ, evaluated->type);
 
   Hash *hash = (Hash *)evaluated;
-
-  hashmap_t expected_map;
-  hashmap_create(4, &expected_map);
+  TEST_ASSERT_EQUAL(4, hash->len);
 
   String one = {STRING_OBJ, "one", strlen("one")};
-  Object *one_obj = (Object *)&one;
-  int32_t one_key = get_hash_key(one_obj);
-  long one_val = 1;
-
-  hashmap_put(&expected_map, &one_key, sizeof(int32_t), &one_val);
+  assert_hash_entry(hash, (Object *)&one, 1);
 
   String two = {STRING_OBJ, "two", strlen("two")};
-  Object *two_obj = (Object *)&two;
-  int32_t two_key = get_hash_key(two_obj);
-  long two_val = 2;
-
-  hashmap_put(&expected_map, &two_key, sizeof(int32_t), &two_val);
+  assert_hash_entry(hash, (Object *)&two, 2);
 
   String three = {STRING_OBJ, "three", strlen("three")};
-  Object *three_obj = (Object *)&three;
-  int32_t three_key = get_hash_key(three_obj);
-  long three_val = 3;
-
-  hashmap_put(&expected_map, &three_key, sizeof(int32_t), &three_val);
+  assert_hash_entry(hash, (Object *)&three, 3);
 
   Number four = {NUMBER_OBJ, 4};
-  Object *four_obj = (Object *)&four;
-  int32_t four_key = get_hash_key(four_obj);
-  long four_val = 4;
-
-  hashmap_put(&expected_map, &four_key, sizeof(int32_t), &four_val);
-
-  hashmap_iterate_pairs(&expected_map, &iter_hash_literal_test, &hash->pairs);
+  assert_hash_entry(hash, (Object *)&four, 4);
 }
 
 void test_hash_index_expressions(void) {
@@ -675,9 +658,9 @@ void test_array_literal_index_reassignment(void) {
   Array *arr = (Array *)evaluated;
 
   TEST_ASSERT_EQUAL(3, arr->elements.len);
-  test_number_object(arr->elements.arr[0], 1);
-  test_number_object(arr->elements.arr[1], 1);
-  test_number_object(arr->elements.arr[2], 3);
+  test_number_object(array_get(arr, 0), 1);
+  test_number_object(array_get(arr, 1), 1);
+  test_number_object(array_get(arr, 2), 3);
 }
 
 void test_array_ident_index_reassignment(void) {
@@ -691,9 +674,53 @@ void test_array_ident_index_reassignment(void) {
   Array *arr = (Array *)evaluated;
 
   TEST_ASSERT_EQUAL(3, arr->elements.len);
-  test_number_object(arr->elements.arr[0], 1);
-  test_number_object(arr->elements.arr[1], 1);
-  test_number_object(arr->elements.arr[2], 3);
+  test_number_object(array_get(arr, 0), 1);
+  test_number_object(array_get(arr, 1), 1);
+  test_number_object(array_get(arr, 2), 3);
+}
+
+void test_float64_array_index_reassignment(void) {
+  char *input = "let a = farray(3); a[1] = 2.5; a[2] = a[1] * 2; a;";
+
+  Object *evaluated = test_eval(input);
+
+  fail_if_object_is_error(evaluated);
+  TEST_ASSERT_EQUAL(FLOAT64_ARRAY_OBJ, evaluated->type);
+
+  Float64Array *array = (Float64Array *)evaluated;
+
+  TEST_ASSERT_EQUAL(3, array->len);
+  TEST_ASSERT_EQUAL_FLOAT(0, array->values[0]);
+  TEST_ASSERT_EQUAL_FLOAT(2.5, array->values[1]);
+  TEST_ASSERT_EQUAL_FLOAT(5, array->values[2]);
+
+  Object *error = test_eval("let a = farray(3); a[0] = true;");
+  TEST_ASSERT_EQUAL(ERROR_OBJ, error->type);
+  TEST_ASSERT_EQUAL_STRING("cannot store BOOLEAN_OBJ in farray",
+                           ((Error *)error)->message);
+}
+
+void test_bits_index_reassignment(void) {
+  char *input = "let b = bits(70); b[1] = true; b[65] = 1; b[66] = 0; b;";
+
+  Object *evaluated = test_eval(input);
+
+  fail_if_object_is_error(evaluated);
+  TEST_ASSERT_EQUAL(BITS_OBJ, evaluated->type);
+
+  Bits *bits = (Bits *)evaluated;
+
+  TEST_ASSERT_EQUAL(70, bits->len);
+  TEST_ASSERT_FALSE(bits_get(bits, 0));
+  TEST_ASSERT_TRUE(bits_get(bits, 1));
+  TEST_ASSERT_TRUE(bits_get(bits, 65));
+  TEST_ASSERT_FALSE(bits_get(bits, 66));
+  TEST_ASSERT_EQUAL(2, bits_popcount(bits));
+
+  Object *error = test_eval("let b = bits(3); b[0] = \"x\";");
+  TEST_ASSERT_EQUAL(ERROR_OBJ, error->type);
+  TEST_ASSERT_EQUAL_STRING("cannot store STRING_OBJ in bits",
+                           ((Error *)error)->message);
 }
 
 int main() {
@@ -712,6 +739,7 @@ int main() {
   RUN_TEST(test_closures);
   RUN_TEST(test_string_literal);
   RUN_TEST(test_string_concatenation);
+  RUN_TEST(test_string_comparison);
   RUN_TEST(test_builtin_len_function);
   RUN_TEST(test_array_literals);
   RUN_TEST(test_array_indexing);
@@ -726,5 +754,7 @@ int main() {
   RUN_TEST(test_floats);
   RUN_TEST(test_array_literal_index_reassignment);
   RUN_TEST(test_array_ident_index_reassignment);
+  RUN_TEST(test_float64_array_index_reassignment);
+  RUN_TEST(test_bits_index_reassignment);
   return UNITY_END();
 }
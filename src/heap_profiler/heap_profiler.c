@@ -0,0 +1,114 @@
+#include "heap_profiler.h"
+#include <string.h>
+
+HeapProfile heap_profile = {
+    .enabled = false,
+    .site = HEAP_SITE_RUNTIME,
+};
+
+void heap_profile_enable(void) {
+  memset(&heap_profile, 0, sizeof(heap_profile));
+  heap_profile.site = HEAP_SITE_RUNTIME;
+  heap_profile.enabled = true;
+}
+
+static void count_alloc(HeapCounter *counter, size_t size) {
+  counter->allocations++;
+  counter->allocated_bytes += size;
+}
+
+static void count_free(HeapCounter *counter, size_t size) {
+  counter->frees++;
+  counter->freed_bytes += size;
+}
+
+// Sizes are shallow: only the object header struct is counted, so that the
+// allocation and the free of an object always account for the same bytes.
+// The counters per type are always kept, attributing allocations to sites
+// needs the VM to track the executing opcode and is left to profiling.
+void heap_profile_record_alloc(Object *obj) {
+  size_t size = sizeof_object(obj);
+  count_alloc(&heap_profile.by_type[obj->type], size);
+
+  if (heap_profile.enabled) {
+    count_alloc(&heap_profile.by_site[heap_profile.site], size);
+  }
+}
+
+void heap_profile_record_free(Object *obj) {
+  count_free(&heap_profile.by_type[obj->type], sizeof_object(obj));
+}
+
+HeapCounter heap_profile_totals(void) {
+  HeapCounter totals = {0};
+
+  for (size_t i = 0; i < OBJECT_TYPE_COUNT; i++) {
+    HeapCounter *counter = &heap_profile.by_type[i];
+    totals.allocations += counter->allocations;
+    totals.frees += counter->frees;
+    totals.allocated_bytes += counter->allocated_bytes;
+    totals.freed_bytes += counter->freed_bytes;
+  }
+
+  return totals;
+}
+
+size_t heap_counter_live_objects(const HeapCounter *counter) {
+  return counter->allocations - counter->frees;
+}
+
+size_t heap_counter_live_bytes(const HeapCounter *counter) {
+  return counter->allocated_bytes - counter->freed_bytes;
+}
+
+const char *heap_site_name(size_t site) {
+  if (site == HEAP_SITE_RUNTIME) {
+    return "<runtime>";
+  }
+
+  return lookup(site)->name;
+}
+
+void heap_profile_snapshot(FILE *out) {
+  fprintf(out, "Heap profile:\n-------------\n");
+  fprintf(out, "%-24s %12s %12s %12s %12s\n", "type", "allocs", "frees",
+          "live", "live bytes");
+
+  for (size_t i = 0; i < OBJECT_TYPE_COUNT; i++) {
+    HeapCounter *counter = &heap_profile.by_type[i];
+    if (counter->allocations == 0) {
+      continue;
+    }
+
+    fprintf(out, "%-24s %12zu %12zu %12zu %12zu\n", ObjectTypeString[i],
+            counter->allocations, counter->frees,
+            heap_counter_live_objects(counter),
+            heap_counter_live_bytes(counter));
+  }
+
+  HeapCounter totals = heap_profile_totals();
+  fprintf(out, "%-24s %12zu %12zu %12zu %12zu\n", "total", totals.allocations,
+          totals.frees, heap_counter_live_objects(&totals),
+          heap_counter_live_bytes(&totals));
+
+  fprintf(out, "-------------\n");
+  fprintf(out, "%-24s %12s %12s\n", "site", "allocs", "bytes");
+
+  for (size_t i = 0; i < HEAP_SITE_COUNT; i++) {
+    HeapCounter *counter = &heap_profile.by_site[i];
+    if (counter->allocations == 0) {
+      continue;
+    }
+
+    fprintf(out, "%-24s %12zu %12zu\n", heap_site_name(i),
+            counter->allocations, counter->allocated_bytes);
+  }
+
+  fprintf(out, "-------------\n");
+}
+
+void heap_profile_report(void) {
+  if (heap_profile.enabled) {
+    heap_profile_snapshot(stderr);
+  }
+}
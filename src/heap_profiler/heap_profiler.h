@@ -0,0 +1,46 @@
+#ifndef HEAP_PROFILER_H
+#define HEAP_PROFILER_H
+
+#include "../code/code.h"
+#include "../object/object.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+#define OBJECT_TYPE_COUNT (BITS_OBJ + 1)
+
+// Allocations made outside of the VM dispatch loop (compiler, evaluator,
+// loader) are attributed to this site.
+#define HEAP_SITE_RUNTIME OP_COUNT
+#define HEAP_SITE_COUNT (OP_COUNT + 1)
+
+typedef struct {
+  size_t allocations;
+  size_t frees;
+  size_t allocated_bytes;
+  size_t freed_bytes;
+} HeapCounter;
+
+// Allocations and frees are always counted per type. The counters per site
+// only fill up while profiling is enabled, and sites record no frees.
+typedef struct {
+  bool enabled;
+  int site; // OpCode currently executing, or HEAP_SITE_RUNTIME
+  HeapCounter by_type[OBJECT_TYPE_COUNT];
+  HeapCounter by_site[HEAP_SITE_COUNT];
+} HeapProfile;
+
+extern HeapProfile heap_profile;
+
+void heap_profile_enable(void);
+void heap_profile_record_alloc(Object *);
+void heap_profile_record_free(Object *);
+
+HeapCounter heap_profile_totals(void);
+size_t heap_counter_live_objects(const HeapCounter *);
+size_t heap_counter_live_bytes(const HeapCounter *);
+const char *heap_site_name(size_t);
+
+void heap_profile_snapshot(FILE *);
+void heap_profile_report(void);
+
+#endif // HEAP_PROFILER_H
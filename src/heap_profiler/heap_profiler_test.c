@@ -0,0 +1,98 @@
+#include "../object/builtins.h"
+#include "../unity/src/unity.h"
+#include "../unity/src/unity_internals.h"
+#include "heap_profiler.h"
+#include <string.h>
+
+void test_counts_allocations_by_type(void) {
+  heap_profile_enable();
+
+  Object *num = new_number(1.5);
+  Object *str = new_string("hello");
+  new_string("world");
+
+  HeapCounter *numbers = &heap_profile.by_type[NUMBER_OBJ];
+  HeapCounter *strings = &heap_profile.by_type[STRING_OBJ];
+  TEST_ASSERT_EQUAL(1, numbers->allocations);
+  TEST_ASSERT_EQUAL(2, strings->allocations);
+  TEST_ASSERT_EQUAL(2 * sizeof(String), heap_counter_live_bytes(strings));
+
+  free_object(num);
+  free_object(str);
+
+  TEST_ASSERT_EQUAL(0, heap_counter_live_objects(numbers));
+  TEST_ASSERT_EQUAL(1, heap_counter_live_objects(strings));
+  TEST_ASSERT_EQUAL(3, heap_profile_totals().allocations);
+  TEST_ASSERT_EQUAL(2, heap_profile_totals().frees);
+}
+
+void test_immortal_objects_are_not_counted(void) {
+  heap_profile_enable();
+
+  new_cached_number(1);
+  new_boolean(true);
+  new_null();
+  free_object(new_cached_number(1));
+
+  TEST_ASSERT_EQUAL(0, heap_profile_totals().allocations);
+  TEST_ASSERT_EQUAL(0, heap_profile_totals().frees);
+}
+
+void test_counts_allocations_by_site(void) {
+  heap_profile_enable();
+
+  heap_profile.site = OP_ADD;
+  new_number(100000);
+  heap_profile.site = HEAP_SITE_RUNTIME;
+  new_number(100000);
+
+  TEST_ASSERT_EQUAL(1, heap_profile.by_site[OP_ADD].allocations);
+  TEST_ASSERT_EQUAL(1, heap_profile.by_site[HEAP_SITE_RUNTIME].allocations);
+}
+
+static Object *stats_entry(Object *stats, char *name) {
+  String key = {.type = STRING_OBJ, .value = name, .len = strlen(name)};
+  return hash_get((Hash *)stats, (Object *)&key);
+}
+
+void test_heap_stats_builtin(void) {
+  heap_profile_enable();
+  heap_profile.enabled = false;
+
+  new_number(1.5);
+
+  DynamicArray args;
+  array_init(&args, 1);
+  Object *stats = get_builtin_by_name("heap_stats")->fn(args);
+
+  TEST_ASSERT_EQUAL(HASH_OBJ, stats->type);
+  Object *allocations = stats_entry(stats, "allocations");
+  TEST_ASSERT_NOT_NULL(allocations);
+  TEST_ASSERT_EQUAL(1, ((Number *)allocations)->value);
+  TEST_ASSERT_NOT_NULL(stats_entry(stats, "live_bytes"));
+  TEST_ASSERT_NULL(stats_entry(stats, "sites"));
+
+  heap_profile_enable();
+  heap_profile.site = OP_ADD;
+  new_number(100000);
+  heap_profile.site = HEAP_SITE_RUNTIME;
+
+  stats = get_builtin_by_name("heap_stats")->fn(args);
+  Object *sites = stats_entry(stats, "sites");
+  TEST_ASSERT_NOT_NULL(sites);
+  TEST_ASSERT_EQUAL(HASH_OBJ, sites->type);
+
+  Object *add = stats_entry(sites, "OP_ADD");
+  TEST_ASSERT_NOT_NULL(add);
+  TEST_ASSERT_EQUAL(1, ((Number *)add)->value);
+  free(args.arr);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_counts_allocations_by_type);
+  RUN_TEST(test_immortal_objects_are_not_counted);
+  RUN_TEST(test_counts_allocations_by_site);
+  RUN_TEST(test_heap_stats_builtin);
+  return UNITY_END();
+}
@@ -0,0 +1,72 @@
+#include "copy_propagation.h"
+
+// The value all the arguments of a phi but itself are, or NULL
+static IrValue *single_argument(IrValue *phi) {
+  IrValue *single = NULL;
+  for (size_t i = 0; i < phi->args.len; i++) {
+    IrValue *arg = ir_resolve(phi->args.arr[i]);
+    if (arg == phi) {
+      continue;
+    }
+    if (single != NULL && arg != single) {
+      return NULL;
+    }
+    single = arg;
+  }
+  return single;
+}
+
+// Removing one phi can make the phis using it redundant too
+static void replace_redundant_phis(IrFunction *fn) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < fn->blocks.len; i++) {
+      IrBlock *block = fn->blocks.arr[i];
+      for (size_t j = 0; j < block->phis.len; j++) {
+        IrValue *phi = block->phis.arr[j];
+        if (phi->kind != IR_PHI) {
+          continue;
+        }
+
+        IrValue *single = single_argument(phi);
+        if (single) {
+          ir_replace(phi, single);
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+static void resolve_args(IrValue *value) {
+  for (size_t i = 0; i < value->args.len; i++) {
+    value->args.arr[i] = ir_resolve(value->args.arr[i]);
+  }
+}
+
+// Keeps the values that are not copies, in order
+static void drop_copies(DynamicArray *values) {
+  size_t kept = 0;
+  for (size_t i = 0; i < values->len; i++) {
+    IrValue *value = values->arr[i];
+    if (value->kind != IR_COPY) {
+      resolve_args(value);
+      values->arr[kept++] = value;
+    }
+  }
+  values->len = kept;
+}
+
+void propagate_copies(IrFunction *fn) {
+  replace_redundant_phis(fn);
+
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    IrBlock *block = fn->blocks.arr[i];
+    drop_copies(&block->phis);
+    drop_copies(&block->values);
+    if (block->terminated && block->exit.value) {
+      block->exit.value = ir_resolve(block->exit.value);
+    }
+  }
+}
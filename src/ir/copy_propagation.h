@@ -0,0 +1,11 @@
+#ifndef COPY_PROPAGATION_H
+#define COPY_PROPAGATION_H
+
+#include "ir.h"
+
+// Points every use of a copy at the value it copies and drops the copies.
+// A phi whose arguments are all one value, or the phi itself around a
+// loop, is a copy of that value too.
+void propagate_copies(IrFunction *);
+
+#endif // COPY_PROPAGATION_H
@@ -0,0 +1,119 @@
+#include "dead_values.h"
+#include <assert.h>
+#include <stdlib.h>
+
+static bool args_are(const IrValue *value, IrType type) {
+  for (size_t i = 0; i < value->args.len; i++) {
+    if (ir_resolve(value->args.arr[i])->type != type) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The VM fails on operands it has no operator for, and the modulo of a
+// division by zero traps
+static bool may_fail(const IrValue *value) {
+  switch (value->op) {
+  case OP_CONSTANT:
+  case OP_TRUE:
+  case OP_FALSE:
+  case OP_NULL:
+  case OP_GET_BUILTIN:
+  case OP_CURRENT_CLOSURE:
+  case OP_GET_FREE:
+  case OP_EQ:
+  case OP_NOT_EQ:
+  case OP_BANG:
+    return false;
+  case OP_ADD:
+    return !args_are(value, IR_TYPE_NUMBER) &&
+           !args_are(value, IR_TYPE_STRING);
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_LSHIFT:
+  case OP_RSHIFT:
+  case OP_BIT_AND:
+  case OP_BIT_OR:
+  case OP_BIT_XOR:
+  case OP_GREATER:
+  case OP_MINUS:
+    return !args_are(value, IR_TYPE_NUMBER);
+  case OP_AND:
+  case OP_OR:
+    return !args_are(value, IR_TYPE_BOOLEAN);
+  default:
+    return true;
+  }
+}
+
+static bool is_removable(const IrValue *value) {
+  switch (value->kind) {
+  case IR_PHI:
+  case IR_COPY:
+    return true;
+  case IR_OPERATION:
+    return !may_fail(value);
+  case IR_PARAMETER:
+    return false;
+  }
+
+  return false;
+}
+
+static void mark_live(IrValue *value, bool *live, DynamicArray *worklist) {
+  value = ir_resolve(value);
+  if (!live[value->id]) {
+    live[value->id] = true;
+    array_append(worklist, value);
+  }
+}
+
+static void keep_live(DynamicArray *values, const bool *live) {
+  size_t kept = 0;
+  for (size_t i = 0; i < values->len; i++) {
+    IrValue *value = values->arr[i];
+    if (live[value->id]) {
+      values->arr[kept++] = value;
+    }
+  }
+  values->len = kept;
+}
+
+void remove_dead_values(IrFunction *fn) {
+  bool *live = calloc(fn->values.len, sizeof(bool));
+  assert(live != NULL);
+
+  DynamicArray worklist;
+  array_init(&worklist, 32);
+
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    IrBlock *block = fn->blocks.arr[i];
+    for (size_t j = 0; j < block->values.len; j++) {
+      IrValue *value = block->values.arr[j];
+      if (!is_removable(value)) {
+        mark_live(value, live, &worklist);
+      }
+    }
+    if (block->terminated && block->exit.value) {
+      mark_live(block->exit.value, live, &worklist);
+    }
+  }
+
+  while (worklist.len > 0) {
+    IrValue *value = worklist.arr[--worklist.len];
+    for (size_t i = 0; i < value->args.len; i++) {
+      mark_live(value->args.arr[i], live, &worklist);
+    }
+  }
+
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    IrBlock *block = fn->blocks.arr[i];
+    keep_live(&block->phis, live);
+    keep_live(&block->values, live);
+  }
+
+  free(worklist.arr);
+  free(live);
+}
@@ -0,0 +1,12 @@
+#ifndef DEAD_VALUES_H
+#define DEAD_VALUES_H
+
+#include "ir.h"
+
+// Removes the values nothing uses that can go without changing what the
+// function does: phis, constants and the pure operations whose argument
+// types say they cannot fail, see propagate_types. An operation that may
+// fail stays, since the error it stops the program with is observable.
+void remove_dead_values(IrFunction *);
+
+#endif // DEAD_VALUES_H
@@ -0,0 +1,77 @@
+#include "gvn.h"
+#include <assert.h>
+#include <stdlib.h>
+
+typedef struct {
+  DynamicArray available; // IrValue*[], computed on the way to the block
+  DynamicArray *children; // IrBlock*[] per block, in the dominator tree
+} Numbering;
+
+static bool same_value(const IrValue *a, const IrValue *b) {
+  if (a->op != b->op || a->operand != b->operand ||
+      a->args.len != b->args.len) {
+    return false;
+  }
+
+  for (size_t i = 0; i < a->args.len; i++) {
+    if (ir_resolve(a->args.arr[i]) != ir_resolve(b->args.arr[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static IrValue *find_available(const Numbering *n, const IrValue *value) {
+  for (size_t i = n->available.len; i-- > 0;) {
+    if (same_value(n->available.arr[i], value)) {
+      return n->available.arr[i];
+    }
+  }
+  return NULL;
+}
+
+// Whatever a block computes is available in the blocks it dominates
+static void number_block(Numbering *n, IrBlock *block) {
+  size_t num_available = n->available.len;
+
+  for (size_t i = 0; i < block->values.len; i++) {
+    IrValue *value = block->values.arr[i];
+    if (!ir_is_pure(value)) {
+      continue;
+    }
+
+    IrValue *found = find_available(n, value);
+    if (found) {
+      ir_replace(value, found);
+    } else {
+      array_append(&n->available, value);
+    }
+  }
+
+  DynamicArray *children = &n->children[block->id];
+  for (size_t i = 0; i < children->len; i++) {
+    number_block(n, children->arr[i]);
+  }
+
+  n->available.len = num_available;
+}
+
+void number_values(IrFunction *fn) {
+  Numbering n;
+  array_init(&n.available, 32);
+  n.children = calloc(fn->blocks.len, sizeof(DynamicArray));
+  assert(n.children != NULL);
+
+  for (size_t i = 1; i < fn->blocks.len; i++) {
+    IrBlock *block = fn->blocks.arr[i];
+    array_append(&n.children[block->idom->id], block);
+  }
+
+  number_block(&n, fn->blocks.arr[0]);
+
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    free(n.children[i].arr);
+  }
+  free(n.children);
+  free(n.available.arr);
+}
@@ -0,0 +1,12 @@
+#ifndef GVN_H
+#define GVN_H
+
+#include "ir.h"
+
+// Global value numbering: a pure operation computing what another one that
+// dominates it already has, the same opcode on the same arguments, becomes
+// a copy of it. The copies are left to propagate_copies. Needs the
+// dominators, see ir_compute_dominators.
+void number_values(IrFunction *);
+
+#endif // GVN_H
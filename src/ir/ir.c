@@ -0,0 +1,523 @@
+#include "ir.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+  size_t variable;
+  IrValue *value;
+} IrDefinition;
+
+IrFunction *new_ir_function(size_t num_parameters) {
+  IrFunction *fn = malloc(sizeof(IrFunction));
+  assert(fn != NULL);
+
+  array_init(&fn->blocks, 8);
+  array_init(&fn->values, 32);
+  fn->num_parameters = num_parameters;
+
+  return fn;
+}
+
+static void free_block(IrBlock *block) {
+  free(block->phis.arr);
+  free(block->values.arr);
+  free(block->preds.arr);
+  array_free(&block->definitions);
+  free(block);
+}
+
+void free_ir_function(IrFunction *fn) {
+  for (size_t i = 0; i < fn->values.len; i++) {
+    IrValue *value = fn->values.arr[i];
+    free(value->args.arr);
+  }
+  array_free(&fn->values);
+
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    free_block(fn->blocks.arr[i]);
+  }
+  free(fn->blocks.arr);
+  free(fn);
+}
+
+IrBlock *ir_new_block(IrFunction *fn) {
+  IrBlock *block = calloc(1, sizeof(IrBlock));
+  assert(block != NULL);
+
+  block->id = fn->blocks.len;
+  array_init(&block->phis, 2);
+  array_init(&block->values, 8);
+  array_init(&block->preds, 2);
+  array_init(&block->definitions, 4);
+  array_append(&fn->blocks, block);
+
+  return block;
+}
+
+static IrValue *new_value(IrFunction *fn, IrKind kind, IrBlock *block) {
+  IrValue *value = calloc(1, sizeof(IrValue));
+  assert(value != NULL);
+
+  value->kind = kind;
+  value->block = block;
+  value->id = fn->values.len;
+  value->type = IR_TYPE_ANY;
+  array_init(&value->args, 2);
+  array_append(&fn->values, value);
+
+  return value;
+}
+
+IrValue *ir_append(IrFunction *fn, IrBlock *block, OpCode op, int operand,
+                   IrValue **args, size_t num_args) {
+  assert(!block->terminated);
+
+  IrValue *value = new_value(fn, IR_OPERATION, block);
+  value->op = op;
+  value->operand = operand;
+  for (size_t i = 0; i < num_args; i++) {
+    array_append(&value->args, args[i]);
+  }
+  array_append(&block->values, value);
+
+  return value;
+}
+
+IrValue *ir_constant(IrFunction *fn, IrBlock *block, size_t index,
+                     IrType type) {
+  IrValue *value = ir_append(fn, block, OP_CONSTANT, index, NULL, 0);
+  value->type = type;
+  return value;
+}
+
+IrValue *ir_parameter(IrFunction *fn, size_t index) {
+  IrValue *value = new_value(fn, IR_PARAMETER, fn->blocks.arr[0]);
+  value->operand = index;
+  return value;
+}
+
+static void terminate(IrBlock *block, IrExit exit) {
+  assert(!block->terminated);
+  block->exit = exit;
+  block->terminated = true;
+}
+
+void ir_jump(IrBlock *block, IrBlock *target) {
+  terminate(block, (IrExit){.kind = IR_JUMP, .targets = {target}});
+  array_append(&target->preds, block);
+}
+
+void ir_branch(IrBlock *block, IrValue *condition, IrBlock *consequence,
+               IrBlock *alternative) {
+  terminate(block, (IrExit){
+                       .kind = IR_BRANCH,
+                       .value = condition,
+                       .targets = {consequence, alternative},
+                   });
+  array_append(&consequence->preds, block);
+  array_append(&alternative->preds, block);
+}
+
+void ir_return(IrBlock *block, IrValue *value) {
+  terminate(block, (IrExit){.kind = IR_RETURN, .value = value});
+}
+
+size_t ir_num_successors(const IrBlock *block) {
+  if (!block->terminated) {
+    return 0;
+  }
+
+  switch (block->exit.kind) {
+  case IR_JUMP:
+    return 1;
+  case IR_BRANCH:
+    return 2;
+  case IR_RETURN:
+    return 0;
+  }
+
+  return 0;
+}
+
+IrBlock *ir_successor(const IrBlock *block, size_t i) {
+  assert(i < ir_num_successors(block));
+  return block->exit.targets[i];
+}
+
+void ir_write_variable(IrBlock *block, size_t variable, IrValue *value) {
+  for (size_t i = 0; i < block->definitions.len; i++) {
+    IrDefinition *def = block->definitions.arr[i];
+    if (def->variable == variable) {
+      def->value = value;
+      return;
+    }
+  }
+
+  IrDefinition *def = malloc(sizeof(IrDefinition));
+  assert(def != NULL);
+
+  *def = (IrDefinition){.variable = variable, .value = value};
+  array_append(&block->definitions, def);
+}
+
+static IrValue *new_phi(IrFunction *fn, IrBlock *block, size_t variable) {
+  IrValue *phi = new_value(fn, IR_PHI, block);
+  phi->operand = variable;
+  array_append(&block->phis, phi);
+  return phi;
+}
+
+static void add_phi_arguments(IrFunction *fn, IrValue *phi,
+                              IrValue *undefined) {
+  IrBlock *block = phi->block;
+  for (size_t i = 0; i < block->preds.len; i++) {
+    array_append(&phi->args, ir_read_variable(fn, block->preds.arr[i],
+                                              phi->operand, undefined));
+  }
+}
+
+IrValue *ir_read_variable(IrFunction *fn, IrBlock *block, size_t variable,
+                          IrValue *undefined) {
+  for (size_t i = 0; i < block->definitions.len; i++) {
+    IrDefinition *def = block->definitions.arr[i];
+    if (def->variable == variable) {
+      return def->value;
+    }
+  }
+
+  IrValue *value;
+  if (!block->sealed) {
+    value = new_phi(fn, block, variable);
+  } else if (block->preds.len == 0) {
+    value = undefined;
+  } else if (block->preds.len == 1) {
+    value = ir_read_variable(fn, block->preds.arr[0], variable, undefined);
+  } else {
+    // Defined before reading the predecessors, which may loop back here
+    IrValue *phi = new_phi(fn, block, variable);
+    ir_write_variable(block, variable, phi);
+    add_phi_arguments(fn, phi, undefined);
+    value = phi;
+  }
+
+  ir_write_variable(block, variable, value);
+  return value;
+}
+
+void ir_seal_block(IrFunction *fn, IrBlock *block, IrValue *undefined) {
+  assert(!block->sealed);
+
+  // Phis created before sealing are the ones without arguments yet
+  size_t num_phis = block->phis.len;
+  for (size_t i = 0; i < num_phis; i++) {
+    IrValue *phi = block->phis.arr[i];
+    if (phi->kind != IR_PHI || phi->args.len > 0) {
+      continue;
+    }
+
+    if (block->preds.len == 0) {
+      ir_replace(phi, undefined);
+    } else {
+      add_phi_arguments(fn, phi, undefined);
+    }
+  }
+
+  block->sealed = true;
+}
+
+IrValue *ir_resolve(IrValue *value) {
+  while (value->kind == IR_COPY) {
+    value = value->args.arr[0];
+  }
+  return value;
+}
+
+void ir_replace(IrValue *value, IrValue *replacement) {
+  replacement = ir_resolve(replacement);
+  if (replacement == value) {
+    return;
+  }
+
+  value->kind = IR_COPY;
+  value->args.len = 0;
+  array_append(&value->args, replacement);
+}
+
+// Reverse postorder, visiting the alternative of a branch before its
+// consequence so that the consequence comes right after the branch
+static void visit_postorder(IrBlock *block, bool *visited,
+                            DynamicArray *order) {
+  visited[block->id] = true;
+  for (size_t i = ir_num_successors(block); i-- > 0;) {
+    IrBlock *succ = ir_successor(block, i);
+    if (!visited[succ->id]) {
+      visit_postorder(succ, visited, order);
+    }
+  }
+  array_append(order, block);
+}
+
+static void drop_unreachable_blocks(IrFunction *fn, const bool *reachable) {
+  DynamicArray blocks;
+  array_init(&blocks, fn->blocks.len);
+
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    IrBlock *block = fn->blocks.arr[i];
+    if (!reachable[i]) {
+      continue;
+    }
+
+    size_t kept = 0;
+    for (size_t p = 0; p < block->preds.len; p++) {
+      IrBlock *pred = block->preds.arr[p];
+      if (!reachable[pred->id]) {
+        continue;
+      }
+
+      for (size_t j = 0; j < block->phis.len; j++) {
+        IrValue *phi = block->phis.arr[j];
+        if (phi->kind == IR_PHI) {
+          phi->args.arr[kept] = phi->args.arr[p];
+        }
+      }
+      block->preds.arr[kept++] = pred;
+    }
+
+    block->preds.len = kept;
+    for (size_t j = 0; j < block->phis.len; j++) {
+      IrValue *phi = block->phis.arr[j];
+      if (phi->kind == IR_PHI) {
+        phi->args.len = kept;
+      }
+    }
+
+    array_append(&blocks, block);
+  }
+
+  // Only now, the preds of the blocks kept may still point at them above
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    if (!reachable[i]) {
+      free_block(fn->blocks.arr[i]);
+    }
+  }
+  free(fn->blocks.arr);
+  fn->blocks = blocks;
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    ((IrBlock *)fn->blocks.arr[i])->id = i;
+  }
+}
+
+static IrBlock *intersect(IrBlock *a, IrBlock *b, const size_t *rpo_index) {
+  while (a != b) {
+    while (rpo_index[a->id] > rpo_index[b->id]) {
+      a = a->idom;
+    }
+    while (rpo_index[b->id] > rpo_index[a->id]) {
+      b = b->idom;
+    }
+  }
+  return a;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+void ir_compute_dominators(IrFunction *fn) {
+  bool *visited = calloc(fn->blocks.len, sizeof(bool));
+  assert(visited != NULL);
+
+  DynamicArray postorder;
+  array_init(&postorder, fn->blocks.len);
+  visit_postorder(fn->blocks.arr[0], visited, &postorder);
+  free(postorder.arr);
+
+  drop_unreachable_blocks(fn, visited);
+  free(visited);
+
+  // Numbered again, now that the unreachable blocks are gone
+  size_t num_blocks = fn->blocks.len;
+  bool *seen = calloc(num_blocks, sizeof(bool));
+  size_t *rpo_index = malloc(num_blocks * sizeof(size_t));
+  assert(seen != NULL && rpo_index != NULL);
+
+  array_init(&postorder, num_blocks);
+  visit_postorder(fn->blocks.arr[0], seen, &postorder);
+  for (size_t i = 0; i < num_blocks; i++) {
+    IrBlock *block = postorder.arr[num_blocks - 1 - i];
+    rpo_index[block->id] = i;
+    block->idom = NULL;
+  }
+
+  IrBlock *entry = fn->blocks.arr[0];
+  entry->idom = entry;
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = num_blocks - 1; i-- > 0;) {
+      IrBlock *block = postorder.arr[i];
+      IrBlock *idom = NULL;
+      for (size_t p = 0; p < block->preds.len; p++) {
+        IrBlock *pred = block->preds.arr[p];
+        if (pred->idom == NULL) {
+          continue;
+        }
+        idom = idom ? intersect(pred, idom, rpo_index) : pred;
+      }
+
+      if (block->idom != idom) {
+        block->idom = idom;
+        changed = true;
+      }
+    }
+  }
+
+  entry->idom = NULL;
+  free(postorder.arr);
+  free(rpo_index);
+  free(seen);
+}
+
+bool ir_dominates(const IrBlock *a, const IrBlock *b) {
+  for (; b != NULL; b = b->idom) {
+    if (a == b) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ir_is_pure(const IrValue *value) {
+  if (value->kind != IR_OPERATION) {
+    return false;
+  }
+
+  switch (value->op) {
+  case OP_CONSTANT:
+  case OP_TRUE:
+  case OP_FALSE:
+  case OP_NULL:
+  case OP_GET_BUILTIN:
+  case OP_CURRENT_CLOSURE:
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_LSHIFT:
+  case OP_RSHIFT:
+  case OP_BIT_AND:
+  case OP_BIT_OR:
+  case OP_BIT_XOR:
+  case OP_AND:
+  case OP_OR:
+  case OP_EQ:
+  case OP_NOT_EQ:
+  case OP_GREATER:
+  case OP_MINUS:
+  case OP_BANG:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool ir_is_constant(const IrValue *value) {
+  if (value->kind != IR_OPERATION) {
+    return false;
+  }
+
+  switch (value->op) {
+  case OP_CONSTANT:
+  case OP_TRUE:
+  case OP_FALSE:
+  case OP_NULL:
+  case OP_GET_BUILTIN:
+  case OP_CURRENT_CLOSURE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool ir_has_result(const IrValue *value) {
+  return value->kind != IR_OPERATION ||
+         (value->op != OP_SET_GLOBAL && value->op != OP_SET_FREE);
+}
+
+static void append_value(ResizableBuffer *buf, const IrValue *value) {
+  char str[32];
+  value = ir_resolve((IrValue *)value);
+  if (value->kind == IR_PARAMETER) {
+    snprintf(str, sizeof(str), " p%d", value->operand);
+  } else {
+    snprintf(str, sizeof(str), " v%zu", value->id);
+  }
+  append_to_buf(buf, str);
+}
+
+static void append_args(ResizableBuffer *buf, const IrValue *value) {
+  for (size_t i = 0; i < value->args.len; i++) {
+    append_value(buf, value->args.arr[i]);
+  }
+}
+
+void ir_to_string(ResizableBuffer *buf, const IrFunction *fn) {
+  char str[64];
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    IrBlock *block = fn->blocks.arr[i];
+    snprintf(str, sizeof(str), "b%zu:\n", block->id);
+    append_to_buf(buf, str);
+
+    for (size_t j = 0; j < block->phis.len; j++) {
+      IrValue *phi = block->phis.arr[j];
+      if (phi->kind != IR_PHI) {
+        continue;
+      }
+      snprintf(str, sizeof(str), "  v%zu = phi", phi->id);
+      append_to_buf(buf, str);
+      append_args(buf, phi);
+      append_to_buf(buf, "\n");
+    }
+
+    for (size_t j = 0; j < block->values.len; j++) {
+      IrValue *value = block->values.arr[j];
+      if (value->kind == IR_COPY) {
+        continue;
+      }
+      snprintf(str, sizeof(str), "  v%zu = %s", value->id,
+               lookup(value->op)->name);
+      append_to_buf(buf, str);
+      if (lookup(value->op)->operand_count > 0) {
+        snprintf(str, sizeof(str), " %d", value->operand);
+        append_to_buf(buf, str);
+      }
+      append_args(buf, value);
+      append_to_buf(buf, "\n");
+    }
+
+    if (!block->terminated) {
+      continue;
+    }
+
+    switch (block->exit.kind) {
+    case IR_JUMP:
+      snprintf(str, sizeof(str), "  jump b%zu\n", block->exit.targets[0]->id);
+      append_to_buf(buf, str);
+      break;
+    case IR_BRANCH:
+      append_to_buf(buf, "  branch");
+      append_value(buf, block->exit.value);
+      snprintf(str, sizeof(str), " b%zu b%zu\n", block->exit.targets[0]->id,
+               block->exit.targets[1]->id);
+      append_to_buf(buf, str);
+      break;
+    case IR_RETURN:
+      append_to_buf(buf, "  return");
+      if (block->exit.value) {
+        append_value(buf, block->exit.value);
+      }
+      append_to_buf(buf, "\n");
+      break;
+    }
+  }
+}
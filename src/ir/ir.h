@@ -0,0 +1,129 @@
+#ifndef IR_H
+#define IR_H
+
+#include "../code/code.h"
+#include "../dyn_array/dyn_array.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// An intermediate representation of one function between the AST and the
+// bytecode: basic blocks of instructions in SSA form, where every value is
+// defined once and a phi picks the value of a variable at the blocks control
+// flow joins at. Optimizations on it (see gvn.h, copy_propagation.h,
+// dead_values.h and type_propagation.h) run before it is lowered back to
+// the opcodes of code.h, see lowering.h.
+
+typedef enum {
+  IR_OPERATION, // `op` of code.h on the arguments, in order
+  IR_PARAMETER, // `operand` is its index, it arrives in that slot
+  IR_PHI,       // one argument per predecessor of the block, in order
+  IR_COPY,      // the value of its only argument
+} IrKind;
+
+// What propagate_types knows about the object a value holds at run time
+typedef enum {
+  IR_TYPE_NONE, // nothing reaches the value yet
+  IR_TYPE_NUMBER,
+  IR_TYPE_BOOLEAN,
+  IR_TYPE_STRING,
+  IR_TYPE_NULL,
+  IR_TYPE_ANY,
+} IrType;
+
+typedef struct IrValue {
+  IrKind kind;
+  OpCode op;
+  int operand; // of `op`, the parameter index, or the variable of a phi
+  DynamicArray args; // IrValue*[], not owned
+  struct IrBlock *block;
+  size_t id;   // index in IrFunction.values
+  IrType type; // see propagate_types, constants keep the one they get
+  // A phi of a local escape analysis found to only hold numbers of its own,
+  // whose slot the lowering may overwrite in place
+  bool scalar;
+} IrValue;
+
+typedef enum {
+  IR_JUMP,   // to targets[0]
+  IR_BRANCH, // to targets[0] when `value` is truthy, targets[1] otherwise
+  IR_RETURN, // `value`, or null when there is none
+} IrExitKind;
+
+typedef struct {
+  IrExitKind kind;
+  IrValue *value;
+  struct IrBlock *targets[2];
+} IrExit;
+
+typedef struct IrBlock {
+  size_t id; // index in IrFunction.blocks
+  DynamicArray phis;   // IrValue*[], not owned
+  DynamicArray values; // IrValue*[] in the order they run, not owned
+  DynamicArray preds;  // IrBlock*[], not owned
+  IrExit exit;
+  bool terminated;
+  // SSA construction, see ir_write_variable
+  bool sealed;
+  DynamicArray definitions; // IrDefinition*[]
+  struct IrBlock *idom;     // immediate dominator, NULL for the entry
+} IrBlock;
+
+typedef struct {
+  DynamicArray blocks; // IrBlock*[], blocks[0] is the entry
+  DynamicArray values; // IrValue*[], every value ever created
+  size_t num_parameters;
+} IrFunction;
+
+IrFunction *new_ir_function(size_t num_parameters);
+void free_ir_function(IrFunction *);
+
+IrBlock *ir_new_block(IrFunction *);
+// Appends an operation with `num_args` arguments to the block
+IrValue *ir_append(IrFunction *, IrBlock *, OpCode, int operand,
+                   IrValue **args, size_t num_args);
+// OP_CONSTANT loading the constant at `index` of the pool, of type `type`
+IrValue *ir_constant(IrFunction *, IrBlock *, size_t index, IrType type);
+IrValue *ir_parameter(IrFunction *, size_t index);
+
+void ir_jump(IrBlock *, IrBlock *target);
+void ir_branch(IrBlock *, IrValue *condition, IrBlock *consequence,
+               IrBlock *alternative);
+void ir_return(IrBlock *, IrValue *);
+
+size_t ir_num_successors(const IrBlock *);
+IrBlock *ir_successor(const IrBlock *, size_t);
+
+// SSA construction as described by Braun et al., "Simple and Efficient
+// Construction of Static Single Assignment Form". Variables are numbers
+// chosen by the caller. A block is sealed once all of its predecessors are
+// known, reads in a block that is not sealed yet get a phi whose arguments
+// are filled in when it is. Reading a variable no definition reaches gives
+// `undefined`.
+void ir_write_variable(IrBlock *, size_t variable, IrValue *);
+IrValue *ir_read_variable(IrFunction *, IrBlock *, size_t variable,
+                          IrValue *undefined);
+void ir_seal_block(IrFunction *, IrBlock *, IrValue *undefined);
+
+// The value a copy, or a chain of them, stands for
+IrValue *ir_resolve(IrValue *);
+// Turns `value` into a copy of `replacement`, which its uses get once copies
+// are propagated
+void ir_replace(IrValue *value, IrValue *replacement);
+
+// Drops the blocks the entry does not reach, along with the arguments phis
+// got from them, then sets the immediate dominator of every block. Passes
+// that look at dominators run after it.
+void ir_compute_dominators(IrFunction *);
+bool ir_dominates(const IrBlock *, const IrBlock *);
+
+// Operations that only depend on their arguments and change nothing. They
+// may still fail on arguments of the wrong type.
+bool ir_is_pure(const IrValue *);
+// Operations the lowering emits again wherever they are used instead of
+// keeping their value in a slot
+bool ir_is_constant(const IrValue *);
+bool ir_has_result(const IrValue *);
+
+void ir_to_string(ResizableBuffer *, const IrFunction *);
+
+#endif // IR_H
@@ -0,0 +1,311 @@
+#include "../unity/src/unity.h"
+#include "copy_propagation.h"
+#include "dead_values.h"
+#include "gvn.h"
+#include "ir.h"
+#include "lowering.h"
+#include "type_propagation.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof(a[0]))
+
+static IrValue *binary(IrFunction *fn, IrBlock *block, OpCode op,
+                       IrValue *left, IrValue *right) {
+  return ir_append(fn, block, op, 0, (IrValue *[]){left, right}, 2);
+}
+
+static void print_ir(const IrFunction *fn) {
+  ResizableBuffer buf;
+  init_resizable_buffer(&buf, 64);
+  ir_to_string(&buf, fn);
+  printf("%s\n", buf.buf);
+  free(buf.buf);
+}
+
+static void test_lowered(IrFunction *fn, Instruction *expected, size_t len,
+                         size_t expected_locals) {
+  Instructions concatted = concat_instructions(len, expected);
+  Instructions actual;
+  int_array_init(&actual, 16);
+
+  size_t num_locals;
+  TEST_ASSERT_TRUE(lower_ir_function(fn, &actual, &num_locals));
+
+  ResizableBuffer expected_buf;
+  init_resizable_buffer(&expected_buf, 64);
+  instructions_to_string(&expected_buf, &concatted);
+  ResizableBuffer actual_buf;
+  init_resizable_buffer(&actual_buf, 64);
+  instructions_to_string(&actual_buf, &actual);
+
+  TEST_ASSERT_EQUAL_STRING(expected_buf.buf, actual_buf.buf);
+  TEST_ASSERT_EQUAL(expected_locals, num_locals);
+
+  free(expected_buf.buf);
+  free(actual_buf.buf);
+  int_array_free(&concatted);
+  int_array_free(&actual);
+}
+
+// An addition in the entry is reused by the branch it dominates, but the
+// multiplications of the two branches are both kept
+void test_gvn(void) {
+  IrFunction *fn = new_ir_function(2);
+  IrBlock *entry = ir_new_block(fn);
+  IrBlock *consequence = ir_new_block(fn);
+  IrBlock *alternative = ir_new_block(fn);
+  IrValue *a = ir_parameter(fn, 0);
+  IrValue *b = ir_parameter(fn, 1);
+
+  IrValue *sum = binary(fn, entry, OP_ADD, a, b);
+  ir_branch(entry, a, consequence, alternative);
+  IrValue *again = binary(fn, consequence, OP_ADD, a, b);
+  IrValue *product = binary(fn, consequence, OP_MUL, again, b);
+  ir_return(consequence, product);
+  IrValue *other = binary(fn, alternative, OP_MUL, sum, b);
+  ir_return(alternative, other);
+
+  ir_compute_dominators(fn);
+  TEST_ASSERT_TRUE(ir_dominates(entry, consequence));
+  TEST_ASSERT_FALSE(ir_dominates(consequence, alternative));
+
+  number_values(fn);
+  propagate_copies(fn);
+
+  TEST_ASSERT_EQUAL_PTR(sum, ir_resolve(again));
+  TEST_ASSERT_EQUAL(1, consequence->values.len);
+  TEST_ASSERT_EQUAL_PTR(sum, ((IrValue *)product->args.arr[0]));
+  TEST_ASSERT_EQUAL(IR_OPERATION, other->kind);
+
+  free_ir_function(fn);
+}
+
+// A loop that never assigns the variable reads the value from before it
+void test_copy_propagation(void) {
+  IrFunction *fn = new_ir_function(1);
+  IrBlock *entry = ir_new_block(fn);
+  IrBlock *header = ir_new_block(fn);
+  IrBlock *body = ir_new_block(fn);
+  IrBlock *exit = ir_new_block(fn);
+  ir_seal_block(fn, entry, NULL);
+  IrValue *null = ir_append(fn, entry, OP_NULL, 0, NULL, 0);
+
+  IrValue *a = ir_parameter(fn, 0);
+  ir_write_variable(entry, 0, a);
+  ir_jump(entry, header);
+
+  IrValue *read = ir_read_variable(fn, header, 0, null);
+  TEST_ASSERT_EQUAL(IR_PHI, read->kind);
+  ir_branch(header, read, body, exit);
+  ir_seal_block(fn, body, null);
+  ir_jump(body, header);
+  ir_seal_block(fn, header, null);
+  ir_seal_block(fn, exit, null);
+  ir_return(exit, ir_read_variable(fn, exit, 0, null));
+  ir_compute_dominators(fn);
+
+  propagate_copies(fn);
+
+  TEST_ASSERT_EQUAL(0, header->phis.len);
+  TEST_ASSERT_EQUAL_PTR(a, header->exit.value);
+  TEST_ASSERT_EQUAL_PTR(a, exit->exit.value);
+
+  free_ir_function(fn);
+}
+
+// Numbers flow around the loop, a string joining them does not
+void test_type_propagation(void) {
+  IrFunction *fn = new_ir_function(0);
+  IrBlock *entry = ir_new_block(fn);
+  IrBlock *header = ir_new_block(fn);
+  IrBlock *body = ir_new_block(fn);
+  IrBlock *exit = ir_new_block(fn);
+  ir_seal_block(fn, entry, NULL);
+  IrValue *null = ir_append(fn, entry, OP_NULL, 0, NULL, 0);
+
+  ir_write_variable(entry, 0, ir_constant(fn, entry, 0, IR_TYPE_NUMBER));
+  ir_write_variable(entry, 1, ir_constant(fn, entry, 1, IR_TYPE_NUMBER));
+  ir_jump(entry, header);
+
+  IrValue *i = ir_read_variable(fn, header, 0, null);
+  IrValue *s = ir_read_variable(fn, header, 1, null);
+  ir_branch(header, i, body, exit);
+  ir_seal_block(fn, body, null);
+
+  IrValue *one = ir_constant(fn, body, 0, IR_TYPE_NUMBER);
+  ir_write_variable(body, 0, binary(fn, body, OP_ADD, i, one));
+  IrValue *text = ir_constant(fn, body, 2, IR_TYPE_STRING);
+  ir_write_variable(body, 1, binary(fn, body, OP_ADD, s, text));
+  ir_jump(body, header);
+  ir_seal_block(fn, header, null);
+  ir_seal_block(fn, exit, null);
+  ir_return(exit, NULL);
+  ir_compute_dominators(fn);
+
+  propagate_types(fn);
+
+  TEST_ASSERT_EQUAL(IR_TYPE_NUMBER, i->type);
+  TEST_ASSERT_EQUAL(IR_TYPE_ANY, s->type);
+  TEST_ASSERT_EQUAL(IR_TYPE_NULL, null->type);
+
+  free_ir_function(fn);
+}
+
+// Unused values go unless they may fail on what they get
+void test_dead_values(void) {
+  IrFunction *fn = new_ir_function(1);
+  IrBlock *entry = ir_new_block(fn);
+  IrValue *a = ir_parameter(fn, 0);
+  IrValue *two = ir_constant(fn, entry, 0, IR_TYPE_NUMBER);
+
+  IrValue *product = binary(fn, entry, OP_MUL, two, two);
+  IrValue *difference = binary(fn, entry, OP_SUB, a, two);
+  IrValue *comparison = binary(fn, entry, OP_EQ, a, two);
+  IrValue *remainder = binary(fn, entry, OP_MOD, two, two);
+  IrValue *returned = binary(fn, entry, OP_ADD, two, two);
+  ir_return(entry, returned);
+  ir_compute_dominators(fn);
+
+  propagate_types(fn);
+  remove_dead_values(fn);
+
+  IrValue *expected[] = {two, difference, remainder, returned};
+  if (entry->values.len != ARRAY_LEN(expected)) {
+    print_ir(fn);
+  }
+  TEST_ASSERT_EQUAL(ARRAY_LEN(expected), entry->values.len);
+  for (size_t i = 0; i < ARRAY_LEN(expected); i++) {
+    TEST_ASSERT_EQUAL_PTR(expected[i], entry->values.arr[i]);
+  }
+  (void)product;
+  (void)comparison;
+
+  free_ir_function(fn);
+}
+
+// Unreachable blocks are dropped along with what their phis got from them
+void test_unreachable_blocks(void) {
+  IrFunction *fn = new_ir_function(1);
+  IrBlock *entry = ir_new_block(fn);
+  IrBlock *dead = ir_new_block(fn);
+  IrBlock *join = ir_new_block(fn);
+  ir_seal_block(fn, entry, NULL);
+  ir_seal_block(fn, dead, NULL);
+  IrValue *null = ir_append(fn, entry, OP_NULL, 0, NULL, 0);
+
+  ir_write_variable(entry, 0, ir_parameter(fn, 0));
+  ir_jump(entry, join);
+  ir_write_variable(dead, 0, ir_append(fn, dead, OP_TRUE, 0, NULL, 0));
+  ir_jump(dead, join);
+  ir_seal_block(fn, join, null);
+
+  IrValue *phi = ir_read_variable(fn, join, 0, null);
+  TEST_ASSERT_EQUAL(2, phi->args.len);
+  ir_return(join, phi);
+
+  ir_compute_dominators(fn);
+
+  TEST_ASSERT_EQUAL(2, fn->blocks.len);
+  TEST_ASSERT_EQUAL(1, join->id);
+  TEST_ASSERT_EQUAL(1, join->preds.len);
+  TEST_ASSERT_EQUAL(1, phi->args.len);
+  TEST_ASSERT_EQUAL_PTR(entry, join->idom);
+
+  free_ir_function(fn);
+}
+
+// A value used once right after it is computed stays on the stack, one used
+// twice gets a slot
+void test_lowering(void) {
+  IrFunction *fn = new_ir_function(1);
+  IrBlock *entry = ir_new_block(fn);
+  IrValue *a = ir_parameter(fn, 0);
+  IrValue *two = ir_constant(fn, entry, 0, IR_TYPE_NUMBER);
+  IrValue *sum = binary(fn, entry, OP_ADD, a, two);
+  IrValue *square = binary(fn, entry, OP_MUL, sum, sum);
+  ir_return(entry, binary(fn, entry, OP_SUB, square, two));
+
+  Instruction expected[] = {
+      make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+      make_instruction(OP_CONSTANT, (int[]){0}, 1),
+      make_instruction(OP_ADD, (int[]){}, 0),
+      make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+      make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+      make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+      make_instruction(OP_MUL, (int[]){}, 0),
+      make_instruction(OP_CONSTANT, (int[]){0}, 1),
+      make_instruction(OP_SUB, (int[]){}, 0),
+      make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+  };
+  test_lowered(fn, expected, ARRAY_LEN(expected), 2);
+
+  free_ir_function(fn);
+}
+
+// The phi of a loop gets its value stored at the end of the entry and of
+// the body, the branch out of the loop needs no copies
+void test_lowering_loops(void) {
+  IrFunction *fn = new_ir_function(1);
+  IrBlock *entry = ir_new_block(fn);
+  IrBlock *header = ir_new_block(fn);
+  IrBlock *body = ir_new_block(fn);
+  IrBlock *exit = ir_new_block(fn);
+  ir_seal_block(fn, entry, NULL);
+  IrValue *null = ir_append(fn, entry, OP_NULL, 0, NULL, 0);
+
+  IrValue *n = ir_parameter(fn, 0);
+  ir_write_variable(entry, 1, ir_constant(fn, entry, 0, IR_TYPE_NUMBER));
+  ir_jump(entry, header);
+
+  IrValue *i = ir_read_variable(fn, header, 1, null);
+  ir_branch(header, binary(fn, header, OP_GREATER, n, i), body, exit);
+  ir_seal_block(fn, body, null);
+  IrValue *one = ir_constant(fn, body, 1, IR_TYPE_NUMBER);
+  ir_write_variable(body, 1, binary(fn, body, OP_ADD, i, one));
+  ir_jump(body, header);
+  ir_seal_block(fn, header, null);
+  ir_seal_block(fn, exit, null);
+  ir_return(exit, ir_read_variable(fn, exit, 1, null));
+  ir_compute_dominators(fn);
+
+  propagate_copies(fn);
+  remove_dead_values(fn);
+
+  Instruction expected[] = {
+      // 0000
+      make_instruction(OP_CONSTANT, (int[]){0}, 1),
+      make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+      make_instruction(OP_JMP, (int[]){8}, 1),
+      // 0008
+      make_instruction(OP_GET_LOCAL, (int[]){0}, 1),
+      make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+      make_instruction(OP_GREATER, (int[]){}, 0),
+      make_instruction(OP_JMP_IF_FALSE, (int[]){30}, 1),
+      make_instruction(OP_JMP, (int[]){19}, 1),
+      // 0019
+      make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+      make_instruction(OP_CONSTANT, (int[]){1}, 1),
+      make_instruction(OP_ADD, (int[]){}, 0),
+      make_instruction(OP_SET_LOCAL, (int[]){1}, 1),
+      make_instruction(OP_JMP, (int[]){8}, 1),
+      // 0030
+      make_instruction(OP_GET_LOCAL, (int[]){1}, 1),
+      make_instruction(OP_RETURN_VALUE, (int[]){}, 0),
+  };
+  test_lowered(fn, expected, ARRAY_LEN(expected), 2);
+
+  free_ir_function(fn);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_gvn);
+  RUN_TEST(test_copy_propagation);
+  RUN_TEST(test_type_propagation);
+  RUN_TEST(test_dead_values);
+  RUN_TEST(test_unreachable_blocks);
+  RUN_TEST(test_lowering);
+  RUN_TEST(test_lowering_loops);
+  return UNITY_END();
+}
@@ -0,0 +1,520 @@
+#include "lowering.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Instructions are numbered by their index in the values of their block, the
+// exit of a block comes after the last one. An instruction uses the values
+// of its arguments, an exit uses the value it branches on or returns, and a
+// jump the arguments its target's phis take from the block.
+
+typedef struct {
+  IrBlock *from;
+  IrBlock *to;
+} Edge;
+
+typedef struct {
+  const IrFunction *fn;
+  Instructions *out;
+  // By value id
+  size_t *uses;
+  IrBlock **user_block; // NULL for values used more than once or by a phi
+                        // the lowering copies arguments to on a branch
+  size_t *user_pos;
+  size_t *pos;
+  size_t *start; // of the instructions computing a value left on the stack
+  bool *on_stack;
+  bool *scalar; // phis that fresh numbers are stored in in place
+  int *slots;
+  size_t num_slots;
+  // Per instruction of the block being lowered, the values to load right
+  // before it. Loads are added last to first.
+  DynamicArray *loads;
+  DynamicArray pending; // IrValue*[], values waiting on the stack
+  IntArray labels;      // offset of each block, then of each edge
+  DynamicArray edges;   // Edge*[], branches to phis copied out of line
+  IntArray jumps;       // offsets of the jumps to patch
+  IntArray jump_labels;
+} Lowering;
+
+static size_t pred_index(const IrBlock *block, const IrBlock *pred) {
+  for (size_t i = 0; i < block->preds.len; i++) {
+    if (block->preds.arr[i] == pred) {
+      return i;
+    }
+  }
+  assert(0 && "not a predecessor");
+  return 0;
+}
+
+// The arguments the phis of `to` take on the edge from `from`, in order
+static void phi_args(const IrBlock *from, const IrBlock *to,
+                     DynamicArray *args) {
+  size_t pred = pred_index(to, from);
+  for (size_t i = 0; i < to->phis.len; i++) {
+    IrValue *phi = to->phis.arr[i];
+    if (phi->kind == IR_PHI) {
+      array_append(args, ir_resolve(phi->args.arr[pred]));
+    }
+  }
+}
+
+static bool has_phis(const IrBlock *block) {
+  for (size_t i = 0; i < block->phis.len; i++) {
+    if (((IrValue *)block->phis.arr[i])->kind == IR_PHI) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The values the instruction at `pos` takes from the stack, in order
+static void stack_args(const IrBlock *block, size_t pos, DynamicArray *args) {
+  args->len = 0;
+  if (pos < block->values.len) {
+    IrValue *value = block->values.arr[pos];
+    for (size_t i = 0; i < value->args.len; i++) {
+      array_append(args, ir_resolve(value->args.arr[i]));
+    }
+    return;
+  }
+
+  switch (block->exit.kind) {
+  case IR_JUMP:
+    phi_args(block, block->exit.targets[0], args);
+    break;
+  case IR_BRANCH:
+    array_append(args, ir_resolve(block->exit.value));
+    break;
+  case IR_RETURN:
+    if (block->exit.value) {
+      array_append(args, ir_resolve(block->exit.value));
+    }
+    break;
+  }
+}
+
+static bool is_instruction(const IrValue *value) {
+  return value->kind == IR_OPERATION && !ir_is_constant(value);
+}
+
+static void add_use(Lowering *l, IrValue *value, IrBlock *block, size_t pos) {
+  size_t id = value->id;
+  if (l->uses[id]++ == 0) {
+    l->user_block[id] = block;
+    l->user_pos[id] = pos;
+  } else {
+    l->user_block[id] = NULL;
+  }
+}
+
+static void count_uses(Lowering *l) {
+  DynamicArray args;
+  array_init(&args, 8);
+
+  for (size_t i = 0; i < l->fn->blocks.len; i++) {
+    IrBlock *block = l->fn->blocks.arr[i];
+    for (size_t pos = 0; pos <= block->values.len; pos++) {
+      if (pos < block->values.len) {
+        IrValue *value = block->values.arr[pos];
+        l->pos[value->id] = pos;
+        if (value->kind == IR_COPY) {
+          continue;
+        }
+      }
+
+      stack_args(block, pos, &args);
+      for (size_t j = 0; j < args.len; j++) {
+        add_use(l, args.arr[j], block, pos);
+      }
+    }
+
+    if (block->exit.kind == IR_BRANCH) {
+      for (size_t t = 0; t < 2; t++) {
+        args.len = 0;
+        phi_args(block, block->exit.targets[t], &args);
+        for (size_t j = 0; j < args.len; j++) {
+          add_use(l, args.arr[j], NULL, 0);
+        }
+      }
+    }
+  }
+
+  free(args.arr);
+}
+
+// Whether the value can wait on the stack for its only use
+static bool may_stay_on_stack(const Lowering *l, const IrValue *value) {
+  size_t id = value->id;
+  return is_instruction(value) && ir_has_result(value) && l->uses[id] == 1 &&
+         l->user_block[id] == value->block && l->user_pos[id] > l->pos[id];
+}
+
+// A number only the use at hand holds: OP_CONSTANT pushes a copy of the
+// constant, and arithmetic a new result
+static bool is_fresh_number(const Lowering *l, const IrValue *value) {
+  if (value->kind != IR_OPERATION) {
+    return false;
+  }
+
+  switch (value->op) {
+  case OP_CONSTANT:
+    return true;
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_LSHIFT:
+  case OP_RSHIFT:
+  case OP_BIT_AND:
+  case OP_BIT_OR:
+  case OP_BIT_XOR:
+  case OP_MINUS:
+    return l->uses[value->id] == 1;
+  default:
+    return false;
+  }
+}
+
+// A phi of a scalar local can be overwritten in place as long as whatever
+// its slot holds belongs to it alone: constants, fresh numbers and what
+// other such phis hold. Values that could be shared, as GVN shares one
+// result between two variables, rule the phi out.
+static void find_scalar_phis(Lowering *l) {
+  const DynamicArray *values = &l->fn->values;
+  for (size_t i = 0; i < values->len; i++) {
+    IrValue *value = values->arr[i];
+    l->scalar[i] = value->kind == IR_PHI && value->scalar;
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < values->len; i++) {
+      IrValue *phi = values->arr[i];
+      if (!l->scalar[i]) {
+        continue;
+      }
+
+      for (size_t j = 0; j < phi->args.len; j++) {
+        IrValue *arg = ir_resolve(phi->args.arr[j]);
+        if (!ir_is_constant(arg) && !is_fresh_number(l, arg) &&
+            !l->scalar[arg->id]) {
+          l->scalar[i] = false;
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+}
+
+static void remove_pending(Lowering *l, const IrValue *value) {
+  size_t kept = 0;
+  for (size_t i = 0; i < l->pending.len; i++) {
+    if (l->pending.arr[i] != value) {
+      l->pending.arr[kept++] = l->pending.arr[i];
+    }
+  }
+  l->pending.len = kept;
+}
+
+// Decides which arguments of the instruction at `pos` are taken from the
+// stack and where the others are loaded: right before the instructions
+// computing the next argument that is on the stack, so that the arguments
+// end up in order. Those instructions may start before an argument loaded
+// ahead of them is computed, then with `keep` false every argument is
+// loaded right before the instruction. Returns where the instructions
+// computing the arguments start, or SIZE_MAX when `keep` does not work out.
+static size_t place_args(Lowering *l, const IrBlock *block, size_t pos,
+                         const DynamicArray *args, bool keep, bool commit) {
+  size_t top = l->pending.len;
+  size_t start = pos;
+
+  for (size_t i = args->len; i-- > 0;) {
+    IrValue *arg = args->arr[i];
+    if (keep && top > 0 && l->pending.arr[top - 1] == arg &&
+        l->user_block[arg->id] == block && l->user_pos[arg->id] == pos) {
+      top--;
+      start = l->start[arg->id];
+      if (commit) {
+        l->on_stack[arg->id] = true;
+      }
+      continue;
+    }
+
+    if (is_instruction(arg) && arg->block == block &&
+        l->pos[arg->id] >= start) {
+      return SIZE_MAX;
+    }
+
+    if (commit) {
+      array_append(&l->loads[start], arg);
+    }
+  }
+
+  if (commit) {
+    l->pending.len = top;
+    for (size_t i = 0; i < args->len; i++) {
+      if (!l->on_stack[((IrValue *)args->arr[i])->id]) {
+        remove_pending(l, args->arr[i]);
+      }
+    }
+  }
+
+  return start;
+}
+
+static void plan_block(Lowering *l, IrBlock *block) {
+  DynamicArray args;
+  array_init(&args, 8);
+  l->pending.len = 0;
+
+  for (size_t pos = 0; pos <= block->values.len; pos++) {
+    IrValue *value = NULL;
+    if (pos < block->values.len) {
+      value = block->values.arr[pos];
+      if (!is_instruction(value)) {
+        continue;
+      }
+    }
+
+    stack_args(block, pos, &args);
+    bool keep = place_args(l, block, pos, &args, true, false) != SIZE_MAX;
+    size_t start = place_args(l, block, pos, &args, keep, true);
+
+    if (value && may_stay_on_stack(l, value)) {
+      l->start[value->id] = start;
+      array_append(&l->pending, value);
+    }
+  }
+
+  free(args.arr);
+}
+
+static size_t emit(Lowering *l, OpCode op, int operand) {
+  Instruction ins =
+      make_instruction(op, (int[]){operand}, lookup(op)->operand_count);
+  size_t position = l->out->len;
+  for (size_t i = 0; i < ins.len; i++) {
+    int_array_append(l->out, ins.arr[i]);
+  }
+  int_array_free(&ins);
+  return position;
+}
+
+static void emit_jump(Lowering *l, OpCode op, size_t label) {
+  int_array_append(&l->jumps, emit(l, op, 0));
+  int_array_append(&l->jump_labels, label);
+}
+
+static int slot(Lowering *l, const IrValue *value) {
+  if (value->kind == IR_PARAMETER) {
+    return value->operand;
+  }
+
+  if (l->slots[value->id] < 0) {
+    l->slots[value->id] = l->num_slots++;
+  }
+  return l->slots[value->id];
+}
+
+static void load(Lowering *l, const IrValue *value) {
+  if (ir_is_constant(value)) {
+    emit(l, value->op, value->operand);
+  } else {
+    emit(l, OP_GET_LOCAL, slot(l, value));
+  }
+}
+
+// Stores the arguments on the stack, `args`, in the phis of `to`
+static void store_phis(Lowering *l, const IrBlock *to,
+                       const DynamicArray *args) {
+  size_t arg = args->len;
+  for (size_t i = to->phis.len; i-- > 0;) {
+    IrValue *phi = to->phis.arr[i];
+    if (phi->kind != IR_PHI) {
+      continue;
+    }
+
+    IrValue *value = args->arr[--arg];
+    bool in_place = l->scalar[phi->id] && is_fresh_number(l, value);
+    emit(l, in_place ? OP_SET_LOCAL_SCALAR : OP_SET_LOCAL, slot(l, phi));
+  }
+}
+
+// The stack holds every argument before the first store, so phis reading
+// each other get the values from before the edge
+static void copy_phi_args(Lowering *l, IrBlock *from, IrBlock *to) {
+  DynamicArray args;
+  array_init(&args, 4);
+  phi_args(from, to, &args);
+  for (size_t i = 0; i < args.len; i++) {
+    load(l, args.arr[i]);
+  }
+  store_phis(l, to, &args);
+  free(args.arr);
+}
+
+// Branches to a block with phis go through their own copies of the
+// arguments, emitted after the blocks
+static size_t edge_label(Lowering *l, IrBlock *from, IrBlock *to) {
+  if (!has_phis(to)) {
+    return to->id;
+  }
+
+  Edge *edge = malloc(sizeof(Edge));
+  assert(edge != NULL);
+
+  *edge = (Edge){.from = from, .to = to};
+  array_append(&l->edges, edge);
+  return l->fn->blocks.len + l->edges.len - 1;
+}
+
+static void lower_exit(Lowering *l, IrBlock *block) {
+  switch (block->exit.kind) {
+  case IR_JUMP: {
+    DynamicArray args;
+    array_init(&args, 4);
+    phi_args(block, block->exit.targets[0], &args);
+    store_phis(l, block->exit.targets[0], &args);
+    free(args.arr);
+    emit_jump(l, OP_JMP, block->exit.targets[0]->id);
+    break;
+  }
+  case IR_BRANCH: {
+    IrBlock *consequence = block->exit.targets[0];
+    IrBlock *alternative = block->exit.targets[1];
+    emit_jump(l, OP_JMP_IF_FALSE, edge_label(l, block, alternative));
+    copy_phi_args(l, block, consequence);
+    emit_jump(l, OP_JMP, consequence->id);
+    break;
+  }
+  case IR_RETURN:
+    emit(l, block->exit.value ? OP_RETURN_VALUE : OP_RETURN, 0);
+    break;
+  }
+}
+
+static void lower_block(Lowering *l, IrBlock *block) {
+  size_t num_positions = block->values.len + 1;
+  l->loads = calloc(num_positions, sizeof(DynamicArray));
+  assert(l->loads != NULL);
+
+  plan_block(l, block);
+  l->labels.arr[block->id] = l->out->len;
+
+  for (size_t pos = 0; pos < num_positions; pos++) {
+    DynamicArray *loads = &l->loads[pos];
+    for (size_t i = loads->len; i-- > 0;) {
+      load(l, loads->arr[i]);
+    }
+    free(loads->arr);
+
+    if (pos == block->values.len) {
+      break;
+    }
+
+    IrValue *value = block->values.arr[pos];
+    if (!is_instruction(value)) {
+      continue;
+    }
+
+    emit(l, value->op, value->operand);
+    if (!ir_has_result(value) || l->on_stack[value->id]) {
+      continue;
+    }
+
+    if (l->uses[value->id] == 0) {
+      emit(l, OP_POP, 0);
+    } else {
+      emit(l, OP_SET_LOCAL, slot(l, value));
+    }
+  }
+
+  free(l->loads);
+  l->loads = NULL;
+  lower_exit(l, block);
+}
+
+static void patch_jumps(Lowering *l) {
+  for (size_t i = 0; i < l->jumps.len; i++) {
+    size_t position = l->jumps.arr[i];
+    OpCode op = l->out->arr[position];
+    Instruction ins = make_instruction(
+        op, (int[]){l->labels.arr[l->jump_labels.arr[i]]}, 1);
+    for (size_t j = 0; j < ins.len; j++) {
+      l->out->arr[position + j] = ins.arr[j];
+    }
+    int_array_free(&ins);
+  }
+}
+
+bool lower_ir_function(const IrFunction *fn, Instructions *out,
+                       size_t *num_locals) {
+  size_t num_values = fn->values.len;
+  Lowering l = {
+      .fn = fn,
+      .out = out,
+      .uses = calloc(num_values, sizeof(size_t)),
+      .user_block = calloc(num_values, sizeof(IrBlock *)),
+      .user_pos = calloc(num_values, sizeof(size_t)),
+      .pos = calloc(num_values, sizeof(size_t)),
+      .start = calloc(num_values, sizeof(size_t)),
+      .on_stack = calloc(num_values, sizeof(bool)),
+      .scalar = calloc(num_values, sizeof(bool)),
+      .slots = malloc(num_values * sizeof(int)),
+      .num_slots = fn->num_parameters,
+  };
+  assert(l.uses && l.user_block && l.user_pos && l.pos && l.start &&
+         l.on_stack && l.scalar && l.slots);
+
+  for (size_t i = 0; i < num_values; i++) {
+    l.slots[i] = -1;
+  }
+  array_init(&l.pending, 8);
+  array_init(&l.edges, 2);
+  int_array_init(&l.labels, fn->blocks.len);
+  l.labels.len = fn->blocks.len;
+  int_array_init(&l.jumps, 8);
+  int_array_init(&l.jump_labels, 8);
+
+  size_t start = out->len;
+  count_uses(&l);
+  find_scalar_phis(&l);
+  for (size_t i = 0; i < fn->blocks.len; i++) {
+    lower_block(&l, fn->blocks.arr[i]);
+  }
+
+  for (size_t i = 0; i < l.edges.len; i++) {
+    Edge *edge = l.edges.arr[i];
+    int_array_append(&l.labels, out->len);
+    copy_phi_args(&l, edge->from, edge->to);
+    emit_jump(&l, OP_JMP, edge->to->id);
+  }
+  patch_jumps(&l);
+
+  bool lowered = l.num_slots <= UINT8_MAX + 1;
+  if (lowered) {
+    *num_locals = l.num_slots;
+  } else {
+    out->len = start;
+  }
+
+  free(l.uses);
+  free(l.user_block);
+  free(l.user_pos);
+  free(l.pos);
+  free(l.start);
+  free(l.on_stack);
+  free(l.scalar);
+  free(l.slots);
+  free(l.pending.arr);
+  array_free(&l.edges);
+  int_array_free(&l.labels);
+  int_array_free(&l.jumps);
+  int_array_free(&l.jump_labels);
+
+  return lowered;
+}
@@ -0,0 +1,24 @@
+#ifndef LOWERING_H
+#define LOWERING_H
+
+#include "../code/code.h"
+#include "ir.h"
+#include <stdbool.h>
+
+// Emits the bytecode of a function in SSA form, with the blocks in the order
+// they were created. A value used once, later in its own block, is left on
+// the stack for its use when the uses between keep it on top; other values
+// are stored in slots of their own, which the slot packing pass shares out
+// afterwards. Parameters keep the slots they arrive in, and phis get the
+// values of their arguments stored in their slots at the end of each
+// predecessor. Constants are emitted again at each use. Phis of scalar locals
+// get fresh numbers with OP_SET_LOCAL_SCALAR, as long as nothing else can
+// hold what their slot does.
+//
+// Returns false, emitting nothing, when the function needs more slots than
+// OP_GET_LOCAL can address. Otherwise sets `num_locals` to the number of
+// slots the frame needs.
+bool lower_ir_function(const IrFunction *, Instructions *,
+                       size_t *num_locals);
+
+#endif // LOWERING_H
@@ -0,0 +1,111 @@
+#include "type_propagation.h"
+
+static IrType join(IrType a, IrType b) {
+  if (a == IR_TYPE_NONE) {
+    return b;
+  }
+  if (b == IR_TYPE_NONE || a == b) {
+    return a;
+  }
+  return IR_TYPE_ANY;
+}
+
+static IrType arg_type(const IrValue *value, size_t i) {
+  return ir_resolve(value->args.arr[i])->type;
+}
+
+static IrType addition_type(const IrValue *value) {
+  IrType left = arg_type(value, 0);
+  IrType right = arg_type(value, 1);
+  if (left == IR_TYPE_NONE || right == IR_TYPE_NONE) {
+    return IR_TYPE_NONE;
+  }
+
+  if (left == right &&
+      (left == IR_TYPE_NUMBER || left == IR_TYPE_STRING)) {
+    return left;
+  }
+  return IR_TYPE_ANY;
+}
+
+static IrType operation_type(const IrValue *value) {
+  switch (value->op) {
+  case OP_CONSTANT:
+    return value->type;
+  case OP_TRUE:
+  case OP_FALSE:
+  case OP_AND:
+  case OP_OR:
+  case OP_EQ:
+  case OP_NOT_EQ:
+  case OP_GREATER:
+  case OP_BANG:
+    return IR_TYPE_BOOLEAN;
+  case OP_NULL:
+    return IR_TYPE_NULL;
+  case OP_ADD:
+    return addition_type(value);
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_LSHIFT:
+  case OP_RSHIFT:
+  case OP_BIT_AND:
+  case OP_BIT_OR:
+  case OP_BIT_XOR:
+  case OP_MINUS:
+    return IR_TYPE_NUMBER;
+  default:
+    return IR_TYPE_ANY;
+  }
+}
+
+static IrType value_type(const IrValue *value) {
+  switch (value->kind) {
+  case IR_OPERATION:
+    return operation_type(value);
+  case IR_PHI: {
+    IrType type = IR_TYPE_NONE;
+    for (size_t i = 0; i < value->args.len; i++) {
+      type = join(type, arg_type(value, i));
+    }
+    return type;
+  }
+  case IR_COPY:
+    return arg_type(value, 0);
+  case IR_PARAMETER:
+    return IR_TYPE_ANY;
+  }
+
+  return IR_TYPE_ANY;
+}
+
+static bool update(IrValue *value) {
+  IrType type = value_type(value);
+  if (type == value->type) {
+    return false;
+  }
+
+  value->type = type;
+  return true;
+}
+
+// Types only go up from IR_TYPE_NONE, so this stops once the phis of every
+// loop agree with what comes back around it
+void propagate_types(IrFunction *fn) {
+  for (size_t i = 0; i < fn->values.len; i++) {
+    IrValue *value = fn->values.arr[i];
+    if (value->kind != IR_OPERATION || value->op != OP_CONSTANT) {
+      value->type = IR_TYPE_NONE;
+    }
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < fn->values.len; i++) {
+      changed |= update(fn->values.arr[i]);
+    }
+  }
+}
@@ -0,0 +1,12 @@
+#ifndef TYPE_PROPAGATION_H
+#define TYPE_PROPAGATION_H
+
+#include "ir.h"
+
+// Sets the type of every value to what it holds whenever it runs without
+// failing: arithmetic gives numbers, comparisons give booleans, an addition
+// of two strings gives a string, a phi the one type its arguments agree on.
+// Parameters, calls and loads are IR_TYPE_ANY.
+void propagate_types(IrFunction *);
+
+#endif // TYPE_PROPAGATION_H
@@ -1,9 +1,14 @@
 #include "file_reader/file_reader.h"
+#include "compiler/passes.h"
+#include "compiler/peephole.h"
+#include "heap_profiler/heap_profiler.h"
 #include "lexer/lexer.h"
 #include "parser/parser.h"
 #include "repl/repl.h"
 #include "vm/file_loader.h"
+#include "vm/vm.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "disassembler/disassembler.h"
 
@@ -14,6 +19,16 @@ void usage() {
   printf("  -c\t\t\tCompiles [input-file] and writes binary to [output-file]\n");
   printf("  -d\t\t\tDisassembles [input-file]\n");
   printf("  -h\t\t\tPrints this help message\n");
+  printf("  --heap-profile\t\tCounts allocations and prints a heap "
+         "snapshot on exit\n");
+  printf("  -O0 to -O3\t\tSelects the optimization passes the compiler "
+         "runs, -O3 by default\n");
+  printf("  --peephole-stats\tPrints how many instructions each peephole "
+         "pass removed on exit\n");
+  printf("  --pass-timings\tPrints the time spent in each optimization "
+         "pass on exit\n");
+  printf("  --heap-limit <bytes>\tFails with an out of memory error when the "
+         "VM heap grows past <bytes>\n");
 }
 
 ReplMode get_repl_mode(char *flag) {
@@ -37,6 +52,38 @@ ReplMode get_repl_mode(char *flag) {
 }
 
 int main(int argc, char **argv) {
+  while (argc > 1 && (strncmp(argv[1], "--", 2) == 0 ||
+                      strncmp(argv[1], "-O", 2) == 0)) {
+    if (strcmp(argv[1], "-O0") == 0 || strcmp(argv[1], "-O1") == 0 ||
+        strcmp(argv[1], "-O2") == 0 || strcmp(argv[1], "-O3") == 0) {
+      set_default_optimization_level(OPTIMIZATION_O0 + argv[1][2] - '0');
+      argc--;
+      argv++;
+    } else if (strcmp(argv[1], "--heap-profile") == 0) {
+      heap_profile_enable();
+      atexit(heap_profile_report);
+      argc--;
+      argv++;
+    } else if (strcmp(argv[1], "--peephole-stats") == 0) {
+      peephole_stats_enable();
+      atexit(peephole_stats_report);
+      argc--;
+      argv++;
+    } else if (strcmp(argv[1], "--pass-timings") == 0) {
+      pass_timings_enable();
+      atexit(pass_timings_report);
+      argc--;
+      argv++;
+    } else if (strcmp(argv[1], "--heap-limit") == 0 && argc > 2) {
+      set_default_heap_limit(strtoull(argv[2], NULL, 10));
+      argc -= 2;
+      argv += 2;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
   if (argc == 1) {
     start_repl(MODE_INTERPRET);
     return 0;
@@ -0,0 +1,82 @@
+#include "array.h"
+#include <string.h>
+
+// Vector slots are pointer sized, which is enough to hold a double
+_Static_assert(sizeof(void *) >= sizeof(double), "slots must fit a double");
+
+static void *pack_number(double value) {
+  void *slot;
+  memcpy(&slot, &value, sizeof(double));
+  return slot;
+}
+
+static double unpack_number(void *slot) {
+  double value;
+  memcpy(&value, &slot, sizeof(double));
+  return value;
+}
+
+double array_get_number(Array *array, size_t i) {
+  return unpack_number(vector_get(&array->elements, i));
+}
+
+Object *array_get(Array *array, size_t i) {
+  if (array->kind == ARRAY_NUMBERS) {
+    return new_cached_number(array_get_number(array, i));
+  }
+
+  return vector_get(&array->elements, i);
+}
+
+// Boxes every element into a new vector, the old nodes may still be shared
+// with other arrays.
+static bool to_objects(Array *array) {
+  Vector objects;
+  vector_init(&objects);
+
+  for (size_t i = 0; i < array->elements.len; i++) {
+    Object *boxed = array_get(array, i);
+    if (boxed == NULL || !vector_push(&objects, boxed)) {
+      return false;
+    }
+  }
+
+  array->elements = objects;
+  array->kind = ARRAY_OBJECTS;
+  return true;
+}
+
+// Returns the slot contents for `value`, changing the kind of the array
+// first if it cannot hold it.
+static bool to_slot(Array *array, Object *value, void **slot) {
+  if (array->kind == ARRAY_NUMBERS) {
+    if (value->type == NUMBER_OBJ) {
+      *slot = pack_number(((Number *)value)->value);
+      return true;
+    }
+
+    if (!to_objects(array)) {
+      return false;
+    }
+  }
+
+  *slot = value;
+  return true;
+}
+
+bool array_set(Array *array, size_t i, Object *value) {
+  void *slot;
+  return to_slot(array, value, &slot) &&
+         vector_set(&array->elements, i, slot);
+}
+
+bool array_push(Array *array, Object *value) {
+  void *slot;
+  return to_slot(array, value, &slot) && vector_push(&array->elements, slot);
+}
+
+bool array_unshift(Array *array, Object *value) {
+  void *slot;
+  return to_slot(array, value, &slot) &&
+         vector_unshift(&array->elements, slot);
+}
@@ -0,0 +1,21 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "object.h"
+#include <stdbool.h>
+
+// Arrays that only ever held numbers keep them unboxed, so reading an
+// element boxes it again (small integers come from the immortal cache).
+// Storing anything else turns the array into an array of objects for good.
+
+// Returns NULL when the number could not be boxed.
+Object *array_get(Array *, size_t);
+double array_get_number(Array *, size_t); // the array must hold numbers
+
+// Return false, leaving the elements unchanged, when the array could not
+// grow or change kinds.
+bool array_set(Array *, size_t, Object *);
+bool array_push(Array *, Object *);
+bool array_unshift(Array *, Object *);
+
+#endif // ARRAY_H
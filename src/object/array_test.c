@@ -0,0 +1,73 @@
+#include "../unity/src/unity.h"
+#include "../unity/src/unity_internals.h"
+#include "array.h"
+
+static Array *numbers(size_t len) {
+  Array *array = (Array *)new_empty_array();
+  for (size_t i = 0; i < len; i++) {
+    array_push(array, new_number(i + 0.5));
+  }
+  return array;
+}
+
+static void assert_number(double expected, Object *actual) {
+  TEST_ASSERT_EQUAL(NUMBER_OBJ, actual->type);
+  TEST_ASSERT_TRUE(expected == ((Number *)actual)->value);
+}
+
+void test_numbers_are_stored_unboxed(void) {
+  Array *array = numbers(100);
+  TEST_ASSERT_EQUAL(ARRAY_NUMBERS, array->kind);
+
+  Number *boxed = (Number *)new_number(7);
+  array_set(array, 3, (Object *)boxed);
+  boxed->value = 8; // the array keeps the value, not the object
+
+  TEST_ASSERT_EQUAL(ARRAY_NUMBERS, array->kind);
+  TEST_ASSERT_TRUE(array_get_number(array, 3) == 7);
+  assert_number(99.5, array_get(array, 99));
+}
+
+void test_storing_objects_boxes_the_elements(void) {
+  Array *array = numbers(100);
+  Array *shared = (Array *)new_shared_array(array);
+
+  array_unshift(array, new_string("first"));
+  TEST_ASSERT_EQUAL(ARRAY_OBJECTS, array->kind);
+  TEST_ASSERT_EQUAL(101, array->elements.len);
+  TEST_ASSERT_EQUAL(STRING_OBJ, array_get(array, 0)->type);
+  for (size_t i = 0; i < 100; i++) {
+    assert_number(i + 0.5, array_get(array, i + 1));
+  }
+
+  // Arrays sharing the old elements keep their kind
+  TEST_ASSERT_EQUAL(ARRAY_NUMBERS, shared->kind);
+  TEST_ASSERT_EQUAL(100, shared->elements.len);
+  assert_number(0.5, array_get(shared, 0));
+
+  // and so do the arrays derived from the new ones
+  Array *derived = (Array *)new_shared_array(array);
+  array_push(derived, new_number(1));
+  TEST_ASSERT_EQUAL(ARRAY_OBJECTS, derived->kind);
+  assert_number(1, array_get(derived, 101));
+}
+
+void test_new_array_picks_the_kind(void) {
+  Object *elements[] = {new_number(1), new_number(2), new_boolean(true)};
+
+  Array *all_numbers = (Array *)new_array(elements, 2);
+  TEST_ASSERT_EQUAL(ARRAY_NUMBERS, all_numbers->kind);
+
+  Array *mixed = (Array *)new_array(elements, 3);
+  TEST_ASSERT_EQUAL(ARRAY_OBJECTS, mixed->kind);
+  assert_number(2, array_get(mixed, 1));
+  TEST_ASSERT_EQUAL_PTR(elements[2], array_get(mixed, 2));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_numbers_are_stored_unboxed);
+  RUN_TEST(test_storing_objects_boxes_the_elements);
+  RUN_TEST(test_new_array_picks_the_kind);
+  return UNITY_END();
+}
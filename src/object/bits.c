@@ -0,0 +1,154 @@
+#include "bits.h"
+#include "../heap_profiler/heap_profiler.h"
+#include "heap.h"
+#include <string.h>
+
+#define WORD_BITS 64
+
+static size_t words_for(size_t len) {
+  return (len + WORD_BITS - 1) / WORD_BITS;
+}
+
+Object *new_bits(size_t len) {
+  Bits *bits = heap_alloc(sizeof(Bits));
+  if (bits == NULL) {
+    return NULL;
+  }
+
+  size_t num_words = words_for(len);
+  uint64_t *words = NULL;
+  if (num_words > 0) {
+    words = heap_alloc(num_words * sizeof(uint64_t));
+    if (words == NULL) {
+      heap_free(bits);
+      heap_release(sizeof(Bits));
+      return NULL;
+    }
+    memset(words, 0, num_words * sizeof(uint64_t));
+  }
+
+  *bits = (Bits){
+      .type = BITS_OBJ,
+      .words = words,
+      .len = len,
+  };
+  heap_profile_record_alloc((Object *)bits);
+
+  return (Object *)bits;
+}
+
+// Clears the bits of the last word that are past the end
+static void clear_tail(Bits *bits) {
+  size_t used = bits->len % WORD_BITS;
+  if (used > 0) {
+    bits->words[bits->len / WORD_BITS] &= (UINT64_C(1) << used) - 1;
+  }
+}
+
+bool bits_get(const Bits *bits, size_t i) {
+  return bits->words[i / WORD_BITS] >> (i % WORD_BITS) & 1;
+}
+
+void bits_set(Bits *bits, size_t i, bool value) {
+  uint64_t mask = UINT64_C(1) << (i % WORD_BITS);
+  if (value) {
+    bits->words[i / WORD_BITS] |= mask;
+  } else {
+    bits->words[i / WORD_BITS] &= ~mask;
+  }
+}
+
+bool bit_value(Object *obj, bool *value) {
+  switch (obj->type) {
+  case BOOLEAN_OBJ:
+    *value = ((Boolean *)obj)->value;
+    return true;
+  case NUMBER_OBJ:
+    *value = ((Number *)obj)->value != 0;
+    return true;
+  default:
+    return false;
+  }
+}
+
+size_t bits_popcount(const Bits *bits) {
+  size_t count = 0;
+  for (size_t i = 0; i < words_for(bits->len); i++) {
+    count += __builtin_popcountll(bits->words[i]);
+  }
+  return count;
+}
+
+void free_bits_words(Bits *bits) {
+  if (bits->words != NULL) {
+    heap_free(bits->words);
+    heap_release(words_for(bits->len) * sizeof(uint64_t));
+  }
+}
+
+// Walks from the last word down, so every source word is read before it is
+// overwritten when dst is src.
+void bits_shift_left(Bits *dst, const Bits *src, size_t n) {
+  size_t num_words = words_for(src->len);
+  size_t word_shift = n / WORD_BITS;
+  unsigned bit_shift = n % WORD_BITS;
+
+  for (size_t i = num_words; i-- > 0;) {
+    uint64_t word = 0;
+    if (i >= word_shift) {
+      size_t from = i - word_shift;
+      word = src->words[from] << bit_shift;
+      if (bit_shift > 0 && from > 0) {
+        word |= src->words[from - 1] >> (WORD_BITS - bit_shift);
+      }
+    }
+    dst->words[i] = word;
+  }
+
+  clear_tail(dst);
+}
+
+// Walks from the first word up, for the same reason as above.
+void bits_shift_right(Bits *dst, const Bits *src, size_t n) {
+  size_t num_words = words_for(src->len);
+  size_t word_shift = n / WORD_BITS;
+  unsigned bit_shift = n % WORD_BITS;
+
+  for (size_t i = 0; i < num_words; i++) {
+    uint64_t word = 0;
+    if (word_shift < num_words - i) {
+      size_t from = i + word_shift;
+      word = src->words[from] >> bit_shift;
+      if (bit_shift > 0 && from + 1 < num_words) {
+        word |= src->words[from + 1] << (WORD_BITS - bit_shift);
+      }
+    }
+    dst->words[i] = word;
+  }
+}
+
+void bits_and(Bits *dst, const Bits *a, const Bits *b) {
+  for (size_t i = 0; i < words_for(dst->len); i++) {
+    dst->words[i] = a->words[i] & b->words[i];
+  }
+}
+
+void bits_or(Bits *dst, const Bits *a, const Bits *b) {
+  for (size_t i = 0; i < words_for(dst->len); i++) {
+    dst->words[i] = a->words[i] | b->words[i];
+  }
+}
+
+void bits_xor(Bits *dst, const Bits *a, const Bits *b) {
+  for (size_t i = 0; i < words_for(dst->len); i++) {
+    dst->words[i] = a->words[i] ^ b->words[i];
+  }
+}
+
+void bits_not(Bits *dst, const Bits *src) {
+  for (size_t i = 0; i < words_for(dst->len); i++) {
+    dst->words[i] = ~src->words[i];
+  }
+
+  clear_tail(dst);
+}
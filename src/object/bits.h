@@ -0,0 +1,41 @@
+#ifndef BITS_H
+#define BITS_H
+
+#include "object.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bitsets are fixed-length and mutable, like deques they are updated in
+// place and shared by every variable referencing them. Bit i lives in word
+// i / 64 at position i % 64, and the bits past `len` in the last word are
+// always zero.
+
+// Returns a bitset with every bit cleared, NULL when it could not be
+// allocated.
+Object *new_bits(size_t len);
+
+bool bits_get(const Bits *, size_t);
+void bits_set(Bits *, size_t, bool);
+size_t bits_popcount(const Bits *);
+
+// Releases the words, but not the bitset itself.
+void free_bits_words(Bits *);
+
+// Reads the value of a bit from a boolean, or a number where only zero is
+// false. Returns false for any other object.
+bool bit_value(Object *, bool *value);
+
+// The operations below write into `dst`, which must have the same length as
+// the sources and may be one of them.
+
+// Bit i of dst is bit i - n of src, or i + n when shifting right. Bits
+// shifted past either end are dropped.
+void bits_shift_left(Bits *dst, const Bits *src, size_t n);
+void bits_shift_right(Bits *dst, const Bits *src, size_t n);
+
+void bits_and(Bits *dst, const Bits *, const Bits *);
+void bits_or(Bits *dst, const Bits *, const Bits *);
+void bits_xor(Bits *dst, const Bits *, const Bits *);
+void bits_not(Bits *dst, const Bits *);
+
+#endif // BITS_H
@@ -0,0 +1,141 @@
+#include "../unity/src/unity.h"
+#include "../unity/src/unity_internals.h"
+#include "bits.h"
+
+#define MODEL_MAX_LEN 200 // spans several words and partial last words
+
+static bool model[MODEL_MAX_LEN], expected[MODEL_MAX_LEN];
+
+// Fills both the bitset and the bool model with the same irregular pattern
+static Bits *pattern(size_t len) {
+  Bits *bits = (Bits *)new_bits(len);
+  for (size_t i = 0; i < len; i++) {
+    model[i] = (i * 7) % 5 < 2;
+    bits_set(bits, i, model[i]);
+  }
+  return bits;
+}
+
+static void assert_bits(const bool *want, const Bits *bits) {
+  size_t count = 0;
+  for (size_t i = 0; i < bits->len; i++) {
+    TEST_ASSERT_EQUAL(want[i], bits_get(bits, i));
+    count += want[i];
+  }
+  // also checks that nothing leaked past the last bit
+  TEST_ASSERT_EQUAL(count, bits_popcount(bits));
+}
+
+void test_new_bits_are_cleared(void) {
+  Bits *bits = (Bits *)new_bits(130);
+  TEST_ASSERT_EQUAL(BITS_OBJ, bits->type);
+  TEST_ASSERT_EQUAL(130, bits->len);
+  TEST_ASSERT_EQUAL(0, bits_popcount(bits));
+
+  Bits *empty = (Bits *)new_bits(0);
+  TEST_ASSERT_EQUAL(0, bits_popcount(empty));
+}
+
+void test_get_and_set(void) {
+  Bits *bits = pattern(MODEL_MAX_LEN);
+  assert_bits(model, bits);
+
+  bits_set(bits, 64, true);
+  bits_set(bits, 64, false);
+  bits_set(bits, 199, true);
+  model[64] = false;
+  model[199] = true;
+  assert_bits(model, bits);
+}
+
+void test_shifts(void) {
+  size_t lens[] = {1, 63, 64, 65, 130, MODEL_MAX_LEN};
+  size_t shifts[] = {0, 1, 5, 63, 64, 65, 129, 300};
+
+  for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+    size_t len = lens[l];
+    Bits *src = pattern(len);
+    Bits *dst = (Bits *)new_bits(len);
+
+    for (size_t s = 0; s < sizeof(shifts) / sizeof(shifts[0]); s++) {
+      size_t n = shifts[s];
+
+      bits_shift_left(dst, src, n);
+      for (size_t i = 0; i < len; i++) {
+        expected[i] = i >= n && model[i - n];
+      }
+      assert_bits(expected, dst);
+
+      bits_shift_right(dst, src, n);
+      for (size_t i = 0; i < len; i++) {
+        expected[i] = i + n < len && model[i + n];
+      }
+      assert_bits(expected, dst);
+    }
+
+    // Shifting in place gives the same result
+    bits_shift_left(src, src, 3);
+    for (size_t i = 0; i < len; i++) {
+      expected[i] = i >= 3 && model[i - 3];
+    }
+    assert_bits(expected, src);
+  }
+}
+
+void test_bitwise(void) {
+  size_t len = 131;
+  Bits *a = pattern(len);
+  Bits *b = (Bits *)new_bits(len);
+  bool b_model[MODEL_MAX_LEN];
+  for (size_t i = 0; i < len; i++) {
+    b_model[i] = i % 3 == 0;
+    bits_set(b, i, b_model[i]);
+  }
+  Bits *dst = (Bits *)new_bits(len);
+
+  bits_and(dst, a, b);
+  for (size_t i = 0; i < len; i++) {
+    expected[i] = model[i] && b_model[i];
+  }
+  assert_bits(expected, dst);
+
+  bits_or(dst, a, b);
+  for (size_t i = 0; i < len; i++) {
+    expected[i] = model[i] || b_model[i];
+  }
+  assert_bits(expected, dst);
+
+  bits_xor(dst, a, b);
+  for (size_t i = 0; i < len; i++) {
+    expected[i] = model[i] != b_model[i];
+  }
+  assert_bits(expected, dst);
+
+  bits_not(dst, a);
+  for (size_t i = 0; i < len; i++) {
+    expected[i] = !model[i];
+  }
+  assert_bits(expected, dst);
+}
+
+void test_bit_value(void) {
+  bool value;
+
+  TEST_ASSERT_TRUE(bit_value(new_boolean(true), &value));
+  TEST_ASSERT_TRUE(value);
+  TEST_ASSERT_TRUE(bit_value(new_number(0), &value));
+  TEST_ASSERT_FALSE(value);
+  TEST_ASSERT_TRUE(bit_value(new_number(2), &value));
+  TEST_ASSERT_TRUE(value);
+  TEST_ASSERT_FALSE(bit_value(new_null(), &value));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_new_bits_are_cleared);
+  RUN_TEST(test_get_and_set);
+  RUN_TEST(test_shifts);
+  RUN_TEST(test_bitwise);
+  RUN_TEST(test_bit_value);
+  return UNITY_END();
+}
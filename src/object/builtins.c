@@ -1,4 +1,9 @@
 #include "builtins.h"
+#include "../heap_profiler/heap_profiler.h"
+#include "array.h"
+#include "bits.h"
+#include "deque.h"
+#include "float64_array.h"
 #include "object.h"
 #include <assert.h>
 #include <string.h>
@@ -29,19 +34,18 @@ Object *unsupported_arg_error(Object *obj, ObjectType type, char *fn_name) {
   return NULL;
 }
 
-Object *len(DynamicArray args) {
-  Object *err = check_args_len(&args, 1);
-  if (err != NULL) {
-    return err;
-  }
-
-  Object *obj = args.arr[0];
-
+Object *builtin_len(Object *obj) {
   switch (obj->type) {
   case STRING_OBJ:
-    return new_number(((String *)obj)->len);
+    return new_cached_number(((String *)obj)->len);
   case ARRAY_OBJ:
-    return new_number(((Array *)obj)->elements.len);
+    return new_cached_number(((Array *)obj)->elements.len);
+  case DEQUE_OBJ:
+    return new_cached_number(((Deque *)obj)->len);
+  case FLOAT64_ARRAY_OBJ:
+    return new_cached_number(((Float64Array *)obj)->len);
+  case BITS_OBJ:
+    return new_cached_number(((Bits *)obj)->len);
   default:
     break;
   }
@@ -49,6 +53,15 @@ Object *len(DynamicArray args) {
   return unsupported_arg_error(obj, -1, "len");
 }
 
+Object *len(DynamicArray args) {
+  Object *err = check_args_len(&args, 1);
+  if (err != NULL) {
+    return err;
+  }
+
+  return builtin_len(args.arr[0]);
+}
+
 Object *builtin_puts(DynamicArray args) {
   if (args.len == 0) {
     char err_msg[255];
@@ -71,15 +84,8 @@ Object *builtin_puts(DynamicArray args) {
   return new_null();
 }
 
-Object *first(DynamicArray args) {
-  Object *err = check_args_len(&args, 1);
-  if (err != NULL) {
-    return err;
-  }
-
-  Object *arg = args.arr[0];
-
-  err = unsupported_arg_error(arg, ARRAY_OBJ, "first");
+Object *builtin_first(Object *arg) {
+  Object *err = unsupported_arg_error(arg, ARRAY_OBJ, "first");
   if (err != NULL) {
     return err;
   }
@@ -90,18 +96,20 @@ Object *first(DynamicArray args) {
     return new_null();
   }
 
-  return arr->elements.arr[0];
+  return array_get(arr, 0);
 }
 
-Object *last(DynamicArray args) {
+Object *first(DynamicArray args) {
   Object *err = check_args_len(&args, 1);
   if (err != NULL) {
     return err;
   }
 
-  Object *arg = args.arr[0];
+  return builtin_first(args.arr[0]);
+}
 
-  err = unsupported_arg_error(arg, ARRAY_OBJ, "last");
+Object *builtin_last(Object *arg) {
+  Object *err = unsupported_arg_error(arg, ARRAY_OBJ, "last");
   if (err != NULL) {
     return err;
   }
@@ -111,7 +119,16 @@ Object *last(DynamicArray args) {
     return new_null();
   }
 
-  return arr->elements.arr[arr->elements.len - 1];
+  return array_get(arr, arr->elements.len - 1);
+}
+
+Object *last(DynamicArray args) {
+  Object *err = check_args_len(&args, 1);
+  if (err != NULL) {
+    return err;
+  }
+
+  return builtin_last(args.arr[0]);
 }
 
 typedef enum {
@@ -119,79 +136,655 @@ typedef enum {
   APPEND_SHIFT,
 } AppendType;
 
+static Object *append(Object *old_arr_obj, Object *value, AppendType type) {
+  Object *err = unsupported_arg_error(old_arr_obj, ARRAY_OBJ, "push");
+  if (err != NULL) {
+    return err;
+  }
+
+  Array *new_arr = (Array *)new_shared_array((Array *)old_arr_obj);
+  if (new_arr == NULL) {
+    return NULL;
+  }
+
+  bool ok = type == APPEND_PUSH ? array_push(new_arr, value)
+                                : array_unshift(new_arr, value);
+  if (!ok) {
+    free_object((Object *)new_arr);
+    return NULL;
+  }
+
+  return (Object *)new_arr;
+}
+
 Object *builtin_append(const DynamicArray *args, AppendType type) {
   Object *err = check_args_len(args, 2);
   if (err != NULL) {
     return err;
   }
 
-  Object *old_arr_obj = args->arr[0];
-  size_t new_element_size = sizeof_object(args->arr[1]);
-  Object *new_element = malloc(new_element_size);
-  memcpy(new_element, args->arr[1], new_element_size);
+  return append(args->arr[0], args->arr[1], type);
+}
+
+Object *builtin_push(Object *arr, Object *value) {
+  return append(arr, value, APPEND_PUSH);
+}
+
+Object *push(DynamicArray args) { return builtin_append(&args, APPEND_PUSH); }
+
+Object *shift(DynamicArray args) { return builtin_append(&args, APPEND_SHIFT); }
 
-  err = unsupported_arg_error(old_arr_obj, ARRAY_OBJ, "push");
+Object *rest(DynamicArray args) {
+  Object *err = check_args_len(&args, 1);
   if (err != NULL) {
     return err;
   }
 
-  Array *old_arr = (Array *)args->arr[0];
+  Object *arg = args.arr[0];
+  Array *old_arr = (Array *)arg;
 
-  Array *new_arr = malloc(sizeof(Array));
-  assert(new_arr != NULL);
+  err = unsupported_arg_error(arg, ARRAY_OBJ, "rest");
+  if (err != NULL) {
+    return err;
+  }
 
-  new_arr->type = ARRAY_OBJ;
-  array_init(&new_arr->elements, old_arr->elements.len + 1);
+  if (old_arr->elements.len < 1) {
+    return new_null();
+  }
+
+  Array *new_arr = (Array *)new_shared_array(old_arr);
+  if (new_arr == NULL) {
+    return NULL;
+  }
+
+  vector_drop_first(&new_arr->elements);
+  return (Object *)new_arr;
+}
+
+static size_t clamp_index(double index, size_t len) {
+  if (index < 0) {
+    return 0;
+  }
+
+  return index > len ? len : index;
+}
+
+// slice(arr, start, end) returns the elements in [start, end) as a new array
+// sharing its storage with arr. Out of range bounds are clamped.
+Object *slice(DynamicArray args) {
+  Object *err = check_args_len(&args, 3);
+  if (err != NULL) {
+    return err;
+  }
 
-  if (type == APPEND_SHIFT) {
-    array_append(&new_arr->elements, args->arr[1]);
+  err = unsupported_arg_error(args.arr[0], ARRAY_OBJ, "slice");
+  if (err != NULL) {
+    return err;
   }
 
-  for (size_t i = 0; i < old_arr->elements.len; i++) {
-    array_append(&new_arr->elements, old_arr->elements.arr[i]);
+  for (size_t i = 1; i < 3; i++) {
+    err = unsupported_arg_error(args.arr[i], NUMBER_OBJ, "slice");
+    if (err != NULL) {
+      return err;
+    }
   }
 
-  if (type == APPEND_PUSH) {
-    array_append(&new_arr->elements, args->arr[1]);
+  Array *old_arr = args.arr[0];
+  size_t len = old_arr->elements.len;
+  size_t start = clamp_index(((Number *)args.arr[1])->value, len);
+  size_t end = clamp_index(((Number *)args.arr[2])->value, len);
+
+  Array *new_arr = (Array *)new_shared_array(old_arr);
+  if (new_arr == NULL) {
+    return NULL;
   }
 
+  vector_slice(&new_arr->elements, start, end);
   return (Object *)new_arr;
 }
 
-Object *push(DynamicArray args) { return builtin_append(&args, APPEND_PUSH); }
+Object *builtin_deque(DynamicArray args) {
+  Object *err = check_args_len(&args, 0);
+  if (err != NULL) {
+    return err;
+  }
 
-Object *shift(DynamicArray args) { return builtin_append(&args, APPEND_SHIFT); }
+  return new_deque();
+}
 
-Object *rest(DynamicArray args) {
+typedef enum {
+  DEQUE_FRONT,
+  DEQUE_BACK,
+} DequeEnd;
+
+// push_front(d, x) and push_back(d, x) add x to d and return d.
+Object *builtin_deque_push(const DynamicArray *args, DequeEnd end,
+                           char *fn_name) {
+  Object *err = check_args_len(args, 2);
+  if (err != NULL) {
+    return err;
+  }
+
+  err = unsupported_arg_error(args->arr[0], DEQUE_OBJ, fn_name);
+  if (err != NULL) {
+    return err;
+  }
+
+  Deque *deque = args->arr[0];
+  bool ok = end == DEQUE_FRONT ? deque_push_front(deque, args->arr[1])
+                               : deque_push_back(deque, args->arr[1]);
+  if (!ok) {
+    return NULL;
+  }
+
+  return (Object *)deque;
+}
+
+// pop_front(d) and pop_back(d) remove and return an element of d, or null
+// when d is empty.
+Object *builtin_deque_pop(const DynamicArray *args, DequeEnd end,
+                          char *fn_name) {
+  Object *err = check_args_len(args, 1);
+  if (err != NULL) {
+    return err;
+  }
+
+  err = unsupported_arg_error(args->arr[0], DEQUE_OBJ, fn_name);
+  if (err != NULL) {
+    return err;
+  }
+
+  Deque *deque = args->arr[0];
+  Object *value = end == DEQUE_FRONT ? deque_pop_front(deque)
+                                     : deque_pop_back(deque);
+  if (value == NULL) {
+    return new_null();
+  }
+
+  return value;
+}
+
+Object *push_front(DynamicArray args) {
+  return builtin_deque_push(&args, DEQUE_FRONT, "push_front");
+}
+
+Object *push_back(DynamicArray args) {
+  return builtin_deque_push(&args, DEQUE_BACK, "push_back");
+}
+
+Object *pop_front(DynamicArray args) {
+  return builtin_deque_pop(&args, DEQUE_FRONT, "pop_front");
+}
+
+Object *pop_back(DynamicArray args) {
+  return builtin_deque_pop(&args, DEQUE_BACK, "pop_back");
+}
+
+// farray(n) returns n zeros, farray(arr) copies an array of numbers.
+Object *builtin_farray(DynamicArray args) {
   Object *err = check_args_len(&args, 1);
   if (err != NULL) {
     return err;
   }
 
   Object *arg = args.arr[0];
-  Array *old_arr = (Array *)arg;
+  if (arg->type == NUMBER_OBJ) {
+    double len = ((Number *)arg)->value;
+    if (len < 0) {
+      return new_error("farray length must not be negative");
+    }
 
-  err = unsupported_arg_error(arg, ARRAY_OBJ, "rest");
+    return new_float64_array(len);
+  }
+
+  err = unsupported_arg_error(arg, ARRAY_OBJ, "farray");
   if (err != NULL) {
     return err;
   }
 
-  if (old_arr->elements.len < 1) {
+  Array *arr = (Array *)arg;
+  if (arr->kind != ARRAY_NUMBERS) {
+    return new_error("argument to 'farray' must only hold numbers");
+  }
+
+  Float64Array *result = (Float64Array *)new_float64_array(arr->elements.len);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < result->len; i++) {
+    result->values[i] = array_get_number(arr, i);
+  }
+
+  return (Object *)result;
+}
+
+// Checks that the first `count` arguments are float64 arrays of the same
+// length.
+static Object *check_float64_args(const DynamicArray *args, size_t count,
+                                  size_t expected_len, char *fn_name) {
+  Object *err = check_args_len(args, expected_len);
+  if (err != NULL) {
+    return err;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    err = unsupported_arg_error(args->arr[i], FLOAT64_ARRAY_OBJ, fn_name);
+    if (err != NULL) {
+      return err;
+    }
+  }
+
+  size_t len = ((Float64Array *)args->arr[0])->len;
+  for (size_t i = 1; i < count; i++) {
+    if (((Float64Array *)args->arr[i])->len != len) {
+      char err_msg[255];
+      sprintf(err_msg, "arguments to '%s' must have the same length",
+              fn_name);
+      return new_error(err_msg);
+    }
+  }
+
+  return NULL;
+}
+
+typedef enum {
+  REDUCE_SUM,
+  REDUCE_MIN,
+  REDUCE_MAX,
+} Reduction;
+
+// sum(a), min(a) and max(a) reduce a float64 array to a number. min and max
+// of an empty array are null.
+Object *float64_reduce(const DynamicArray *args, Reduction reduction,
+                       char *fn_name) {
+  Object *err = check_float64_args(args, 1, 1, fn_name);
+  if (err != NULL) {
+    return err;
+  }
+
+  Float64Array *array = args->arr[0];
+  const Float64Kernels *kernels = float64_kernels();
+
+  if (reduction == REDUCE_SUM) {
+    return new_cached_number(kernels->sum(array->values, array->len));
+  }
+
+  if (array->len == 0) {
     return new_null();
   }
 
-  Array *new_arr = malloc(sizeof(Array));
-  assert(new_arr != NULL && "Error allocating memory for new array");
+  return new_cached_number(reduction == REDUCE_MIN
+                               ? kernels->min(array->values, array->len)
+                               : kernels->max(array->values, array->len));
+}
+
+Object *builtin_sum(DynamicArray args) {
+  return float64_reduce(&args, REDUCE_SUM, "sum");
+}
+
+Object *builtin_min(DynamicArray args) {
+  return float64_reduce(&args, REDUCE_MIN, "min");
+}
+
+Object *builtin_max(DynamicArray args) {
+  return float64_reduce(&args, REDUCE_MAX, "max");
+}
+
+Object *builtin_dot(DynamicArray args) {
+  Object *err = check_float64_args(&args, 2, 2, "dot");
+  if (err != NULL) {
+    return err;
+  }
+
+  Float64Array *a = args.arr[0];
+  Float64Array *b = args.arr[1];
 
-  array_init(&new_arr->elements, old_arr->elements.len - 1);
+  return new_cached_number(float64_kernels()->dot(a->values, b->values,
+                                                  a->len));
+}
 
-  for (size_t i = 1; i < old_arr->elements.len; i++) {
-    array_append(&new_arr->elements, old_arr->elements.arr[i]);
+// scale(a, k) returns a new float64 array with every element of a times k.
+Object *builtin_scale(DynamicArray args) {
+  Object *err = check_float64_args(&args, 1, 2, "scale");
+  if (err != NULL) {
+    return err;
   }
 
-  new_arr->type = ARRAY_OBJ;
+  err = unsupported_arg_error(args.arr[1], NUMBER_OBJ, "scale");
+  if (err != NULL) {
+    return err;
+  }
 
-  return (Object *)new_arr;
+  Float64Array *a = args.arr[0];
+  Float64Array *result = (Float64Array *)new_float64_array(a->len);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  float64_kernels()->scale(result->values, a->values,
+                           ((Number *)args.arr[1])->value, a->len);
+  return (Object *)result;
+}
+
+typedef enum {
+  ELEMENTWISE_ADD,
+  ELEMENTWISE_MUL,
+} Elementwise;
+
+// add(a, b) and mul(a, b) return a new float64 array with the elementwise
+// sums or products of a and b.
+Object *float64_elementwise(const DynamicArray *args, Elementwise op,
+                            char *fn_name) {
+  Object *err = check_float64_args(args, 2, 2, fn_name);
+  if (err != NULL) {
+    return err;
+  }
+
+  Float64Array *a = args->arr[0];
+  Float64Array *b = args->arr[1];
+  Float64Array *result = (Float64Array *)new_float64_array(a->len);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  const Float64Kernels *kernels = float64_kernels();
+  if (op == ELEMENTWISE_ADD) {
+    kernels->add(result->values, a->values, b->values, a->len);
+  } else {
+    kernels->mul(result->values, a->values, b->values, a->len);
+  }
+
+  return (Object *)result;
+}
+
+Object *builtin_add(DynamicArray args) {
+  return float64_elementwise(&args, ELEMENTWISE_ADD, "add");
+}
+
+Object *builtin_mul(DynamicArray args) {
+  return float64_elementwise(&args, ELEMENTWISE_MUL, "mul");
+}
+
+// bits(n) returns a bitset of n cleared bits.
+Object *builtin_bits(DynamicArray args) {
+  Object *err = check_args_len(&args, 1);
+  if (err != NULL) {
+    return err;
+  }
+
+  err = unsupported_arg_error(args.arr[0], NUMBER_OBJ, "bits");
+  if (err != NULL) {
+    return err;
+  }
+
+  double len = ((Number *)args.arr[0])->value;
+  if (len < 0) {
+    return new_error("bits length must not be negative");
+  }
+
+  return new_bits(len);
+}
+
+// Checks that the first `count` arguments are bitsets of the same length.
+static Object *check_bits_args(const DynamicArray *args, size_t count,
+                               size_t expected_len, char *fn_name) {
+  Object *err = check_args_len(args, expected_len);
+  if (err != NULL) {
+    return err;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    err = unsupported_arg_error(args->arr[i], BITS_OBJ, fn_name);
+    if (err != NULL) {
+      return err;
+    }
+  }
+
+  size_t len = ((Bits *)args->arr[0])->len;
+  for (size_t i = 1; i < count; i++) {
+    if (((Bits *)args->arr[i])->len != len) {
+      char err_msg[255];
+      sprintf(err_msg, "arguments to '%s' must have the same length",
+              fn_name);
+      return new_error(err_msg);
+    }
+  }
+
+  return NULL;
+}
+
+// Reads the bit position or shift amount passed to `fn_name`, which must be
+// a number in [0, max).
+static Object *bits_position_arg(Object *arg, size_t max, char *fn_name,
+                                 size_t *position) {
+  Object *err = unsupported_arg_error(arg, NUMBER_OBJ, fn_name);
+  if (err != NULL) {
+    return err;
+  }
+
+  double value = ((Number *)arg)->value;
+  if (value < 0 || value >= max) {
+    char err_msg[255];
+    sprintf(err_msg, "position %g out of range in '%s'", value, fn_name);
+    return new_error(err_msg);
+  }
+
+  *position = value;
+  return NULL;
+}
+
+Object *builtin_get_bit(DynamicArray args) {
+  Object *err = check_bits_args(&args, 1, 2, "get_bit");
+  if (err != NULL) {
+    return err;
+  }
+
+  Bits *bits = args.arr[0];
+  size_t i;
+  err = bits_position_arg(args.arr[1], bits->len, "get_bit", &i);
+  if (err != NULL) {
+    return err;
+  }
+
+  return new_boolean(bits_get(bits, i));
+}
+
+// set_bit(b, i, v) sets bit i of b to v, a boolean or a number where zero
+// clears the bit, and returns b.
+Object *builtin_set_bit(DynamicArray args) {
+  Object *err = check_bits_args(&args, 1, 3, "set_bit");
+  if (err != NULL) {
+    return err;
+  }
+
+  Bits *bits = args.arr[0];
+  size_t i;
+  err = bits_position_arg(args.arr[1], bits->len, "set_bit", &i);
+  if (err != NULL) {
+    return err;
+  }
+
+  bool value;
+  if (!bit_value(args.arr[2], &value)) {
+    return new_error("bit value to 'set_bit' must be a boolean or a number");
+  }
+
+  bits_set(bits, i, value);
+  return (Object *)bits;
+}
+
+Object *builtin_popcount(DynamicArray args) {
+  Object *err = check_bits_args(&args, 1, 1, "popcount");
+  if (err != NULL) {
+    return err;
+  }
+
+  return new_cached_number(bits_popcount(args.arr[0]));
+}
+
+typedef enum {
+  SHIFT_LEFT,
+  SHIFT_RIGHT,
+} Shift;
+
+// shift_left(b, k) and shift_right(b, k) return a new bitset of the same
+// length with the bits of b moved k positions up or down.
+Object *bits_shift(const DynamicArray *args, Shift shift, char *fn_name) {
+  Object *err = check_bits_args(args, 1, 2, fn_name);
+  if (err != NULL) {
+    return err;
+  }
+
+  Bits *bits = args->arr[0];
+  size_t n;
+  err = bits_position_arg(args->arr[1], SIZE_MAX, fn_name, &n);
+  if (err != NULL) {
+    return err;
+  }
+
+  Bits *result = (Bits *)new_bits(bits->len);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  if (shift == SHIFT_LEFT) {
+    bits_shift_left(result, bits, n);
+  } else {
+    bits_shift_right(result, bits, n);
+  }
+
+  return (Object *)result;
+}
+
+Object *builtin_shift_left(DynamicArray args) {
+  return bits_shift(&args, SHIFT_LEFT, "shift_left");
+}
+
+Object *builtin_shift_right(DynamicArray args) {
+  return bits_shift(&args, SHIFT_RIGHT, "shift_right");
+}
+
+typedef enum {
+  BITWISE_AND,
+  BITWISE_OR,
+  BITWISE_XOR,
+  BITWISE_NOT,
+} Bitwise;
+
+// bits_and(a, b), bits_or(a, b), bits_xor(a, b) and bits_not(a) return a new
+// bitset, combining a and b a word at a time.
+Object *bits_bitwise(const DynamicArray *args, Bitwise op, char *fn_name) {
+  size_t count = op == BITWISE_NOT ? 1 : 2;
+  Object *err = check_bits_args(args, count, count, fn_name);
+  if (err != NULL) {
+    return err;
+  }
+
+  Bits *a = args->arr[0];
+  Bits *result = (Bits *)new_bits(a->len);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  switch (op) {
+  case BITWISE_AND:
+    bits_and(result, a, args->arr[1]);
+    break;
+  case BITWISE_OR:
+    bits_or(result, a, args->arr[1]);
+    break;
+  case BITWISE_XOR:
+    bits_xor(result, a, args->arr[1]);
+    break;
+  case BITWISE_NOT:
+    bits_not(result, a);
+    break;
+  }
+
+  return (Object *)result;
+}
+
+Object *builtin_bits_and(DynamicArray args) {
+  return bits_bitwise(&args, BITWISE_AND, "bits_and");
+}
+
+Object *builtin_bits_or(DynamicArray args) {
+  return bits_bitwise(&args, BITWISE_OR, "bits_or");
+}
+
+Object *builtin_bits_xor(DynamicArray args) {
+  return bits_bitwise(&args, BITWISE_XOR, "bits_xor");
+}
+
+Object *builtin_bits_not(DynamicArray args) {
+  return bits_bitwise(&args, BITWISE_NOT, "bits_not");
+}
+
+static Object *heap_counter_to_hash(const HeapCounter *counter) {
+  Hash *hash = (Hash *)new_hash(4);
+  if (hash == NULL) {
+    return NULL;
+  }
+
+  hash_put(hash, new_string("allocations"),
+           new_number(counter->allocations));
+  hash_put(hash, new_string("frees"), new_number(counter->frees));
+  hash_put(hash, new_string("live_objects"),
+           new_number(heap_counter_live_objects(counter)));
+  hash_put(hash, new_string("live_bytes"),
+           new_number(heap_counter_live_bytes(counter)));
+
+  return (Object *)hash;
+}
+
+Object *heap_stats(DynamicArray args) {
+  Object *err = check_args_len(&args, 0);
+  if (err != NULL) {
+    return err;
+  }
+
+  // Building the result allocates, so read the counters before that
+  HeapCounter totals = heap_profile_totals();
+  HeapCounter by_type[OBJECT_TYPE_COUNT];
+  memcpy(by_type, heap_profile.by_type, sizeof(by_type));
+  HeapCounter by_site[HEAP_SITE_COUNT];
+  memcpy(by_site, heap_profile.by_site, sizeof(by_site));
+
+  Hash *stats = (Hash *)heap_counter_to_hash(&totals);
+  if (stats == NULL) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < OBJECT_TYPE_COUNT; i++) {
+    if (by_type[i].allocations == 0) {
+      continue;
+    }
+
+    hash_put(stats, new_string((char *)ObjectTypeString[i]),
+             heap_counter_to_hash(&by_type[i]));
+  }
+
+  if (!heap_profile.enabled) {
+    return (Object *)stats;
+  }
+
+  Hash *sites = (Hash *)new_hash(8);
+  if (sites == NULL) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < HEAP_SITE_COUNT; i++) {
+    if (by_site[i].allocations == 0) {
+      continue;
+    }
+
+    hash_put(sites, new_string((char *)heap_site_name(i)),
+             new_number(by_site[i].allocations));
+  }
+  hash_put(stats, new_string("sites"), (Object *)sites);
+
+  return (Object *)stats;
 }
 
 const BuiltinDef builtin_definitions[] = {
@@ -251,6 +844,206 @@ const BuiltinDef builtin_definitions[] = {
                 .fn = rest,
             },
     },
+    {
+        .name = "heap_stats",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = heap_stats,
+            },
+    },
+    {
+        .name = "slice",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = slice,
+            },
+    },
+    {
+        .name = "deque",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_deque,
+            },
+    },
+    {
+        .name = "push_front",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = push_front,
+            },
+    },
+    {
+        .name = "pop_front",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = pop_front,
+            },
+    },
+    {
+        .name = "push_back",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = push_back,
+            },
+    },
+    {
+        .name = "pop_back",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = pop_back,
+            },
+    },
+    {
+        .name = "farray",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_farray,
+            },
+    },
+    {
+        .name = "sum",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_sum,
+            },
+    },
+    {
+        .name = "dot",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_dot,
+            },
+    },
+    {
+        .name = "min",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_min,
+            },
+    },
+    {
+        .name = "max",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_max,
+            },
+    },
+    {
+        .name = "scale",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_scale,
+            },
+    },
+    {
+        .name = "add",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_add,
+            },
+    },
+    {
+        .name = "mul",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_mul,
+            },
+    },
+    {
+        .name = "bits",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_bits,
+            },
+    },
+    {
+        .name = "get_bit",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_get_bit,
+            },
+    },
+    {
+        .name = "set_bit",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_set_bit,
+            },
+    },
+    {
+        .name = "popcount",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_popcount,
+            },
+    },
+    {
+        .name = "shift_left",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_shift_left,
+            },
+    },
+    {
+        .name = "shift_right",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_shift_right,
+            },
+    },
+    {
+        .name = "bits_and",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_bits_and,
+            },
+    },
+    {
+        .name = "bits_or",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_bits_or,
+            },
+    },
+    {
+        .name = "bits_xor",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_bits_xor,
+            },
+    },
+    {
+        .name = "bits_not",
+        .builtin =
+            (Builtin){
+                .type = BUILTIN_OBJ,
+                .fn = builtin_bits_not,
+            },
+    },
 };
 const size_t builtin_definitions_len = ARRAY_LEN(builtin_definitions);
 
@@ -12,6 +12,13 @@ extern const size_t builtin_definitions_len;
 extern const BuiltinDef builtin_definitions[];
 const Builtin *get_builtin_by_name(char *);
 
+// Bodies of the builtins the VM runs as opcodes of their own (see OP_LEN),
+// without collecting their arguments in an array
+Object *builtin_len(Object *);
+Object *builtin_first(Object *);
+Object *builtin_last(Object *);
+Object *builtin_push(Object *arr, Object *value);
+
 // TODO: remove
 Object *unsupported_arg_error(Object *, ObjectType, char *);
 Object *check_args_len(const DynamicArray *, size_t);
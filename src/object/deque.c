@@ -0,0 +1,108 @@
+#include "deque.h"
+#include "../heap_profiler/heap_profiler.h"
+#include "heap.h"
+
+#define DEQUE_MIN_CAPACITY 8
+
+Object *new_deque(void) {
+  Deque *deque = heap_alloc(sizeof(Deque));
+  if (deque == NULL) {
+    return NULL;
+  }
+
+  *deque = (Deque){
+      .type = DEQUE_OBJ,
+      .items = NULL,
+      .head = 0,
+      .len = 0,
+      .cap = 0,
+  };
+  heap_profile_record_alloc((Object *)deque);
+
+  return (Object *)deque;
+}
+
+static size_t slot(const Deque *deque, size_t i) {
+  return (deque->head + i) & (deque->cap - 1);
+}
+
+Object *deque_get(const Deque *deque, size_t i) {
+  return deque->items[slot(deque, i)];
+}
+
+// Doubles the ring buffer, moving the elements so that the front is back at
+// slot zero.
+static bool grow(Deque *deque) {
+  size_t cap = deque->cap ? deque->cap * 2 : DEQUE_MIN_CAPACITY;
+
+  Object **items = heap_alloc(cap * sizeof(Object *));
+  if (items == NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < deque->len; i++) {
+    items[i] = deque_get(deque, i);
+  }
+
+  if (deque->items) {
+    heap_free(deque->items);
+    heap_release(deque->cap * sizeof(Object *));
+  }
+
+  deque->items = items;
+  deque->head = 0;
+  deque->cap = cap;
+
+  return true;
+}
+
+bool deque_push_front(Deque *deque, Object *value) {
+  if (deque->len == deque->cap && !grow(deque)) {
+    return false;
+  }
+
+  deque->head = (deque->head - 1) & (deque->cap - 1);
+  deque->items[deque->head] = value;
+  deque->len++;
+
+  return true;
+}
+
+bool deque_push_back(Deque *deque, Object *value) {
+  if (deque->len == deque->cap && !grow(deque)) {
+    return false;
+  }
+
+  deque->items[slot(deque, deque->len)] = value;
+  deque->len++;
+
+  return true;
+}
+
+Object *deque_pop_front(Deque *deque) {
+  if (deque->len == 0) {
+    return NULL;
+  }
+
+  Object *value = deque->items[deque->head];
+  deque->head = slot(deque, 1);
+  deque->len--;
+
+  return value;
+}
+
+Object *deque_pop_back(Deque *deque) {
+  if (deque->len == 0) {
+    return NULL;
+  }
+
+  deque->len--;
+  return deque->items[slot(deque, deque->len)];
+}
+
+void free_deque_items(Deque *deque) {
+  if (deque->items != NULL) {
+    heap_free(deque->items);
+    heap_release(deque->cap * sizeof(Object *));
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include "object.h"
+#include <stdbool.h>
+
+// Deques are mutable: every operation updates the deque in place, so all
+// variables referencing it observe the change. Pushing at either end is
+// amortized O(1), the ring buffer doubles when it is full.
+
+Object *new_deque(void);
+
+Object *deque_get(const Deque *, size_t);
+
+// Return false when the ring buffer could not grow.
+bool deque_push_front(Deque *, Object *);
+bool deque_push_back(Deque *, Object *);
+
+// Return NULL when the deque is empty.
+Object *deque_pop_front(Deque *);
+Object *deque_pop_back(Deque *);
+
+// Releases the ring buffer, but not the deque itself.
+void free_deque_items(Deque *);
+
+#endif // DEQUE_H
@@ -0,0 +1,76 @@
+#include "../unity/src/unity.h"
+#include "../unity/src/unity_internals.h"
+#include "deque.h"
+
+static Object *value(size_t i) { return new_cached_number(i); }
+
+static void assert_contents(Deque *deque, size_t first, size_t len) {
+  TEST_ASSERT_EQUAL(len, deque->len);
+  for (size_t i = 0; i < len; i++) {
+    TEST_ASSERT_EQUAL_PTR(value(first + i), deque_get(deque, i));
+  }
+}
+
+void test_push_and_pop_both_ends(void) {
+  Deque *deque = (Deque *)new_deque();
+
+  TEST_ASSERT_NULL(deque_pop_front(deque));
+  TEST_ASSERT_NULL(deque_pop_back(deque));
+
+  for (size_t i = 100; i < 200; i++) {
+    TEST_ASSERT_TRUE(deque_push_back(deque, value(i)));
+  }
+  for (size_t i = 100; i > 0; i--) {
+    TEST_ASSERT_TRUE(deque_push_front(deque, value(i - 1)));
+  }
+  assert_contents(deque, 0, 200);
+
+  TEST_ASSERT_EQUAL_PTR(value(0), deque_pop_front(deque));
+  TEST_ASSERT_EQUAL_PTR(value(199), deque_pop_back(deque));
+  assert_contents(deque, 1, 198);
+
+  free_object((Object *)deque);
+}
+
+void test_queue_wraps_around(void) {
+  Deque *deque = (Deque *)new_deque();
+
+  // Steady queue usage keeps reusing the same slots
+  for (size_t i = 0; i < 5; i++) {
+    deque_push_back(deque, value(i));
+  }
+  size_t cap = deque->cap;
+
+  for (size_t i = 5; i < 1000; i++) {
+    deque_push_back(deque, value(i));
+    TEST_ASSERT_EQUAL_PTR(value(i - 5), deque_pop_front(deque));
+  }
+
+  TEST_ASSERT_EQUAL(cap, deque->cap);
+  assert_contents(deque, 995, 5);
+
+  free_object((Object *)deque);
+}
+
+void test_inspect(void) {
+  Deque *deque = (Deque *)new_deque();
+  deque_push_back(deque, value(1));
+  deque_push_front(deque, value(0));
+
+  ResizableBuffer buf;
+  init_resizable_buffer(&buf, 16);
+  inspect_object(&buf, (Object *)deque);
+
+  TEST_ASSERT_EQUAL_STRING("deque[0, 1]", buf.buf);
+
+  free(buf.buf);
+  free_object((Object *)deque);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_push_and_pop_both_ends);
+  RUN_TEST(test_queue_wraps_around);
+  RUN_TEST(test_inspect);
+  return UNITY_END();
+}
@@ -0,0 +1,359 @@
+#include "float64_array.h"
+#include "../heap_profiler/heap_profiler.h"
+#include "heap.h"
+#include <pthread.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+Object *new_float64_array(size_t len) {
+  Float64Array *array = heap_alloc(sizeof(Float64Array));
+  if (array == NULL) {
+    return NULL;
+  }
+
+  double *values = NULL;
+  if (len > 0) {
+    values = heap_alloc(len * sizeof(double));
+    if (values == NULL) {
+      heap_free(array);
+      heap_release(sizeof(Float64Array));
+      return NULL;
+    }
+    memset(values, 0, len * sizeof(double));
+  }
+
+  *array = (Float64Array){
+      .type = FLOAT64_ARRAY_OBJ,
+      .values = values,
+      .len = len,
+  };
+  heap_profile_record_alloc((Object *)array);
+
+  return (Object *)array;
+}
+
+void free_float64_values(Float64Array *array) {
+  if (array->values != NULL) {
+    heap_free(array->values);
+    heap_release(array->len * sizeof(double));
+  }
+}
+
+// Scalar kernels, also used for the elements left over by the vector ones.
+
+static double scalar_sum(const double *a, size_t len) {
+  double sum = 0;
+  for (size_t i = 0; i < len; i++) {
+    sum += a[i];
+  }
+  return sum;
+}
+
+static double scalar_dot(const double *a, const double *b, size_t len) {
+  double sum = 0;
+  for (size_t i = 0; i < len; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+static double scalar_min(const double *a, size_t len) {
+  double min = a[0];
+  for (size_t i = 1; i < len; i++) {
+    min = a[i] < min ? a[i] : min;
+  }
+  return min;
+}
+
+static double scalar_max(const double *a, size_t len) {
+  double max = a[0];
+  for (size_t i = 1; i < len; i++) {
+    max = a[i] > max ? a[i] : max;
+  }
+  return max;
+}
+
+static void scalar_scale(double *dst, const double *a, double factor,
+                         size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    dst[i] = a[i] * factor;
+  }
+}
+
+static void scalar_add(double *dst, const double *a, const double *b,
+                       size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    dst[i] = a[i] + b[i];
+  }
+}
+
+static void scalar_mul(double *dst, const double *a, const double *b,
+                       size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    dst[i] = a[i] * b[i];
+  }
+}
+
+const Float64Kernels float64_scalar_kernels = {
+    .name = "scalar",
+    .sum = scalar_sum,
+    .dot = scalar_dot,
+    .min = scalar_min,
+    .max = scalar_max,
+    .scale = scalar_scale,
+    .add = scalar_add,
+    .mul = scalar_mul,
+};
+
+#ifdef __SSE2__
+// SSE2 handles two doubles at a time. The reductions keep two accumulators
+// so consecutive additions do not wait on each other.
+
+static double sse2_hsum(__m128d v) {
+  return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static double sse2_sum(const double *a, size_t len) {
+  __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    acc0 = _mm_add_pd(acc0, _mm_loadu_pd(a + i));
+    acc1 = _mm_add_pd(acc1, _mm_loadu_pd(a + i + 2));
+  }
+  return sse2_hsum(_mm_add_pd(acc0, acc1)) + scalar_sum(a + i, len - i);
+}
+
+static double sse2_dot(const double *a, const double *b, size_t len) {
+  __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    acc0 = _mm_add_pd(acc0,
+                      _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    acc1 = _mm_add_pd(
+        acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+  }
+  return sse2_hsum(_mm_add_pd(acc0, acc1)) +
+         scalar_dot(a + i, b + i, len - i);
+}
+
+static double sse2_min(const double *a, size_t len) {
+  if (len < 2) {
+    return scalar_min(a, len);
+  }
+
+  __m128d acc = _mm_loadu_pd(a);
+  size_t i = 2;
+  for (; i + 2 <= len; i += 2) {
+    acc = _mm_min_pd(acc, _mm_loadu_pd(a + i));
+  }
+
+  double lanes[2];
+  _mm_storeu_pd(lanes, acc);
+  double min = scalar_min(lanes, 2);
+  return i < len && a[i] < min ? a[i] : min;
+}
+
+static double sse2_max(const double *a, size_t len) {
+  if (len < 2) {
+    return scalar_max(a, len);
+  }
+
+  __m128d acc = _mm_loadu_pd(a);
+  size_t i = 2;
+  for (; i + 2 <= len; i += 2) {
+    acc = _mm_max_pd(acc, _mm_loadu_pd(a + i));
+  }
+
+  double lanes[2];
+  _mm_storeu_pd(lanes, acc);
+  double max = scalar_max(lanes, 2);
+  return i < len && a[i] > max ? a[i] : max;
+}
+
+static void sse2_scale(double *dst, const double *a, double factor,
+                       size_t len) {
+  __m128d k = _mm_set1_pd(factor);
+  size_t i = 0;
+  for (; i + 2 <= len; i += 2) {
+    _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(a + i), k));
+  }
+  scalar_scale(dst + i, a + i, factor, len - i);
+}
+
+static void sse2_add(double *dst, const double *a, const double *b,
+                     size_t len) {
+  size_t i = 0;
+  for (; i + 2 <= len; i += 2) {
+    _mm_storeu_pd(dst + i,
+                  _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  }
+  scalar_add(dst + i, a + i, b + i, len - i);
+}
+
+static void sse2_mul(double *dst, const double *a, const double *b,
+                     size_t len) {
+  size_t i = 0;
+  for (; i + 2 <= len; i += 2) {
+    _mm_storeu_pd(dst + i,
+                  _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  }
+  scalar_mul(dst + i, a + i, b + i, len - i);
+}
+
+const Float64Kernels float64_sse2_kernels = {
+    .name = "sse2",
+    .sum = sse2_sum,
+    .dot = sse2_dot,
+    .min = sse2_min,
+    .max = sse2_max,
+    .scale = sse2_scale,
+    .add = sse2_add,
+    .mul = sse2_mul,
+};
+#endif // __SSE2__
+
+#ifdef __x86_64__
+// AVX2 kernels handle four doubles at a time. They are compiled for AVX2
+// whatever the build flags, and only picked when the CPU supports it.
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static double avx2_hsum(__m256d v) {
+  __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v),
+                           _mm256_extractf128_pd(v, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+AVX2 static double avx2_sum(const double *a, size_t len) {
+  __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(a + i));
+    acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(a + i + 4));
+  }
+  return avx2_hsum(_mm256_add_pd(acc0, acc1)) + scalar_sum(a + i, len - i);
+}
+
+AVX2 static double avx2_dot(const double *a, const double *b, size_t len) {
+  __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    acc0 = _mm256_add_pd(
+        acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+                                             _mm256_loadu_pd(b + i + 4)));
+  }
+  return avx2_hsum(_mm256_add_pd(acc0, acc1)) +
+         scalar_dot(a + i, b + i, len - i);
+}
+
+AVX2 static double avx2_min(const double *a, size_t len) {
+  if (len < 4) {
+    return scalar_min(a, len);
+  }
+
+  __m256d acc = _mm256_loadu_pd(a);
+  size_t i = 4;
+  for (; i + 4 <= len; i += 4) {
+    acc = _mm256_min_pd(acc, _mm256_loadu_pd(a + i));
+  }
+
+  double lanes[4];
+  _mm256_storeu_pd(lanes, acc);
+  double min = scalar_min(lanes, 4);
+  for (; i < len; i++) {
+    min = a[i] < min ? a[i] : min;
+  }
+  return min;
+}
+
+AVX2 static double avx2_max(const double *a, size_t len) {
+  if (len < 4) {
+    return scalar_max(a, len);
+  }
+
+  __m256d acc = _mm256_loadu_pd(a);
+  size_t i = 4;
+  for (; i + 4 <= len; i += 4) {
+    acc = _mm256_max_pd(acc, _mm256_loadu_pd(a + i));
+  }
+
+  double lanes[4];
+  _mm256_storeu_pd(lanes, acc);
+  double max = scalar_max(lanes, 4);
+  for (; i < len; i++) {
+    max = a[i] > max ? a[i] : max;
+  }
+  return max;
+}
+
+AVX2 static void avx2_scale(double *dst, const double *a, double factor,
+                            size_t len) {
+  __m256d k = _mm256_set1_pd(factor);
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), k));
+  }
+  scalar_scale(dst + i, a + i, factor, len - i);
+}
+
+AVX2 static void avx2_add(double *dst, const double *a, const double *b,
+                          size_t len) {
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    _mm256_storeu_pd(
+        dst + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  }
+  scalar_add(dst + i, a + i, b + i, len - i);
+}
+
+AVX2 static void avx2_mul(double *dst, const double *a, const double *b,
+                          size_t len) {
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    _mm256_storeu_pd(
+        dst + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  }
+  scalar_mul(dst + i, a + i, b + i, len - i);
+}
+
+const Float64Kernels float64_avx2_kernels = {
+    .name = "avx2",
+    .sum = avx2_sum,
+    .dot = avx2_dot,
+    .min = avx2_min,
+    .max = avx2_max,
+    .scale = avx2_scale,
+    .add = avx2_add,
+    .mul = avx2_mul,
+};
+
+bool float64_avx2_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif // __x86_64__
+
+static const Float64Kernels *kernels = &float64_scalar_kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static void pick_kernels(void) {
+#ifdef __SSE2__
+  kernels = &float64_sse2_kernels;
+#endif
+#ifdef __x86_64__
+  if (float64_avx2_supported()) {
+    kernels = &float64_avx2_kernels;
+  }
+#endif
+}
+
+const Float64Kernels *float64_kernels(void) {
+  pthread_once(&kernels_once, pick_kernels);
+  return kernels;
+}
@@ -0,0 +1,44 @@
+#ifndef FLOAT64_ARRAY_H
+#define FLOAT64_ARRAY_H
+
+#include "object.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Float64Arrays are fixed-length and mutable, like deques they are updated
+// in place and shared by every variable referencing them.
+
+// Returns a zero-filled array, NULL when it could not be allocated.
+Object *new_float64_array(size_t len);
+
+// Releases the values, but not the array itself.
+void free_float64_values(Float64Array *);
+
+// Kernels over `len` doubles. Reductions may add in a different order than a
+// loop would, so sums can differ from it in the last bits. min and max need
+// len > 0, and their result is unspecified when the values include NaN.
+typedef struct {
+  const char *name;
+  double (*sum)(const double *, size_t len);
+  double (*dot)(const double *, const double *, size_t len);
+  double (*min)(const double *, size_t len);
+  double (*max)(const double *, size_t len);
+  // The destination may be one of the sources
+  void (*scale)(double *dst, const double *, double factor, size_t len);
+  void (*add)(double *dst, const double *, const double *, size_t len);
+  void (*mul)(double *dst, const double *, const double *, size_t len);
+} Float64Kernels;
+
+// The fastest kernels this CPU supports, picked on first use.
+const Float64Kernels *float64_kernels(void);
+
+extern const Float64Kernels float64_scalar_kernels;
+#ifdef __SSE2__
+extern const Float64Kernels float64_sse2_kernels;
+#endif
+#ifdef __x86_64__
+extern const Float64Kernels float64_avx2_kernels;
+bool float64_avx2_supported(void);
+#endif
+
+#endif // FLOAT64_ARRAY_H
@@ -0,0 +1,103 @@
+#include "../unity/src/unity.h"
+#include "../unity/src/unity_internals.h"
+#include "float64_array.h"
+
+#define KERNEL_MAX_LEN 67 // covers every remainder of the vector widths
+
+static double a[KERNEL_MAX_LEN], b[KERNEL_MAX_LEN], out[KERNEL_MAX_LEN];
+
+// Small integers keep every sum exact, whatever order it is computed in
+static void fill(void) {
+  for (size_t i = 0; i < KERNEL_MAX_LEN; i++) {
+    a[i] = (double)((i * 7) % 23) - 11;
+    b[i] = (double)((i * 5) % 13) - 6;
+  }
+}
+
+static void assert_kernels(const Float64Kernels *kernels) {
+  const Float64Kernels *ref = &float64_scalar_kernels;
+  fill();
+
+  for (size_t len = 0; len <= KERNEL_MAX_LEN; len++) {
+    TEST_ASSERT_TRUE(kernels->sum(a, len) == ref->sum(a, len));
+    TEST_ASSERT_TRUE(kernels->dot(a, b, len) == ref->dot(a, b, len));
+
+    if (len > 0) {
+      TEST_ASSERT_TRUE(kernels->min(a, len) == ref->min(a, len));
+      TEST_ASSERT_TRUE(kernels->max(a, len) == ref->max(a, len));
+    }
+
+    kernels->scale(out, a, 0.5, len);
+    for (size_t i = 0; i < len; i++) {
+      TEST_ASSERT_TRUE(out[i] == a[i] * 0.5);
+    }
+
+    kernels->add(out, a, b, len);
+    for (size_t i = 0; i < len; i++) {
+      TEST_ASSERT_TRUE(out[i] == a[i] + b[i]);
+    }
+
+    kernels->mul(out, a, b, len);
+    for (size_t i = 0; i < len; i++) {
+      TEST_ASSERT_TRUE(out[i] == a[i] * b[i]);
+    }
+  }
+
+  // Writing over a source is allowed
+  double last = a[KERNEL_MAX_LEN - 1] + b[KERNEL_MAX_LEN - 1];
+  kernels->add(a, a, b, KERNEL_MAX_LEN);
+  TEST_ASSERT_TRUE(a[KERNEL_MAX_LEN - 1] == last);
+}
+
+void test_scalar_kernels(void) {
+  fill();
+  TEST_ASSERT_TRUE(float64_scalar_kernels.sum(a, 4) == -11 - 4 + 3 + 10);
+  TEST_ASSERT_TRUE(float64_scalar_kernels.min(a, KERNEL_MAX_LEN) == -11);
+  TEST_ASSERT_TRUE(float64_scalar_kernels.max(a, KERNEL_MAX_LEN) == 11);
+}
+
+void test_sse2_kernels(void) {
+#ifdef __SSE2__
+  assert_kernels(&float64_sse2_kernels);
+#else
+  TEST_IGNORE_MESSAGE("built without SSE2");
+#endif
+}
+
+void test_avx2_kernels(void) {
+#ifdef __x86_64__
+  if (!float64_avx2_supported()) {
+    TEST_IGNORE_MESSAGE("the CPU does not support AVX2");
+  }
+  assert_kernels(&float64_avx2_kernels);
+#else
+  TEST_IGNORE_MESSAGE("built for a CPU without AVX2");
+#endif
+}
+
+void test_dispatched_kernels(void) {
+  assert_kernels(float64_kernels());
+  TEST_ASSERT_EQUAL_PTR(float64_kernels(), float64_kernels());
+}
+
+void test_new_float64_array(void) {
+  Float64Array *array = (Float64Array *)new_float64_array(100);
+  TEST_ASSERT_EQUAL(FLOAT64_ARRAY_OBJ, array->type);
+  TEST_ASSERT_EQUAL(100, array->len);
+  for (size_t i = 0; i < 100; i++) {
+    TEST_ASSERT_TRUE(array->values[i] == 0);
+  }
+
+  Float64Array *empty = (Float64Array *)new_float64_array(0);
+  TEST_ASSERT_EQUAL(0, empty->len);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_scalar_kernels);
+  RUN_TEST(test_sse2_kernels);
+  RUN_TEST(test_avx2_kernels);
+  RUN_TEST(test_dispatched_kernels);
+  RUN_TEST(test_new_float64_array);
+  return UNITY_END();
+}
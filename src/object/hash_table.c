@@ -0,0 +1,376 @@
+// Hash objects whose keys are all interned strings are records: their keys
+// are described by a Shape (see shape.c) and their values sit in a dense
+// slot vector, in the order the keys were added. Any other key, or more than
+// SHAPE_MAX_KEYS of them, switches the hash to dictionary mode for good.
+//
+// In dictionary mode hashes are open-addressing tables in the style of Swiss
+// tables. Every slot has a control byte: CTRL_EMPTY, or the low 7 bits of the
+// hash of the key stored there. Lookups scan a whole group of control bytes
+// at once for the 7 bits of the key they want (with SSE2 when available) and
+// only compare the keys of the slots that match. The rest of the hash picks
+// the group where probing starts. The first group of control bytes is
+// repeated after the last one, so a group starting near the end can be
+// loaded without wrapping around.
+//
+// Monkey has no way to remove keys, so there are no tombstones.
+#include "heap.h"
+#include "../heap_profiler/heap_profiler.h"
+#include "object.h"
+#include "shape.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define GROUP_WIDTH 16
+#else
+#define GROUP_WIDTH 8
+#endif
+
+#define CTRL_EMPTY ((int8_t)-128)
+#define MIN_SLOTS 4
+
+typedef uint32_t GroupMask; // bit i set when slot i of the group matches
+
+#ifdef __SSE2__
+static GroupMask match_byte(const int8_t *group, int8_t byte) {
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+}
+#else
+static GroupMask match_byte(const int8_t *group, int8_t byte) {
+  GroupMask mask = 0;
+  for (size_t i = 0; i < GROUP_WIDTH; i++) {
+    mask |= (GroupMask)(group[i] == byte) << i;
+  }
+  return mask;
+}
+#endif
+
+static int8_t h2(uint64_t hash) { return hash & 0x7f; }
+
+static size_t h1(uint64_t hash) { return hash >> 7; }
+
+static size_t ctrl_size(size_t cap) { return cap + GROUP_WIDTH; }
+
+static size_t table_size(size_t cap) {
+  return cap * sizeof(HashPair) + ctrl_size(cap);
+}
+
+// Tables are kept at most 7/8 full
+static size_t max_len(size_t cap) { return cap - cap / 8; }
+
+static void set_ctrl(Hash *hash, size_t i, int8_t ctrl) {
+  hash->ctrl[i] = ctrl;
+  if (i < GROUP_WIDTH) {
+    hash->ctrl[hash->cap + i] = ctrl;
+  }
+}
+
+// Allocates empty slots for `cap` pairs, in one block with the control bytes.
+static bool alloc_table(Hash *hash, size_t cap) {
+  HashPair *pairs = heap_alloc(table_size(cap));
+  if (pairs == NULL) {
+    return false;
+  }
+
+  hash->pairs = pairs;
+  hash->ctrl = (int8_t *)(pairs + cap);
+  hash->cap = cap;
+  hash->growth_left = max_len(cap) - hash->len;
+  memset(hash->ctrl, CTRL_EMPTY, ctrl_size(cap));
+
+  return true;
+}
+
+// Walks the groups where `hash` may live. Triangular steps over a power of
+// two number of groups visit all of them.
+typedef struct {
+  size_t mask;
+  size_t pos;
+  size_t step;
+} Probe;
+
+static Probe probe_start(const Hash *hash, uint64_t key_hash) {
+  size_t mask = hash->cap - 1;
+  return (Probe){.mask = mask, .pos = h1(key_hash) & mask, .step = 0};
+}
+
+static void probe_next(Probe *probe) {
+  probe->step += GROUP_WIDTH;
+  probe->pos = (probe->pos + probe->step) & probe->mask;
+}
+
+// Slot of the first match in the group at the probe position.
+static size_t probe_slot(const Probe *probe, GroupMask matches) {
+  return (probe->pos + __builtin_ctz(matches)) & probe->mask;
+}
+
+static size_t find_empty_slot(const Hash *hash, uint64_t key_hash) {
+  for (Probe probe = probe_start(hash, key_hash);; probe_next(&probe)) {
+    GroupMask empty = match_byte(hash->ctrl + probe.pos, CTRL_EMPTY);
+    if (empty) {
+      return probe_slot(&probe, empty);
+    }
+  }
+}
+
+static HashPair *find(const Hash *hash, Object *key, uint64_t key_hash) {
+  if (hash->cap == 0) {
+    return NULL;
+  }
+
+  for (Probe probe = probe_start(hash, key_hash);; probe_next(&probe)) {
+    const int8_t *group = hash->ctrl + probe.pos;
+
+    for (GroupMask m = match_byte(group, h2(key_hash)); m; m &= m - 1) {
+      HashPair *pair = &hash->pairs[probe_slot(&probe, m)];
+      if (pair->hash == key_hash && hash_keys_equal(pair->key, key)) {
+        return pair;
+      }
+    }
+
+    if (match_byte(group, CTRL_EMPTY)) {
+      return NULL;
+    }
+  }
+}
+
+static void insert_new(Hash *hash, HashPair pair) {
+  size_t i = find_empty_slot(hash, pair.hash);
+  set_ctrl(hash, i, h2(pair.hash));
+  hash->pairs[i] = pair;
+  hash->len++;
+  hash->growth_left--;
+}
+
+// Moves every pair to a table twice as large, using the cached hashes.
+static bool grow(Hash *hash) {
+  Hash old = *hash;
+  size_t cap = old.cap ? old.cap * 2 : GROUP_WIDTH;
+
+  hash->len = 0;
+  if (!alloc_table(hash, cap)) {
+    *hash = old;
+    return false;
+  }
+
+  for (size_t i = 0; i < old.cap; i++) {
+    if (old.ctrl[i] != CTRL_EMPTY) {
+      insert_new(hash, old.pairs[i]);
+    }
+  }
+
+  if (old.cap > 0) {
+    heap_free(old.pairs);
+    heap_release(table_size(old.cap));
+  }
+
+  return true;
+}
+
+// Smallest table that holds `len` pairs without growing.
+static size_t table_capacity(size_t len) {
+  size_t cap = GROUP_WIDTH;
+  while (max_len(cap) < len) {
+    cap *= 2;
+  }
+  return cap;
+}
+
+static bool alloc_slots(Hash *hash, size_t cap) {
+  Object **slots = heap_alloc(cap * sizeof(Object *));
+  if (slots == NULL) {
+    return false;
+  }
+
+  if (hash->slots_cap > 0) {
+    memcpy(slots, hash->slots, hash->len * sizeof(Object *));
+    heap_free(hash->slots);
+    heap_release(hash->slots_cap * sizeof(Object *));
+  }
+
+  hash->slots = slots;
+  hash->slots_cap = cap;
+  return true;
+}
+
+static bool is_record_key(Hash *hash, Object *key) {
+  return key->type == STRING_OBJ && ((String *)key)->interned &&
+         hash->shape->len < SHAPE_MAX_KEYS;
+}
+
+static bool add_record_key(Hash *hash, String *key, Object *value) {
+  if (hash->len == hash->slots_cap &&
+      !alloc_slots(hash, hash->slots_cap ? hash->slots_cap * 2 : MIN_SLOTS)) {
+    return false;
+  }
+
+  hash->shape = shape_add_key(hash->shape, key);
+  hash->slots[hash->len++] = value;
+  return true;
+}
+
+// Moves the pairs of a record into a table with room for one more.
+static bool to_dictionary(Hash *hash) {
+  Hash dict = *hash;
+  dict.shape = NULL;
+  dict.slots = NULL;
+  dict.slots_cap = 0;
+  dict.len = 0;
+
+  if (!alloc_table(&dict, table_capacity(hash->len + 1))) {
+    return false;
+  }
+
+  for (size_t i = 0; i < hash->len; i++) {
+    Object *key = (Object *)hash->shape->keys[i];
+    uint64_t key_hash;
+    get_hash_key(key, &key_hash);
+
+    insert_new(&dict, (HashPair){
+                          .hash = key_hash,
+                          .key = key,
+                          .value = hash->slots[i],
+                      });
+  }
+
+  if (hash->slots_cap > 0) {
+    heap_free(hash->slots);
+    heap_release(hash->slots_cap * sizeof(Object *));
+  }
+
+  *hash = dict;
+  return true;
+}
+
+Object *new_hash(size_t capacity) {
+  Hash *hash = heap_alloc(sizeof(Hash));
+  if (hash == NULL) {
+    return NULL;
+  }
+
+  *hash = (Hash){
+      .type = HASH_OBJ,
+      .shape = root_shape(),
+      .slots = NULL,
+      .slots_cap = 0,
+      .ctrl = NULL,
+      .pairs = NULL,
+      .cap = 0,
+      .len = 0,
+      .growth_left = 0,
+  };
+
+  bool ok = true;
+  if (capacity > SHAPE_MAX_KEYS) {
+    hash->shape = NULL;
+    ok = alloc_table(hash, table_capacity(capacity));
+  } else if (capacity > 0) {
+    ok = alloc_slots(hash, capacity);
+  }
+
+  if (!ok) {
+    heap_free(hash);
+    heap_release(sizeof(Hash));
+    return NULL;
+  }
+
+  heap_profile_record_alloc((Object *)hash);
+  return (Object *)hash;
+}
+
+bool hash_put(Hash *hash, Object *key, Object *value) {
+  if (key == NULL || value == NULL) {
+    return false; // failed allocation
+  }
+
+  uint64_t key_hash;
+  if (!get_hash_key(key, &key_hash)) {
+    return false;
+  }
+
+  if (hash->shape) {
+    int64_t slot = key->type == STRING_OBJ
+                       ? shape_find(hash->shape, (String *)key)
+                       : -1;
+    if (slot >= 0) {
+      hash->slots[slot] = value;
+      return true;
+    }
+
+    if (is_record_key(hash, key)) {
+      return add_record_key(hash, (String *)key, value);
+    }
+
+    if (!to_dictionary(hash)) {
+      return false;
+    }
+  }
+
+  HashPair *pair = find(hash, key, key_hash);
+  if (pair) {
+    pair->value = value;
+    return true;
+  }
+
+  if (hash->growth_left == 0 && !grow(hash)) {
+    return false;
+  }
+
+  insert_new(hash, (HashPair){.hash = key_hash, .key = key, .value = value});
+  return true;
+}
+
+Object *hash_get(Hash *hash, Object *key) {
+  if (hash->shape) {
+    if (key->type != STRING_OBJ) {
+      return NULL;
+    }
+
+    int64_t slot = shape_find(hash->shape, (String *)key);
+    return slot >= 0 ? hash->slots[slot] : NULL;
+  }
+
+  uint64_t key_hash;
+  if (!get_hash_key(key, &key_hash)) {
+    return NULL;
+  }
+
+  HashPair *pair = find(hash, key, key_hash);
+  return pair ? pair->value : NULL;
+}
+
+bool hash_next(Hash *hash, size_t *cursor, Object **key, Object **value) {
+  if (hash->shape) {
+    if (*cursor >= hash->len) {
+      return false;
+    }
+
+    *key = (Object *)hash->shape->keys[*cursor];
+    *value = hash->slots[(*cursor)++];
+    return true;
+  }
+
+  for (; *cursor < hash->cap; (*cursor)++) {
+    if (hash->ctrl[*cursor] != CTRL_EMPTY) {
+      HashPair *pair = &hash->pairs[(*cursor)++];
+      *key = pair->key;
+      *value = pair->value;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void free_hash_storage(Hash *hash) {
+  if (hash->slots_cap > 0) {
+    heap_free(hash->slots);
+    heap_release(hash->slots_cap * sizeof(Object *));
+  }
+
+  if (hash->cap > 0) {
+    heap_free(hash->pairs);
+    heap_release(table_size(hash->cap));
+  }
+}
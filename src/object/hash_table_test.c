@@ -0,0 +1,140 @@
+#include "../unity/src/unity.h"
+#include "../unity/src/unity_internals.h"
+#include "object.h"
+#include "shape.h"
+#include <stdio.h>
+#include <string.h>
+
+static Number *number(double value) { return (Number *)new_number(value); }
+
+void test_put_and_get(void) {
+  Hash *hash = (Hash *)new_hash(0);
+  TEST_ASSERT_NULL(hash_get(hash, (Object *)number(1)));
+
+  for (size_t i = 0; i < 5000; i++) {
+    TEST_ASSERT_TRUE(
+        hash_put(hash, (Object *)number(i), (Object *)number(i * 2)));
+  }
+  TEST_ASSERT_EQUAL(5000, hash->len);
+
+  for (size_t i = 0; i < 5000; i++) {
+    Object *value = hash_get(hash, (Object *)number(i));
+    TEST_ASSERT_NOT_NULL(value);
+    TEST_ASSERT_EQUAL(i * 2, ((Number *)value)->value);
+  }
+  TEST_ASSERT_NULL(hash_get(hash, (Object *)number(5000)));
+}
+
+void test_put_replaces_existing_keys(void) {
+  Hash *hash = (Hash *)new_hash(1);
+  Object *key = new_string("key");
+
+  hash_put(hash, key, (Object *)number(1));
+  hash_put(hash, new_string("key"), (Object *)number(2));
+
+  TEST_ASSERT_EQUAL(1, hash->len);
+  TEST_ASSERT_EQUAL(2, ((Number *)hash_get(hash, key))->value);
+}
+
+void test_keys_of_different_types_are_distinct(void) {
+  Hash *hash = (Hash *)new_hash(0);
+
+  hash_put(hash, (Object *)number(1), (Object *)number(1));
+  hash_put(hash, new_string("1"), (Object *)number(2));
+  hash_put(hash, new_boolean(true), (Object *)number(3));
+  hash_put(hash, (Object *)number(4294967296), (Object *)number(4));
+  hash_put(hash, (Object *)number(0), (Object *)number(5));
+
+  TEST_ASSERT_EQUAL(5, hash->len);
+  TEST_ASSERT_EQUAL(1, ((Number *)hash_get(hash, (Object *)number(1)))->value);
+  TEST_ASSERT_EQUAL(2, ((Number *)hash_get(hash, new_string("1")))->value);
+  TEST_ASSERT_EQUAL(3, ((Number *)hash_get(hash, new_boolean(true)))->value);
+  TEST_ASSERT_EQUAL(
+      5, ((Number *)hash_get(hash, (Object *)number(-0.0)))->value);
+}
+
+void test_unhashable_keys(void) {
+  Hash *hash = (Hash *)new_hash(0);
+
+  TEST_ASSERT_FALSE(hash_put(hash, new_null(), (Object *)number(1)));
+  TEST_ASSERT_NULL(hash_get(hash, new_null()));
+  TEST_ASSERT_EQUAL(0, hash->len);
+}
+
+void test_next_visits_every_pair_once(void) {
+  Hash *hash = (Hash *)new_hash(0);
+  for (size_t i = 0; i < 100; i++) {
+    hash_put(hash, (Object *)number(i), (Object *)number(i));
+  }
+
+  bool seen[100] = {false};
+  size_t cursor = 0;
+  size_t count = 0;
+  Object *key_obj, *value;
+  for (; hash_next(hash, &cursor, &key_obj, &value); count++) {
+    size_t key = ((Number *)key_obj)->value;
+    TEST_ASSERT_FALSE(seen[key]);
+    seen[key] = true;
+  }
+
+  TEST_ASSERT_EQUAL(100, count);
+}
+
+static Hash *record(size_t num_keys) {
+  Hash *hash = (Hash *)new_hash(0);
+  for (size_t i = 0; i < num_keys; i++) {
+    char key[32];
+    sprintf(key, "key%zu", i);
+    hash_put(hash, new_interned_string(key), (Object *)number(i));
+  }
+  return hash;
+}
+
+void test_records_share_shapes(void) {
+  Hash *a = record(3);
+  Hash *b = record(3);
+
+  TEST_ASSERT_NOT_NULL(a->shape);
+  TEST_ASSERT_EQUAL_PTR(a->shape, b->shape);
+  TEST_ASSERT_EQUAL(3, a->shape->len);
+
+  // Updating an existing key keeps the shape, also with a plain string
+  hash_put(a, new_string("key1"), (Object *)number(10));
+  TEST_ASSERT_EQUAL_PTR(b->shape, a->shape);
+  TEST_ASSERT_EQUAL(10, ((Number *)hash_get(a, new_string("key1")))->value);
+  TEST_ASSERT_EQUAL(1, ((Number *)hash_get(b, new_string("key1")))->value);
+
+  hash_put(b, new_interned_string("other"), (Object *)number(3));
+  TEST_ASSERT_EQUAL_PTR(a->shape, b->shape->parent);
+  TEST_ASSERT_NULL(hash_get(a, new_interned_string("other")));
+}
+
+void test_records_fall_back_to_dictionaries(void) {
+  Hash *large = record(SHAPE_MAX_KEYS + 1);
+  TEST_ASSERT_NULL(large->shape);
+  TEST_ASSERT_EQUAL(SHAPE_MAX_KEYS + 1, large->len);
+
+  Hash *mixed = record(3);
+  hash_put(mixed, (Object *)number(1), (Object *)number(100));
+  TEST_ASSERT_NULL(mixed->shape);
+
+  Hash *hashes[] = {large, mixed};
+  for (size_t i = 0; i < 2; i++) {
+    Object *value = hash_get(hashes[i], new_string("key2"));
+    TEST_ASSERT_EQUAL(2, ((Number *)value)->value);
+  }
+  TEST_ASSERT_EQUAL(
+      100, ((Number *)hash_get(mixed, (Object *)number(1)))->value);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_put_and_get);
+  RUN_TEST(test_put_replaces_existing_keys);
+  RUN_TEST(test_keys_of_different_types_are_distinct);
+  RUN_TEST(test_unhashable_keys);
+  RUN_TEST(test_next_visits_every_pair_once);
+  RUN_TEST(test_records_share_shapes);
+  RUN_TEST(test_records_fall_back_to_dictionaries);
+  return UNITY_END();
+}
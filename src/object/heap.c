@@ -0,0 +1,276 @@
+#include "heap.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+_Thread_local Heap *current_heap = NULL;
+
+static const size_t size_classes[] = {16, 32, 48, 64, 96, 128, 256, 512, 1024};
+
+#define SIZE_CLASS_COUNT (sizeof(size_classes) / sizeof(size_classes[0]))
+#define LARGE_BLOCK SIZE_CLASS_COUNT
+
+typedef struct HeapArena HeapArena;
+
+typedef struct HeapBlock {
+  HeapArena *arena; // NULL for large blocks taken straight from malloc
+  size_t size_class;
+  struct HeapBlock *next_free; // overlaps the payload while the block is free
+} HeapBlock;
+
+#define BLOCK_HEADER_SIZE offsetof(HeapBlock, next_free)
+
+typedef struct HeapChunk {
+  struct HeapChunk *next;
+  max_align_t data[];
+} HeapChunk;
+
+// Allocation buffer of a single thread. Only the owner touches the free
+// lists and the bump pointer, other threads only push to remote_frees.
+struct HeapArena {
+  HeapBlock *free_lists[SIZE_CLASS_COUNT];
+  char *bump;
+  char *bump_end;
+  HeapChunk *chunks;
+  size_t live_blocks;
+  _Atomic(HeapBlock *) remote_frees;
+};
+
+static _Thread_local HeapArena *thread_arena = NULL;
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+
+void heap_init(Heap *heap, size_t limit) {
+  *heap = (Heap){
+      .limit = limit,
+      .used = 0,
+      .peak = 0,
+      .out_of_memory = false,
+      .on_limit = NULL,
+  };
+}
+
+static bool heap_has_room(Heap *heap, size_t size) {
+  return heap->limit == 0 || heap->used + size <= heap->limit;
+}
+
+// Charges size bytes to the current heap without allocating them, for
+// payloads that are allocated elsewhere (e.g. DynamicArray storage).
+bool heap_reserve(size_t size) {
+  Heap *heap = current_heap;
+  if (!heap) {
+    return true;
+  }
+
+  if (!heap_has_room(heap, size) && heap->on_limit) {
+    heap->on_limit(heap);
+  }
+
+  if (!heap_has_room(heap, size)) {
+    heap->out_of_memory = true;
+    return false;
+  }
+
+  heap->used += size;
+  if (heap->used > heap->peak) {
+    heap->peak = heap->used;
+  }
+
+  return true;
+}
+
+static void reclaim_remote_frees(HeapArena *arena) {
+  HeapBlock *block = atomic_exchange_explicit(&arena->remote_frees, NULL,
+                                              memory_order_acquire);
+  while (block) {
+    HeapBlock *next = block->next_free;
+    block->next_free = arena->free_lists[block->size_class];
+    arena->free_lists[block->size_class] = block;
+    arena->live_blocks--;
+    block = next;
+  }
+}
+
+// Runs when a thread exits. Blocks still referenced from other threads keep
+// the whole arena alive, since there is no way to tell when they are gone.
+static void release_arena(void *ptr) {
+  HeapArena *arena = ptr;
+  reclaim_remote_frees(arena);
+  if (arena->live_blocks > 0) {
+    return;
+  }
+
+  while (arena->chunks) {
+    HeapChunk *next = arena->chunks->next;
+    free(arena->chunks);
+    arena->chunks = next;
+  }
+  free(arena);
+}
+
+static void create_arena_key(void) {
+  pthread_key_create(&arena_key, release_arena);
+}
+
+static HeapArena *get_thread_arena(void) {
+  if (thread_arena) {
+    return thread_arena;
+  }
+
+  pthread_once(&arena_key_once, create_arena_key);
+
+  HeapArena *arena = calloc(1, sizeof(HeapArena));
+  if (!arena) {
+    return NULL;
+  }
+  atomic_init(&arena->remote_frees, NULL);
+
+  pthread_setspecific(arena_key, arena);
+  thread_arena = arena;
+  return arena;
+}
+
+static size_t size_class_of(size_t size) {
+  for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+    if (size <= size_classes[i]) {
+      return i;
+    }
+  }
+
+  return LARGE_BLOCK;
+}
+
+static HeapBlock *carve_block(HeapArena *arena, size_t size_class) {
+  size_t block_size = BLOCK_HEADER_SIZE + size_classes[size_class];
+
+  if (arena->bump == NULL || arena->bump + block_size > arena->bump_end) {
+    HeapChunk *chunk = malloc(HEAP_CHUNK_SIZE);
+    if (!chunk) {
+      return NULL;
+    }
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->bump = (char *)chunk->data;
+    arena->bump_end = (char *)chunk + HEAP_CHUNK_SIZE;
+  }
+
+  HeapBlock *block = (HeapBlock *)arena->bump;
+  arena->bump += block_size;
+
+  block->arena = arena;
+  block->size_class = size_class;
+  return block;
+}
+
+static HeapBlock *arena_alloc(HeapArena *arena, size_t size_class) {
+  if (!arena->free_lists[size_class] &&
+      atomic_load_explicit(&arena->remote_frees, memory_order_relaxed)) {
+    reclaim_remote_frees(arena);
+  }
+
+  HeapBlock *block = arena->free_lists[size_class];
+  if (block) {
+    arena->free_lists[size_class] = block->next_free;
+  } else {
+    block = carve_block(arena, size_class);
+    if (!block) {
+      return NULL;
+    }
+  }
+
+  arena->live_blocks++;
+  return block;
+}
+
+static void *allocate_block(size_t size) {
+  size_t size_class = size_class_of(size);
+  HeapArena *arena = size_class == LARGE_BLOCK ? NULL : get_thread_arena();
+
+  HeapBlock *block;
+  if (arena) {
+    block = arena_alloc(arena, size_class);
+  } else {
+    block = malloc(BLOCK_HEADER_SIZE + size);
+    if (block) {
+      block->arena = NULL;
+      block->size_class = LARGE_BLOCK;
+    }
+  }
+
+  if (!block) {
+    return NULL;
+  }
+
+  return (char *)block + BLOCK_HEADER_SIZE;
+}
+
+// Returns NULL instead of aborting when the budget is exhausted or malloc
+// fails, and flags the heap so the VM can report VM_OUT_OF_MEMORY. Memory
+// returned here must be released with heap_free, never with free.
+void *heap_alloc(size_t size) {
+  if (!heap_reserve(size)) {
+    return NULL;
+  }
+
+  void *ptr = allocate_block(size);
+  if (!ptr) {
+    heap_release(size);
+    if (current_heap) {
+      current_heap->out_of_memory = true;
+    }
+  }
+
+  return ptr;
+}
+
+void heap_release(size_t size) {
+  Heap *heap = current_heap;
+  if (!heap) {
+    return;
+  }
+
+  heap->used = size > heap->used ? 0 : heap->used - size;
+}
+
+void heap_free(void *ptr) {
+  if (!ptr) {
+    return;
+  }
+
+  HeapBlock *block = (HeapBlock *)((char *)ptr - BLOCK_HEADER_SIZE);
+  HeapArena *arena = block->arena;
+
+  if (!arena) {
+    free(block);
+    return;
+  }
+
+  if (arena == thread_arena) {
+    block->next_free = arena->free_lists[block->size_class];
+    arena->free_lists[block->size_class] = block;
+    arena->live_blocks--;
+    return;
+  }
+
+  // The owner picks the block up on its next allocation
+  HeapBlock *head =
+      atomic_load_explicit(&arena->remote_frees, memory_order_relaxed);
+  do {
+    block->next_free = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &arena->remote_frees, &head, block, memory_order_release,
+      memory_order_relaxed));
+}
+
+size_t heap_block_capacity(const void *ptr) {
+  const HeapBlock *block =
+      (const HeapBlock *)((const char *)ptr - BLOCK_HEADER_SIZE);
+  if (block->size_class == LARGE_BLOCK) {
+    return SIZE_MAX;
+  }
+
+  return size_classes[block->size_class];
+}
@@ -0,0 +1,46 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Heap Heap;
+
+// Called when an allocation would exceed the budget, before it fails. There
+// is no collector, so nothing is reclaimed on its own: the handler is where
+// the host frees what it holds or raises the limit, which is checked again
+// once it returns.
+typedef void (*HeapLimitHandler)(Heap *);
+
+// Byte budget for the objects allocated while a VM is running. Objects are
+// charged with their header plus any payload allocated alongside them
+// (string bytes, array slots).
+struct Heap {
+  size_t limit; // 0 means unlimited
+  size_t used;
+  size_t peak;
+  bool out_of_memory;
+  HeapLimitHandler on_limit; // NULL to fail right away
+};
+
+// Heap charged by the object constructors on this thread, or NULL to
+// allocate without a budget (compiler, evaluator, bytecode loader).
+extern _Thread_local Heap *current_heap;
+
+void heap_init(Heap *, size_t);
+bool heap_reserve(size_t);
+void heap_release(size_t);
+
+// Small blocks are carved from chunks owned by the allocating thread, so VMs
+// running on different threads never contend on malloc. A block freed by
+// another thread is queued back to its owner and recycled there.
+#define HEAP_CHUNK_SIZE (64 * 1024)
+
+void *heap_alloc(size_t);
+void heap_free(void *);
+
+// Bytes that fit in the block behind memory returned by heap_alloc. Large
+// blocks do not record their size, they report SIZE_MAX.
+size_t heap_block_capacity(const void *);
+
+#endif // HEAP_H
@@ -0,0 +1,76 @@
+#include "../unity/src/unity.h"
+#include "../unity/src/unity_internals.h"
+#include "heap.h"
+#include <pthread.h>
+
+void test_blocks_are_recycled(void) {
+  void *first = heap_alloc(16);
+  heap_free(first);
+
+  void *second = heap_alloc(16);
+  TEST_ASSERT_EQUAL_PTR(first, second);
+
+  // Different size classes never share blocks
+  void *other = heap_alloc(100);
+  TEST_ASSERT_NOT_EQUAL(second, other);
+
+  heap_free(second);
+  heap_free(other);
+}
+
+void test_large_blocks(void) {
+  char *large = heap_alloc(HEAP_CHUNK_SIZE * 2);
+  TEST_ASSERT_NOT_NULL(large);
+
+  large[HEAP_CHUNK_SIZE * 2 - 1] = 'x';
+  heap_free(large);
+}
+
+static void *free_block(void *block) {
+  heap_free(block);
+  return NULL;
+}
+
+void test_cross_thread_frees_return_to_owner(void) {
+  void *block = heap_alloc(48);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, free_block, block);
+  pthread_join(thread, NULL);
+
+  TEST_ASSERT_EQUAL_PTR(block, heap_alloc(48));
+  heap_free(block);
+}
+
+static void *read_current_heap(void *out) {
+  *(Heap **)out = current_heap;
+  return NULL;
+}
+
+void test_current_heap_is_per_thread(void) {
+  Heap heap;
+  heap_init(&heap, 0);
+  current_heap = &heap;
+
+  Heap *seen_by_thread = &heap;
+  pthread_t thread;
+  pthread_create(&thread, NULL, read_current_heap, &seen_by_thread);
+  pthread_join(thread, NULL);
+
+  TEST_ASSERT_NULL(seen_by_thread);
+
+  void *block = heap_alloc(32);
+  TEST_ASSERT_EQUAL(32, heap.used);
+  heap_free(block);
+
+  current_heap = NULL;
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_blocks_are_recycled);
+  RUN_TEST(test_large_blocks);
+  RUN_TEST(test_cross_thread_frees_return_to_owner);
+  RUN_TEST(test_current_heap_is_per_thread);
+  return UNITY_END();
+}
@@ -1,15 +1,72 @@
 #include "./object.h"
 #include "../crc/crc.h"
+#include "../heap_profiler/heap_profiler.h"
+#include "array.h"
+#include "bits.h"
+#include "deque.h"
+#include "float64_array.h"
+#include "heap.h"
 #include "../str_utils/str_utils.h"
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 
+#define ARRAY_LEN(a) (sizeof(a) / sizeof(a[0]))
+
 const char *ObjectTypeString[] = {
-    "NUMBER_OBJ", "BOOLEAN_OBJ",  "NULL_OBJ",     "RETURN_OBJ",
-    "ERROR_OBJ",  "FUNCTION_OBJ", "STRING_OBJ",   "BUILTIN_OBJ",
-    "ARRAY_OBJ",  "HASH_OBJ",     "CONTINUE_OBJ", "BREAK_OBJ",
+    "NUMBER_OBJ",   "BOOLEAN_OBJ",  "NULL_OBJ",
+    "RETURN_OBJ",   "ERROR_OBJ",    "FUNCTION_OBJ",
+    "STRING_OBJ",   "BUILTIN_OBJ",  "ARRAY_OBJ",
+    "HASH_OBJ",     "CONTINUE_OBJ", "BREAK_OBJ",
+    "COMPILED_FUNCTION_OBJ",        "CLOSURE_OBJ",
+    "COMPILED_LOOP_OBJ",            "DEQUE_OBJ",
+    "FLOAT64_ARRAY_OBJ",            "BITS_OBJ",
+};
+
+Boolean obj_true = {
+    .type = BOOLEAN_OBJ,
+    .value = true,
+};
+
+Boolean obj_false = {
+    .type = BOOLEAN_OBJ,
+    .value = false,
+};
+
+Null obj_null = {
+    .type = NULL_OBJ,
 };
 
+static Number small_numbers[SMALL_NUMBER_MAX - SMALL_NUMBER_MIN + 1];
+static pthread_once_t small_numbers_once = PTHREAD_ONCE_INIT;
+
+static void init_small_numbers(void) {
+  for (long i = SMALL_NUMBER_MIN; i <= SMALL_NUMBER_MAX; i++) {
+    small_numbers[i - SMALL_NUMBER_MIN] = (Number){
+        .type = NUMBER_OBJ,
+        .value = i,
+    };
+  }
+}
+
+static bool is_small_number(double value) {
+  // -0.0 is left out so that it keeps its sign through later divisions
+  return value >= SMALL_NUMBER_MIN && value <= SMALL_NUMBER_MAX &&
+         value == (long)value && !(value == 0 && signbit(value));
+}
+
+bool is_immortal_object(Object *obj) {
+  if (obj == (Object *)&obj_true || obj == (Object *)&obj_false ||
+      obj == (Object *)&obj_null) {
+    return true;
+  }
+
+  Number *num = (Number *)obj;
+  return num >= small_numbers &&
+         num < small_numbers + ARRAY_LEN(small_numbers);
+}
+
 void inspect_number_object(ResizableBuffer *buf, Number *obj) {
   char temp_buf[100];
   sprintf(temp_buf, "%d", (int)obj->value);
@@ -52,7 +109,7 @@ void inspect_function_object(ResizableBuffer *buf, Function *obj) {
 }
 
 void inspect_string_object(ResizableBuffer *buf, String *str) {
-  append_to_buf(buf, str->value);
+  append_to_buf(buf, (char *)string_value(str));
 }
 
 void inspect_builtin(ResizableBuffer *buf) {
@@ -63,7 +120,12 @@ void inspect_array_object(ResizableBuffer *buf, Array *arr) {
   append_to_buf(buf, "[");
 
   for (size_t i = 0; i < arr->elements.len; i++) {
-    inspect_object(buf, arr->elements.arr[i]);
+    if (arr->kind == ARRAY_NUMBERS) {
+      Number number = {.type = NUMBER_OBJ, .value = array_get_number(arr, i)};
+      inspect_object(buf, (Object *)&number);
+    } else {
+      inspect_object(buf, vector_get(&arr->elements, i));
+    }
 
     if (i < arr->elements.len - 1) {
       append_to_buf(buf, ", ");
@@ -72,22 +134,54 @@ void inspect_array_object(ResizableBuffer *buf, Array *arr) {
   append_to_buf(buf, "]");
 }
 
-int hash_inspect_iter(void *buf, hashmap_element_t *pair) {
-  HashPair *value = pair->data;
+void inspect_deque_object(ResizableBuffer *buf, Deque *deque) {
+  append_to_buf(buf, "deque[");
 
-  ResizableBuffer *char_buf = buf;
+  for (size_t i = 0; i < deque->len; i++) {
+    inspect_object(buf, deque_get(deque, i));
 
-  inspect_object(char_buf, value->key);
-  append_to_buf(char_buf, ": ");
-  inspect_object(char_buf, value->value);
-  append_to_buf(char_buf, ", ");
+    if (i < deque->len - 1) {
+      append_to_buf(buf, ", ");
+    }
+  }
+  append_to_buf(buf, "]");
+}
 
-  return 0;
+void inspect_float64_array_object(ResizableBuffer *buf, Float64Array *array) {
+  append_to_buf(buf, "farray[");
+
+  for (size_t i = 0; i < array->len; i++) {
+    Number number = {.type = NUMBER_OBJ, .value = array->values[i]};
+    inspect_number_object(buf, &number);
+
+    if (i < array->len - 1) {
+      append_to_buf(buf, ", ");
+    }
+  }
+  append_to_buf(buf, "]");
+}
+
+void inspect_bits_object(ResizableBuffer *buf, Bits *bits) {
+  append_to_buf(buf, "bits[");
+
+  for (size_t i = 0; i < bits->len; i++) {
+    append_to_buf(buf, bits_get(bits, i) ? "1" : "0");
+  }
+  append_to_buf(buf, "]");
 }
 
 void inspect_hash_object(ResizableBuffer *buf, Hash *hash) {
   append_to_buf(buf, "{");
-  hashmap_iterate_pairs(&hash->pairs, &hash_inspect_iter, buf);
+
+  size_t cursor = 0;
+  Object *key, *value;
+  while (hash_next(hash, &cursor, &key, &value)) {
+    inspect_object(buf, key);
+    append_to_buf(buf, ": ");
+    inspect_object(buf, value);
+    append_to_buf(buf, ", ");
+  }
+
   append_to_buf(buf, "}");
 }
 
@@ -136,34 +230,83 @@ void inspect_object(ResizableBuffer *buf, Object *obj) {
     return inspect_closure(buf, (Closure *)obj);
   case COMPILED_LOOP_OBJ:
     return inspect_compiled_loop(buf, (CompiledLoop *)obj);
+  case DEQUE_OBJ:
+    return inspect_deque_object(buf, (Deque *)obj);
+  case FLOAT64_ARRAY_OBJ:
+    return inspect_float64_array_object(buf, (Float64Array *)obj);
+  case BITS_OBJ:
+    return inspect_bits_object(buf, (Bits *)obj);
   case CONTINUE_OBJ:
   case BREAK_OBJ:
     return; // break and continue object are sentinel values
   }
 }
 
-int32_t get_string_hash_key(String *str) {
-  return crc32((unsigned char *)str->value, strlen(str->value), 10);
+// Final mix of splitmix64, spreads every input bit over the whole result so
+// that both the probe position and the control byte of a key vary.
+static uint64_t mix_hash(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
 }
 
-int32_t get_bool_hash_key(Boolean *boolean) {
-  return boolean->value << BOOLEAN_OBJ;
+static uint64_t hash_string_contents(const char *value, size_t len) {
+  uint64_t crc = crc32((unsigned char *)value, len, 10);
+  return mix_hash(crc | (uint64_t)len << 32);
 }
 
-int32_t get_int_hash_key(Number *integer) {
-  return (long)integer->value << NUMBER_OBJ;
+static uint64_t get_string_hash_key(String *str) {
+  if (!str->hashed) {
+    str->hash = hash_string_contents(string_value(str), str->len);
+    str->hashed = true;
+  }
+
+  return str->hash;
 }
 
-int32_t get_hash_key(Object *obj) {
+static uint64_t get_number_hash_key(Number *num) {
+  // 0.0 and -0.0 are equal keys, so they need the same hash
+  double value = num->value == 0 ? 0 : num->value;
+
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  return mix_hash(bits);
+}
+
+bool get_hash_key(Object *obj, uint64_t *out) {
   switch (obj->type) {
   case STRING_OBJ:
-    return get_string_hash_key((String *)obj);
+    *out = get_string_hash_key((String *)obj);
+    return true;
+  case BOOLEAN_OBJ:
+    *out = mix_hash(((Boolean *)obj)->value ? 1 : 2);
+    return true;
+  case NUMBER_OBJ:
+    *out = get_number_hash_key((Number *)obj);
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool hash_keys_equal(Object *a, Object *b) {
+  if (a->type != b->type) {
+    return false;
+  }
+
+  switch (a->type) {
+  case STRING_OBJ:
+    return string_equals((String *)a, (String *)b);
   case BOOLEAN_OBJ:
-    return get_bool_hash_key((Boolean *)obj);
+    return ((Boolean *)a)->value == ((Boolean *)b)->value;
   case NUMBER_OBJ:
-    return get_int_hash_key((Number *)obj);
+    return ((Number *)a)->value == ((Number *)b)->value;
   default:
-    return -1;
+    return false;
   }
 }
 
@@ -198,77 +341,271 @@ size_t sizeof_object(Object *obj) {
     return sizeof(Closure);
   case COMPILED_LOOP_OBJ:
     return sizeof(CompiledLoop);
+  case DEQUE_OBJ:
+    return sizeof(Deque);
+  case FLOAT64_ARRAY_OBJ:
+    return sizeof(Float64Array);
+  case BITS_OBJ:
+    return sizeof(Bits);
   }
 
   assert(0 && "unknown object type");
 }
 
 Object *new_number(double value) {
-  Number *int_obj = malloc(sizeof(Number));
-  assert(int_obj != NULL && "Error allocating memory for integer");
+  Number *int_obj = heap_alloc(sizeof(Number));
+  if (int_obj == NULL) {
+    return NULL;
+  }
 
   int_obj->value = value;
   int_obj->type = NUMBER_OBJ;
+  heap_profile_record_alloc((Object *)int_obj);
 
   return (Object *)int_obj;
 }
 
-Object *new_string(char *value) {
-  String *str = malloc(sizeof(String));
-  assert(str != NULL && "error allocating memory for string");
+// Returns the shared immortal Number for small integers, so that hot VM
+// paths such as loop counters and indices do not allocate.
+Object *new_cached_number(double value) {
+  if (!is_small_number(value)) {
+    return new_number(value);
+  }
+
+  pthread_once(&small_numbers_once, init_small_numbers);
+
+  return (Object *)&small_numbers[(long)value - SMALL_NUMBER_MIN];
+}
+
+static String *alloc_string(size_t len) {
+  String *str = heap_alloc(sizeof(String));
+  if (str == NULL) {
+    return NULL;
+  }
+
+  str->value = heap_alloc(len + 1);
+  if (str->value == NULL) {
+    heap_free(str);
+    heap_release(sizeof(String));
+    return NULL;
+  }
 
   str->type = STRING_OBJ;
-  str->len = strlen(value);
-  str->value = strdup(value);
+  str->len = len;
+  str->buffer = NULL;
+  str->hashed = false;
+  str->interned = false;
+
+  return str;
+}
+
+Object *new_string(char *value) {
+  String *str = alloc_string(strlen(value));
+  if (str == NULL) {
+    return NULL;
+  }
+
+  memcpy(str->value, value, str->len + 1);
+  heap_profile_record_alloc((Object *)str);
 
   return (Object *)str;
 }
 
+#define STRING_BUFFER_MIN_CAPACITY 32
+
+static StringBuffer *new_string_buffer(size_t cap) {
+  StringBuffer *buffer = heap_alloc(sizeof(StringBuffer) + cap + 1);
+  if (buffer == NULL) {
+    return NULL;
+  }
+
+  buffer->len = 0;
+  buffer->cap = cap;
+  buffer->refs = 0;
+  buffer->data[0] = '\0';
+
+  return buffer;
+}
+
+static void release_string_buffer(StringBuffer *buffer) {
+  if (buffer->refs > 0 && --buffer->refs > 0) {
+    return;
+  }
+
+  heap_release(sizeof(StringBuffer) + buffer->cap + 1);
+  heap_free(buffer);
+}
+
+// Concatenation appends right to the buffer left was built in whenever left
+// is still the longest string using it. Repeatedly growing a string, as in
+// `s = s + "x"`, then only copies each character about twice overall instead
+// of copying the whole string on every step.
 Object *new_concatted_string(String *left, String *right) {
-  String *new_string = malloc(sizeof(String));
-  assert(new_string != NULL);
+  size_t len = left->len + right->len;
+
+  StringBuffer *buffer = left->buffer;
+  if (buffer == NULL || buffer->len != left->len || len > buffer->cap) {
+    size_t cap = len * 2;
+    buffer = new_string_buffer(cap < STRING_BUFFER_MIN_CAPACITY
+                                   ? STRING_BUFFER_MIN_CAPACITY
+                                   : cap);
+    if (buffer == NULL) {
+      return NULL;
+    }
 
-  new_string->type = STRING_OBJ;
-  new_string->len = left->len + right->len;
+    memcpy(buffer->data, left->value, left->len);
+    buffer->len = left->len;
+  }
+
+  String *str = heap_alloc(sizeof(String));
+  if (str == NULL) {
+    if (buffer->refs == 0) {
+      release_string_buffer(buffer);
+    }
+    return NULL;
+  }
 
-  new_string->value = malloc(new_string->len + 1);
+  memcpy(buffer->data + buffer->len, right->value, right->len);
+  buffer->len = len;
+  buffer->data[len] = '\0';
 
-  strlcpy(new_string->value, left->value, new_string->len + 1);
-  strncat(new_string->value, right->value, new_string->len + 1);
+  str->type = STRING_OBJ;
+  str->value = buffer->data;
+  str->len = len;
+  str->buffer = buffer;
+  buffer->refs++;
+  str->hashed = false;
+  str->interned = false;
+  heap_profile_record_alloc((Object *)str);
 
-  return (Object *)new_string;
+  return (Object *)str;
+}
+
+const char *string_value(String *str) {
+  if (str->buffer == NULL || str->buffer->len == str->len) {
+    return str->value;
+  }
+
+  // A longer string was appended to the buffer since, take a private copy.
+  // Should the allocation fail, the caller still gets the value cut to len.
+  char *value = heap_alloc(str->len + 1);
+  if (value == NULL) {
+    return strndup(str->value, str->len);
+  }
+
+  memcpy(value, str->value, str->len);
+  value[str->len] = '\0';
+
+  release_string_buffer(str->buffer);
+  str->value = value;
+  str->buffer = NULL;
+
+  return value;
+}
+
+// Canonical String of every interned value, keyed by contents. Entries live
+// as long as the process, like the other immortal objects.
+static hashmap_t interned_strings;
+static pthread_once_t interned_strings_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t interned_strings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void init_interned_strings(void) {
+  hashmap_create(256, &interned_strings);
+}
+
+static String *intern(const char *value) {
+  pthread_once(&interned_strings_once, init_interned_strings);
+  pthread_mutex_lock(&interned_strings_lock);
+
+  size_t len = strlen(value);
+  String *canonical = hashmap_get(&interned_strings, value, len);
+  if (canonical == NULL) {
+    canonical = malloc(sizeof(String));
+    assert(canonical != NULL);
+
+    *canonical = (String){
+        .type = STRING_OBJ,
+        .value = strdup(value),
+        .len = len,
+        .buffer = NULL,
+        .hash = hash_string_contents(value, len),
+        .hashed = true,
+        .interned = true,
+    };
+    assert(canonical->value != NULL);
+
+    hashmap_put(&interned_strings, canonical->value, len, canonical);
+  }
+
+  pthread_mutex_unlock(&interned_strings_lock);
+  return canonical;
+}
+
+Object *new_interned_string(const char *value) {
+  String *canonical = intern(value);
+
+  // Callers own the object they get back, only the contents are shared
+  String *str = heap_alloc(sizeof(String));
+  if (str == NULL) {
+    return NULL;
+  }
+
+  *str = *canonical;
+  heap_profile_record_alloc((Object *)str);
+
+  return (Object *)str;
+}
+
+bool string_equals(String *left, String *right) {
+  if (left->interned && right->interned) {
+    return left->value == right->value;
+  }
+
+  if (left->len != right->len) {
+    return false;
+  }
+
+  if (left->hashed && right->hashed && left->hash != right->hash) {
+    return false;
+  }
+
+  return memcmp(left->value, right->value, left->len) == 0;
 }
 
 Object *new_compiled_function(Instructions *instructions, size_t num_locals,
                               size_t num_parameters) {
-  CompiledFunction *fn = malloc(sizeof(CompiledFunction));
+  CompiledFunction *fn = heap_alloc(sizeof(CompiledFunction));
   assert(fn != NULL);
   fn->type = COMPILED_FUNCTION_OBJ;
   fn->num_locals = num_locals;
   fn->num_parameters = num_parameters;
 
   fn->instructions = *instructions;
+  heap_profile_record_alloc((Object *)fn);
 
   return (Object *)fn;
 }
 
 Object *new_concatted_compiled_function(Instructions *instructions,
                                         size_t instructions_count) {
-  CompiledFunction *fn = malloc(sizeof(CompiledFunction));
+  CompiledFunction *fn = heap_alloc(sizeof(CompiledFunction));
   assert(fn != NULL);
 
+  fn->type = COMPILED_FUNCTION_OBJ;
   fn->instructions = concat_instructions(instructions_count, instructions);
+  heap_profile_record_alloc((Object *)fn);
 
   return (Object *)fn;
 }
 
 Object *new_compiled_loop(Instructions *instructions, size_t num_locals) {
-  CompiledLoop *loop = malloc(sizeof(CompiledLoop));
+  CompiledLoop *loop = heap_alloc(sizeof(CompiledLoop));
   assert(loop != NULL);
 
   loop->type = COMPILED_LOOP_OBJ;
   loop->num_locals = num_locals;
   loop->instructions = *instructions;
+  heap_profile_record_alloc((Object *)loop);
 
   return (Object *)loop;
 }
@@ -276,68 +613,215 @@ Object *new_compiled_loop(Instructions *instructions, size_t num_locals) {
 Object *new_concatted_compiled_loop(Instructions *instructions,
                                     size_t instructions_count,
                                     size_t num_locals) {
-  CompiledLoop *loop = malloc(sizeof(CompiledLoop));
+  CompiledLoop *loop = heap_alloc(sizeof(CompiledLoop));
   assert(loop != NULL);
 
+  loop->type = COMPILED_LOOP_OBJ;
   loop->instructions = concat_instructions(instructions_count, instructions);
   loop->num_locals = num_locals;
+  heap_profile_record_alloc((Object *)loop);
 
   return (Object *)loop;
 }
 
+// Releases the blocks an object owns besides its own struct. Interned
+// strings share the process-wide copy of their value, and arrays share their
+// nodes with the arrays derived from them, so neither owns anything here.
+static void free_payload(Object *obj) {
+  switch (obj->type) {
+  case STRING_OBJ: {
+    String *str = (String *)obj;
+    if (str->buffer != NULL) {
+      release_string_buffer(str->buffer);
+    } else if (!str->interned) {
+      heap_release(str->len + 1);
+      heap_free(str->value);
+    }
+    break;
+  }
+  case HASH_OBJ:
+    free_hash_storage((Hash *)obj);
+    break;
+  case DEQUE_OBJ:
+    free_deque_items((Deque *)obj);
+    break;
+  case FLOAT64_ARRAY_OBJ:
+    free_float64_values((Float64Array *)obj);
+    break;
+  case BITS_OBJ:
+    free_bits_words((Bits *)obj);
+    break;
+  default:
+    break;
+  }
+}
+
 void free_object(Object *obj) {
+  if (is_immortal_object(obj)) {
+    return;
+  }
+
   if (obj->type != BOOLEAN_OBJ && obj->type != BUILTIN_OBJ &&
       obj->type != NULL_OBJ) {
-    free(obj);
+    heap_profile_record_free(obj);
+    free_payload(obj);
+    heap_release(sizeof_object(obj));
+    heap_free(obj);
   }
 }
 
+void free_objects(DynamicArray *objects) {
+  for (size_t i = 0; i < objects->len; i++) {
+    free_object(objects->arr[i]);
+  }
+
+  free(objects->arr);
+  objects->arr = NULL;
+  objects->len = 0;
+  objects->cap = 0;
+}
+
 Object *new_error(char *message) {
-  Error *err = malloc(sizeof(Error));
-  assert(err != NULL);
-  err->message = message;
+  Error *err = heap_alloc(sizeof(Error));
+  if (err == NULL) {
+    return NULL;
+  }
+
+  // Callers usually format the message in a stack buffer
+  err->message = strdup(message);
   err->type = ERROR_OBJ;
+  heap_profile_record_alloc((Object *)err);
 
   return (Object *)err;
 }
 
-Object *new_array(Object **arr, size_t len) {
-  Array *array = malloc(sizeof(Array));
-  assert(array != NULL);
+Object *new_empty_array(void) {
+  Array *array = heap_alloc(sizeof(Array));
+  if (array == NULL) {
+    return NULL;
+  }
 
   array->type = ARRAY_OBJ;
-  array_init(&array->elements, len);
+  array->kind = ARRAY_NUMBERS;
+  vector_init(&array->elements);
+  heap_profile_record_alloc((Object *)array);
+
+  return (Object *)array;
+}
+
+Object *new_array(Object **arr, size_t len) {
+  Array *array = (Array *)new_empty_array();
+  if (array == NULL) {
+    return NULL;
+  }
+
+  // The new array owns all of its nodes, so they are filled in place
   for (size_t i = 0; i < len; i++) {
-    array_append(&array->elements, arr[i]);
+    if (!array_push(array, arr[i])) {
+      free_object((Object *)array);
+      return NULL;
+    }
   }
 
   return (Object *)array;
 }
 
+// Returns a new array holding the same elements as `source` in O(1). Both
+// arrays stay independent: updating one copies the nodes it touches.
+Object *new_shared_array(Array *source) {
+  Array *array = (Array *)new_empty_array();
+  if (array == NULL) {
+    return NULL;
+  }
+
+  array->kind = source->kind;
+  vector_share(&source->elements, &array->elements);
+
+  return (Object *)array;
+}
+
+Object *copy_object(Object *obj) {
+  size_t size = sizeof_object(obj);
+  Object *copy = heap_alloc(size);
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  memcpy(copy, obj, size);
+
+  // Both strings are freed on their own, so each needs its own claim on the
+  // contents
+  if (obj->type == STRING_OBJ) {
+    String *str = (String *)copy;
+    if (str->buffer != NULL) {
+      str->buffer->refs++;
+    } else if (!str->interned) {
+      str->value = heap_alloc(str->len + 1);
+      if (str->value == NULL) {
+        heap_release(size);
+        heap_free(copy);
+        return NULL;
+      }
+      memcpy(str->value, ((String *)obj)->value, str->len + 1);
+    }
+  }
+
+  heap_profile_record_alloc(copy);
+
+  return copy;
+}
+
+static size_t largest_object_size(void) {
+  static size_t largest = 0;
+  if (largest == 0) {
+    for (ObjectType type = 0; type < OBJECT_TYPE_COUNT; type++) {
+      Object obj = {.type = type};
+      size_t size = sizeof_object(&obj);
+      largest = size > largest ? size : largest;
+    }
+  }
+
+  return largest;
+}
+
+Object *box_object(Object *obj) {
+  Object *box = heap_alloc(largest_object_size());
+  if (box == NULL) {
+    return NULL;
+  }
+
+  memcpy(box, obj, sizeof_object(obj));
+  heap_profile_record_alloc(box);
+
+  return box;
+}
+
+// Immortal objects and builtins are static, not heap blocks
+bool is_boxed_object(Object *obj) {
+  return !is_immortal_object(obj) && obj->type != BUILTIN_OBJ &&
+         heap_block_capacity(obj) >= largest_object_size();
+}
+
 Object *new_closure(Object *fn) {
-  Closure *closure = malloc(sizeof(Closure));
+  Closure *closure = heap_alloc(sizeof(Closure));
+  if (closure == NULL) {
+    return NULL;
+  }
+
   closure->type = CLOSURE_OBJ;
 
   closure->enclosed = fn;
+  heap_profile_record_alloc((Object *)closure);
 
   return (Object *)closure;
 }
 
 Object *new_boolean(bool value) {
-  Boolean *boolean = malloc(sizeof(Boolean));
-  assert(boolean);
-
-  boolean->type = BOOLEAN_OBJ;
-  boolean->value = value;
+  if (value) {
+    return (Object *)&obj_true;
+  }
 
-  return (Object *)boolean;
+  return (Object *)&obj_false;
 }
 
-Object *new_null() {
-  Object *nil = malloc(sizeof(Object));
-  assert(nil);
-
-  nil->type = NULL_OBJ;
-
-  return nil;
-}
+Object *new_null() { return (Object *)&obj_null; }
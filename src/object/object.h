@@ -4,6 +4,7 @@
 #include "../code/code.h"
 #include "../environment/environment.h"
 #include "../parser/parser.h"
+#include "vector.h"
 #include <stdbool.h>
 
 typedef enum {
@@ -22,6 +23,9 @@ typedef enum {
   COMPILED_FUNCTION_OBJ,
   CLOSURE_OBJ,
   COMPILED_LOOP_OBJ,
+  DEQUE_OBJ,
+  FLOAT64_ARRAY_OBJ,
+  BITS_OBJ,
 } ObjectType;
 
 extern const char *ObjectTypeString[];
@@ -60,12 +64,29 @@ typedef struct {
   Environment *env;
 } Function;
 
+// Append buffer shared by the strings built from it by concatenation. Each
+// of them is a prefix of data, only the longest one may extend it in place.
+typedef struct {
+  size_t len; // data[len] is always '\0'
+  size_t cap;
+  size_t refs; // strings whose value points into data
+  char data[];
+} StringBuffer;
+
 typedef struct {
   ObjectType type; // STRING_OBJ
-  char *value;
+  char *value; // not NUL-terminated when it is a shorter prefix of `buffer`
   uint32_t len;
+  StringBuffer *buffer; // NULL unless value points into an append buffer
+  uint64_t hash;        // hash key, valid once `hashed` is set
+  bool hashed;
+  bool interned; // value is the single copy shared by equal interned strings
 } String;
 
+// NUL-terminated contents of the string, copied out of a shared append
+// buffer if needed. Use it instead of `value` whenever `len` is not enough.
+const char *string_value(String *);
+
 typedef Object *(*BuiltinFunction)(DynamicArray args); // Takes Object*[]
 
 typedef struct {
@@ -73,25 +94,79 @@ typedef struct {
   BuiltinFunction fn;
 } Builtin;
 
+// What the slots of an array's vector hold, see array.c
+typedef enum {
+  ARRAY_NUMBERS, // raw doubles, the array only ever held numbers
+  ARRAY_OBJECTS, // Object*
+} ElementKind;
+
 typedef struct {
   ObjectType type; // ARRAY_OBJ
-  DynamicArray elements;
+  ElementKind kind;
+  Vector elements;
 } Array;
 
+// Double-ended queue backed by a growable ring buffer, see deque.h.
+typedef struct {
+  ObjectType type; // DEQUE_OBJ
+  Object **items;  // `cap` slots, cap is zero or a power of two
+  size_t head;     // slot of the front element
+  size_t len;
+  size_t cap;
+} Deque;
+
+typedef struct {
+  ObjectType type; // FLOAT64_ARRAY_OBJ
+  double *values;  // `len` contiguous doubles
+  size_t len;
+} Float64Array;
+
+typedef struct {
+  ObjectType type; // BITS_OBJ
+  uint64_t *words;
+  size_t len; // in bits
+} Bits;
+
 typedef struct {
   ObjectType type; // NULL_OBJ
 } Null;
 
-int32_t get_hash_key(Object *);
+// Stores the hash of a key in the out parameter, or returns false when the
+// object cannot be used as a hash key.
+bool get_hash_key(Object *, uint64_t *);
+bool hash_keys_equal(Object *, Object *);
 
 typedef struct {
+  uint64_t hash; // cached hash of key, reused when the table grows
   Object *key;
   Object *value;
 } HashPair;
 
+// Describes the keys of hashes used as records, see shape.c. Shapes are
+// shared by every hash that got the same keys in the same order.
+typedef struct Shape {
+  struct Shape *parent;
+  String **keys; // interned, keys[i] lives in slot i
+  size_t len;
+  struct Shape **transitions; // shapes with one more key than this one
+  size_t num_transitions;
+  size_t transitions_cap;
+} Shape;
+
+// Hashes start in shape mode: while every key is an interned string the keys
+// are described by `shape` and the values live in the dense `slots` vector.
+// Any other key, or too many of them, moves the hash to dictionary mode, an
+// open-addressing table in the style of Swiss tables, see hash_table.c.
 typedef struct {
   ObjectType type; // HASH_OBJ
-  hashmap_t pairs;
+  Shape *shape;    // NULL in dictionary mode
+  Object **slots;  // shape mode values, `slots_cap` entries
+  size_t slots_cap;
+  int8_t *ctrl;    // one control byte per slot, then a copy of the first group
+  HashPair *pairs; // stored inline, `cap` slots
+  size_t cap;      // zero or a power of two
+  size_t len;
+  size_t growth_left;
 } Hash;
 
 typedef struct {
@@ -114,7 +189,20 @@ typedef struct {
   size_t num_free_variables;
 } Closure;
 
+// Immortal objects are statically allocated and shared by every value that
+// compares equal to them. They must never be freed or mutated in place.
+#define SMALL_NUMBER_MIN -1024
+#define SMALL_NUMBER_MAX 65535
+
+extern Boolean obj_true;
+extern Boolean obj_false;
+extern Null obj_null;
+
+bool is_immortal_object(Object *);
+
 void free_object(Object *);
+// Frees every object in the array and the array storage itself
+void free_objects(DynamicArray *);
 
 Object *new_compiled_function(Instructions *, size_t, size_t);
 Object *new_concatted_compiled_function(Instructions *, size_t);
@@ -122,11 +210,34 @@ Object *new_concatted_compiled_function(Instructions *, size_t);
 size_t sizeof_object(Object *);
 
 Object *new_number(double);
+Object *new_cached_number(double);
 Object *new_string(char *);
 Object *new_concatted_string(String *, String *);
+// Strings built from the same contents share one immutable value and a
+// precomputed hash, so they compare by pointer. Used for the constants
+// produced by the compiler and the bytecode loader.
+Object *new_interned_string(const char *);
+bool string_equals(String *, String *);
 
 Object *new_error(char *);
+Object *new_empty_array(void);
 Object *new_array(Object **, size_t);
+Object *new_shared_array(Array *);
+Object *new_hash(size_t);
+// Returns false when the key is not hashable or the table could not grow.
+bool hash_put(Hash *, Object *, Object *);
+// Returns NULL when the key is missing or not hashable.
+Object *hash_get(Hash *, Object *);
+// Iterates the pairs in slot order: start with *cursor = 0, false at the end.
+bool hash_next(Hash *, size_t *cursor, Object **key, Object **value);
+// Releases the slots or the table of a hash, but not the hash itself.
+void free_hash_storage(Hash *);
+Object *copy_object(Object *);
+// Captured variables are updated by copying the new value over them, so
+// they must sit in a block any object fits in. box_object returns such a
+// copy of an object, is_boxed_object tells whether it already is one.
+Object *box_object(Object *);
+bool is_boxed_object(Object *);
 Object *new_closure(Object *);
 Object *new_compiled_loop(Instructions *, size_t);
 Object *new_concatted_compiled_loop(Instructions *, size_t, size_t);
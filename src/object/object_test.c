@@ -1,13 +1,18 @@
 #include "../unity/src/unity.h"
 #include "../unity/src/unity_internals.h"
+#include "bits.h"
+#include "deque.h"
+#include "float64_array.h"
+#include "heap.h"
 #include "object.h"
 #include <string.h>
 
 void assert_keys(Object *a, Object *b) {
-  int32_t hash_a = get_hash_key(a);
-  int32_t hash_b = get_hash_key(b);
+  uint64_t hash_a, hash_b;
+  TEST_ASSERT_TRUE(get_hash_key(a, &hash_a));
+  TEST_ASSERT_TRUE(get_hash_key(b, &hash_b));
 
-  TEST_ASSERT_EQUAL(hash_a, hash_b);
+  TEST_ASSERT_EQUAL_UINT64(hash_a, hash_b);
 }
 
 void test_string_hash_key(void) {
@@ -41,8 +46,140 @@ void test_string_hash_key(void) {
   assert_keys((Object*)&jeff1, (Object*)&jeff2);
 }
 
+void test_immortal_objects(void) {
+  TEST_ASSERT_EQUAL_PTR(&obj_true, new_boolean(true));
+  TEST_ASSERT_EQUAL_PTR(&obj_false, new_boolean(false));
+  TEST_ASSERT_EQUAL_PTR(&obj_null, new_null());
+
+  Object *zero = new_cached_number(0);
+  TEST_ASSERT_EQUAL_PTR(zero, new_cached_number(0));
+  TEST_ASSERT_TRUE(is_immortal_object(zero));
+  TEST_ASSERT_TRUE(is_immortal_object(new_cached_number(SMALL_NUMBER_MIN)));
+  TEST_ASSERT_TRUE(is_immortal_object(new_cached_number(SMALL_NUMBER_MAX)));
+
+  Object *big = new_cached_number(SMALL_NUMBER_MAX + 1);
+  Object *fraction = new_cached_number(1.5);
+  TEST_ASSERT_FALSE(is_immortal_object(big));
+  TEST_ASSERT_FALSE(is_immortal_object(fraction));
+  TEST_ASSERT_EQUAL(SMALL_NUMBER_MAX + 1, ((Number *)big)->value);
+  TEST_ASSERT_TRUE(((Number *)fraction)->value == 1.5);
+
+  free_object(zero);
+  free_object(new_boolean(true));
+  TEST_ASSERT_EQUAL(0, ((Number *)new_cached_number(0))->value);
+
+  free_object(big);
+  free_object(fraction);
+}
+
+void test_repeated_concatenation(void) {
+  String *x = (String *)new_string("x");
+  String *s = (String *)new_string("");
+  String *prefix = NULL;
+
+  size_t buffers = 0;
+  StringBuffer *last_buffer = NULL;
+
+  for (size_t i = 0; i < 1024 * 1024; i++) {
+    s = (String *)new_concatted_string(s, x);
+
+    if (s->buffer != last_buffer) {
+      buffers++;
+      last_buffer = s->buffer;
+    }
+
+    if (i == 2) {
+      prefix = s;
+    }
+  }
+
+  // The buffer doubles, so there is one per power of two
+  TEST_ASSERT_EQUAL(1024 * 1024, s->len);
+  TEST_ASSERT_LESS_OR_EQUAL(17, buffers);
+
+  TEST_ASSERT_EQUAL_STRING("xxx", string_value(prefix));
+  TEST_ASSERT_NULL(prefix->buffer);
+  TEST_ASSERT_EQUAL(1024 * 1024, strlen(string_value(s)));
+
+  // A prefix sharing the buffer gets a copy instead of overwriting it
+  String *left = (String *)new_string("a");
+  String *ab = (String *)new_concatted_string(left, left);
+  String *abc = (String *)new_concatted_string(ab, x);
+  String *abd = (String *)new_concatted_string(ab, left);
+
+  TEST_ASSERT_EQUAL_STRING("aax", string_value(abc));
+  TEST_ASSERT_EQUAL_STRING("aaa", string_value(abd));
+  TEST_ASSERT_EQUAL_STRING("aa", string_value(ab));
+}
+
+void test_interned_strings(void) {
+  String *a = (String *)new_interned_string("monkey");
+  String *b = (String *)new_interned_string("monkey");
+  String *other = (String *)new_interned_string("donkey");
+
+  TEST_ASSERT_NOT_EQUAL(a, b);
+  TEST_ASSERT_EQUAL_PTR(a->value, b->value);
+  TEST_ASSERT_TRUE(a->hashed);
+
+  String *plain = (String *)new_string("monkey");
+  uint64_t plain_hash;
+  TEST_ASSERT_TRUE(get_hash_key((Object *)plain, &plain_hash));
+  TEST_ASSERT_EQUAL_UINT64(a->hash, plain_hash);
+  TEST_ASSERT_TRUE(plain->hashed);
+
+  TEST_ASSERT_TRUE(string_equals(a, b));
+  TEST_ASSERT_TRUE(string_equals(a, plain));
+  TEST_ASSERT_FALSE(string_equals(a, other));
+
+  free_object((Object *)a);
+  free_object((Object *)b);
+  free_object((Object *)other);
+  free_object((Object *)plain);
+}
+
+void test_free_object_releases_payloads(void) {
+  Heap heap;
+  heap_init(&heap, 0);
+  current_heap = &heap;
+
+  Object *a = new_string("a");
+  Object *ab = new_concatted_string((String *)a, (String *)a);
+  Object *abc = new_concatted_string((String *)ab, (String *)a);
+  Object *copy = copy_object(abc);
+  Object *abd = new_concatted_string((String *)ab, (String *)a);
+  string_value((String *)ab);
+
+  Object *key = new_interned_string("key");
+  Object *record = new_hash(0);
+  TEST_ASSERT_TRUE(hash_put((Hash *)record, key, a));
+  Object *number = new_number(1);
+  Object *dict = new_hash(0);
+  TEST_ASSERT_TRUE(hash_put((Hash *)dict, number, a));
+
+  Object *deque = new_deque();
+  for (size_t i = 0; i < 20; i++) {
+    TEST_ASSERT_TRUE(deque_push_back((Deque *)deque, a));
+  }
+
+  Object *farray = new_float64_array(100);
+  Object *bits = new_bits(100);
+
+  Object *objects[] = {a,   ab,     abc,  copy,  abd,    key,
+                       record, number, dict, deque, farray, bits};
+  for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); i++) {
+    free_object(objects[i]);
+  }
+
+  TEST_ASSERT_EQUAL(0, heap.used);
+  current_heap = NULL;
+}
+
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_string_hash_key);
+  RUN_TEST(test_immortal_objects);
+  RUN_TEST(test_repeated_concatenation);
+  RUN_TEST(test_interned_strings);
+  RUN_TEST(test_free_object_releases_payloads);
   return UNITY_END();
 }
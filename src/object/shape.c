@@ -0,0 +1,85 @@
+#include "shape.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static Shape root = {
+    .parent = NULL,
+    .keys = NULL,
+    .len = 0,
+    .transitions = NULL,
+    .num_transitions = 0,
+    .transitions_cap = 0,
+};
+static pthread_mutex_t transitions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+Shape *root_shape(void) { return &root; }
+
+int64_t shape_find(Shape *shape, String *key) {
+  for (size_t i = 0; i < shape->len; i++) {
+    if (string_equals(shape->keys[i], key)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static Shape *new_child_shape(Shape *parent, String *key) {
+  Shape *shape = malloc(sizeof(Shape));
+  assert(shape != NULL);
+
+  String **keys = malloc((parent->len + 1) * sizeof(String *));
+  assert(keys != NULL);
+  if (parent->len > 0) {
+    memcpy(keys, parent->keys, parent->len * sizeof(String *));
+  }
+
+  // Shapes outlive the objects they were built from, keep a copy of the key
+  // (its contents are interned, so they live as long as the process).
+  keys[parent->len] = malloc(sizeof(String));
+  assert(keys[parent->len] != NULL);
+  *keys[parent->len] = *key;
+
+  *shape = (Shape){
+      .parent = parent,
+      .keys = keys,
+      .len = parent->len + 1,
+      .transitions = NULL,
+      .num_transitions = 0,
+      .transitions_cap = 0,
+  };
+
+  if (parent->num_transitions == parent->transitions_cap) {
+    parent->transitions_cap =
+        parent->transitions_cap ? parent->transitions_cap * 2 : 2;
+    parent->transitions = realloc(parent->transitions,
+                                  parent->transitions_cap * sizeof(Shape *));
+    assert(parent->transitions != NULL);
+  }
+  parent->transitions[parent->num_transitions++] = shape;
+
+  return shape;
+}
+
+Shape *shape_add_key(Shape *shape, String *key) {
+  assert(key->interned);
+  pthread_mutex_lock(&transitions_lock);
+
+  Shape *next = NULL;
+  for (size_t i = 0; i < shape->num_transitions; i++) {
+    Shape *child = shape->transitions[i];
+    if (child->keys[shape->len]->value == key->value) {
+      next = child;
+      break;
+    }
+  }
+
+  if (next == NULL) {
+    next = new_child_shape(shape, key);
+  }
+
+  pthread_mutex_unlock(&transitions_lock);
+  return next;
+}
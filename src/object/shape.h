@@ -0,0 +1,24 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include "object.h"
+#include <stdint.h>
+
+// Hashes with more keys than this are kept in dictionary mode
+#define SHAPE_MAX_KEYS 32
+
+// Shapes form a tree rooted at the shape without keys. Every transition adds
+// one key, so hashes that got the same keys in the same order end up with
+// the same Shape and can be compared by pointer. Shapes are never freed.
+
+Shape *root_shape(void);
+
+// Returns the slot of `key` or -1 when the shape does not have it. `key`
+// does not need to be interned.
+int64_t shape_find(Shape *, String *key);
+
+// Returns the shape with `key` appended, `key` must be interned and missing
+// from the shape.
+Shape *shape_add_key(Shape *, String *key);
+
+#endif // SHAPE_H
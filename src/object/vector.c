@@ -0,0 +1,227 @@
+#include "vector.h"
+#include "heap.h"
+#include <stdatomic.h>
+#include <string.h>
+
+static _Atomic uint64_t next_edit = 1;
+
+static uint64_t new_edit(void) { return atomic_fetch_add(&next_edit, 1); }
+
+void vector_init(Vector *v) {
+  *v = (Vector){
+      .len = 0,
+      .offset = 0,
+      .shift = VECTOR_BITS,
+      .root = NULL,
+      .tail = NULL,
+      .edit = new_edit(),
+  };
+}
+
+void vector_share(Vector *from, Vector *to) {
+  *to = *from;
+  from->edit = new_edit();
+  to->edit = new_edit();
+}
+
+// Trie position of the first element held by the tail.
+static size_t tail_offset(size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+
+  return ((size - 1) >> VECTOR_BITS) << VECTOR_BITS;
+}
+
+static size_t root_capacity(const Vector *v) {
+  return (size_t)1 << (v->shift + VECTOR_BITS);
+}
+
+// Returns a node v may mutate: the node itself when v owns it, otherwise a
+// copy (or an empty node when there is nothing to copy).
+static VectorNode *editable(Vector *v, VectorNode *node) {
+  if (node && node->edit == v->edit) {
+    return node;
+  }
+
+  VectorNode *copy = heap_alloc(sizeof(VectorNode));
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  if (node) {
+    memcpy(copy->slots, node->slots, sizeof(copy->slots));
+  } else {
+    memset(copy->slots, 0, sizeof(copy->slots));
+  }
+  copy->edit = v->edit;
+
+  return copy;
+}
+
+// Walks down to the node at `level` on the way to trie position `pos`,
+// making every node on the path editable, and returns the slot of that node
+// that leads to `pos`.
+static void **editable_slot(Vector *v, size_t pos, unsigned level) {
+  VectorNode **slot = &v->root;
+
+  for (unsigned l = v->shift;; l -= VECTOR_BITS) {
+    VectorNode *node = editable(v, *slot);
+    if (node == NULL) {
+      return NULL;
+    }
+    *slot = node;
+
+    void **child = &node->slots[(pos >> l) & VECTOR_MASK];
+    if (l == level) {
+      return child;
+    }
+
+    slot = (VectorNode **)child;
+  }
+}
+
+// Trie leaf holding position pos.
+static VectorNode *leaf_at(const Vector *v, size_t pos) {
+  VectorNode *node = v->root;
+  for (unsigned level = v->shift; level > 0; level -= VECTOR_BITS) {
+    node = node->slots[(pos >> level) & VECTOR_MASK];
+  }
+
+  return node;
+}
+
+void *vector_get(const Vector *v, size_t i) {
+  size_t pos = v->offset + i;
+  size_t tail_start = tail_offset(v->offset + v->len);
+
+  if (pos >= tail_start) {
+    return v->tail->slots[pos - tail_start];
+  }
+
+  return leaf_at(v, pos)->slots[pos & VECTOR_MASK];
+}
+
+static bool set_position(Vector *v, size_t pos, void *value) {
+  size_t tail_start = tail_offset(v->offset + v->len);
+
+  if (pos >= tail_start) {
+    VectorNode *tail = editable(v, v->tail);
+    if (tail == NULL) {
+      return false;
+    }
+
+    v->tail = tail;
+    tail->slots[pos - tail_start] = value;
+    return true;
+  }
+
+  void **slot = editable_slot(v, pos, 0);
+  if (slot == NULL) {
+    return false;
+  }
+
+  *slot = value;
+  return true;
+}
+
+bool vector_set(Vector *v, size_t i, void *value) {
+  return set_position(v, v->offset + i, value);
+}
+
+// Adds a level on top of the root, placing the current root at child
+// `index`. Positions grow by the old capacity for every index past zero.
+static bool grow_root(Vector *v, size_t index) {
+  VectorNode *root = editable(v, NULL);
+  if (root == NULL) {
+    return false;
+  }
+
+  root->slots[index] = v->root;
+  v->offset += index * root_capacity(v);
+  v->root = root;
+  v->shift += VECTOR_BITS;
+
+  return true;
+}
+
+// Moves the full tail into the trie.
+static bool push_tail(Vector *v, size_t tail_start) {
+  if (tail_start >= root_capacity(v) && !grow_root(v, 0)) {
+    return false;
+  }
+
+  void **slot = editable_slot(v, tail_start, VECTOR_BITS);
+  if (slot == NULL) {
+    return false;
+  }
+
+  *slot = v->tail;
+  v->tail = NULL;
+  return true;
+}
+
+bool vector_push(Vector *v, void *value) {
+  size_t size = v->offset + v->len;
+  size_t tail_start = tail_offset(size);
+
+  if (size > 0 && size - tail_start == VECTOR_WIDTH) {
+    if (!push_tail(v, tail_start)) {
+      return false;
+    }
+    tail_start = size;
+  }
+
+  VectorNode *tail = editable(v, v->tail);
+  if (tail == NULL) {
+    return false;
+  }
+
+  v->tail = tail;
+  tail->slots[size - tail_start] = value;
+  v->len++;
+
+  return true;
+}
+
+bool vector_unshift(Vector *v, void *value) {
+  if (v->len == 0) {
+    return vector_push(v, value);
+  }
+
+  // Leave room in front by moving everything one root capacity forward
+  if (v->offset == 0 && !grow_root(v, 1)) {
+    return false;
+  }
+
+  if (!set_position(v, v->offset - 1, value)) {
+    return false;
+  }
+
+  v->offset--;
+  v->len++;
+
+  return true;
+}
+
+void vector_slice(Vector *v, size_t start, size_t end) {
+  if (start >= end) {
+    // Nothing left to share, start over instead of keeping the nodes alive
+    vector_init(v);
+    return;
+  }
+
+  size_t old_tail_start = tail_offset(v->offset + v->len);
+
+  v->offset += start;
+  v->len = end - start;
+
+  // The leaf now holding the last elements takes over as the tail. Slots
+  // past the end are left as they are, appending copies or overwrites them.
+  size_t tail_start = tail_offset(v->offset + v->len);
+  if (tail_start < old_tail_start) {
+    v->tail = leaf_at(v, tail_start);
+  }
+}
+
+void vector_drop_first(Vector *v) { vector_slice(v, 1, v->len); }
@@ -0,0 +1,55 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VECTOR_BITS 5
+#define VECTOR_WIDTH (1 << VECTOR_BITS)
+#define VECTOR_MASK (VECTOR_WIDTH - 1)
+
+typedef struct VectorNode {
+  uint64_t edit; // token of the vector allowed to mutate this node in place
+  void *slots[VECTOR_WIDTH];
+} VectorNode;
+
+// Persistent bit-partitioned vector trie. Elements live in 32-wide leaves
+// under `root`, except for the last (partial) leaf which is kept apart in
+// `tail` so that appending rarely touches the trie. `offset` is the trie
+// position of the first element, which lets the front be dropped or grown
+// without moving anything.
+//
+// Vectors derived from each other share their nodes. A node is only
+// mutated in place by the vector whose `edit` token it carries, every other
+// vector copies the node (and the path leading to it) first. Filling a fresh
+// vector or updating the same region of a vector repeatedly therefore
+// allocates nothing after the first copy.
+typedef struct {
+  size_t len;
+  size_t offset;
+  unsigned shift;
+  VectorNode *root;
+  VectorNode *tail;
+  uint64_t edit;
+} Vector;
+
+void vector_init(Vector *);
+
+// Makes `to` a copy of `from` in O(1). Both vectors give up ownership of
+// the nodes they now share, so later updates to either stay invisible to
+// the other.
+void vector_share(Vector *from, Vector *to);
+
+void *vector_get(const Vector *, size_t);
+
+// Updates return false, leaving the vector unchanged, when a node could not
+// be allocated.
+bool vector_set(Vector *, size_t, void *);
+bool vector_push(Vector *, void *);
+bool vector_unshift(Vector *, void *);
+// Keeps only the elements in [start, end), without copying anything.
+void vector_slice(Vector *, size_t start, size_t end);
+void vector_drop_first(Vector *);
+
+#endif // VECTOR_H
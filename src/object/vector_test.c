@@ -0,0 +1,151 @@
+#include "../unity/src/unity.h"
+#include "../unity/src/unity_internals.h"
+#include "vector.h"
+
+// Large enough for a three level trie
+#define LARGE_LEN (VECTOR_WIDTH * VECTOR_WIDTH * 2 + 7)
+
+static void *value(size_t i) { return (void *)(i + 1); }
+
+static void assert_range(const Vector *v, size_t first, size_t len) {
+  TEST_ASSERT_EQUAL(len, v->len);
+  for (size_t i = 0; i < len; i++) {
+    TEST_ASSERT_EQUAL_PTR(value(first + i), vector_get(v, i));
+  }
+}
+
+void test_push_and_get(void) {
+  Vector v;
+  vector_init(&v);
+
+  for (size_t i = 0; i < LARGE_LEN; i++) {
+    TEST_ASSERT_TRUE(vector_push(&v, value(i)));
+  }
+
+  assert_range(&v, 0, LARGE_LEN);
+}
+
+void test_set(void) {
+  Vector v;
+  vector_init(&v);
+  for (size_t i = 0; i < LARGE_LEN; i++) {
+    vector_push(&v, value(0));
+  }
+
+  for (size_t i = 0; i < LARGE_LEN; i++) {
+    TEST_ASSERT_TRUE(vector_set(&v, i, value(i)));
+  }
+
+  assert_range(&v, 0, LARGE_LEN);
+}
+
+void test_unshift_and_drop_first(void) {
+  Vector v;
+  vector_init(&v);
+
+  for (size_t i = LARGE_LEN; i > 0; i--) {
+    TEST_ASSERT_TRUE(vector_unshift(&v, value(i - 1)));
+  }
+  assert_range(&v, 0, LARGE_LEN);
+
+  for (size_t i = 1; i < LARGE_LEN; i++) {
+    vector_drop_first(&v);
+    TEST_ASSERT_EQUAL_PTR(value(i), vector_get(&v, 0));
+  }
+
+  // Both ends keep working after the front moved
+  vector_push(&v, value(LARGE_LEN));
+  vector_unshift(&v, value(LARGE_LEN - 2));
+  assert_range(&v, LARGE_LEN - 2, 3);
+
+  vector_drop_first(&v);
+  vector_drop_first(&v);
+  vector_drop_first(&v);
+  TEST_ASSERT_EQUAL(0, v.len);
+}
+
+void test_slice(void) {
+  Vector v;
+  vector_init(&v);
+  for (size_t i = 0; i < LARGE_LEN; i++) {
+    vector_push(&v, value(i));
+  }
+
+  Vector middle;
+  vector_share(&v, &middle);
+  vector_slice(&middle, 40, 1000);
+  assert_range(&middle, 40, 960);
+
+  // Appending after the cut overwrites what used to follow the end
+  vector_push(&middle, value(0));
+  TEST_ASSERT_EQUAL_PTR(value(0), vector_get(&middle, 960));
+  TEST_ASSERT_EQUAL_PTR(value(1000), vector_get(&v, 1000));
+
+  vector_set(&middle, 0, value(0));
+  TEST_ASSERT_EQUAL_PTR(value(40), vector_get(&v, 40));
+
+  vector_slice(&middle, 5, 5);
+  TEST_ASSERT_EQUAL(0, middle.len);
+
+  assert_range(&v, 0, LARGE_LEN);
+}
+
+void test_shared_vectors_are_independent(void) {
+  Vector a;
+  vector_init(&a);
+  for (size_t i = 0; i < LARGE_LEN; i++) {
+    vector_push(&a, value(i));
+  }
+
+  Vector b;
+  vector_share(&a, &b);
+
+  vector_set(&b, 0, value(100));
+  vector_set(&b, LARGE_LEN - 1, value(100));
+  vector_push(&b, value(100));
+  vector_unshift(&b, value(100));
+
+  Vector c;
+  vector_share(&a, &c);
+  vector_drop_first(&c);
+  vector_set(&a, 1, value(200));
+
+  assert_range(&c, 1, LARGE_LEN - 1);
+  TEST_ASSERT_EQUAL(LARGE_LEN + 2, b.len);
+  TEST_ASSERT_EQUAL_PTR(value(100), vector_get(&b, 1));
+  TEST_ASSERT_EQUAL_PTR(value(1), vector_get(&b, 2));
+
+  vector_set(&a, 1, value(1));
+  assert_range(&a, 0, LARGE_LEN);
+}
+
+void test_owned_nodes_are_updated_in_place(void) {
+  Vector v;
+  vector_init(&v);
+  for (size_t i = 0; i < LARGE_LEN; i++) {
+    vector_push(&v, value(i));
+  }
+
+  Vector shared;
+  vector_share(&v, &shared);
+
+  // The first update copies the path, the following ones reuse it
+  vector_set(&v, 0, value(1));
+  VectorNode *root = v.root;
+  vector_set(&v, 1, value(2));
+  vector_set(&v, 0, value(0));
+
+  TEST_ASSERT_EQUAL_PTR(root, v.root);
+  TEST_ASSERT_NOT_EQUAL(shared.root, v.root);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_push_and_get);
+  RUN_TEST(test_set);
+  RUN_TEST(test_unshift_and_drop_first);
+  RUN_TEST(test_slice);
+  RUN_TEST(test_shared_vectors_are_independent);
+  RUN_TEST(test_owned_nodes_are_updated_in_place);
+  return UNITY_END();
+}
@@ -195,7 +195,7 @@ void illegal_statement_error(Parser *p, char *stmt_type) {
   array_append(&p->errors, err_msg);
 }
 
-static bool INSIDE_LOOP = false;
+static _Thread_local bool INSIDE_LOOP = false;
 
 Statement *parse_continue_statement(Parser *p) {
   if (!INSIDE_LOOP) {
@@ -463,6 +463,7 @@ Expression *parse_function_literal(Parser *p) {
 
   fn->token = p->cur_token;
   fn->type = FN_EXPR;
+  fn->name = NULL;
 
   fn->parameters = parse_function_parameters(p);
   if (fn->parameters.len < 0) {
@@ -1,6 +1,7 @@
 #include "file_loader.h"
 #include "../big_endian/big_endian.h"
 #include "../code/code.h"
+#include "../object/heap.h"
 #include "../object/object.h"
 #include "../file_reader/file_reader.h"
 #include "vm.h"
@@ -26,7 +27,7 @@ static bool test_magic_number(uint8_t *value) {
 }
 
 static Object *read_number_constant(FILE *file) {
-  Number *num = malloc(sizeof(Number));
+  Number *num = heap_alloc(sizeof(Number));
   assert(num);
   num->type = NUMBER_OBJ;
 
@@ -39,10 +40,6 @@ static Object *read_number_constant(FILE *file) {
 }
 
 static Object *read_string_constant(FILE *file) {
-  String *str = malloc(sizeof(String));
-  assert(str);
-  str->type = STRING_OBJ;
-
   int8_t len_buf[2];
   len_buf[0] = fgetc(file);
   len_buf[1] = fgetc(file);
@@ -50,8 +47,6 @@ static Object *read_string_constant(FILE *file) {
   uint16_t len;
   big_endian_to_uint16(&len, len_buf);
 
-  str->len = len;
-
   char str_value[len + 1];
 
   size_t i = 0;
@@ -60,13 +55,14 @@ static Object *read_string_constant(FILE *file) {
   }
   str_value[i] = '\0';
 
-  str->value = strdup(str_value);
+  Object *str = new_interned_string(str_value);
+  assert(str);
 
-  return (Object *)str;
+  return str;
 }
 
 static Object *read_function_constant(FILE *file) {
-  CompiledFunction *fn = malloc(sizeof(CompiledFunction));
+  CompiledFunction *fn = heap_alloc(sizeof(CompiledFunction));
   assert(fn);
   fn->type = COMPILED_FUNCTION_OBJ;
 
@@ -99,7 +95,7 @@ static Object *read_function_constant(FILE *file) {
 }
 
 static Object *read_loop_constant(FILE *file) {
-  CompiledLoop *loop = malloc(sizeof(CompiledLoop));
+  CompiledLoop *loop = heap_alloc(sizeof(CompiledLoop));
   assert(loop);
   loop->type = COMPILED_LOOP_OBJ;
 
@@ -185,11 +181,10 @@ Bytecode get_bytecode_from_file(const char *filename) {
   big_endian_to_uint16(&num_instructions, num_instructions_buf);
 
   Instructions ins;
-  int_array_init(&ins, 10);
+  int_array_init(&ins, num_instructions);
 
-  int8_t c;
-  while ((c = fgetc(file)) != EOF) {
-    int_array_append(&ins, c);
+  for (size_t i = 0; i < num_instructions; i++) {
+    int_array_append(&ins, fgetc(file));
   }
 
   return (Bytecode) {
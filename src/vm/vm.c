@@ -1,12 +1,21 @@
 #include "vm.h"
 #include "../big_endian/big_endian.h"
+#include "../heap_profiler/heap_profiler.h"
+#include "../object/array.h"
+#include "../object/bits.h"
 #include "../object/builtins.h"
+#include "../object/deque.h"
+#include "../object/shape.h"
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+static size_t default_heap_limit = 0;
+
+void set_default_heap_limit(size_t limit) { default_heap_limit = limit; }
+
 VM *new_vm(Bytecode bytecode) {
   Object *main_fn = new_compiled_function(&bytecode.instructions, 0, 0);
   Closure *main_closure = (Closure *)new_closure(main_fn);
@@ -18,11 +27,16 @@ VM *new_vm(Bytecode bytecode) {
   memset(vm->globals, 0, sizeof(vm->globals));
   memset(vm->frames, 0, sizeof(vm->frames));
   memset(vm->stack, 0, sizeof(vm->stack));
+  memset(vm->index_caches, 0, sizeof(vm->index_caches));
+  for (size_t i = 0; i < STACK_SIZE; i++) {
+    vm->numbers[i] = (Number){.type = NUMBER_OBJ};
+  }
 
   vm->constants = bytecode.constants;
   vm->sp = 0;
   vm->frames[0] = main_frame;
   vm->frames_index = 1;
+  heap_init(&vm->heap, default_heap_limit);
 
   return vm;
 }
@@ -34,7 +48,7 @@ VM *new_vm_with_state(Bytecode bytecode, Object *globals[GLOBALS_SIZE]) {
 }
 
 void free_vm(VM *vm) {
-  array_free(&vm->constants);
+  free_objects(&vm->constants);
   free(vm);
 }
 
@@ -53,6 +67,10 @@ Object *stack_top(VM *vm) {
 }
 
 VMResult stack_push(VM *vm, Object *value) {
+  if (value == NULL) {
+    return VM_OUT_OF_MEMORY; // constructors return NULL when over budget
+  }
+
   if (vm->sp >= STACK_SIZE) {
     return VM_STACK_OVERFLOW;
   }
@@ -62,40 +80,111 @@ VMResult stack_push(VM *vm, Object *value) {
 }
 
 VMResult stack_push_constant(VM *vm, uint16_t constant_index) {
-  size_t sizeof_constant = sizeof_object(vm->constants.arr[constant_index]);
-
-  void *constant_copy = malloc(sizeof_constant);
-  assert(constant_copy);
+  Object *constant = vm->constants.arr[constant_index];
+  if (constant->type == NUMBER_OBJ) {
+    return stack_push(vm, new_cached_number(((Number *)constant)->value));
+  }
 
-  memcpy(constant_copy, vm->constants.arr[constant_index], sizeof_constant);
-  return stack_push(vm, (Object *)constant_copy);
+  return stack_push(vm, copy_object(constant));
 }
 
 Object *stack_pop(VM *vm) { return vm->stack[--vm->sp]; }
 
+// Locals captured by closures or loop bodies are mutated in place through
+// OP_SET_FREE, so they must never hold one of the shared immortal objects.
+static Object *unshare_immortal(Object *obj) {
+  if (!is_immortal_object(obj)) {
+    return obj;
+  }
+
+  return copy_object(obj);
+}
+
+// Results of typed operators, owned by the VM rather than the heap
+static bool is_unboxed_number(VM *vm, Object *obj) {
+  Number *num = (Number *)obj;
+  return num >= vm->numbers && num < vm->numbers + STACK_SIZE;
+}
+
+static void free_temporary(VM *vm, Object *value) {
+  if (value->type == NUMBER_OBJ && !is_unboxed_number(vm, value)) {
+    free_object(value);
+  }
+}
+
+// OP_SET_LOCAL_SCALAR is only emitted for locals that never escape their
+// frame and only ever receive fresh numbers, so the Number already in the
+// slot can be overwritten and the temporary released right away.
+static VMResult set_scalar_local(VM *vm, Object **slot, Object *value) {
+  if (value->type == NUMBER_OBJ && (*slot)->type == NUMBER_OBJ &&
+      !is_immortal_object(*slot)) {
+    ((Number *)*slot)->value = ((Number *)value)->value;
+    free_temporary(vm, value);
+    return VM_OK;
+  }
+
+  *slot = is_unboxed_number(vm, value) ? copy_object(value)
+                                       : unshare_immortal(value);
+  if (*slot == NULL) {
+    return VM_OUT_OF_MEMORY;
+  }
+
+  return VM_OK;
+}
+
+// Captured variables are always overwritten in place, the scalar tag only
+// tells that the stored value is a temporary nobody else holds.
+static void set_scalar_free(VM *vm, Object *captured, Object *value) {
+  assert(is_boxed_object(captured));
+  memcpy(captured, value, sizeof_object(value));
+  free_temporary(vm, value);
+}
+
+// Scalar stores trust whatever the slot holds, so locals must not start out
+// pointing at objects left behind by an earlier frame.
+static VMResult reserve_locals(VM *vm, size_t base_pointer,
+                               size_t num_locals) {
+  if (base_pointer + num_locals > STACK_SIZE) {
+    return VM_STACK_OVERFLOW;
+  }
+
+  for (size_t i = vm->sp; i < base_pointer + num_locals; i++) {
+    vm->stack[i] = new_null();
+  }
+  vm->sp = base_pointer + num_locals;
+
+  return VM_OK;
+}
+
 VMResult execute_binary_integer_operation(VM *vm, OpCode op, Number *left,
                                           Number *right) {
   switch (op) {
   case OP_ADD:
-    return stack_push(vm, new_number(left->value + right->value));
+    return stack_push(vm, new_cached_number(left->value + right->value));
   case OP_SUB:
-    return stack_push(vm, new_number(left->value - right->value));
+    return stack_push(vm, new_cached_number(left->value - right->value));
   case OP_MUL:
-    return stack_push(vm, new_number(left->value * right->value));
+    return stack_push(vm, new_cached_number(left->value * right->value));
   case OP_DIV:
-    return stack_push(vm, new_number(left->value / right->value));
+    return stack_push(vm, new_cached_number(left->value / right->value));
   case OP_MOD:
-    return stack_push(vm, new_number((long)left->value % (long)right->value));
+    return stack_push(
+        vm, new_cached_number((long)left->value % (long)right->value));
   case OP_RSHIFT:
-    return stack_push(vm, new_number((long)left->value >> (long)right->value));
+    return stack_push(
+        vm, new_cached_number((long)left->value >> (long)right->value));
   case OP_LSHIFT:
-    return stack_push(vm, new_number((long)left->value << (long)right->value));
+    return stack_push(
+        vm, new_cached_number((long)left->value << (long)right->value));
   case OP_BIT_AND:
-    return stack_push(vm, new_number((long)left->value & (long)right->value));
+    return stack_push(
+        vm, new_cached_number((long)left->value & (long)right->value));
   case OP_BIT_OR:
-    return stack_push(vm, new_number((long)left->value | (long)right->value));
+    return stack_push(
+        vm, new_cached_number((long)left->value | (long)right->value));
   case OP_BIT_XOR:
-    return stack_push(vm, new_number((long)left->value ^ (long)right->value));
+    return stack_push(
+        vm, new_cached_number((long)left->value ^ (long)right->value));
   default:
     return VM_UNSUPPORTED_OPERATION;
   }
@@ -171,6 +260,19 @@ VMResult execute_comparison(VM *vm, OpCode op) {
     return execute_number_comparison(vm, op, (Number *)left, (Number *)right);
   }
 
+  if (right->type == STRING_OBJ && left->type == STRING_OBJ) {
+    bool equal = string_equals((String *)left, (String *)right);
+
+    switch (op) {
+    case OP_EQ:
+      return stack_push(vm, new_boolean(equal));
+    case OP_NOT_EQ:
+      return stack_push(vm, new_boolean(!equal));
+    default:
+      return VM_UNSUPPORTED_OPERATION;
+    }
+  }
+
   if (right->type == BOOLEAN_OBJ && left->type == BOOLEAN_OBJ) {
     Boolean *r_as_bool = (Boolean *)right;
     Boolean *l_as_bool = (Boolean *)left;
@@ -197,6 +299,22 @@ VMResult execute_comparison(VM *vm, OpCode op) {
   }
 }
 
+// Typed operators are only emitted for operands the compiler proved are
+// numbers, and the arithmetic ones only for results that are copied out
+// before anything else is pushed in their place, see type_inference.h. The
+// result goes to the unboxed Number of the stack slot it takes.
+static void pop_numbers(VM *vm, double *left, double *right) {
+  *right = ((Number *)vm->stack[--vm->sp])->value;
+  *left = ((Number *)vm->stack[--vm->sp])->value;
+}
+
+// Never overflows, typed operators pop two numbers first
+static void push_unboxed(VM *vm, double value) {
+  Number *num = &vm->numbers[vm->sp];
+  num->value = value;
+  vm->stack[vm->sp++] = (Object *)num;
+}
+
 VMResult execute_bang_operator(VM *vm) {
   Object *operand = stack_pop(vm);
 
@@ -221,7 +339,7 @@ VMResult execute_minus_operator(VM *vm) {
   }
 
   double value = -((Number *)operand)->value;
-  return stack_push(vm, new_number(value));
+  return stack_push(vm, new_cached_number(value));
 }
 
 static bool is_truthy(Object *obj) {
@@ -237,78 +355,123 @@ static bool is_truthy(Object *obj) {
 }
 
 Object *vm_build_array(VM *vm, size_t start, size_t end) {
-  Array *arr = malloc(sizeof(Array));
-  assert(arr != NULL);
-  arr->type = ARRAY_OBJ;
-  array_init(&arr->elements, end - start);
-
-  for (size_t i = start; i < end; i++) {
-    array_append(&arr->elements, vm->stack[i]);
-  }
-
-  return (Object *)arr;
+  return new_array(&vm->stack[start], end - start);
 }
 
-Object *vm_build_hash(VM *vm, size_t start, size_t end) {
-  Hash *hash = malloc(sizeof(Hash));
-  hash->type = HASH_OBJ;
-  assert(hash != NULL);
-  hashmap_create(end - start, &hash->pairs);
+VMResult vm_build_hash(VM *vm, size_t start, size_t end, Object **out) {
+  Hash *hash = (Hash *)new_hash((end - start) / 2);
+  if (hash == NULL) {
+    return VM_OUT_OF_MEMORY;
+  }
 
   for (size_t i = start; i < end; i += 2) {
     Object *key = vm->stack[i];
     Object *value = vm->stack[i + 1];
 
-    HashPair *pair = malloc(sizeof(HashPair));
-    assert(pair != NULL);
-    pair->key = key;
-    pair->value = value;
-    int32_t hash_key = get_hash_key(key);
-    if (hash_key < 0) {
-      return NULL;
+    if (!hash_put(hash, key, value)) {
+      return vm->heap.out_of_memory ? VM_OUT_OF_MEMORY : VM_UNHASHABLE_OBJECT;
     }
-    int32_t *hash_key_in_heap = malloc(sizeof(int32_t));
-    assert(hash_key_in_heap != NULL);
-    *hash_key_in_heap = hash_key;
-
-    hashmap_put(&hash->pairs, hash_key_in_heap, sizeof(int32_t), pair);
   }
 
-  return (Object *)hash;
+  *out = (Object *)hash;
+  return VM_OK;
 }
 
 VMResult execute_array_index(VM *vm, Array *left, Number *index) {
-  size_t i = index->value;
-  size_t max_index = left->elements.len - 1;
+  if (index->value < 0 || index->value >= left->elements.len) {
+    return stack_push(vm, new_null());
+  }
+
+  if (left->kind == ARRAY_NUMBERS) {
+    double value = array_get_number(left, index->value);
+    return stack_push(vm, new_cached_number(value));
+  }
+
+  return stack_push(vm, vector_get(&left->elements, index->value));
+}
+
+VMResult execute_deque_index(VM *vm, Deque *deque, Number *index) {
+  if (index->value < 0 || index->value >= deque->len) {
+    return stack_push(vm, new_null());
+  }
+
+  return stack_push(vm, deque_get(deque, index->value));
+}
+
+VMResult execute_float64_array_index(VM *vm, Float64Array *array,
+                                     Number *index) {
+  if (index->value < 0 || index->value >= array->len) {
+    return stack_push(vm, new_null());
+  }
 
-  if (i < 0 || i > max_index) {
+  double value = array->values[(size_t)index->value];
+  return stack_push(vm, new_cached_number(value));
+}
+
+VMResult execute_bits_index(VM *vm, Bits *bits, Number *index) {
+  if (index->value < 0 || index->value >= bits->len) {
     return stack_push(vm, new_null());
   }
 
-  return stack_push(vm, left->elements.arr[i]);
+  return stack_push(vm, new_boolean(bits_get(bits, index->value)));
 }
 
-VMResult execute_hash_index(VM *vm, Hash *hash, Object *index) {
-  int32_t hash_key = get_hash_key(index);
-  if (hash_key < 0) {
+VMResult execute_hash_index(VM *vm, Hash *hash, Object *index,
+                            IndexCache *cache) {
+  String *key = (String *)index;
+  bool is_string = index->type == STRING_OBJ;
+
+  if (hash->shape == cache->shape && is_string && key->value == cache->key) {
+    return stack_push(vm, hash->slots[cache->slot]);
+  }
+
+  uint64_t key_hash;
+  if (!get_hash_key(index, &key_hash)) {
     return VM_UNHASHABLE_OBJECT;
   }
 
-  HashPair *pair = hashmap_get(&hash->pairs, &hash_key, sizeof(int32_t));
-  if (!pair) {
+  if (hash->shape != NULL && is_string) {
+    int64_t slot = shape_find(hash->shape, key);
+    if (slot >= 0 && key->interned) {
+      *cache = (IndexCache){
+          .shape = hash->shape,
+          .key = key->value,
+          .slot = slot,
+      };
+    }
+
+    return stack_push(vm, slot >= 0 ? hash->slots[slot] : new_null());
+  }
+
+  Object *value = hash_get(hash, index);
+  if (!value) {
     return stack_push(vm, new_null());
   }
 
-  return stack_push(vm, pair->value);
+  return stack_push(vm, value);
 }
 
-VMResult execute_index_expression(VM *vm, Object *left, Object *index) {
+VMResult execute_index_expression(VM *vm, Object *left, Object *index,
+                                  IndexCache *cache) {
   if (left->type == ARRAY_OBJ && index->type == NUMBER_OBJ) {
     return execute_array_index(vm, (Array *)left, (Number *)index);
   }
 
+  if (left->type == DEQUE_OBJ && index->type == NUMBER_OBJ) {
+    return execute_deque_index(vm, (Deque *)left, (Number *)index);
+  }
+
+  if (left->type == FLOAT64_ARRAY_OBJ && index->type == NUMBER_OBJ) {
+    return execute_float64_array_index(vm, (Float64Array *)left,
+                                       (Number *)index);
+  }
+
+  if (left->type == BITS_OBJ && index->type == NUMBER_OBJ) {
+    return execute_bits_index(vm, (Bits *)left, (Number *)index);
+  }
+
   if (left->type == HASH_OBJ) {
-    return execute_hash_index(vm, (Hash *)left, index);
+    return execute_hash_index(vm, (Hash *)left, index, cache);
   }
 
   return VM_UNINDEXABLE_OBJECT;
@@ -323,14 +486,16 @@ VMResult call_builtin_function(VM *vm, Builtin *fn, size_t num_args) {
   }
 
   Object *return_value = fn->fn(args);
-  // Only remove the arguments from the stack after executing the function
-  // to comply with our calling convention
-  vm->sp -= num_args;
+  // Only remove the arguments and the builtin from the stack after executing
+  // the function to comply with our calling convention
+  vm->sp -= num_args + 1;
+  free(args.arr);
 
-  VMResult result = stack_push(vm, return_value);
+  if (vm->heap.out_of_memory) {
+    return VM_OUT_OF_MEMORY;
+  }
 
-  free(args.arr);
-  return result;
+  return stack_push(vm, return_value);
 }
 
 VMResult call_closure(VM *vm, Closure *closure, size_t num_args) {
@@ -344,9 +509,7 @@ VMResult call_closure(VM *vm, Closure *closure, size_t num_args) {
   Frame frame = new_frame(closure, vm->sp - num_args);
   push_frame(vm, frame);
 
-  vm->sp = frame.base_pointer + fn->num_locals;
-
-  return VM_OK;
+  return reserve_locals(vm, frame.base_pointer, fn->num_locals);
 }
 
 VMResult execute_call(VM *vm, size_t num_args) {
@@ -362,14 +525,74 @@ VMResult execute_call(VM *vm, size_t num_args) {
   }
 }
 
+// Runs the builtin an intrinsic opcode stands for on its arguments where
+// they are on the stack, with no argument array to build and no builtin
+// object under them to pop.
+static VMResult execute_intrinsic(VM *vm, OpCode op) {
+  Object **args = &vm->stack[vm->sp - (op == OP_PUSH ? 2 : 1)];
+  Object *return_value;
+
+  switch (op) {
+  case OP_LEN:
+    return_value = builtin_len(args[0]);
+    break;
+  case OP_FIRST:
+    return_value = builtin_first(args[0]);
+    break;
+  case OP_LAST:
+    return_value = builtin_last(args[0]);
+    break;
+  case OP_PUSH:
+    return_value = builtin_push(args[0], args[1]);
+    break;
+  default:
+    return VM_UNSUPPORTED_OPERATION;
+  }
+
+  vm->sp = args - vm->stack;
+  if (vm->heap.out_of_memory) {
+    return VM_OUT_OF_MEMORY;
+  }
+
+  return stack_push(vm, return_value);
+}
+
+// OP_SET_FREE copies the new value over the captured object, which is what
+// lets the frame owning the local see the update. The first capture moves the
+// object to a box any value fits in and points the frame's slots at it.
+static Object *capture(VM *vm, Object *obj) {
+  if (is_boxed_object(obj)) {
+    return obj;
+  }
+
+  Object *box = box_object(obj);
+  if (box == NULL) {
+    return NULL;
+  }
+
+  for (size_t i = current_frame(vm)->base_pointer; i < vm->sp; i++) {
+    if (vm->stack[i] == obj) {
+      vm->stack[i] = box;
+    }
+  }
+
+  return box;
+}
+
 VMResult push_closure(VM *vm, size_t const_index, size_t num_free) {
   Object *constant = vm->constants.arr[const_index];
 
   Closure *closure = (Closure *)new_closure(constant);
+  if (closure == NULL) {
+    return VM_OUT_OF_MEMORY;
+  }
   closure->num_free_variables = num_free;
 
   for (size_t i = 0; i < num_free; i++) {
-    closure->free_variables[i] = vm->stack[vm->sp - num_free + i];
+    closure->free_variables[i] = capture(vm, vm->stack[vm->sp - num_free + i]);
+    if (closure->free_variables[i] == NULL) {
+      return VM_OUT_OF_MEMORY;
+    }
   }
 
   vm->sp -= num_free;
@@ -390,41 +613,67 @@ VMResult reassign_index(VM *vm) {
       return VM_UNUSABLE_AS_INDEX;
     }
     Number *num_index = (Number *)index;
+    if (num_index->value < 0 || num_index->value >= arr->elements.len) {
+      return VM_UNUSABLE_AS_INDEX;
+    }
+
+    if (!array_set(arr, num_index->value, new_value)) {
+      return VM_OUT_OF_MEMORY;
+    }
 
-    arr->elements.arr[(size_t)num_index->value] = new_value;
     return stack_push(vm, new_value);
   }
-  case HASH_OBJ: {
-    Hash *hash = (Hash *)indexed;
-    int32_t key = get_hash_key(index);
-    if (key == -1) {
+  case FLOAT64_ARRAY_OBJ: {
+    Float64Array *array = (Float64Array *)indexed;
+
+    if (index->type != NUMBER_OBJ) {
+      return VM_UNUSABLE_AS_INDEX;
+    }
+    Number *num_index = (Number *)index;
+    if (num_index->value < 0 || num_index->value >= array->len) {
       return VM_UNUSABLE_AS_INDEX;
     }
 
-    HashPair *pair = malloc(sizeof(HashPair));
-    assert(pair != NULL);
-    pair->key = index;
-    pair->value = new_value;
+    if (new_value->type != NUMBER_OBJ) {
+      return VM_UNSUPPORTED_TYPE_FOR_OPERATION;
+    }
 
-    HashPair *old_pair = hashmap_get(&hash->pairs, &key, sizeof(int32_t));
-    if (old_pair) {
-      free(old_pair);
+    array->values[(size_t)num_index->value] = ((Number *)new_value)->value;
+    return stack_push(vm, new_value);
+  }
+  case BITS_OBJ: {
+    Bits *bits = (Bits *)indexed;
+
+    if (index->type != NUMBER_OBJ) {
+      return VM_UNUSABLE_AS_INDEX;
+    }
+    Number *num_index = (Number *)index;
+    if (num_index->value < 0 || num_index->value >= bits->len) {
+      return VM_UNUSABLE_AS_INDEX;
     }
 
-    int32_t *hash_key_in_heap = malloc(sizeof(int32_t));
-    assert(hash_key_in_heap != NULL);
-    *hash_key_in_heap = key;
+    bool value;
+    if (!bit_value(new_value, &value)) {
+      return VM_UNSUPPORTED_TYPE_FOR_OPERATION;
+    }
 
-    hashmap_put(&hash->pairs, hash_key_in_heap, sizeof(int32_t), pair);
+    bits_set(bits, num_index->value, value);
+    return stack_push(vm, new_value);
+  }
+  case HASH_OBJ: {
+    Hash *hash = (Hash *)indexed;
+    if (!hash_put(hash, index, new_value)) {
+      return vm->heap.out_of_memory ? VM_OUT_OF_MEMORY : VM_UNUSABLE_AS_INDEX;
+    }
 
-    return stack_push(vm, pair->value);
+    return stack_push(vm, new_value);
   }
   default:
     return VM_UNINDEXABLE_OBJECT;
   }
 }
 
-VMResult run_vm(VM *vm) {
+static VMResult execute_instructions(VM *vm) {
   size_t ip;
   const Instructions *ins;
   OpCode op;
@@ -435,8 +684,12 @@ VMResult run_vm(VM *vm) {
     ip = current_frame(vm)->ip;
     ins = frame_instructions(current_frame(vm));
     op = ins->arr[ip];
+    if (heap_profile.enabled) {
+      heap_profile.site = op;
+    }
 
     VMResult result;
+    double left, right; // operands of typed operators
 
     switch (op) {
     case OP_CONSTANT: {
@@ -516,6 +769,16 @@ VMResult run_vm(VM *vm) {
       }
       break;
     }
+    case OP_JMP_IF_TRUE: {
+      uint16_t pos = big_endian_read_uint16(ins, ip + 1);
+      current_frame(vm)->ip += 2; // skip the operand
+
+      Object *condition = stack_pop(vm);
+      if (is_truthy(condition)) {
+        current_frame(vm)->ip = pos - 1;
+      }
+      break;
+    }
     case OP_NULL:
       result = stack_push(vm, new_null());
       if (result != VM_OK) {
@@ -545,6 +808,31 @@ VMResult run_vm(VM *vm) {
       vm->stack[frame->base_pointer + local_index] = stack_pop(vm);
       break;
     }
+    case OP_SET_LOCAL_CAPTURED: {
+      uint8_t local_index = ins->arr[ip + 1];
+      current_frame(vm)->ip++;
+      Frame *frame = current_frame(vm);
+
+      Object *value = unshare_immortal(stack_pop(vm));
+      if (value == NULL) {
+        return VM_OUT_OF_MEMORY;
+      }
+      vm->stack[frame->base_pointer + local_index] = value;
+      break;
+    }
+    case OP_SET_LOCAL_SCALAR: {
+      uint8_t local_index = ins->arr[ip + 1];
+      current_frame(vm)->ip++;
+      Frame *frame = current_frame(vm);
+
+      VMResult result =
+          set_scalar_local(vm, &vm->stack[frame->base_pointer + local_index],
+                           stack_pop(vm));
+      if (result != VM_OK) {
+        return result;
+      }
+      break;
+    }
     case OP_GET_LOCAL: {
       uint8_t local_index = ins->arr[ip + 1];
       current_frame(vm)->ip++;
@@ -575,23 +863,29 @@ VMResult run_vm(VM *vm) {
       uint16_t num_elements = big_endian_read_uint16(ins, ip + 1);
       current_frame(vm)->ip += 2;
 
-      Object *hash = vm_build_hash(vm, vm->sp - num_elements, vm->sp);
-      if (!hash) {
-        return VM_UNHASHABLE_OBJECT;
+      Object *hash;
+      VMResult result =
+          vm_build_hash(vm, vm->sp - num_elements, vm->sp, &hash);
+      if (result != VM_OK) {
+        return result;
       }
 
       vm->sp = vm->sp - num_elements;
-      VMResult result = stack_push(vm, hash);
+      result = stack_push(vm, hash);
       if (result != VM_OK) {
         return result;
       }
       break;
     }
     case OP_INDEX: {
+      uint16_t cache_index = big_endian_read_uint16(ins, ip + 1);
+      current_frame(vm)->ip += 2;
+
       Object *index = stack_pop(vm);
       Object *left = stack_pop(vm);
 
-      VMResult result = execute_index_expression(vm, left, index);
+      VMResult result = execute_index_expression(
+          vm, left, index, &vm->index_caches[cache_index]);
 
       if (result != VM_OK) {
         return result;
@@ -638,8 +932,8 @@ VMResult run_vm(VM *vm) {
       uint8_t builtin_index = ins->arr[ip + 1];
       current_frame(vm)->ip++;
 
-      BuiltinDef definition = builtin_definitions[builtin_index];
-      VMResult result = stack_push(vm, (Object *)&definition.builtin);
+      const Builtin *builtin = &builtin_definitions[builtin_index].builtin;
+      VMResult result = stack_push(vm, (Object *)builtin);
       if (result != VM_OK) {
         return result;
       }
@@ -676,13 +970,21 @@ VMResult run_vm(VM *vm) {
       Closure *current_closure = current_frame(vm)->closure;
 
       Object *new_value = stack_pop(vm);
+      assert(is_boxed_object(current_closure->free_variables[free_index]));
 
-      // Is this dangerous? What if the variables are of different types?
-      // Could not reproduce any errors, but it seems like it could be a problem
       memcpy(current_closure->free_variables[free_index], new_value,
              sizeof_object(new_value));
       break;
     }
+    case OP_SET_FREE_SCALAR: {
+      uint8_t free_index = ins->arr[ip + 1];
+      current_frame(vm)->ip++;
+
+      Closure *current_closure = current_frame(vm)->closure;
+      set_scalar_free(vm, current_closure->free_variables[free_index],
+                      stack_pop(vm));
+      break;
+    }
     case OP_CURRENT_CLOSURE: {
       Closure *current_closure = current_frame(vm)->closure;
       VMResult result = stack_push(vm, (Object *)current_closure);
@@ -702,20 +1004,27 @@ VMResult run_vm(VM *vm) {
       Frame frame = new_frame(closure, vm->sp);
       push_frame(vm, frame);
 
-      vm->sp = frame.base_pointer + loop->num_locals;
+      result = reserve_locals(vm, frame.base_pointer, loop->num_locals);
+      if (result != VM_OK) {
+        return result;
+      }
 
       break;
     }
     case OP_CONTINUE: {
       Frame frame = pop_frame(vm);
       vm->sp = frame.base_pointer;
+      // Loop bodies get a new closure every iteration and nothing else can
+      // reference it, so hand it back to the allocator right away
+      free_object((Object *)frame.closure);
       break;
     }
     case OP_BREAK: {
-      uint16_t pos = ins->arr[ip + 1];
+      uint16_t pos = big_endian_read_uint16(ins, ip + 1);
       Frame frame = pop_frame(vm);
       vm->sp = frame.base_pointer;
       current_frame(vm)->ip = pos - 1;
+      free_object((Object *)frame.closure);
       break;
     }
     case OP_REASSIGN_INDEX: {
@@ -726,6 +1035,76 @@ VMResult run_vm(VM *vm) {
 
       break;
     }
+    case OP_LEN:
+    case OP_FIRST:
+    case OP_LAST:
+    case OP_PUSH:
+      result = execute_intrinsic(vm, op);
+      if (result != VM_OK) {
+        return result;
+      }
+      break;
+    case OP_ADD_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, left + right);
+      break;
+    case OP_SUB_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, left - right);
+      break;
+    case OP_MUL_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, left * right);
+      break;
+    case OP_DIV_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, left / right);
+      break;
+    case OP_LSHIFT_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, (long)left << (long)right);
+      break;
+    case OP_RSHIFT_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, (long)left >> (long)right);
+      break;
+    case OP_MOD_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, (long)left % (long)right);
+      break;
+    case OP_BIT_OR_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, (long)left | (long)right);
+      break;
+    case OP_BIT_AND_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, (long)left & (long)right);
+      break;
+    case OP_BIT_XOR_NUMBER:
+      pop_numbers(vm, &left, &right);
+      push_unboxed(vm, (long)left ^ (long)right);
+      break;
+    case OP_EQ_NUMBER:
+      pop_numbers(vm, &left, &right);
+      vm->stack[vm->sp++] = new_boolean(left == right);
+      break;
+    case OP_NOT_EQ_NUMBER:
+      pop_numbers(vm, &left, &right);
+      vm->stack[vm->sp++] = new_boolean(left != right);
+      break;
+    case OP_GREATER_NUMBER:
+      pop_numbers(vm, &left, &right);
+      vm->stack[vm->sp++] = new_boolean(left > right);
+      break;
+    case OP_ADD_STRING: {
+      String *right_str = (String *)stack_pop(vm);
+      String *left_str = (String *)stack_pop(vm);
+      result = stack_push(vm, new_concatted_string(left_str, right_str));
+      if (result != VM_OK) {
+        return result;
+      }
+      break;
+    }
     case OP_COUNT:
       assert(0 && "unreachable");
     }
@@ -734,6 +1113,22 @@ VMResult run_vm(VM *vm) {
   return VM_OK;
 }
 
+VMResult run_vm(VM *vm) {
+  Heap *previous_heap = current_heap;
+  current_heap = &vm->heap;
+  vm->heap.out_of_memory = false;
+
+  VMResult result = execute_instructions(vm);
+
+  current_heap = previous_heap;
+  heap_profile.site = HEAP_SITE_RUNTIME;
+  return result;
+}
+
+void vm_set_heap_limit(VM *vm, size_t limit) { vm->heap.limit = limit; }
+
+size_t vm_heap_usage(const VM *vm) { return vm->heap.used; }
+
 Object *vm_last_popped_stack_elem(VM *vm) { return vm->stack[vm->sp]; }
 
 void vm_error(VMResult error, char *buf, size_t bufsize) {
@@ -764,5 +1159,8 @@ void vm_error(VMResult error, char *buf, size_t bufsize) {
   case VM_UNUSABLE_AS_INDEX:
     snprintf(buf, bufsize, "value unusable as index");
     return;
+  case VM_OUT_OF_MEMORY:
+    snprintf(buf, bufsize, "out of memory");
+    return;
   }
 }
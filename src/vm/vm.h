@@ -3,6 +3,7 @@
 #include "../code/code.h"
 #include "../compiler/compiler.h"
 #include "../dyn_array/dyn_array.h"
+#include "../object/heap.h"
 #include "../object/object.h"
 #include "frame.h"
 
@@ -10,13 +11,24 @@
 #define STACK_SIZE 2048
 #define MAX_FRAMES 1024
 
+// Remembers where the last record indexed at an OP_INDEX site kept the key,
+// so the next record with the same shape is read without searching its keys.
+typedef struct {
+  Shape *shape;
+  const char *key; // contents of an interned string, which never move
+  size_t slot;
+} IndexCache;
+
 typedef struct {
   DynamicArray constants; // Object*[]
   Object *stack[STACK_SIZE];
+  Number numbers[STACK_SIZE]; // unboxed results of typed operators, by slot
   size_t sp; // points to the next value
   Object *globals[GLOBALS_SIZE];
   Frame frames[MAX_FRAMES];
   size_t frames_index;
+  Heap heap;
+  IndexCache index_caches[INDEX_CACHES_SIZE];
 } VM;
 
 typedef enum {
@@ -29,6 +41,7 @@ typedef enum {
   VM_CALL_NON_FUNCTION,
   VM_WRONG_NUMBER_OF_ARGUMENTS,
   VM_UNUSABLE_AS_INDEX,
+  VM_OUT_OF_MEMORY,
 } VMResult;
 
 VM *new_vm(Bytecode);
@@ -36,6 +49,12 @@ VM *new_vm_with_state(Bytecode, Object *[GLOBALS_SIZE]);
 
 void free_vm(VM *);
 VMResult run_vm(VM *);
+
+// Heap budget in bytes for objects allocated by run_vm, 0 for unlimited.
+void set_default_heap_limit(size_t);
+void vm_set_heap_limit(VM *, size_t);
+size_t vm_heap_usage(const VM *);
+
 void vm_error(VMResult, char *, size_t);
 Object *vm_last_popped_stack_elem(VM *);
 
@@ -1,6 +1,7 @@
 #include "../ast/ast.h"
 #include "../compiler/compiler.h"
 #include "../lexer/lexer.h"
+#include "../object/array.h"
 #include "../object/object.h"
 #include "../parser/parser.h"
 #include "../unity/src/unity.h"
@@ -40,8 +41,8 @@ void test_boolean_object(Object *expected, Object *actual) {
 void test_string_object(Object *expected, Object *actual) {
   TEST_ASSERT_EQUAL(STRING_OBJ, actual->type);
   TEST_ASSERT_EQUAL(STRING_OBJ, expected->type);
-  TEST_ASSERT_EQUAL_STRING(((String *)expected)->value,
-                           ((String *)actual)->value);
+  TEST_ASSERT_EQUAL_STRING(string_value((String *)expected),
+                           string_value((String *)actual));
 }
 
 void test_array_object(Object *expected, Object *actual) {
@@ -52,8 +53,8 @@ void test_array_object(Object *expected, Object *actual) {
 
   for (size_t i = 0; i < ((Array *)expected)->elements.len; i++) {
     // might need to expend to accept other types
-    test_number_object(((Array *)expected)->elements.arr[i],
-                       ((Array *)actual)->elements.arr[i]);
+    test_number_object(array_get((Array *)expected, i),
+                       array_get((Array *)actual, i));
   }
 }
 
@@ -221,6 +222,10 @@ void test_conditionals(void) {
       {"if (false) { 10; }", new_null()},
       {"if (1 > 2) { 10; }", new_null()},
       {"!(if (false) { 10; })", new_boolean(true)},
+      {"let c = 1 < 2; [if (c) { let a = 5; } else { 3 }, 7][1]",
+       new_number(7)},
+      {"let c = 1 > 2; if (c) { let a = 5; } else { 3 }", new_number(3)},
+      {"let c = 1 < 2; if (c) { let a = 5; } else { 3 }", new_null()},
   };
 
   VM_RUN_TESTS(tests);
@@ -241,6 +246,23 @@ void test_string_expressions(void) {
       {"\"monkey\"", new_string("monkey")},
       {"\"mon\" + \"key\"", new_string("monkey")},
       {"\"mon\" + \"key\" + \"banana\"", new_string("monkeybanana")},
+      {"\"mon\" == \"mon\"", new_boolean(true)},
+      {"\"mon\" + \"key\" == \"monkey\"", new_boolean(true)},
+      {"\"mon\" == \"key\"", new_boolean(false)},
+      {"\"mon\" != \"key\"", new_boolean(true)},
+      {"let h = {\"a\": 1, \"b\": 2}; let t = 0;"
+       "for (let i = 0; i < 100; i = i + 1) { t = t + h[\"a\"] + h[\"b\"]; }"
+       "t",
+       new_number(300)},
+      // Strings sharing an append buffer keep their own contents
+      {"let s = \"ab\" + \"c\"; let t = s + \"d\"; let u = s + \"e\"; t",
+       new_string("abcd")},
+      {"let s = \"ab\" + \"c\"; let t = s + \"d\"; let u = s + \"e\"; u",
+       new_string("abce")},
+      {"let s = \"ab\" + \"c\"; let t = s + \"d\"; s", new_string("abc")},
+      {"let s = \"\"; for (let i = 0; i < 10000; i = i + 1) { s = s + \"x\"; }"
+       "len(s)",
+       new_number(10000)},
   };
 
   VM_RUN_TESTS(tests);
@@ -291,6 +313,38 @@ void test_index_expressions(void) {
   VM_RUN_TESTS(tests);
 }
 
+void test_hashes(void) {
+  vmTestCase tests[] = {
+      // Keys are compared in full, not only by their hash
+      {"{4294967296: 1, 0: 2}[0]", new_number(2)},
+      {"{4294967296: 1, 0: 2}[4294967296]", new_number(1)},
+      {"{1: 1, \"1\": 2}[\"1\"]", new_number(2)},
+      {"{true: 1, 1: 2}[true]", new_number(1)},
+      {"{0.5: 1}[0.5]", new_number(1)},
+      {"{\"a\" + \"b\": 1}[\"ab\"]", new_number(1)},
+      // Growing keeps every pair
+      {"let h = {}; for (let i = 0; i < 1000; i = i + 1) { h[i] = i * 2; }"
+       "let t = 0; for (let i = 0; i < 1000; i = i + 1) { t = t + h[i]; } t",
+       new_number(999000)},
+      {"let h = {1: 1}; h[1] = 2; h[1]", new_number(2)},
+      // The inline cache of a site is checked against the shape and the key
+      {"let name = fn(p) { p[\"name\"] };"
+       "name({\"name\": 1, \"age\": 2}) + name({\"age\": 3, \"name\": 4})"
+       " + name({\"name\": 5, \"age\": 6})",
+       new_number(10)},
+      {"let get = fn(p, k) { p[k] }; let p = {\"a\": 1, \"b\": 2};"
+       "get(p, \"a\") + get(p, \"b\") + get(p, \"a\")",
+       new_number(4)},
+      {"let p = {\"a\": 1}; let a = p[\"a\"]; p[\"b\"] = 2; p[3] = 3;"
+       "a + p[\"a\"] + p[\"b\"] + p[3]",
+       new_number(7)},
+      {"let p = {\"a\": 1}; p[\"b\"]", new_null()},
+      {"let p = {\"a\": 1}; p[\"a\" + \"\"]", new_number(1)},
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
 void test_calling_functions(void) {
   vmTestCase tests[] = {
       {
@@ -516,6 +570,21 @@ void test_builtin_functions(void) {
                               },
                               2)},
       {"rest([])", new_null()},
+      {"shift([2, 3], 1)", new_array(
+                               (Object *[]){
+                                   new_number(1),
+                                   new_number(2),
+                                   new_number(3),
+                               },
+                               3)},
+      {"slice([1, 2, 3, 4], 1, 3)",
+       new_array((Object *[]){new_number(2), new_number(3)}, 2)},
+      {"slice([1, 2, 3], -5, 10)",
+       new_array((Object *[]){new_number(1), new_number(2), new_number(3)},
+                 3)},
+      {"slice([1, 2, 3], 2, 1)", new_array((Object *[]){}, 0)},
+      {"slice([1], \"a\", 1)",
+       new_error("argument to 'slice' not supported, got STRING_OBJ")},
       {"puts(\"hello\", \"world!\")", new_null()},
       {"push(1, 1)",
        new_error("argument to 'push' not supported, got NUMBER_OBJ")},
@@ -524,6 +593,156 @@ void test_builtin_functions(void) {
   VM_RUN_TESTS(tests);
 }
 
+void test_persistent_arrays(void) {
+  vmTestCase tests[] = {
+      {"let a = [1, 2]; let b = push(a, 3); a[0] = 9; b",
+       new_array((Object *[]){new_number(1), new_number(2), new_number(3)},
+                 3)},
+      {"let a = [1, 2]; let b = push(a, 3); b[0] = 9; a",
+       new_array((Object *[]){new_number(1), new_number(2)}, 2)},
+      {"let a = [2, 3]; let b = shift(a, 1); b[1] = 9; a",
+       new_array((Object *[]){new_number(2), new_number(3)}, 2)},
+      {"let a = [1, 2, 3]; let b = rest(a); b[0] = 9; a",
+       new_array((Object *[]){new_number(1), new_number(2), new_number(3)},
+                 3)},
+      {"let a = [1, 2, 3, 4];"
+       "let b = slice(a, 1, 3); b[0] = 9; push(b, 8); a",
+       new_array((Object *[]){new_number(1), new_number(2), new_number(3),
+                              new_number(4)},
+                 4)},
+      {"let a = [1, 2, 3]; let b = rest(a); a[1] = 9; b",
+       new_array((Object *[]){new_number(2), new_number(3)}, 2)},
+      // Arrays are still shared by reference between variables
+      {"let a = [1, 2]; let b = a; b[0] = 9; a",
+       new_array((Object *[]){new_number(9), new_number(2)}, 2)},
+      {"let a = [];"
+       "for (let i = 0; i < 3000; i = i + 1) { a = push(a, i); }"
+       "for (let i = 0; i < 1000; i = i + 1) { a = shift(a, i); }"
+       "for (let i = 0; i < 1500; i = i + 1) { a = rest(a); }"
+       "a[0] + a[len(a) - 1] + len(a)",
+       new_number(500 + 2999 + 2500)},
+      // Number arrays keep working after storing something else
+      {"let a = [1, 2, 3]; a[1] = \"two\"; a[0] + a[2]", new_number(4)},
+      {"let a = [1, 2]; let b = push(a, true); a[1] = 0.5; a[1] + b[1]",
+       new_number(2.5)},
+      {"let a = [1, 2]; let b = a; b[0] = [3]; a[0][0] + a[1]",
+       new_number(5)},
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_deques(void) {
+  vmTestCase tests[] = {
+      {"let d = deque(); push_back(d, 1); push_back(d, 2); push_front(d, 0);"
+       "d[0] + d[2] * 10 + len(d) * 100",
+       new_number(320)},
+      {"let d = push_back(push_back(deque(), 1), 2); pop_front(d) + len(d)",
+       new_number(2)},
+      {"let d = push_front(push_front(deque(), 1), 2); pop_back(d)",
+       new_number(1)},
+      {"pop_front(deque())", new_null()},
+      {"pop_back(deque())", new_null()},
+      {"deque()[0]", new_null()},
+      {"push_back(1, 1)",
+       new_error("argument to 'push_back' not supported, got NUMBER_OBJ")},
+      {"deque(1)", new_error("wrong number of arguments: Expected 0 got 1")},
+      // Breadth-first walk of the implicit binary tree rooted at 1
+      {"let queue = push_back(deque(), 1); let visited = 0;"
+       "while (len(queue) > 0) {"
+       "  let node = pop_front(queue);"
+       "  visited = visited + 1;"
+       "  if (node < 512) {"
+       "    push_back(queue, node * 2); push_back(queue, node * 2 + 1);"
+       "  }"
+       "}"
+       "visited",
+       new_number(1023)},
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_float64_arrays(void) {
+  vmTestCase tests[] = {
+      {"let a = farray(3); a[1] = 2.5; a[1] + len(a)", new_number(5.5)},
+      {"farray(2)[2]", new_null()},
+      {"let a = farray([1, 2, 3, 4, 5]); sum(a)", new_number(15)},
+      {"let a = farray([3, -1, 7]); min(a) * 10 + max(a)", new_number(-3)},
+      {"min(farray(0))", new_null()},
+      {"dot(farray([1, 2, 3]), farray([4, 5, 6]))", new_number(32)},
+      {"sum(scale(farray([1, 2, 3]), 2))", new_number(12)},
+      {"let a = farray([1, 2]); let b = farray([3, 4]);"
+       "let c = add(a, b); let d = mul(a, b); c[0] * 100 + c[1] + d[1]",
+       new_number(414)},
+      // farrays are updated in place, like deques
+      {"let a = farray(1); let b = a; b[0] = 4; a[0]", new_number(4)},
+      {"let a = farray(1000);"
+       "for (let i = 0; i < 1000; i = i + 1) { a[i] = i; } sum(a)",
+       new_number(499500)},
+      {"dot(farray(1), farray(2))",
+       new_error("arguments to 'dot' must have the same length")},
+      {"sum([1])", new_error("argument to 'sum' not supported, got ARRAY_OBJ")},
+      {"farray([1, true])",
+       new_error("argument to 'farray' must only hold numbers")},
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_bits(void) {
+  vmTestCase tests[] = {
+      {"let b = bits(100); b[3] = true; b[99] = 1; popcount(b)",
+       new_number(2)},
+      {"let b = bits(3); b[1] = true; b[1]", new_boolean(true)},
+      {"let b = bits(3); b[1] = true; b[0]", new_boolean(false)},
+      {"bits(3)[3]", new_null()},
+      {"let b = set_bit(bits(70), 64, true); get_bit(b, 64)",
+       new_boolean(true)},
+      {"let b = set_bit(bits(70), 63, true); get_bit(shift_left(b, 1), 64)",
+       new_boolean(true)},
+      {"let b = set_bit(bits(70), 63, true); shift_right(b, 63)[0]",
+       new_boolean(true)},
+      {"let a = set_bit(set_bit(bits(8), 0, 1), 1, 1);"
+       "let b = set_bit(set_bit(bits(8), 1, 1), 2, 1);"
+       "[popcount(bits_and(a, b)), popcount(bits_or(a, b)),"
+       " popcount(bits_xor(a, b)), popcount(bits_not(a))]",
+       new_array((Object *[]){new_number(1), new_number(3), new_number(2),
+                              new_number(6)},
+                 4)},
+      // bitsets are updated in place, like deques
+      {"let a = bits(1); let b = a; b[0] = 1; a[0]", new_boolean(true)},
+      {"len(bits(130))", new_number(130)},
+      {"bits_and(bits(1), bits(2))",
+       new_error("arguments to 'bits_and' must have the same length")},
+      {"get_bit(bits(2), 2)",
+       new_error("position 2 out of range in 'get_bit'")},
+      {"set_bit(bits(2), 0, \"1\")",
+       new_error("bit value to 'set_bit' must be a boolean or a number")},
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_constant_folding(void) {
+  vmTestCase tests[] = {
+      {"2 * (3 + 4) - 10 / 4", new_number(11.5)},
+      {"(7 % 3) | (1 << 4) ^ 2", new_number(19)},
+      {"-(5 & 3) + (-8 >> 1)", new_number(-5)},
+      {"1 < 2 && !(2 > 3) || false", new_boolean(true)},
+      {"\"a\" + \"b\" == \"ab\"", new_boolean(true)},
+      {"len(\"monkey\") + first([2, 3]) + last([4, 5])", new_number(13)},
+      {"let COLS = 30; let f = fn() { COLS - 1 }; f()", new_number(29)},
+      {"let n = 1; let f = fn() { n }; n = 2; f()", new_number(2)},
+      {"let f = fn(n) { n * 2 }; let n = 1; f(4)", new_number(8)},
+      // Folding only applies to builtins nothing else is bound to
+      {"let len = fn(x) { 7 }; len(\"abc\")", new_number(7)},
+      {"let f = fn(first) { first([1]) }; f(fn(a) { 9 })", new_number(9)},
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
 void test_closures(void) {
   vmTestCase tests[] = {
       {
@@ -680,6 +899,30 @@ void test_while_loop(void) {
                    "a;",
           .expected = new_number(5),
       },
+      {
+          .input = "let a = 0;"
+                   "while (!(a == 3)) {"
+                   "  a = a + 1;"
+                   "};"
+                   "a;",
+          .expected = new_number(3),
+      },
+      {
+          // Breaks past the first 255 bytes of the program
+          .input = "let a = 0;"
+                   "  a = a + 1; a = a + 1; a = a + 1; a = a + 1; a = a + 1;"
+                   "  a = a + 1; a = a + 1; a = a + 1; a = a + 1; a = a + 1;"
+                   "  a = a + 1; a = a + 1; a = a + 1; a = a + 1; a = a + 1;"
+                   "  a = a + 1; a = a + 1; a = a + 1; a = a + 1; a = a + 1;"
+                   "  a = a + 1; a = a + 1; a = a + 1; a = a + 1; a = a + 1;"
+                   "  a = a + 1; a = a + 1; a = a + 1; a = a + 1; a = a + 1;"
+                   "while (a < 100) {"
+                   "  a = a + 1;"
+                   "  if (a == 40) { break; }"
+                   "};"
+                   "a;",
+          .expected = new_number(40),
+      },
   };
 
   VM_RUN_TESTS(tests);
@@ -767,11 +1010,639 @@ void test_nested_closures(void) {
                    "foo(2);                              ",
           .expected = new_string("aa"),
       },
+      {
+          .input = "let foo = fn () {                  "
+                   "  let acc = 0;                       "
+                   "  let i = 0;                         "
+                   "  while (i < 2) {                    "
+                   "    acc = \"a\" + \"bcdefgh\";        "
+                   "    i = i + 1;                       "
+                   "  };                                 "
+                   "  return acc;                        "
+                   "};                                   "
+                   "foo();                               ",
+          .expected = new_string("abcdefgh"),
+      },
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_mutating_captured_immortals(void) {
+  vmTestCase tests[] = {
+      {
+          .input = "let f = fn () {                "
+                   "  let swapped = false;         "
+                   "  let i = 0;                   "
+                   "  while (i < 3) {              "
+                   "    swapped = true;            "
+                   "    i = i + 1;                 "
+                   "  };                           "
+                   "  swapped;                     "
+                   "};                             "
+                   "f();                           "
+                   "false;                         ",
+          .expected = new_boolean(false),
+      },
+      {
+          .input = "let f = fn (x) {               "
+                   "  while (x < 5) {              "
+                   "    x = x + 1;                 "
+                   "  };                           "
+                   "  x;                           "
+                   "};                             "
+                   "f(0);                          "
+                   "0;                             ",
+          .expected = new_number(0),
+      },
+      // Locals that are not assigned through a closure keep sharing the
+      // immortal objects, and must not be boxed along with one that is
+      {
+          .input = "let f = fn () {                "
+                   "  let a = 5;                   "
+                   "  let b = 5;                   "
+                   "  let g = fn () { a = 6; };    "
+                   "  g();                         "
+                   "  [a, b];                      "
+                   "};                             "
+                   "f();                           ",
+          .expected = new_array((Object *[]){new_number(6), new_number(5)}, 2),
+      },
+      {
+          .input = "let f = fn (x) {               "
+                   "  let y = 5;                   "
+                   "  let g = fn () { x = x + 1; };"
+                   "  g();                         "
+                   "  [x, y];                      "
+                   "};                             "
+                   "f(5);                          ",
+          .expected = new_array((Object *[]){new_number(6), new_number(5)}, 2),
+      },
+      {
+          .input = "let f = fn () {                "
+                   "  let t = 0;                   "
+                   "  let z = 0;                   "
+                   "  for (let i = 0; i < 3; i = i + 1) { t = t + 1; };"
+                   "  [t, z];                      "
+                   "};                             "
+                   "f();                           ",
+          .expected = new_array((Object *[]){new_number(3), new_number(0)}, 2),
+      },
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_dead_code(void) {
+  vmTestCase tests[] = {
+      {
+          .input = "let f = fn(x) {          "
+                   "  if (x > 1) {           "
+                   "    return 1;            "
+                   "    x = 5;               "
+                   "  };                     "
+                   "  x;                     "
+                   "};                       "
+                   "f(5) + f(0);             ",
+          .expected = new_number(1),
+      },
+      {
+          .input = "let a = 0;               "
+                   "while (true) {           "
+                   "  a = a + 1;             "
+                   "  if (a == 3) {          "
+                   "    break;               "
+                   "    a = 100;             "
+                   "  };                     "
+                   "  continue;              "
+                   "  a = 200;               "
+                   "};                       "
+                   "a;                       ",
+          .expected = new_number(3),
+      },
+      {
+          .input = "let unused = fn() { helper() };"
+                   "let helper = fn() { 1 };       "
+                   "let used = fn() { 2 };         "
+                   "used();                        ",
+          .expected = new_number(2),
+      },
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_inlining(void) {
+  vmTestCase tests[] = {
+      {
+          .input = "let max = fn(a, b) {     "
+                   "  if (a > b) {           "
+                   "    return a;            "
+                   "  };                     "
+                   "  b;                     "
+                   "};                       "
+                   "max(1, 2) * max(4, 3);   ",
+          .expected = new_number(8),
+      },
+      {
+          .input = "let sq = fn(x) {         "
+                   "  let y = x * x;         "
+                   "  y;                     "
+                   "};                       "
+                   "let y = 3;               "
+                   "sq(y) + y;               ",
+          .expected = new_number(12),
+      },
+      {
+          .input = "let inc = fn(x) { x + 1 };        "
+                   "let twice = fn(x) { inc(inc(x)) };"
+                   "let f = fn(x) { twice(x) * 10 };  "
+                   "f(1);                             ",
+          .expected = new_number(30),
+      },
+      {
+          .input = "let f = fn() { 1 };      "
+                   "let g = fn() { f() };    "
+                   "f = fn() { 2 };          "
+                   "g();                     ",
+          .expected = new_number(2),
+      },
+      {
+          .input = "let f = fn(x) { x };     "
+                   "let g = fn(f) { f(1) };  "
+                   "g(fn(x) { x + 1 });      ",
+          .expected = new_number(2),
+      },
+      {
+          .input = "let r = 0; r = 5; r;",
+          .expected = new_number(5),
+      },
   };
 
   VM_RUN_TESTS(tests);
 }
 
+static VM *run_at_level(char *input, OptimizationLevel level) {
+  Program *program = parse((vmTestCase){.input = input});
+  Compiler *compiler = new_compiler();
+  compiler->optimization_level = level;
+  TEST_ASSERT_EQUAL(COMPILER_OK, compile_program(compiler, program));
+
+  VM *vm = new_vm(bytecode(compiler));
+  TEST_ASSERT_EQUAL(VM_OK, run_vm(vm));
+
+  free_program(program);
+  free_compiler(compiler);
+  return vm;
+}
+
+// Inlined bodies must see the globals the function saw, not the ones bound
+// to the same names by later lets
+void test_inlining_matches_unoptimized(void) {
+  char *inputs[] = {
+      "let x = 1; let g = fn() { x }; let x = 2; g();",
+      "let x = 4;                          "
+      "let g = fn() { x };                 "
+      "let k = fn(a) { a + 1 };            "
+      "let m = fn(a) { k(a) + g() };       "
+      "let x = 5;                          "
+      "m(3);                               ",
+      "let x = 1;                          "
+      "let g = fn(a) { a + x };            "
+      "let x = 10;                         "
+      "let f = fn() { let x = 100; g(x) }; "
+      "f();                                ",
+      "let n = 1;                          "
+      "let bump = fn() { n = n + 1; };     "
+      "let n = 10;                         "
+      "bump();                             "
+      "n;                                  ",
+      "let f = fn(a) { len(a) };           "
+      "let len = fn(a) { 0 };              "
+      "f([1, 2]);                          ",
+      "let m = fn(x) {                     "
+      "  if (x > 1) { let c = 7; c } else { c } "
+      "};                                  "
+      "m(0);                               ",
+      "let m = fn(x) {                     "
+      "  if (x > 1) { let c = 7; c } else { c } "
+      "};                                  "
+      "let f = fn() { m(5); m(0) };        "
+      "f();                                ",
+  };
+
+  for (size_t i = 0; i < ARRAY_LEN(inputs); i++) {
+    VM *unoptimized = run_at_level(inputs[i], OPTIMIZATION_O0);
+    VM *optimized = run_at_level(inputs[i], OPTIMIZATION_O2);
+
+    test_expected_object(vm_last_popped_stack_elem(unoptimized),
+                         vm_last_popped_stack_elem(optimized));
+
+    free_vm(unoptimized);
+    free_vm(optimized);
+  }
+}
+
+// Functions compiled through the SSA form give what they give as written
+void test_ssa_form_matches_unoptimized(void) {
+  char *inputs[] = {
+      "let f = fn(n) {                     "
+      "  let total = 0;                    "
+      "  for (let i = 0; i < n; i = i + 1) {"
+      "    if (i % 3 == 0) { continue; };  "
+      "    if (i > 20) { break; };         "
+      "    total = total + i;              "
+      "  };                                "
+      "  total                             "
+      "};                                  "
+      "f(100);                             ",
+      "let f = fn(n) {                     "
+      "  let i = 0;                        "
+      "  let seen = [];                    "
+      "  while (i < n) {                   "
+      "    let x = 0;                      "
+      "    if (i % 2 == 0) { x = x + i; }; "
+      "    seen = push(seen, x);           "
+      "    i = i + 1;                      "
+      "  };                                "
+      "  seen                              "
+      "};                                  "
+      "f(5);                               ",
+      "let f = fn(n) {                     "
+      "  let count = 0;                    "
+      "  for (let i = 0; i < n; i = i + 1) {"
+      "    for (let j = 0; j < i; j = j + 1) {"
+      "      count = count + j;            "
+      "    };                              "
+      "  };                                "
+      "  count                             "
+      "};                                  "
+      "f(10);                              ",
+      "let f = fn(a, b) {                  "
+      "  let s = if (a > b) { a - b } else { b - a };"
+      "  s * (a + b) + (a + b)             "
+      "};                                  "
+      "[f(3, 8), f(8, 3), f(5, 5)];        ",
+      "let calls = 0;                      "
+      "let f = fn(n) {                     "
+      "  calls = calls + n;                "
+      "  let s = \"\";                      "
+      "  let i = 0;                        "
+      "  while (i < n) { s = s + \"ab\"; i = i + 1; };"
+      "  s                                 "
+      "};                                  "
+      "let s = f(3) + f(2);                "
+      "if (calls == 5) { s } else { \"\" }; ",
+      "let f = fn(h, key) {                "
+      "  let total = 0;                    "
+      "  let i = 0;                        "
+      "  while (i < 4) { total = total + h[key] * i; i = i + 1; };"
+      "  if (total > 10) { total } else { -h[key] }"
+      "};                                  "
+      "[f({\"a\": 1}, \"a\"), f({\"a\": 5}, \"a\")];",
+      "let collatz = fn(n) {               "
+      "  let steps = 0;                    "
+      "  while (n != 1) {                  "
+      "    if (n % 2 == 0) { n = n / 2 } else { n = 3 * n + 1 };"
+      "    steps = steps + 1;              "
+      "  };                                "
+      "  steps                             "
+      "};                                  "
+      "[collatz(27), collatz(1), collatz(6)];",
+  };
+
+  for (size_t i = 0; i < ARRAY_LEN(inputs); i++) {
+    VM *unoptimized = run_at_level(inputs[i], OPTIMIZATION_O0);
+    VM *optimized = run_at_level(inputs[i], OPTIMIZATION_O3);
+
+    test_expected_object(vm_last_popped_stack_elem(unoptimized),
+                         vm_last_popped_stack_elem(optimized));
+
+    free_vm(unoptimized);
+    free_vm(optimized);
+  }
+}
+
+void test_intrinsics(void) {
+  vmTestCase tests[] = {
+      {
+          .input = "let a = [];              "
+                   "for (let i = 0; len(a) < 5; i = i + 1) {"
+                   "  a = push(a, i * i);    "
+                   "};                       "
+                   "first(a) + last(a) + len(a);",
+          .expected = new_number(21),
+      },
+      {
+          .input = "let f = fn(len) { len(\"ab\") };"
+                   "f(fn(x) { 10 });                ",
+          .expected = new_number(10),
+      },
+      {
+          .input = "let first = fn(x) { 1 - x }; first(5);",
+          .expected = new_number(-4),
+      },
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_loop_invariants(void) {
+  vmTestCase tests[] = {
+      {
+          .input = "let f = fn(n) {                       "
+                   "  let s = 0;                          "
+                   "  for (let i = 0; i < n * 2 - 1; i = i + 1) {"
+                   "    for (let j = 0; j < n - i; j = j + 1) {"
+                   "      s = s + 1;                      "
+                   "    };                                "
+                   "  };                                  "
+                   "  s;                                  "
+                   "};                                    "
+                   "f(3);                                 ",
+          .expected = new_number(6),
+      },
+      {
+          .input = "let n = len([1, 2, 3, 4, 5]);         "
+                   "let i = 0;                            "
+                   "while (i < n - 1) {                   "
+                   "  n = n - 1;                          "
+                   "  i = i + 1;                          "
+                   "};                                    "
+                   "i;                                    ",
+          .expected = new_number(2),
+      },
+      {
+          .input = "let n = len([1, 2, 3, 4, 5]);         "
+                   "let shrink = fn() { n = n - 1; };     "
+                   "let i = 0;                            "
+                   "while (i < n - 1) {                   "
+                   "  shrink();                           "
+                   "  i = i + 1;                          "
+                   "};                                    "
+                   "i;                                    ",
+          .expected = new_number(2),
+      },
+      {
+          .input = "let f = fn(n) {                       "
+                   "  let i = 0;                          "
+                   "  let shrink = fn() { n = n - 1; };   "
+                   "  while (i < n - 1) {                 "
+                   "    shrink();                         "
+                   "    i = i + 1;                        "
+                   "  };                                  "
+                   "  i;                                  "
+                   "};                                    "
+                   "f(5);                                 ",
+          .expected = new_number(2),
+      },
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+VM *compile_to_vm(char *input) {
+  Program *program = parse((vmTestCase){.input = input});
+  Compiler *compiler = new_compiler();
+  TEST_ASSERT_EQUAL(COMPILER_OK, compile_program(compiler, program));
+
+  return new_vm(bytecode(compiler));
+}
+
+static void double_heap_limit(Heap *heap) { heap->limit *= 2; }
+
+void test_heap_limit(void) {
+  char *input = "let arr = [];"
+                "for (let i = 0; i < 1000; i = i + 1) {"
+                "  arr = push(arr, \"item\" + \"s\");"
+                "}"
+                "len(arr);";
+
+  VM *unlimited = compile_to_vm(input);
+  TEST_ASSERT_EQUAL(VM_OK, run_vm(unlimited));
+  test_number_object(new_number(1000), vm_last_popped_stack_elem(unlimited));
+  TEST_ASSERT_GREATER_THAN(1000, vm_heap_usage(unlimited));
+  TEST_ASSERT_NULL(current_heap);
+
+  VM *limited = compile_to_vm(input);
+  vm_set_heap_limit(limited, 4096);
+  TEST_ASSERT_EQUAL(VM_OUT_OF_MEMORY, run_vm(limited));
+  TEST_ASSERT_LESS_OR_EQUAL(4096, vm_heap_usage(limited));
+
+  char msg[100];
+  vm_error(VM_OUT_OF_MEMORY, msg, 100);
+  TEST_ASSERT_EQUAL_STRING("out of memory", msg);
+
+  VM *raised = compile_to_vm(input);
+  vm_set_heap_limit(raised, 4096);
+  raised->heap.on_limit = &double_heap_limit;
+  TEST_ASSERT_EQUAL(VM_OK, run_vm(raised));
+  test_number_object(new_number(1000), vm_last_popped_stack_elem(raised));
+  TEST_ASSERT_GREATER_THAN(4096, raised->heap.limit);
+}
+
+void test_scalar_locals(void) {
+  vmTestCase tests[] = {
+      {
+          .input = "let f = fn () {                "
+                   "  let x = 100000;              "
+                   "  for (let i = 0; i < 3; i = i + 1) {"
+                   "    x = x + 100000;            "
+                   "  };                           "
+                   "  x * 1;                       "
+                   "};                             "
+                   "f();                           ",
+          .expected = new_number(400000),
+      },
+      {
+          .input = "let f = fn () {                "
+                   "  let a = 100000;              "
+                   "  let b = a;                   "
+                   "  a = a + 1;                   "
+                   "  b;                           "
+                   "};                             "
+                   "f();                           ",
+          .expected = new_number(100000),
+      },
+      {
+          .input = "let f = fn () {                "
+                   "  let x = 100000;              "
+                   "  let arr = [x];               "
+                   "  x = x + 1;                   "
+                   "  arr[0];                      "
+                   "};                             "
+                   "f();                           ",
+          .expected = new_number(100000),
+      },
+      {
+          .input = "let f = fn (c) {               "
+                   "  if (c) { let x = 5; };       "
+                   "  x = x + 1;                   "
+                   "  x * 1;                       "
+                   "};                             "
+                   "f(true);                       ",
+          .expected = new_number(6),
+      },
+      {
+          // The left operand still holds x when the right one stores to it
+          .input = "fn () {                        "
+                   "  let x = 1 + 1;               "
+                   "  x + (x = 5 + 0);             "
+                   "}();                           ",
+          .expected = new_number(7),
+      },
+      {
+          .input = "fn () {                        "
+                   "  let i = 300 + 0;             "
+                   "  i * (i = i + 1);             "
+                   "}();                           ",
+          .expected = new_number(90300),
+      },
+      {
+          .input = "fn (c) {                       "
+                   "  let x = 1 + 1;               "
+                   "  x + (if (c) { x = 5 + 0; 1 } else { 2 });"
+                   "}(true);                       ",
+          .expected = new_number(3),
+      },
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_scalar_locals_release_temporaries(void) {
+  // Identical loops, except that returning x makes it escape
+  VM *scalar = compile_to_vm("let f = fn () {"
+                             "  let x = 100000;"
+                             "  for (let i = 0; i < 1000; i = i + 1) {"
+                             "    x = x + 1;"
+                             "  };"
+                             "  x * 1;"
+                             "};"
+                             "f();");
+  VM *escaping = compile_to_vm("let f = fn () {"
+                               "  let x = 100000;"
+                               "  for (let i = 0; i < 1000; i = i + 1) {"
+                               "    x = x + 1;"
+                               "  };"
+                               "  x;"
+                               "};"
+                               "f();");
+
+  TEST_ASSERT_EQUAL(VM_OK, run_vm(scalar));
+  TEST_ASSERT_EQUAL(VM_OK, run_vm(escaping));
+  test_number_object(new_number(101000), vm_last_popped_stack_elem(scalar));
+  test_number_object(new_number(101000), vm_last_popped_stack_elem(escaping));
+
+  // Every x + 1 temporary is released, only the result of x * 1 is kept
+  TEST_ASSERT_LESS_OR_EQUAL(vm_heap_usage(escaping) - 999 * sizeof(Number),
+                            vm_heap_usage(scalar));
+}
+
+void test_typed_operators(void) {
+  vmTestCase tests[] = {
+      {
+          .input = "let f = fn(a, b) { let d = a * b + 1; d - a }; f(3, 4)",
+          .expected = new_number(10),
+      },
+      {
+          .input = "let f = fn(a) { let b = a % 4; [b > 2, b == 3, b != 3] };"
+                   "f(7)[0]",
+          .expected = new_boolean(true),
+      },
+      {
+          .input = "let f = fn(s) { let t = s + \"!\"; t + t }; f(\"hi\")",
+          .expected = new_string("hi!hi!"),
+      },
+      {
+          .input = "let f = fn(n) {                       "
+                   "  let acc = 0;                        "
+                   "  for (let i = 0; i < n; i = i + 1) { "
+                   "    let x = (i << 1) | 1;             "
+                   "    acc = acc + x;                    "
+                   "  };                                  "
+                   "  acc;                                "
+                   "};                                    "
+                   "f(10);                                ",
+          .expected = new_number(100),
+      },
+      // The call turns the captured number a holds into a string
+      {
+          .input = "let f = fn() {                        "
+                   "  let x = 1000;                       "
+                   "  let set = fn() { x = \"s\" };       "
+                   "  let g = fn(a) { a - 1; set(); a + \"!\" };"
+                   "  g(x);                               "
+                   "};                                    "
+                   "f();                                  ",
+          .expected = new_string("s!"),
+      },
+      // Unboxed results feed each other and get copied by scalar stores. The
+      // functions are bound by locals, so that they are not inlined
+      {
+          .input = "let g = fn() {                        "
+                   "  let f = fn(a) {                     "
+                   "    let b = a * 0.5;                  "
+                   "    let c = b * b + b * 0.25;         "
+                   "    let d = c * 2 - b;                "
+                   "    d + c;                            "
+                   "  };                                  "
+                   "  f(3);                               "
+                   "};                                    "
+                   "g();                                  ",
+          .expected = new_number(6.375),
+      },
+      // Both results take the same stack slot
+      {
+          .input = "let g = fn() {                        "
+                   "  let f = fn(a) {                     "
+                   "    let p = a * 1;                    "
+                   "    let x = p * 1.5;                  "
+                   "    let y = p * 2.5;                  "
+                   "    x - y;                            "
+                   "  };                                  "
+                   "  f(2);                               "
+                   "};                                    "
+                   "g();                                  ",
+          .expected = new_number(-2),
+      },
+      {
+          .input = "let g = fn() {                        "
+                   "  let f = fn(a) {                     "
+                   "    let p = a * 1;                    "
+                   "    let q = if (p * 0.5 > 1) { p * 0.5 } else { p };"
+                   "    q + 0.5;                          "
+                   "  };                                  "
+                   "  f(3);                               "
+                   "};                                    "
+                   "g();                                  ",
+          .expected = new_number(2),
+      },
+  };
+
+  VM_RUN_TESTS(tests);
+}
+
+void test_typed_operators_allocate_nothing(void) {
+  char *input = "let f = fn(a) {                         "
+                "  let p = a + 0.1;                      "
+                "  p * 1.5 + p * 2.5 > 1000000;          "
+                "};                                      "
+                "for (let i = 0; i < 1000; i = i + 1) { f(i) };";
+  VM *generic = run_at_level(input, OPTIMIZATION_O0);
+  VM *typed = run_at_level(input, OPTIMIZATION_O2);
+
+  // The two products and their sum of every call
+  TEST_ASSERT_LESS_OR_EQUAL(vm_heap_usage(generic) - 3 * 999 * sizeof(Number),
+                            vm_heap_usage(typed));
+  TEST_ASSERT_GREATER_OR_EQUAL(vm_heap_usage(generic) -
+                                   3 * 1000 * sizeof(Number) - 4096,
+                               vm_heap_usage(typed));
+
+  free_vm(generic);
+  free_vm(typed);
+}
+
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_integer_arithmetic);
@@ -780,6 +1651,7 @@ int main(void) {
   RUN_TEST(test_global_let_statements);
   RUN_TEST(test_string_expressions);
   RUN_TEST(test_array_literals);
+  RUN_TEST(test_hashes);
   RUN_TEST(test_calling_functions);
   RUN_TEST(test_functions_with_return_statement);
   RUN_TEST(test_functions_without_return_value);
@@ -787,6 +1659,11 @@ int main(void) {
   RUN_TEST(test_functions_with_arguments_and_bindings);
   RUN_TEST(test_calling_functions_with_wrong_arguments);
   RUN_TEST(test_builtin_functions);
+  RUN_TEST(test_persistent_arrays);
+  RUN_TEST(test_deques);
+  RUN_TEST(test_float64_arrays);
+  RUN_TEST(test_bits);
+  RUN_TEST(test_constant_folding);
   RUN_TEST(test_closures);
   RUN_TEST(test_recursive_functions);
   RUN_TEST(test_reassignments);
@@ -795,5 +1672,17 @@ int main(void) {
   RUN_TEST(test_for_loop);
   RUN_TEST(test_nested_loops);
   RUN_TEST(test_nested_closures);
+  RUN_TEST(test_mutating_captured_immortals);
+  RUN_TEST(test_dead_code);
+  RUN_TEST(test_inlining);
+  RUN_TEST(test_inlining_matches_unoptimized);
+  RUN_TEST(test_ssa_form_matches_unoptimized);
+  RUN_TEST(test_intrinsics);
+  RUN_TEST(test_loop_invariants);
+  RUN_TEST(test_heap_limit);
+  RUN_TEST(test_scalar_locals);
+  RUN_TEST(test_scalar_locals_release_temporaries);
+  RUN_TEST(test_typed_operators);
+  RUN_TEST(test_typed_operators_allocate_nothing);
   return UNITY_END();
 }